@@ -24,7 +24,18 @@ public:
 
     void parse_args(int argc, char* argv[]);
 
+    // By default -h/--help as the first argument of a parser prints its help and
+    // exits. When disabled, parse_args records the request and returns instead;
+    // subcommands inherit the setting.
+    void set_exit_on_help(bool enabled);
+    // True if -h/--help was given to this parser or to the subcommand it ran,
+    // in any position where it is parsed as that flag.
+    bool help_requested() const;
+
     bool is_subcommand_used(const std::string& name) const;
+    // Position of the subcommand name among the parsed arguments (argv without
+    // the program name), or their count when no subcommand was used.
+    size_t subcommand_position() const;
     Parser& get_subparser(const std::string& name);
 
     template<typename T> T get(const std::string& name) {
@@ -59,6 +70,9 @@ private:
 
     std::map<std::string, std::unique_ptr<Parser>> m_subparsers;
     std::string m_used_subcommand_name;
+    size_t m_subcommand_position = 0;
+    bool m_exit_on_help = true;
+    bool m_help_requested = false;
 
     // Upgraded to use the new ArgValue variant
     std::map<std::string, ArgValue> m_parsed_values;
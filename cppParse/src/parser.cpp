@@ -44,6 +44,23 @@ bool Parser::is_subcommand_used(const std::string& name) const {
     return m_used_subcommand_name == name;
 }
 
+size_t Parser::subcommand_position() const {
+    return m_subcommand_position;
+}
+
+void Parser::set_exit_on_help(bool enabled) {
+    m_exit_on_help = enabled;
+}
+
+bool Parser::help_requested() const {
+    auto help = m_parsed_values.find("help");
+    if (m_help_requested || (help != m_parsed_values.end() && std::get_if<bool>(&help->second) && std::get<bool>(help->second))) {
+        return true;
+    }
+    auto it = m_subparsers.find(m_used_subcommand_name);
+    return it != m_subparsers.end() && it->second->help_requested();
+}
+
 Parser& Parser::get_subparser(const std::string& name) {
     auto it = m_subparsers.find(name);
     if (it == m_subparsers.end()) {
@@ -82,12 +99,17 @@ void Parser::parse_args(int argc, char* argv[]) {
     std::vector<std::string> raw_args(argv + 1, argv + argc);
 
     if (argc > 1 && (raw_args[0] == "-h" || raw_args[0] == "--help")) {
+        if (!m_exit_on_help) {
+            m_help_requested = true;
+            return;
+        }
         HelpFormatter formatter(*this);
         std::cout << formatter.format() << std::endl;
         exit(0);
     }
 
     std::vector<std::string> positional_candidates;
+    m_subcommand_position = raw_args.size();
 
     for (size_t i = 0; i < raw_args.size(); ++i) {
         const std::string& arg = raw_args[i];
@@ -95,7 +117,9 @@ void Parser::parse_args(int argc, char* argv[]) {
         auto subparser_it = m_subparsers.find(arg);
         if (subparser_it != m_subparsers.end()) {
             m_used_subcommand_name = arg;
+            m_subcommand_position = i;
             Parser& subparser = *subparser_it->second;
+            subparser.m_exit_on_help = m_exit_on_help;
             std::vector<char*> sub_argv;
             sub_argv.push_back(const_cast<char*>(arg.c_str()));
             for (size_t j = i + 1; j < raw_args.size(); ++j) {
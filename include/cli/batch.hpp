@@ -0,0 +1,33 @@
+#pragma once
+
+#include "cppParse/parser.hpp"
+
+#include <cstddef>
+#include <string>
+
+namespace allin1::cli {
+
+struct BatchOptions {
+    std::string script_path;    // File to read commands from, or "-" for stdin
+    size_t jobs = 1;            // Commands run concurrently between "wait" lines
+    bool keep_going = false;    // Continue after a failing command
+    bool output_enabled = false;
+    std::string format;         // Passed on to every command unless empty
+};
+
+void register_batch_command(cppParse::Parser& program);
+
+/**
+ * Runs every command in a batch script inside the current process.
+ *
+ * Each non-empty line that does not start with '#' is one AllIn1 command line
+ * (without the program name), split using shell quoting rules and parsed with a
+ * fresh root parser. With jobs > 1, consecutive commands up to the next line
+ * reading "wait" are treated as independent and run concurrently; their output
+ * is replayed in script order once the group finishes.
+ *
+ * Returns 0 if every command succeeded, 1 otherwise.
+ */
+int run_batch(const BatchOptions& options);
+
+} // namespace allin1::cli
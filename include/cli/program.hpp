@@ -0,0 +1,28 @@
+#pragma once
+
+#include "cppParse/parser.hpp"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace allin1::cli {
+
+constexpr std::string_view app_version = "0.1.0a";
+
+// Builds the root AllIn1 parser with every subcommand registered.
+std::unique_ptr<cppParse::Parser> build_program();
+
+// Runs the command selected on an already parsed root parser and returns the exit code.
+// nested is set for the commands of a batch script or a server; root options that
+// change state shared by the whole process are rejected there.
+// Errors raised by the selected command propagate to the caller.
+int run_program(cppParse::Parser& program, bool no_arguments, bool nested);
+
+// Parses one command line (without the program name) with a fresh root parser and runs it
+// as a nested command.
+// Parse errors and command errors propagate to the caller.
+int run_command_args(const std::vector<std::string>& args);
+
+} // namespace allin1::cli
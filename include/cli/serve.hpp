@@ -0,0 +1,38 @@
+#pragma once
+
+#include "cppParse/parser.hpp"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace allin1::cli {
+
+struct ServeOptions {
+    std::string socket_path;
+    size_t workers = 0;         // 0 = one per CPU; also the number of connections served at once
+};
+
+void register_serve_command(cppParse::Parser& program);
+
+/**
+ * Serves AllIn1 commands over a Unix domain socket until SIGINT or SIGTERM.
+ *
+ * Every frame is a 4-byte big-endian payload length followed by the payload.
+ * A request payload is the client's working directory followed by the command
+ * arguments, each terminated by a NUL byte; an empty directory runs the command
+ * in the directory the server was started in. Each worker thread has its own
+ * working directory (Linux), and a request is refused when it cannot have one.
+ * A response payload is a 4-byte big-endian exit code followed by the captured
+ * stdout and stderr text, each prefixed by its own 4-byte big-endian length. A
+ * connection may carry any number of requests.
+ */
+int run_server(const ServeOptions& options);
+
+/**
+ * Sends one command (argv without the program name and --connect option) to a
+ * running server and replays its output. Returns the remote exit code.
+ */
+int run_client(const std::string& socket_path, const std::vector<std::string>& args);
+
+} // namespace allin1::cli
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+
+namespace allin1::common {
+
+/**
+ * @brief Builds a file out of sight and publishes it under its final name in one step.
+ *
+ * On Linux the file starts as an anonymous O_TMPFILE inode in the destination
+ * directory, so a crash leaves nothing behind, and commit() links it into
+ * place with linkat(2). Where O_TMPFILE (or /proc) is unavailable it is
+ * written under a hidden temporary name next to the destination and renamed
+ * over it. An existing file is replaced atomically either way; readers see
+ * the old file or the complete new one, never a partial write.
+ *
+ * Write the contents through write_path() with any API, then call commit().
+ * Destroying an uncommitted file discards it.
+ */
+class AtomicFile {
+public:
+    explicit AtomicFile(std::filesystem::path path, unsigned int mode = 0666);
+    ~AtomicFile();
+
+    AtomicFile(const AtomicFile&) = delete;
+    AtomicFile& operator=(const AtomicFile&) = delete;
+
+    /**
+     * @brief Where to write the contents: /proc/self/fd/N for an anonymous file, otherwise the temporary name.
+     */
+    const std::filesystem::path& write_path() const { return m_write_path; }
+
+    /**
+     * @brief "O_TMPFILE" or "rename".
+     */
+    const char* method() const { return m_anonymous ? "O_TMPFILE" : "rename"; }
+
+    /**
+     * @brief Publishes the file under its final name. Throws std::filesystem::filesystem_error on failure.
+     */
+    void commit();
+
+private:
+    std::filesystem::path m_path;
+    std::filesystem::path m_write_path;
+    int m_fd = -1;                      // Keeps the anonymous inode alive until it is linked
+    bool m_anonymous = false;
+    bool m_committed = false;
+};
+
+/**
+ * @brief A fresh hidden name next to path (".name.allin1-XXXXXXXX") for staging a replacement.
+ */
+std::filesystem::path hidden_temp_path(const std::filesystem::path& path);
+
+/**
+ * @brief True if name has the form hidden_temp_path() gives a file name.
+ */
+bool is_hidden_temp_name(const std::string& name);
+
+#if !defined(_WIN32)
+/**
+ * @brief Points the symlink name in dir_fd at target without it ever going
+ * missing: the new link is created under a hidden name and renamed over it.
+ * Returns 0 or the errno of the failure.
+ */
+int replace_symlink_at(int dir_fd, const std::string& name, const std::string& target);
+#endif
+
+} // namespace allin1::common
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace allin1::common {
+
+/**
+ * @brief Caps how many directories a parallel tree walk keeps open at once, so
+ * that wide trees stay within RLIMIT_NOFILE however many workers are queued.
+ *
+ * Before opening a directory a walker calls acquire_or_defer(). When the cap is
+ * reached the work that would open it is kept instead and handed back by
+ * release() once another directory is closed, still holding that directory's
+ * slot. Deferred work is taken last in, first out, so the walk goes deep and
+ * finishes subtrees (closing their directories) before opening new ones.
+ */
+class DirectoryBudget {
+public:
+    /**
+     * @param fds_per_directory Descriptors a walker holds for every open directory
+     * @param reserved_fds Descriptors left for everything else: standard streams,
+     * files being copied and the listing each worker has open
+     */
+    DirectoryBudget(size_t fds_per_directory, size_t reserved_fds);
+
+    DirectoryBudget(const DirectoryBudget&) = delete;
+    DirectoryBudget& operator=(const DirectoryBudget&) = delete;
+
+    /**
+     * @brief Takes a slot even when the cap is reached; for the root of a walk.
+     */
+    void acquire();
+
+    /**
+     * @brief Takes a slot and returns true, or keeps open_later for release() and returns false.
+     */
+    bool acquire_or_defer(std::function<void()> open_later);
+
+    /**
+     * @brief Gives back a slot. Returns deferred work that now owns it, if any,
+     * for the caller to run or queue.
+     */
+    std::function<void()> release();
+
+    /**
+     * @brief Returns deferred work over the cap, or nothing when none is left.
+     *
+     * For a walker whose pool went idle while work was still deferred: every open
+     * directory is then an ancestor of that work (deeper than the cap allows), and
+     * nothing would otherwise ever be released.
+     */
+    std::function<void()> take_stalled();
+
+    size_t capacity() const { return m_capacity; }
+
+private:
+    size_t m_capacity;
+    std::mutex m_mutex;
+    size_t m_open = 0;
+    std::vector<std::function<void()>> m_deferred;
+};
+
+} // namespace allin1::common
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace allin1::common {
+
+namespace detail {
+extern std::atomic<bool> durable_enabled_flag;
+void track_durable_file(const std::filesystem::path& path);
+void track_durable_directory(const std::filesystem::path& path);
+void track_durable_entry(const std::filesystem::path& path);
+}
+
+/**
+ * @brief Tracks files and directories written for the rest of the process so
+ * flush_durable() can make them survive a crash. Calling it again has no effect.
+ */
+void enable_durable();
+
+inline bool durable_enabled() {
+    return detail::durable_enabled_flag.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Records a file whose data must reach storage.
+ */
+inline void track_file(const std::filesystem::path& path) {
+    if (durable_enabled()) detail::track_durable_file(path);
+}
+
+/**
+ * @brief Records a directory whose entries changed.
+ */
+inline void track_directory(const std::filesystem::path& path) {
+    if (durable_enabled()) detail::track_durable_directory(path);
+}
+
+/**
+ * @brief Records a newly created entry: its parent directory and every
+ * ancestor above it, so directories created on the way are durable too.
+ */
+inline void track_new_entry(const std::filesystem::path& path) {
+    if (durable_enabled()) detail::track_durable_entry(path);
+}
+
+struct DurableFlushResult {
+    uint64_t files = 0;                 // Synced with fdatasync
+    uint64_t directories = 0;           // Synced with fsync
+    uint64_t filesystems = 0;           // Synced as a whole with syncfs
+    std::vector<std::string> errors;    // Entries that could not be synced, with the reason
+
+    bool ok() const { return errors.empty(); }
+};
+
+/**
+ * @brief Syncs everything tracked so far in one batch.
+ *
+ * File data is synced first with parallel fdatasync calls, then directories
+ * with parallel fsync calls. A filesystem with many tracked entries is
+ * synced with a single syncfs(2) instead (Linux). Tracking also flushes
+ * automatically once enough entries pile up, so memory stays bounded;
+ * errors from those flushes are reported by the next call.
+ */
+DurableFlushResult flush_durable();
+
+/**
+ * @brief While one exists, commands do not flush when they finish; the owner
+ * (a batch run) flushes once at the end instead.
+ */
+class ScopedDurableBatch {
+public:
+    ScopedDurableBatch();
+    ~ScopedDurableBatch();
+
+    ScopedDurableBatch(const ScopedDurableBatch&) = delete;
+    ScopedDurableBatch& operator=(const ScopedDurableBatch&) = delete;
+};
+
+bool durable_flush_deferred();
+
+} // namespace allin1::common
@@ -1,5 +1,8 @@
 #pragma once
 
+#include "common/errors.hpp"
+
+#include <filesystem>
 #include <string>
 
 namespace allin1::common {
@@ -14,4 +17,15 @@ std::string get_system_error_message(unsigned long error_code);
  */
 std::string get_contextual_error_message(unsigned long error_code);
 
+/**
+ * @brief Builds the error for a failed system call on path and records error_code
+ * in the run's statistics.
+ *
+ * The message reads "<what> '<path>'. Code: <n>: <system message>", followed by
+ * ". Suggestion: " and suggestion, or the contextual message for the code when
+ * suggestion is empty (and nothing if there is none).
+ */
+IOCreateError make_errno_error(const std::string& what, const std::filesystem::path& path, unsigned long error_code,
+                               const std::string& suggestion = {});
+
 } // namespace allin1::common
@@ -16,6 +16,11 @@ public:
     explicit HexByteParseError(const std::string& message);
 };
 
+class CommandLineParseError : public std::runtime_error {
+public:
+    explicit CommandLineParseError(const std::string& message);
+};
+
 // For I/O operation errors in create, symlink, etc.
 class IOCreateError : public std::runtime_error {
 public:
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace allin1::common {
+
+enum class HashAlgorithm {
+    Crc32c,   // CRC-32C (Castagnoli), hardware accelerated with SSE4.2
+    Xxh64,    // XXH64, a fast non-cryptographic 64-bit hash
+    Sha256    // SHA-256, hardware accelerated with the SHA extensions
+};
+
+/**
+ * @brief Parses "crc32c", "xxh64" or "sha256" (case-insensitive). Throws std::invalid_argument otherwise.
+ */
+HashAlgorithm parse_hash_algorithm(const std::string& name);
+
+const char* hash_algorithm_name(HashAlgorithm algorithm);
+
+/**
+ * @brief Returns the BSD-style tag used in manifests ("CRC32C", "XXH64", "SHA256").
+ */
+const char* hash_algorithm_tag(HashAlgorithm algorithm);
+
+/**
+ * @brief Describes the implementation selected for this CPU, e.g. "sse4.2" or "portable".
+ */
+const char* hash_implementation(HashAlgorithm algorithm);
+
+/**
+ * @brief An incremental hash. hex_digest() finalizes it; update() must not be called afterwards.
+ */
+class Hasher {
+public:
+    virtual ~Hasher() = default;
+    virtual void update(const void* data, size_t size) = 0;
+    virtual std::string hex_digest() = 0;
+};
+
+std::unique_ptr<Hasher> make_hasher(HashAlgorithm algorithm);
+
+/**
+ * @brief Continues a CRC-32C over data. Start with crc = 0; the result is the finished CRC.
+ */
+uint32_t crc32c(uint32_t crc, const void* data, size_t size);
+
+/**
+ * @brief Returns the CRC-32C of A followed by B, given crc(A), crc(B) and the length of B.
+ * Lets independent chunks of a file be checksummed in parallel.
+ */
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, uint64_t length2);
+
+std::string crc32c_hex(uint32_t crc);
+
+} // namespace allin1::common
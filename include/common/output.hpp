@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace allin1::common {
+
+enum class OutputFormat {
+    Text,   // Human readable status lines
+    Json,   // One JSON array of records per command
+    Ndjson  // One JSON object per line, streamed
+};
+
+/**
+ * @brief Parses "text", "json" or "ndjson". Throws std::invalid_argument otherwise.
+ */
+OutputFormat parse_output_format(const std::string& format);
+
+/**
+ * @brief Returns the stream status messages should be written to on the calling thread.
+ *
+ * Defaults to a process-wide stdout stream with a large buffer that is only
+ * flushed when full, on flush_output(), or before anything is written to
+ * std::cerr. Callers should end lines with '\n' rather than std::endl.
+ */
+std::ostream& out();
+
+/**
+ * @brief Returns the stream error messages should be written to on the calling thread.
+ *
+ * Defaults to std::cerr unless a ScopedOutputRedirect is active on this thread.
+ */
+std::ostream& err();
+
+/**
+ * @brief Flushes the buffered stdout stream.
+ */
+void flush_output();
+
+/**
+ * @brief Redirects out() and err() for the current thread until destroyed.
+ *
+ * Used to capture the output of commands running concurrently so it can be
+ * replayed in order instead of interleaving on the terminal.
+ */
+class ScopedOutputRedirect {
+public:
+    ScopedOutputRedirect(std::ostream& out_stream, std::ostream& err_stream);
+    ~ScopedOutputRedirect();
+
+    ScopedOutputRedirect(const ScopedOutputRedirect&) = delete;
+    ScopedOutputRedirect& operator=(const ScopedOutputRedirect&) = delete;
+
+private:
+    std::ostream* m_previous_out;
+    std::ostream* m_previous_err;
+};
+
+/**
+ * @brief Returns the record format selected on the calling thread (Text by default).
+ */
+OutputFormat output_format();
+
+/**
+ * @brief Selects the record format for the current thread until destroyed.
+ *
+ * In Json mode the records emitted inside the scope are written to out() as a
+ * single array, which is closed when the scope ends.
+ */
+class ScopedOutputFormat {
+public:
+    explicit ScopedOutputFormat(OutputFormat format);
+    ~ScopedOutputFormat();
+
+    ScopedOutputFormat(const ScopedOutputFormat&) = delete;
+    ScopedOutputFormat& operator=(const ScopedOutputFormat&) = delete;
+
+private:
+    OutputFormat m_previous_format;
+    uint64_t* m_previous_record_count;
+    uint64_t m_record_count = 0;
+};
+
+/**
+ * @brief A snapshot of the calling thread's output streams and format.
+ */
+struct OutputContext {
+    std::ostream* out = nullptr;
+    std::ostream* err = nullptr;
+    OutputFormat format = OutputFormat::Text;
+    uint64_t* record_count = nullptr;
+};
+
+OutputContext current_output_context();
+
+/**
+ * @brief Makes a worker thread write to another thread's output context until destroyed.
+ *
+ * Parallel operations adopt the context of the thread that started them so their
+ * output lands in the same (possibly captured) stream and JSON array.
+ */
+class ScopedOutputContext {
+public:
+    explicit ScopedOutputContext(const OutputContext& context);
+    ~ScopedOutputContext();
+
+    ScopedOutputContext(const ScopedOutputContext&) = delete;
+    ScopedOutputContext& operator=(const ScopedOutputContext&) = delete;
+
+private:
+    OutputContext m_previous;
+};
+
+/**
+ * @brief A flat, machine-readable result record built directly as JSON.
+ */
+class OutputRecord {
+public:
+    explicit OutputRecord(const std::string& event);
+
+    OutputRecord& add(const std::string& key, const std::string& value);
+    OutputRecord& add(const std::string& key, const char* value);
+    OutputRecord& add(const std::string& key, uint64_t value);
+    OutputRecord& add(const std::string& key, int64_t value);
+    OutputRecord& add(const std::string& key, double value);
+    OutputRecord& add(const std::string& key, bool value);
+
+    // Returns the record as a single-line JSON object.
+    std::string json() const { return m_json + "}"; }
+
+private:
+    void add_key(const std::string& key);
+
+    std::string m_json;
+};
+
+/**
+ * @brief Writes a record to out() in the current structured format. No-op in Text mode.
+ *
+ * Safe to call from several threads; each record is written whole.
+ */
+void emit(const OutputRecord& record);
+
+/**
+ * @brief Appends value to buffer as a quoted, escaped JSON string.
+ */
+void append_json_string(std::string& buffer, const std::string& value);
+
+} // namespace allin1::common
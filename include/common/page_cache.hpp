@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+
+namespace allin1::common {
+
+// Page-cache-neutral streaming keeps roughly this much of a file cached at a time
+constexpr uint64_t write_behind_window_bytes = 8ull * 1024 * 1024;
+
+/**
+ * @brief Keeps a sequential write from growing the page cache by more than a couple of windows.
+ *
+ * Each completed window is handed to writeback without waiting; the window
+ * before it is then waited for and its pages dropped with POSIX_FADV_DONTNEED.
+ * Pages of an optional source file read in step are dropped as well. Without
+ * sync_file_range(2) the file is flushed with fdatasync instead; on Windows
+ * this does nothing.
+ */
+class WriteBehind {
+public:
+    explicit WriteBehind(int fd, int source_fd = -1, uint64_t window = write_behind_window_bytes);
+
+    WriteBehind(const WriteBehind&) = delete;
+    WriteBehind& operator=(const WriteBehind&) = delete;
+
+    /**
+     * @brief Reports that everything before offset has been written.
+     */
+    void advance(uint64_t offset);
+
+    /**
+     * @brief Writes back and drops whatever is still cached. Call once the data is complete.
+     */
+    void finish();
+
+private:
+    void drop(uint64_t offset, uint64_t length);
+
+    int m_fd;
+    int m_source_fd;
+    uint64_t m_window;
+    uint64_t m_started = 0;     // Writeback has been started for everything before this offset
+    uint64_t m_dropped = 0;     // Pages before this offset have been dropped
+};
+
+} // namespace allin1::common
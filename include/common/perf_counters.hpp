@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace allin1::common {
+
+// Major io phases that hardware counters are collected around.
+enum class PerfPhase {
+    Create,
+    Fill,
+    Permissions,
+    Symlink,
+    Shortcut,
+    Copy,
+    Checksum,
+    DiskUsage,
+    Dedupe,
+    Sync,
+    Remove,
+    Count
+};
+
+// Counters opened as one perf_event_open group per thread.
+enum class PerfEvent {
+    Cycles,
+    Instructions,
+    CacheMisses,
+    ContextSwitches,
+    TaskClock,
+    Count
+};
+
+const char* perf_phase_name(PerfPhase phase);
+const char* perf_event_name(PerfEvent event);
+
+constexpr size_t perf_event_count = static_cast<size_t>(PerfEvent::Count);
+
+namespace detail {
+extern std::atomic<bool> perf_counters_enabled_flag;
+bool read_perf_counters(uint64_t (&values)[perf_event_count]);
+void add_perf_sample(PerfPhase phase, const uint64_t (&start)[perf_event_count], const uint64_t (&end)[perf_event_count]);
+}
+
+/**
+ * @brief Starts collecting hardware counters for the rest of the process lifetime.
+ *
+ * Counters are opened lazily on each thread the first time it enters a phase.
+ * Events the kernel does not permit or the CPU does not provide are reported
+ * as unavailable instead of failing the run.
+ */
+void enable_perf_counters();
+
+inline bool perf_counters_enabled() {
+    return detail::perf_counters_enabled_flag.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Descriptors a thread may hold for its counter group: perf_event_count
+ * while counters are enabled, otherwise 0. Tree walks reserve this per worker.
+ */
+size_t perf_counter_fds_per_thread();
+
+/**
+ * @brief Accumulates the counter deltas of the enclosing scope into phase.
+ * Reads the thread's counter group once on entry and once on exit.
+ */
+class ScopedPerfCounters {
+public:
+    explicit ScopedPerfCounters(PerfPhase phase) : m_phase(phase), m_active(perf_counters_enabled()) {
+        if (m_active) {
+            m_active = detail::read_perf_counters(m_start);
+        }
+    }
+
+    ~ScopedPerfCounters() {
+        uint64_t end[perf_event_count];
+        if (m_active && detail::read_perf_counters(end)) {
+            detail::add_perf_sample(m_phase, m_start, end);
+        }
+    }
+
+    ScopedPerfCounters(const ScopedPerfCounters&) = delete;
+    ScopedPerfCounters& operator=(const ScopedPerfCounters&) = delete;
+
+private:
+    PerfPhase m_phase;
+    bool m_active;
+    uint64_t m_start[perf_event_count] = {};
+};
+
+struct PerfPhaseSummary {
+    PerfPhase phase;
+    uint64_t calls = 0;
+    uint64_t values[perf_event_count] = {};
+};
+
+struct PerfCountersSummary {
+    bool available[perf_event_count] = {};   // Opened successfully on at least one thread
+    std::string unavailable_reason;          // First error seen while opening counters
+    std::vector<PerfPhaseSummary> phases;    // Only phases that ran
+};
+
+/**
+ * @brief Merges the per-thread counter totals collected so far.
+ */
+PerfCountersSummary collect_perf_counters();
+
+/**
+ * @brief Prints the counters as text to out(), or emits a "perf_counters" record in structured formats.
+ */
+void report_perf_counters(const PerfCountersSummary& summary);
+
+} // namespace allin1::common
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "errors.hpp" // Include the consolidated error definitions
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -15,10 +16,21 @@ struct Permissions {
     bool execute = false;
 };
 
+/**
+ * @brief Receives the outcome for every entry visited by set_permissions.
+ *
+ * error is nullptr when the entry succeeded.
+ */
+using PermissionEntryCallback = std::function<void(const std::string& path, const PermissionError* error)>;
+
 /**
  * @brief Sets the permissions for a given user on a file or directory.
+ *
+ * In recursive mode per-entry failures, including directories that cannot be
+ * listed, are reported through on_entry and the walk continues; otherwise
+ * failures are thrown as PermissionError.
  */
-void set_permissions(const std::string& path, const std::string& user, const Permissions& perms, bool recursive, bool output_enabled);
+void set_permissions(const std::string& path, const std::string& user, const Permissions& perms, bool recursive, const PermissionEntryCallback& on_entry);
 
 /**
  * @brief Parses a permission string (keyword, octal, or hex) into a Permissions struct.
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <string>
 #include <map>
 
@@ -57,4 +58,9 @@ int get_cpu_core_count();
 long long get_total_memory_bytes();
 long long get_available_memory_bytes();
 
+// --- Process Resource Usage ---
+long long get_peak_rss_bytes();
+void get_process_cpu_seconds(double& user_seconds, double& system_seconds);
+size_t get_open_file_limit(); // Soft RLIMIT_NOFILE; SIZE_MAX when unlimited or not applicable
+
 } // namespace allin1::common
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+namespace allin1::common {
+
+/**
+ * @brief Paces work to a sustained rate of tokens per second.
+ *
+ * Every acquire() reserves its tokens on a shared timeline and sleeps until
+ * its slot starts, so callers (on any number of threads) are spaced out
+ * evenly instead of running flat out and then stalling for a whole second.
+ * Credit is not saved up while idle, so there is no burst after a pause.
+ */
+class TokenBucket {
+public:
+    /**
+     * @brief Sets the rate; 0 removes the limit.
+     */
+    void set_rate(uint64_t tokens_per_second);
+
+    uint64_t rate() const { return m_rate.load(std::memory_order_relaxed); }
+
+    void acquire(uint64_t tokens);
+
+private:
+    std::atomic<uint64_t> m_rate{0};
+    std::mutex m_mutex;
+    std::chrono::steady_clock::time_point m_next{};   // Start of the next free slot
+};
+
+namespace detail {
+extern std::atomic<bool> rate_limits_enabled_flag;
+void throttle(uint64_t bytes, uint64_t ops);
+}
+
+/**
+ * @brief Limits data throughput and operation rate for the rest of the process (0 = unlimited).
+ * The limits are shared by all threads, including batch and daemon workers.
+ * Only the writes of a create fill and per-entry permission changes are paced;
+ * other io commands run unthrottled.
+ */
+void set_rate_limits(uint64_t max_bytes_per_second, uint64_t max_ops_per_second);
+
+/**
+ * @brief Waits until bytes may be transferred. Free when no limit is set.
+ */
+inline void throttle_bytes(uint64_t bytes) {
+    if (detail::rate_limits_enabled_flag.load(std::memory_order_relaxed)) {
+        detail::throttle(bytes, 0);
+    }
+}
+
+/**
+ * @brief Waits until ops more operations may be issued. Free when no limit is set.
+ */
+inline void throttle_ops(uint64_t ops = 1) {
+    if (detail::rate_limits_enabled_flag.load(std::memory_order_relaxed)) {
+        detail::throttle(0, ops);
+    }
+}
+
+/**
+ * @brief Shrinks a transfer size under a bandwidth limit so each one takes about 10 ms,
+ * keeping the pacing smooth. The result is a multiple of alignment and at most preferred.
+ */
+size_t paced_chunk_bytes(size_t preferred, size_t alignment);
+
+} // namespace allin1::common
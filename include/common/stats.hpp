@@ -0,0 +1,166 @@
+#pragma once
+
+#include "common/trace.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace allin1::common {
+
+// Syscall-level operations whose count and latency are tracked.
+enum class StatOp {
+    Open,
+    Read,
+    Write,
+    Stat,
+    Chown,
+    Chmod,
+    Mkdir,
+    Symlink,
+    Unlink,
+    Rename,
+    Fsync,
+    Count
+};
+
+enum class StatCounter {
+    EntriesVisited,
+    BytesRead,
+    BytesWritten,
+    Count
+};
+
+const char* stat_op_name(StatOp op);
+const char* stat_counter_name(StatCounter counter);
+
+namespace detail {
+extern std::atomic<bool> stats_enabled_flag;
+void record_op_latency(StatOp op, uint64_t nanoseconds);
+struct StatsTotals;
+}
+
+/**
+ * @brief Starts collecting statistics for the rest of the process lifetime.
+ * Calling it again once enabled has no effect.
+ */
+void enable_stats();
+
+/**
+ * @brief Collects statistics while alive, for a batch line or server request
+ * that asked for them. Collection stops again once the last one is gone, unless
+ * enable_stats() turned it on for the whole run.
+ */
+class ScopedStats {
+public:
+    ScopedStats();
+    ~ScopedStats();
+
+    ScopedStats(const ScopedStats&) = delete;
+    ScopedStats& operator=(const ScopedStats&) = delete;
+};
+
+inline bool stats_enabled() {
+    return detail::stats_enabled_flag.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Adds n to a counter. Costs a single relaxed load/store on the calling thread's slot.
+ */
+void count(StatCounter counter, uint64_t n = 1);
+
+/**
+ * @brief Records a failed operation by its errno (or platform error code).
+ */
+void record_error(int error_code);
+
+/**
+ * @brief Times an operation for the latency histogram of op, and records it as a
+ * "syscall" trace event when tracing. Free when both are disabled.
+ */
+class ScopedOpTimer {
+public:
+    explicit ScopedOpTimer(StatOp op) : m_op(op), m_stats(stats_enabled()), m_trace(trace_enabled()) {
+        if (m_stats || m_trace) {
+            m_start_ns = detail::trace_clock_ns();
+        }
+    }
+
+    ~ScopedOpTimer() {
+        if (m_stats || m_trace) {
+            uint64_t end_ns = detail::trace_clock_ns();
+            if (m_stats) {
+                detail::record_op_latency(m_op, end_ns - m_start_ns);
+            }
+            if (m_trace) {
+                detail::record_trace_event(stat_op_name(m_op), "syscall", m_start_ns, end_ns, {});
+            }
+        }
+    }
+
+    ScopedOpTimer(const ScopedOpTimer&) = delete;
+    ScopedOpTimer& operator=(const ScopedOpTimer&) = delete;
+
+private:
+    StatOp m_op;
+    bool m_stats;
+    bool m_trace;
+    uint64_t m_start_ns = 0;
+};
+
+struct OpSummary {
+    StatOp op;
+    uint64_t count = 0;
+    uint64_t total_ns = 0;
+    uint64_t max_ns = 0;
+    uint64_t p50_ns = 0;
+    uint64_t p90_ns = 0;
+    uint64_t p99_ns = 0;
+};
+
+struct StatsSummary {
+    bool whole_run = true;                            // False when measured from a StatsMark
+    double wall_seconds = 0;
+    double cpu_user_seconds = 0;
+    double cpu_system_seconds = 0;
+    long long peak_rss_bytes = 0;
+    uint64_t counters[static_cast<size_t>(StatCounter::Count)] = {};
+    std::vector<OpSummary> ops;                       // Only operations that ran
+    std::vector<std::pair<int, uint64_t>> errors;     // (error code, occurrences)
+};
+
+/**
+ * @brief The statistics gathered up to the moment mark_stats() was called.
+ */
+struct StatsMark {
+    std::chrono::steady_clock::time_point taken_at;
+    std::shared_ptr<const detail::StatsTotals> totals;
+};
+
+/**
+ * @brief Remembers the current totals, so that one command of a batch or server
+ * run can report only what happened after this point.
+ */
+StatsMark mark_stats();
+
+/**
+ * @brief Merges the per-thread statistics collected so far.
+ */
+StatsSummary collect_stats();
+
+/**
+ * @brief Like collect_stats(), but only counts what happened since mark. Work of
+ * other commands running at the same time is included, and CPU time and peak
+ * RSS always cover the whole process.
+ */
+StatsSummary collect_stats(const StatsMark& mark);
+
+/**
+ * @brief Prints a summary as text to out(), or emits it as a "stats" record in structured formats.
+ */
+void report_stats(const StatsSummary& summary);
+
+} // namespace allin1::common
@@ -2,6 +2,7 @@
 
 #include <string>
 #include <cstdint>
+#include <vector>
 
 namespace allin1::common {
 
@@ -13,4 +14,9 @@ uint64_t parse_size(const std::string& size_str);
 // Throws a HexByteParseError if the format is invalid.
 unsigned char parse_hex_byte(const std::string& hex_str);
 
+// Splits a command line into arguments using POSIX shell quoting rules
+// (single quotes, double quotes with backslash escapes, bare backslashes).
+// Throws a CommandLineParseError on an unterminated quote or trailing backslash.
+std::vector<std::string> split_command_line(const std::string& line);
+
 } // namespace allin1::common
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace allin1::common {
+
+/**
+ * @brief A fixed-size pool of worker threads consuming a shared FIFO task queue.
+ *
+ * Tasks must not throw; callers are expected to catch and record their own errors.
+ */
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t thread_count);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(std::function<void()> task);
+
+    /**
+     * @brief Blocks until the queue is empty and no task is running.
+     */
+    void wait_idle();
+
+    size_t size() const { return m_workers.size(); }
+
+private:
+    void worker_loop();
+
+    std::vector<std::thread> m_workers;
+    std::deque<std::function<void()>> m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_task_available;
+    std::condition_variable m_idle;
+    size_t m_active = 0;
+    bool m_stopping = false;
+};
+
+/**
+ * @brief Returns a sensible default worker count for this machine (at least 1).
+ */
+size_t default_worker_count();
+
+} // namespace allin1::common
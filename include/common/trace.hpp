@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace allin1::common {
+
+namespace detail {
+extern std::atomic<bool> trace_enabled_flag;
+void record_trace_event(const char* name, const char* category, uint64_t start_ns, uint64_t end_ns, std::string_view detail);
+
+inline uint64_t trace_clock_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+}
+
+/**
+ * @brief Starts recording trace events; write_trace() later saves them to path.
+ * Calling it again once enabled has no effect.
+ */
+void enable_trace(const std::string& path);
+
+inline bool trace_enabled() {
+    return detail::trace_enabled_flag.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Writes every recorded event to the trace file as Chrome trace JSON
+ * (loadable in chrome://tracing and Perfetto).
+ *
+ * Each thread records into its own fixed-size ring buffer, so once a buffer is
+ * full its oldest events are overwritten. The buffer of a thread that has exited
+ * is reused by the next thread started, which shows up on the same track. Must be called while no other thread
+ * is recording. Throws std::runtime_error if the file cannot be written.
+ */
+void write_trace();
+
+/**
+ * @brief Records a complete event covering the lifetime of the scope.
+ *
+ * name and category must be string literals; detail (e.g. the path being
+ * processed) is copied, truncated, when the scope ends and must outlive it.
+ * Costs a single relaxed load when tracing is disabled.
+ */
+class TraceScope {
+public:
+    explicit TraceScope(const char* name, std::string_view detail = {}, const char* category = "io")
+        : m_name(name), m_category(category), m_detail(detail), m_active(trace_enabled()) {
+        if (m_active) {
+            m_start_ns = detail::trace_clock_ns();
+        }
+    }
+
+    ~TraceScope() {
+        if (m_active) {
+            detail::record_trace_event(m_name, m_category, m_start_ns, detail::trace_clock_ns(), m_detail);
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* m_name;
+    const char* m_category;
+    std::string_view m_detail;
+    bool m_active;
+    uint64_t m_start_ns = 0;
+};
+
+} // namespace allin1::common
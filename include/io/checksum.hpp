@@ -0,0 +1,45 @@
+#pragma once
+
+#include "common/hash.hpp"
+#include "io/operation.hpp"
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+
+namespace allin1::io {
+
+struct ChecksumOptions {
+    std::filesystem::path path;         // File or directory to hash; with verify, the manifest to check
+    common::HashAlgorithm algorithm = common::HashAlgorithm::Sha256;
+    bool recursive = false;             // Hash every regular file below a directory (symlinks are not followed)
+    bool verify = false;                // Re-hash the files listed in the manifest at path and compare
+    std::filesystem::path manifest;     // When set, written after hashing; paths are relative to its directory
+    size_t jobs = 0;                    // Parallel workers (0 = one per CPU)
+    bool use_cache = false;             // Reuse and record digests in user.allin1.* xattrs (or a sidecar index)
+    ProgressCallback progress;          // Called on the calling thread, in input order, once all files are hashed
+};
+
+// Hashes files in parallel; CRC-32C of very large files is additionally split
+// into chunks hashed in parallel and combined. Manifests use the BSD tag format
+// ("SHA256 (path) = digest"), with backslashes and newlines in paths escaped
+// as coreutils does; verification also accepts "digest  path" lines,
+// hashed with options.algorithm. With use_cache, a file whose inode, size,
+// mtime and ctime still match its cached digest is not read at all. Unreadable or
+// mismatching files are reported per entry and counted in entries_failed. So
+// is a directory that cannot be listed; the rest of the tree is still hashed,
+// but no manifest is written, as it would not cover the whole tree.
+OperationResult perform_checksum(const ChecksumOptions& options);
+
+void handle_checksum(
+    const std::string& path,
+    const std::string& algorithm,
+    bool recursive,
+    const std::string& manifest,
+    bool verify,
+    bool use_cache,
+    const std::string& jobs,
+    bool output_enabled
+);
+
+} // namespace allin1::io
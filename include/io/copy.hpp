@@ -0,0 +1,57 @@
+#pragma once
+
+#include "io/operation.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+namespace allin1::io {
+
+// How the data of a file was copied, fastest first. Every method except
+// Buffered moves the data inside the kernel (or shares extents) without
+// passing it through user space.
+enum class CopyMethod {
+    Reflink,        // FICLONE: the copy shares extents with the source (Btrfs, XFS, ...)
+    CopyFileRange,  // copy_file_range(2), which can offload to the filesystem or server
+    Sendfile,       // sendfile(2) from the page cache
+    Platform,       // The platform's native file copy (Windows)
+    Buffered        // read(2)/write(2) through a user-space buffer
+};
+
+const char* copy_method_name(CopyMethod method);
+
+struct CopyOptions {
+    std::filesystem::path source;
+    std::filesystem::path destination;  // Existing directories receive an entry named after source
+    bool recursive = false;             // Copy a directory tree; per-entry failures are collected in the result
+    size_t jobs = 0;                    // Workers for recursive copies (0 = one per CPU)
+    bool no_cache = false;              // Drop copied data from the page cache behind a fixed window
+    ProgressCallback progress;          // Called from worker threads (serialized) for recursive copies
+};
+
+// Copies a regular file, or with recursive a directory tree, without writing to
+// stdout/stderr. Existing destination files are overwritten. A single file gets
+// the source's permission bits; a tree copy also preserves timestamps,
+// ownership (where permitted) and symlinks as links.
+OperationResult perform_copy(const CopyOptions& options);
+
+#if !defined(_WIN32)
+// Copies size bytes from one open regular file into another with the fastest
+// method available, adding what was written to bytes_copied. The destination
+// should be empty. Throws common::IOCreateError; the paths are for messages.
+CopyMethod copy_file_contents(int in_fd, int out_fd, uint64_t size, const std::filesystem::path& source,
+                              const std::filesystem::path& destination, uint64_t& bytes_copied);
+#endif
+
+void handle_copy(
+    const std::string& source,
+    const std::string& destination,
+    bool recursive,
+    const std::string& jobs,
+    bool no_cache,
+    bool output_enabled
+);
+
+} // namespace allin1::io
@@ -1,15 +1,45 @@
 #pragma once
 
+#include "io/operation.hpp"
+
+#include <cstdint>
+#include <filesystem>
 #include <string>
 
 namespace allin1::io {
 
+enum class CreateType {
+    File,
+    Directory
+};
+
+struct CreateOptions {
+    CreateType type = CreateType::File;
+    std::filesystem::path path;         // Full path of the object to create
+    bool fill = false;                  // Fill the file with fill_size copies of fill_byte
+    unsigned char fill_byte = 0;
+    uint64_t fill_size = 0;
+    bool no_cache = false;              // Stream the fill past the page cache (O_DIRECT or write-behind)
+    bool verify = false;                // Read the filled file back from storage and compare it with the pattern
+    bool atomic = false;                // Build the file unnamed (or hidden) and publish it complete in one step
+    ProgressCallback progress;
+};
+
+// Creates a file or directory without writing to stdout/stderr. A failed
+// verification throws common::IOCreateError with the number of differing
+// bytes and the offset of the first one. With atomic, an existing file is
+// replaced only once the new one is complete (and verified).
+OperationResult perform_create(const CreateOptions& options);
+
 void handle_create(
     const std::string& type,
     const std::string& path,
     const std::string& name,
     const std::string& fill,
     const std::string& fill_size,
+    bool no_cache,
+    bool verify,
+    bool atomic,
     bool output_enabled
 );
 
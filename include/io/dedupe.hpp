@@ -0,0 +1,68 @@
+#pragma once
+
+#include "common/hash.hpp"
+#include "io/operation.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+
+namespace allin1::io {
+
+enum class DedupeAction {
+    Report,                             // Only report duplicates
+    Hardlink,                           // Replace each duplicate by a hard link to the file kept
+    Reflink                             // Share the kept file's extents with FIDEDUPERANGE (Linux)
+};
+
+struct DedupeOptions {
+    std::filesystem::path path;
+    DedupeAction action = DedupeAction::Report;
+    std::optional<common::HashAlgorithm> algorithm; // Default: sha256 for Hardlink (the only one it accepts), xxh64 otherwise
+    uint64_t min_size = 1;              // Smaller files are ignored
+    size_t jobs = 0;                    // Parallel readers (0 = one per CPU)
+    ProgressCallback progress;          // Called in a stable order once the pipeline has run
+};
+
+struct DedupeReport {
+    uint64_t files = 0;                 // Regular files examined, counting hard-linked names once
+    uint64_t same_size = 0;             // ...that share their size with another
+    uint64_t same_ends = 0;             // ...and their first and last blocks
+    uint64_t duplicate_sets = 0;
+    uint64_t duplicates = 0;            // Files identical to the one kept in their set
+    uint64_t duplicate_bytes = 0;
+    uint64_t replaced = 0;              // Duplicates hard-linked or reflinked
+};
+
+// Finds files with identical contents below path in three stages, each
+// reading only the candidates that survived the one before: files are
+// bucketed by size (no reads), then by a hash of their first and last blocks,
+// then by a full hash. The walk and both hashing stages run on a pool of
+// workers. Names that are already hard links of one another count as one
+// file. A directory that cannot be opened or listed is reported as a failure
+// and the rest of the tree is still examined.
+//
+// In each set the file with the smallest path is kept and the others are
+// reported as ProgressKind::Duplicate (the kept path in the message, the size
+// in bytes). With Hardlink each name of a duplicate is then swapped for a
+// link to the kept file by rename; with Reflink its extents are shared with
+// the kept file's by the kernel, which compares the bytes itself. Either is
+// reported as Linked ("hardlink" or "reflink"). Duplicates on a different
+// filesystem than the kept file are only reported. Hardlink only links files
+// whose inode, size, mtime and ctime are still those the walk found, for the
+// kept file and the duplicate alike, and only with sha256 digests.
+OperationResult perform_dedupe(const DedupeOptions& options, DedupeReport& report);
+
+void handle_dedupe(
+    const std::string& path,
+    bool hardlink,
+    bool reflink,
+    const std::string& algorithm,
+    const std::string& min_size,
+    const std::string& jobs,
+    bool output_enabled
+);
+
+} // namespace allin1::io
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "io/operation.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace allin1::io {
+
+struct DiskUsageOptions {
+    std::filesystem::path path;
+    size_t top = 10;                    // Largest subtrees to report (0 = totals only)
+    bool one_file_system = false;       // Skip directories on other filesystems than path
+    bool apparent_size = false;         // Rank subtrees by file sizes rather than allocated space
+    size_t jobs = 0;                    // Parallel workers (0 = one per CPU)
+    ProgressCallback progress;          // Called for failures only, serialized across workers
+};
+
+struct SubtreeUsage {
+    std::string path;
+    uint64_t allocated_bytes = 0;       // Blocks actually allocated; holes in sparse files cost nothing
+    uint64_t apparent_bytes = 0;        // Sum of file sizes
+    uint64_t entries = 0;
+};
+
+struct DiskUsageReport {
+    SubtreeUsage total;
+    std::vector<SubtreeUsage> largest;  // Directories below path, largest first
+    uint64_t hard_links_skipped = 0;    // Further names of files already counted
+};
+
+// Measures the tree at path with a pool of workers, one directory per task.
+// Entries are examined with statx asking only for type, link count, inode,
+// size and blocks, without forcing attribute syncs on network filesystems.
+// A file with several hard links is counted once, at the lexicographically
+// smallest of its names, so subtree totals do not depend on which worker got
+// there first; directories reached twice (bind mounts) are counted once.
+// Subtree totals are rolled up into their parents as each subtree finishes,
+// and the top largest are kept in a bounded heap, with subtrees holding hard
+// links re-ranked once those are charged. Symlinks are not followed.
+// entries_processed counts the entries examined.
+OperationResult perform_disk_usage(const DiskUsageOptions& options, DiskUsageReport& report);
+
+void handle_disk_usage(
+    const std::string& path,
+    const std::string& top,
+    bool one_file_system,
+    bool apparent_size,
+    const std::string& jobs,
+    bool output_enabled
+);
+
+} // namespace allin1::io
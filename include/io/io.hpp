@@ -8,4 +8,8 @@ namespace allin1::io {
 
 void register_io_commands(cppParse::Parser& io_parser);
 
+// Runs whichever io subcommand was selected on an already parsed io parser.
+// Prints the io help text when no subcommand was given.
+void run_io_command(cppParse::Parser& io_parser, bool output_enabled);
+
 } // namespace allin1::io
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace allin1::io {
+
+enum class ProgressKind {
+    Created,        // A file, directory or shortcut was created at path
+    Linked,         // A symlink (or hard link / reflink) was created at path; message may say how (e.g. "retargeted")
+    Removed,        // The entry at path was removed
+    Broken,         // The symlink at path does not resolve; message holds why and its target
+    Copied,         // A file was copied to path; message holds the copy method
+    Hashed,         // path was checksummed; message holds the digest, bytes the size
+    Verified,       // path matched its manifest entry; message holds the digest
+    Duplicate,      // path has the same contents as the file in message; bytes holds the size
+    PermissionSet,  // Permissions were applied to path
+    BytesWritten,   // bytes holds the running total written to path
+    EntryFailed,    // An entry failed; message holds the reason and the operation continues
+    Warning         // Something at path went wrong without failing the operation; message holds what
+};
+
+struct ProgressEvent {
+    ProgressKind kind;
+    std::string path;
+    uint64_t bytes = 0;
+    std::string message;
+};
+
+// Called synchronously on the thread running the operation.
+using ProgressCallback = std::function<void(const ProgressEvent&)>;
+
+struct EntryError {
+    std::string path;
+    std::string message;
+};
+
+// Outcome of an io operation. Fatal errors are thrown as common::IOCreateError
+// or common::PermissionError; per-entry failures of multi-entry operations are
+// collected in errors instead.
+struct OperationResult {
+    uint64_t entries_processed = 0;
+    uint64_t entries_failed = 0;
+    uint64_t bytes_written = 0;
+    uint64_t bytes_read = 0;
+    std::chrono::nanoseconds elapsed{0};
+    std::vector<EntryError> errors;
+
+    bool ok() const { return entries_failed == 0; }
+};
+
+const char* progress_kind_name(ProgressKind kind);
+
+// Emits a structured record for a progress event of operation op (no-op in text mode).
+void emit_progress_record(const std::string& op, const ProgressEvent& event);
+
+// Emits the structured summary record of a finished operation (no-op in text mode).
+void emit_result_record(const std::string& op, const OperationResult& result);
+
+} // namespace allin1::io
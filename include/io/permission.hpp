@@ -1,9 +1,23 @@
 #pragma once
 
+#include "io/operation.hpp"
+#include "common/permission_utils.hpp"
+
 #include <string>
 
 namespace allin1::io {
 
+struct PermissionOptions {
+    std::string path;
+    std::string user;
+    common::Permissions permissions;
+    bool recursive = false;             // Per-entry failures are collected in the result
+    ProgressCallback progress;
+};
+
+// Applies permissions for a user without writing to stdout/stderr.
+OperationResult perform_permission(const PermissionOptions& options);
+
 void handle_permission(
     const std::string& path,
     const std::string& user,
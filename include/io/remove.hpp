@@ -0,0 +1,63 @@
+#pragma once
+
+#include "io/operation.hpp"
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+
+namespace allin1::io {
+
+struct RemoveOptions {
+    std::filesystem::path path;
+    bool recursive = false;             // Remove a directory with everything below it
+    bool background = false;            // Move the directory out of the way, then delete it in a detached process
+    size_t jobs = 0;                    // Parallel workers for recursive removal (0 = one per CPU)
+    ProgressCallback progress;          // Failures, then path once it is gone; serialized across workers
+};
+
+// Removes the file, symlink or empty directory at path, or with recursive a
+// whole tree. Trees are taken apart by a pool of workers: every directory is
+// opened relative to its parent, its entries are unlinked with unlinkat in
+// batches (so a huge directory is shared among workers too), sibling
+// subdirectories are emptied in parallel, and each directory is removed as
+// soon as its last subtree is gone. Symlinks are removed, never followed.
+// Mount points below path are not descended into; they, and the directories
+// above them, are reported as failures.
+//
+// With background the tree is first renamed to a hidden name next to path,
+// so path disappears in one step, and a detached process deletes it while the
+// call returns. That process is this executable started again (Linux; on other
+// systems the tree is deleted in the foreground), runs at a lower priority and
+// its failures are not reported. entries_processed counts the entries
+// removed, or in background mode the path alone.
+OperationResult perform_remove(const RemoveOptions& options);
+
+#if !defined(_WIN32)
+// Removes the directory name in parent_fd with everything below it, with the
+// walk perform_remove uses and jobs workers; for callers that already hold the
+// parent open. held_fds is how many descriptors the caller may have open
+// meanwhile, which the walk leaves free. Failures are returned in the result
+// rather than thrown, and entries_processed counts the entries removed or failed.
+OperationResult remove_directory_at(int parent_fd, const std::string& name, const std::string& path, size_t jobs, size_t held_fds = 0);
+#endif
+
+// First argument of the process perform_remove starts to delete a tree in the
+// background; main() passes such a command line to run_background_remove.
+inline constexpr const char* background_remove_argument = "--allin1-background-remove";
+
+// Entry point of that process, called before anything else runs in it:
+// detaches from the caller and removes the tree at path with jobs workers.
+// Exits with an error, removing nothing, unless path is absolute and names a
+// hidden temporary (".name.allin1-XXXXXXXX") and jobs is a number.
+[[noreturn]] void run_background_remove(const char* path, const char* jobs);
+
+void handle_remove(
+    const std::string& path,
+    bool recursive,
+    bool background,
+    const std::string& jobs,
+    bool output_enabled
+);
+
+} // namespace allin1::io
@@ -1,13 +1,50 @@
 #pragma once
 
+#include "io/operation.hpp"
+
+#include <cstddef>
+#include <filesystem>
 #include <string>
 
 namespace allin1::io {
 
+struct ShortcutOptions {
+    std::filesystem::path target;
+    std::filesystem::path link;         // On Linux ".desktop" is appended to this path
+    std::string description;
+    bool atomic = false;                // Publish the .desktop file only once it is complete (Linux)
+    ProgressCallback progress;
+};
+
+// Creates a platform-specific shortcut without writing to stdout/stderr.
+OperationResult perform_shortcut(const ShortcutOptions& options);
+
 void handle_shortcut(
     const std::string& target_path,
     const std::string& link_path,
     const std::string& description,
+    bool atomic,
+    bool output_enabled
+);
+
+struct ShortcutManifestOptions {
+    std::filesystem::path manifest;     // "target<TAB>link[<TAB>description]" per line
+    bool atomic = false;                // As ShortcutOptions::atomic, for every entry
+    size_t jobs = 0;                    // Parallel workers (0 = one per CPU)
+    ProgressCallback progress;          // Called in manifest order once all entries are written
+};
+
+// Creates one shortcut per manifest line. Relative paths are taken relative
+// to the manifest's directory. Parent directories are created once up front;
+// the entries themselves are rendered and written in parallel, each .desktop
+// file with a single open and write. Entries that fail are reported as
+// EntryFailed and counted in entries_failed; the rest are still created.
+OperationResult perform_shortcut_manifest(const ShortcutManifestOptions& options);
+
+void handle_shortcut_manifest(
+    const std::string& manifest,
+    bool atomic,
+    const std::string& jobs,
     bool output_enabled
 );
 
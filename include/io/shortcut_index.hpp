@@ -0,0 +1,56 @@
+#pragma once
+
+#include "io/operation.hpp"
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace allin1::io {
+
+struct ShortcutInfo {
+    std::string id;                     // Desktop file ID, e.g. "org.gnome.Terminal.desktop"
+    std::string path;                   // The .desktop file that provides it
+    std::string name;
+    std::string generic_name;
+    std::string comment;
+    std::string exec;
+    std::string keywords;
+    bool no_display = false;            // NoDisplay=true: installed, but not meant for menus
+};
+
+struct ShortcutListOptions {
+    std::string query;                  // Case-insensitive substring of the id, name, generic name, comment, keywords or exec; empty lists all
+    std::vector<std::filesystem::path> data_dirs;   // Searched in order; empty means $XDG_DATA_HOME, then $XDG_DATA_DIRS
+    std::filesystem::path cache_file;   // Empty means $XDG_CACHE_HOME/allin1/shortcut-index.bin
+    bool use_cache = true;
+    size_t jobs = 0;                    // Parallel parsers for changed directories (0 = one per CPU)
+};
+
+struct ShortcutListing {
+    std::vector<ShortcutInfo> shortcuts;    // Sorted by id
+    size_t directories = 0;                 // applications directories checked
+    size_t directories_rescanned = 0;       // ...of which were read and parsed again
+};
+
+// Lists the application launchers visible through the XDG data directories.
+// As in the desktop entry spec, an id found in an earlier directory shadows
+// later ones and Hidden=true removes it. Only the [Desktop Entry] group is
+// scanned, in place, and only unlocalized keys are kept.
+//
+// The parsed entries are kept in a binary index, recorded per directory with
+// its mtime and per file with its mtime and size: a directory whose mtime (and
+// inode) are unchanged is taken from the index without being listed, and of
+// its files only those whose mtime or size moved are read again, so a repeated
+// query costs one stat per directory and per file.
+// entries_processed counts the shortcuts returned, bytes_read the bytes parsed.
+OperationResult perform_shortcut_list(const ShortcutListOptions& options, ShortcutListing& listing);
+
+void handle_shortcut_list(
+    const std::string& query,
+    const std::string& jobs,
+    bool output_enabled
+);
+
+} // namespace allin1::io
@@ -1,13 +1,31 @@
 #pragma once
 
+#include "io/operation.hpp"
+
+#include <filesystem>
 #include <string>
 
 namespace allin1::io {
 
+struct SymlinkOptions {
+    std::filesystem::path target;
+    std::filesystem::path link;
+    bool directory = false;             // Create a directory symlink (only matters on Windows)
+    bool replace = false;               // Atomically switch an existing link instead of failing
+    ProgressCallback progress;
+};
+
+// Creates a symbolic link without writing to stdout/stderr. With replace, the
+// new link is created under a hidden name and exchanged (renameat2) or renamed
+// over the old one, so the link never goes missing; the Linked event carries
+// the previous target in its message. A non-link at the path is never replaced.
+OperationResult perform_symlink(const SymlinkOptions& options);
+
 void handle_symlink(
     const std::string& target_path,
     const std::string& link_path,
     bool is_directory,
+    bool replace,
     bool output_enabled
 );
 
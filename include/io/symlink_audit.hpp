@@ -0,0 +1,39 @@
+#pragma once
+
+#include "io/operation.hpp"
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+
+namespace allin1::io {
+
+struct SymlinkAuditOptions {
+    std::filesystem::path path;         // Tree to scan; symlinks are examined, never followed
+    bool remove = false;                // Remove broken links that were not retargeted
+    std::string retarget_from;          // With retarget_to: broken links whose target starts with this...
+    std::string retarget_to;            // ...are pointed here instead, if the new target resolves
+    size_t jobs = 0;                    // Parallel workers (0 = one per CPU)
+    ProgressCallback progress;          // Called for findings and repairs only, serialized across workers
+};
+
+// Finds dangling and looping symlinks below path in parallel. Link targets
+// are resolved against a cache of directories already opened (or known to be
+// missing), so links into the same directory cost one lookup of the final
+// component; loops are confirmed by following the chain with a (dev, inode)
+// set. Each directory is visited once, even through bind-mount cycles.
+// Broken links are reported as ProgressKind::Broken ("dangling" or "loop"
+// and the target in the message), retargeted ones as Linked (the new target
+// in the message) and removed ones as Removed; those neither retargeted nor removed
+// count in entries_failed. entries_processed counts the symlinks examined.
+OperationResult perform_symlink_audit(const SymlinkAuditOptions& options);
+
+void handle_symlink_audit(
+    const std::string& path,
+    bool remove,
+    const std::string& retarget,
+    const std::string& jobs,
+    bool output_enabled
+);
+
+} // namespace allin1::io
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "io/operation.hpp"
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+
+namespace allin1::io {
+
+struct SymlinkMirrorOptions {
+    std::filesystem::path source;       // Tree to mirror
+    std::filesystem::path destination;  // Receives the directory skeleton and one relative symlink per entry
+    bool incremental = false;           // Also retarget changed links and remove links whose source is gone
+    size_t jobs = 0;                    // Parallel workers (0 = one per CPU)
+    ProgressCallback progress;          // Called for changes only, serialized across workers
+};
+
+// Builds a stow-style symlink farm: every directory of source is created in
+// destination and every other entry becomes a relative symlink to it. Links
+// that already point where they should are left alone, so a re-run only pays
+// for a readdir per directory. With incremental, links with a different
+// target are switched atomically and links (and emptied directories) whose
+// source entry is gone are removed, and an entry that turned from a file into
+// a directory or back has its link or directory replaced; only links whose
+// target is exactly what the mirror would have written are ever removed, and
+// directories only once that leaves them empty. Without it, conflicting
+// entries are reported per entry and counted in entries_failed.
+OperationResult perform_symlink_mirror(const SymlinkMirrorOptions& options);
+
+void handle_symlink_mirror(
+    const std::string& source,
+    const std::string& destination,
+    bool incremental,
+    const std::string& jobs,
+    bool output_enabled
+);
+
+} // namespace allin1::io
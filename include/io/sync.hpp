@@ -0,0 +1,77 @@
+#pragma once
+
+#include "io/operation.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+namespace allin1::io {
+
+// Name of the index io sync keeps in the root of the destination. It is never
+// synced from the source nor removed as extraneous.
+inline constexpr const char* sync_index_name = ".allin1-sync-index";
+
+struct SyncOptions {
+    std::filesystem::path source;
+    std::filesystem::path destination;  // Created if missing
+    bool delete_extraneous = false;     // Remove destination entries that are not in the source
+    bool rescan = false;                // Ignore the index and compare every directory with the destination
+    uint64_t delta_min_size = 16ull * 1024 * 1024; // Changed files this large are updated block by block
+    size_t jobs = 0;                    // Parallel workers (0 = one per CPU)
+    ProgressCallback progress;          // Called from worker threads, serialized
+};
+
+struct SyncReport {
+    uint64_t examined = 0;              // Source entries stat'ed
+    uint64_t unchanged = 0;             // ...that needed nothing
+    uint64_t listed = 0;                // Source directories read because their listing may have changed
+    uint64_t copied = 0;                // Files written in full
+    uint64_t delta_updated = 0;         // Files updated block by block
+    uint64_t delta_blocks_written = 0;  // Blocks rewritten in those...
+    uint64_t delta_blocks = 0;          // ...out of this many
+    uint64_t metadata_updated = 0;      // Entries whose contents matched but mode, owner or times did not
+    uint64_t linked = 0;                // Symlinks (re)created
+    uint64_t removed = 0;               // Extraneous destination entries removed, counting everything below them
+    bool index_used = false;            // A valid index from an earlier sync was found
+};
+
+// Makes destination a mirror of the source tree (files, directories and
+// symlinks with their modes, owners where permitted and timestamps) with a
+// pool of workers, one directory per task.
+//
+// The work done follows the changes rather than the tree: an index of what
+// every synced entry looked like (type, size, inode, mode, owner, mtime and
+// ctime) is kept in the destination. A source directory whose own stat still
+// matches the index is not read again; its entries are taken from the index
+// and each costs one fstatat, and entries that still match are left alone
+// without touching the destination. Only directories whose listing changed
+// are read, and only those are compared with the destination for extraneous
+// entries, along with any last synced without delete_extraneous. Without an
+// index (first run, or rescan) a file whose destination already has the same
+// size and mtime is taken as synced.
+//
+// Changed files are copied to a hidden name with the fastest CopyMethod
+// available and renamed into place. Files of at least delta_min_size that
+// already exist in the destination are instead updated in place: the source
+// is read in blocks and only blocks that differ are written, compared with
+// the block hashes stored in the index or, failing that, with the
+// destination's data. Entries whose timestamps are too recent to be trusted
+// are indexed so that the next run looks at them again.
+//
+// Changes made to the destination behind io sync's back are only noticed with
+// rescan. entries_processed counts the source entries examined.
+OperationResult perform_sync(const SyncOptions& options, SyncReport& report);
+
+void handle_sync(
+    const std::string& source,
+    const std::string& destination,
+    bool delete_extraneous,
+    bool rescan,
+    const std::string& delta_min_size,
+    const std::string& jobs,
+    bool output_enabled
+);
+
+} // namespace allin1::io
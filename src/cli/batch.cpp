@@ -0,0 +1,174 @@
+#include "cli/batch.hpp"
+#include "cli/program.hpp"
+#include "common/output.hpp"
+#include "common/string_utils.hpp"
+#include "common/thread_pool.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+namespace allin1::cli {
+
+namespace {
+
+struct BatchCommand {
+    size_t line_number = 0;
+    std::vector<std::string> args;
+};
+
+struct CapturedResult {
+    bool ok = false;
+    std::ostringstream out;
+    std::ostringstream err;
+};
+
+// Parses and runs one command with a fresh root parser, reporting any error on err().
+bool run_batch_command(const BatchCommand& command, const BatchOptions& options) {
+    try {
+        if (!options.output_enabled && options.format.empty()) {
+            return run_command_args(command.args) == 0;
+        }
+        // Root options of the batch invocation apply to every command
+        std::vector<std::string> args;
+        args.reserve(command.args.size() + 3);
+        if (options.output_enabled) {
+            args.emplace_back("--output");
+        }
+        if (!options.format.empty()) {
+            args.emplace_back("--format");
+            args.emplace_back(options.format);
+        }
+        args.insert(args.end(), command.args.begin(), command.args.end());
+        return run_command_args(args) == 0;
+    } catch (const std::exception& e) {
+        common::err() << "Error on line " << command.line_number << ": " << e.what() << std::endl;
+        return false;
+    }
+}
+
+// Runs a group of independent commands on the pool and replays their output in order.
+bool run_parallel_group(common::ThreadPool& pool, const std::vector<BatchCommand>& group, const BatchOptions& options) {
+    std::vector<std::unique_ptr<CapturedResult>> results;
+    results.reserve(group.size());
+    for (const auto& command : group) {
+        auto result = std::make_unique<CapturedResult>();
+        CapturedResult* slot = result.get();
+        results.push_back(std::move(result));
+        pool.submit([slot, &command, &options] {
+            common::ScopedOutputRedirect redirect(slot->out, slot->err);
+            slot->ok = run_batch_command(command, options);
+        });
+    }
+    pool.wait_idle();
+
+    bool all_ok = true;
+    for (const auto& result : results) {
+        common::out() << result->out.str();
+        common::err() << result->err.str();
+        all_ok = all_ok && result->ok;
+    }
+    return all_ok;
+}
+
+} // namespace
+
+void register_batch_command(cppParse::Parser& program) {
+    auto& batch_parser = program.add_subparser("batch");
+    batch_parser.add_description("Run many commands from a script in a single process.");
+    batch_parser.add_argument(std::vector<std::string>{"script"}).help("File with one command per line, or - to read from stdin.").required();
+    batch_parser.add_argument(std::vector<std::string>{"-j", "--jobs"}).takes_value().help("Run up to N independent commands at once (0 = one per CPU). Lines reading 'wait' separate dependent groups.");
+    batch_parser.add_argument(std::vector<std::string>{"--keep-going"}).store_true().help("Continue with the remaining commands after a failure.");
+}
+
+int run_batch(const BatchOptions& options) {
+    std::ifstream script_file;
+    std::istream* input = &std::cin;
+    if (options.script_path != "-") {
+        script_file.open(options.script_path);
+        if (!script_file.is_open()) {
+            throw std::runtime_error("Failed to open batch script: " + options.script_path);
+        }
+        input = &script_file;
+    }
+
+    size_t jobs = options.jobs == 0 ? common::default_worker_count() : options.jobs;
+    std::unique_ptr<common::ThreadPool> pool;
+    if (jobs > 1) {
+        pool = std::make_unique<common::ThreadPool>(jobs);
+    }
+
+    bool all_ok = true;
+    std::vector<BatchCommand> group;
+
+    auto flush_group = [&]() {
+        if (!group.empty()) {
+            all_ok = run_parallel_group(*pool, group, options) && all_ok;
+            group.clear();
+        }
+        return all_ok || options.keep_going;
+    };
+
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(*input, line)) {
+        ++line_number;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+
+        BatchCommand command;
+        command.line_number = line_number;
+        try {
+            command.args = common::split_command_line(line);
+        } catch (const std::exception& e) {
+            common::err() << "Error on line " << line_number << ": " << e.what() << std::endl;
+            all_ok = false;
+            if (!options.keep_going) {
+                break;
+            }
+            continue;
+        }
+
+        if (command.args.empty() || command.args[0].front() == '#') {
+            continue;
+        }
+
+        if (!pool) {
+            if (command.args.size() == 1 && command.args[0] == "wait") {
+                continue;
+            }
+            if (!run_batch_command(command, options)) {
+                all_ok = false;
+                if (!options.keep_going) {
+                    break;
+                }
+            }
+            continue;
+        }
+
+        if (command.args.size() == 1 && command.args[0] == "wait") {
+            if (!flush_group()) {
+                break;
+            }
+            continue;
+        }
+        group.push_back(std::move(command));
+        if (group.size() >= jobs * 64) {
+            // Bound memory for very long scripts without a wait barrier
+            if (!flush_group()) {
+                break;
+            }
+        }
+    }
+    if (pool && (all_ok || options.keep_going)) {
+        flush_group();
+    }
+
+    return all_ok ? 0 : 1;
+}
+
+} // namespace allin1::cli
@@ -0,0 +1,268 @@
+#include "cli/program.hpp"
+#include "cli/batch.hpp"
+#include "cli/serve.hpp"
+#include "cppParse/help_formatter.hpp"
+#include "io/io.hpp"
+#include "io/version.hpp"
+#include "common/durability.hpp"
+#include "common/output.hpp"
+#include "common/perf_counters.hpp"
+#include "common/rate_limit.hpp"
+#include "common/stats.hpp"
+#include "common/string_utils.hpp"
+#include "common/trace.hpp"
+
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace allin1::cli {
+
+std::unique_ptr<cppParse::Parser> build_program() {
+    auto program = std::make_unique<cppParse::Parser>("AllIn1-alpha", std::string(app_version));
+    program->add_description("A collection of command-line tools.");
+    program->add_argument(std::vector<std::string>{"-v", "--version"}).store_true().help("shows version information and exits");
+    program->add_argument(std::vector<std::string>{"--output"}).store_true().help("Enable output messages");
+    program->add_argument(std::vector<std::string>{"--format"}).takes_value().help("Result format: text (default), json or ndjson");
+    program->add_argument(std::vector<std::string>{"--stats"}).store_true().help("Print operation counts, latency percentiles and resource usage at the end of the run");
+    program->add_argument(std::vector<std::string>{"--perf-counters"}).store_true().help("Collect CPU cycles, instructions, cache misses and context switches per io phase (Linux)");
+    program->add_argument(std::vector<std::string>{"--max-bw"}).takes_value().help("Limit data written per second by io create --fill, paced smoothly (e.g., 50M)");
+    program->add_argument(std::vector<std::string>{"--max-iops"}).takes_value().help("Limit io create --fill writes and per-entry permission changes per second");
+    program->add_argument(std::vector<std::string>{"--durable"}).store_true().help("Flush created files and directories to stable storage in batches before finishing");
+    program->add_argument(std::vector<std::string>{"--trace"}).takes_value().help("Record a timeline of io phases and write it to this file as Chrome trace JSON");
+
+    auto& io_parser = program->add_subparser("io");
+    io_parser.add_description("Perform I/O operations.");
+
+    allin1::io::register_io_commands(io_parser);
+    register_batch_command(*program);
+    register_serve_command(*program);
+
+    return program;
+}
+
+int run_program(cppParse::Parser& program, bool no_arguments, bool nested) {
+    if (nested && program.help_requested()) {
+        throw std::runtime_error("Help is not available inside a batch or through the server.");
+    }
+
+    if (program.get<bool>("version")) {
+        common::out() << "AllIn1 version " << app_version << '\n';
+        common::out() << "  - allin1_io version " << allin1::io::version << '\n';
+        return 0;
+    }
+
+    bool output_enabled = program.get<bool>("output");
+    std::string format = program.get<std::string>("format");
+    common::OutputFormat output_format = format.empty() ? common::output_format() : common::parse_output_format(format);
+
+    // The counters are process-wide; a nested command collects only while it runs
+    // and reports the difference from where they stood when it started
+    bool stats_requested = program.get<bool>("stats");
+    common::StatsMark stats_mark;
+    std::optional<common::ScopedStats> stats_scope;
+    if (stats_requested) {
+        if (nested) {
+            stats_scope.emplace();
+            stats_mark = common::mark_stats();
+        } else {
+            common::enable_stats();
+        }
+    }
+    // Hardware counters stay on once enabled and only keep process-wide totals, so
+    // a nested command would switch them on for everyone and report their cycles too
+    bool perf_counters_requested = program.get<bool>("perf-counters");
+    if (perf_counters_requested && nested) {
+        throw std::runtime_error("--perf-counters applies to the whole process; pass it to batch or serve instead.");
+    }
+    if (perf_counters_requested) {
+        common::enable_perf_counters();
+    }
+    bool summary_requested = stats_requested || perf_counters_requested;
+    auto report_stats = [stats_requested, perf_counters_requested, nested, &stats_mark] {
+        if (stats_requested) {
+            common::report_stats(nested ? common::collect_stats(stats_mark) : common::collect_stats());
+        }
+        if (perf_counters_requested) {
+            common::report_perf_counters(common::collect_perf_counters());
+        }
+    };
+
+    // Checked on the parsed command, so root options in front of it change nothing:
+    // a batch line running a batch would recurse without end, a serve would never return
+    // and another --connect would be run here instead of forwarded
+    if (nested && (program.is_subcommand_used("batch") || program.is_subcommand_used("serve"))) {
+        throw std::runtime_error("batch and serve cannot be run inside a batch or through the server.");
+    }
+    if (nested && !program.get<std::string>("connect").empty()) {
+        throw std::runtime_error("--connect cannot be used inside a batch or through the server.");
+    }
+
+    // The limits are shared by the whole process, so a batch line or server request
+    // cannot change them for everyone else; given to batch or serve they cover the run
+    std::string max_bw = program.get<std::string>("max-bw");
+    std::string max_iops = program.get<std::string>("max-iops");
+    if (nested && (!max_bw.empty() || !max_iops.empty())) {
+        throw std::runtime_error("--max-bw and --max-iops apply to the whole process; pass them to batch or serve instead.");
+    }
+    if (!max_bw.empty() || !max_iops.empty()) {
+        uint64_t bytes_per_second = 0;
+        uint64_t ops_per_second = 0;
+        try {
+            if (!max_bw.empty()) bytes_per_second = common::parse_size(max_bw);
+        } catch (const std::exception& e) {
+            throw std::runtime_error("Invalid value for --max-bw: \"" + max_bw + "\": " + e.what());
+        }
+        try {
+            if (!max_iops.empty()) ops_per_second = std::stoull(max_iops);
+        } catch (const std::exception&) {
+            throw std::runtime_error("Invalid value for --max-iops: \"" + max_iops + "\"");
+        }
+        common::set_rate_limits(bytes_per_second, ops_per_second);
+    }
+
+    // Durable mode tracks the entries written by the whole process and stays on
+    // once enabled. A batch flushes them once at the end; a server cannot tell
+    // its requests' entries apart, so each would flush (and report) the others'.
+    bool durable_requested = program.get<bool>("durable");
+    if (durable_requested && nested) {
+        throw std::runtime_error("--durable applies to the whole process; pass it to batch instead.");
+    }
+    if (durable_requested && program.is_subcommand_used("serve")) {
+        throw std::runtime_error("--durable is not supported by serve.");
+    }
+    if (durable_requested) {
+        common::enable_durable();
+    }
+    auto flush_durable = [] {
+        common::DurableFlushResult result = common::flush_durable();
+        if (!result.ok()) {
+            throw std::runtime_error("Failed to make " + std::to_string(result.errors.size()) + " entries durable: " + result.errors.front());
+        }
+    };
+
+    // One timeline per process, saved once the run is over: a nested command would
+    // neither get its own file nor be the last one recording
+    std::string trace_path = program.get<std::string>("trace");
+    if (!trace_path.empty() && nested) {
+        throw std::runtime_error("--trace applies to the whole process; pass it to batch or serve instead.");
+    }
+    if (!trace_path.empty()) {
+        common::enable_trace(trace_path);
+    }
+    // A trace that cannot be saved should not turn a successful run into a failure
+    auto save_trace = [&trace_path] {
+        if (trace_path.empty()) {
+            return;
+        }
+        try {
+            common::write_trace();
+        } catch (const std::exception& e) {
+            common::err() << "Warning: " << e.what() << std::endl;
+        }
+    };
+
+    if (program.is_subcommand_used("io")) {
+        common::ScopedOutputFormat format_scope(output_format);
+        try {
+            allin1::io::run_io_command(program.get_subparser("io"), output_enabled);
+            if (common::durable_enabled() && !common::durable_flush_deferred()) {
+                flush_durable();
+            }
+        } catch (const std::exception& e) {
+            common::emit(common::OutputRecord("error").add("message", e.what()));
+            if (common::durable_enabled() && !common::durable_flush_deferred()) {
+                common::flush_durable(); // Keep whatever was written; the first error is already reported
+            }
+            report_stats();
+            save_trace();
+            throw;
+        }
+        report_stats();
+        save_trace();
+    } else if (program.is_subcommand_used("batch")) {
+        auto& used_batch_parser = program.get_subparser("batch");
+
+        BatchOptions options;
+        options.script_path = used_batch_parser.get<std::string>("script");
+        options.keep_going = used_batch_parser.get<bool>("keep-going");
+        options.output_enabled = output_enabled;
+        options.format = format;
+        std::string jobs = used_batch_parser.get<std::string>("jobs");
+        if (!jobs.empty()) {
+            try {
+                options.jobs = std::stoul(jobs);
+            } catch (const std::exception&) {
+                throw std::runtime_error("Invalid value for --jobs: \"" + jobs + "\"");
+            }
+        }
+
+        int exit_code;
+        if (common::durable_enabled()) {
+            // One flush for the whole script instead of one per line
+            {
+                common::ScopedDurableBatch batch;
+                exit_code = run_batch(options);
+            }
+            try {
+                flush_durable();
+            } catch (const std::exception& e) {
+                common::err() << "Error: " << e.what() << std::endl;
+                exit_code = 1;
+            }
+        } else {
+            exit_code = run_batch(options);
+        }
+        if (summary_requested) {
+            common::ScopedOutputFormat format_scope(output_format);
+            report_stats();
+        }
+        save_trace();
+        return exit_code;
+    } else if (program.is_subcommand_used("serve")) {
+        auto& used_serve_parser = program.get_subparser("serve");
+
+        ServeOptions options;
+        options.socket_path = used_serve_parser.get<std::string>("socket");
+        std::string workers = used_serve_parser.get<std::string>("workers");
+        if (!workers.empty()) {
+            try {
+                options.workers = std::stoul(workers);
+            } catch (const std::exception&) {
+                throw std::runtime_error("Invalid value for --workers: \"" + workers + "\"");
+            }
+        }
+
+        int exit_code = run_server(options);
+        if (summary_requested) {
+            common::ScopedOutputFormat format_scope(output_format);
+            report_stats();
+        }
+        save_trace();
+        return exit_code;
+    } else if (no_arguments) {
+        common::out() << "Welcome to AllIn1. Use --help to see available commands." << '\n';
+    }
+
+    return 0;
+}
+
+int run_command_args(const std::vector<std::string>& args) {
+    std::vector<std::string> full_args;
+    full_args.reserve(args.size() + 1);
+    full_args.emplace_back("AllIn1");
+    full_args.insert(full_args.end(), args.begin(), args.end());
+
+    std::vector<char*> argv;
+    argv.reserve(full_args.size());
+    for (auto& arg : full_args) {
+        argv.push_back(arg.data());
+    }
+
+    auto program = build_program();
+    program->set_exit_on_help(false); // Exiting would end the whole batch or server
+    program->parse_args(static_cast<int>(argv.size()), argv.data());
+    return run_program(*program, false, true);
+}
+
+} // namespace allin1::cli
@@ -0,0 +1,378 @@
+#include "cli/serve.hpp"
+#include "cli/program.hpp"
+#include "common/output.hpp"
+#include "common/thread_pool.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+namespace allin1::cli {
+
+#if !defined(_WIN32)
+namespace {
+
+constexpr uint32_t max_request_size = 1024 * 1024;
+constexpr uint32_t max_response_size = 256 * 1024 * 1024;
+
+volatile std::sig_atomic_t stop_requested = 0;
+
+// The directory the server started in; requests that send no directory run there
+int base_directory_fd = -1;
+
+void handle_stop_signal(int) {
+    stop_requested = 1;
+}
+
+bool write_all(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+bool read_all(int fd, char* data, size_t size) {
+    while (size > 0) {
+        ssize_t received = ::recv(fd, data, size, 0);
+        if (received < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (received == 0) {
+            return false; // Peer closed the connection
+        }
+        data += received;
+        size -= static_cast<size_t>(received);
+    }
+    return true;
+}
+
+void append_u32(std::string& buffer, uint32_t value) {
+    char bytes[4] = {
+        static_cast<char>((value >> 24) & 0xFF), static_cast<char>((value >> 16) & 0xFF),
+        static_cast<char>((value >> 8) & 0xFF), static_cast<char>(value & 0xFF)};
+    buffer.append(bytes, 4);
+}
+
+uint32_t decode_u32(const char* bytes) {
+    return (static_cast<uint32_t>(static_cast<unsigned char>(bytes[0])) << 24) |
+           (static_cast<uint32_t>(static_cast<unsigned char>(bytes[1])) << 16) |
+           (static_cast<uint32_t>(static_cast<unsigned char>(bytes[2])) << 8) |
+           static_cast<uint32_t>(static_cast<unsigned char>(bytes[3]));
+}
+
+bool write_frame(int fd, const std::string& payload) {
+    std::string header;
+    append_u32(header, static_cast<uint32_t>(payload.size()));
+    return write_all(fd, header.data(), header.size()) && write_all(fd, payload.data(), payload.size());
+}
+
+bool read_frame(int fd, std::string& payload, uint32_t max_size) {
+    char header[4];
+    if (!read_all(fd, header, sizeof(header))) {
+        return false;
+    }
+    uint32_t size = decode_u32(header);
+    if (size > max_size) {
+        return false;
+    }
+    payload.resize(size);
+    return size == 0 || read_all(fd, payload.data(), size);
+}
+
+sockaddr_un make_address(const std::string& socket_path) {
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socket_path.empty() || socket_path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Invalid socket path: \"" + socket_path + "\"");
+    }
+    std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+    return address;
+}
+
+// Gives the calling worker thread its own working directory so requests can
+// resolve relative paths against the client's directory without racing.
+// Returns 0 or the errno of the failure.
+int ensure_private_cwd() {
+#if defined(__linux__)
+    thread_local int error = (::unshare(CLONE_FS) == 0) ? 0 : errno;
+    return error;
+#else
+    return ENOSYS;
+#endif
+}
+
+// Moves the worker thread into the request's directory. Without a directory of
+// its own per thread, relative paths would resolve against whichever directory
+// another request entered last, so the request is refused instead.
+void enter_request_directory(const std::string& cwd) {
+    if (int error = ensure_private_cwd()) {
+        throw std::runtime_error(std::string("Failed to give the request a working directory of its own: ") + std::strerror(error));
+    }
+    // Without a directory the request starts from the server's, not from wherever
+    // the previous request on this thread left off
+    if (cwd.empty()) {
+        if (::fchdir(base_directory_fd) != 0) {
+            throw std::runtime_error(std::string("Failed to enter the server's working directory: ") + std::strerror(errno));
+        }
+    } else if (::chdir(cwd.c_str()) != 0) {
+        throw std::runtime_error("Failed to enter working directory '" + cwd + "': " + std::strerror(errno));
+    }
+}
+
+std::string execute_request(const std::string& payload) {
+    std::vector<std::string> fields;
+    size_t start = 0;
+    while (start < payload.size()) {
+        size_t end = payload.find('\0', start);
+        if (end == std::string::npos) {
+            end = payload.size();
+        }
+        fields.emplace_back(payload, start, end - start);
+        start = end + 1;
+    }
+
+    std::ostringstream out_stream;
+    std::ostringstream err_stream;
+    int exit_code = 1;
+    {
+        common::ScopedOutputRedirect redirect(out_stream, err_stream);
+        try {
+            if (fields.empty()) {
+                throw std::runtime_error("Malformed request.");
+            }
+            std::string cwd = fields.front();
+            std::vector<std::string> args(fields.begin() + 1, fields.end());
+            enter_request_directory(cwd);
+            exit_code = run_command_args(args);
+        } catch (const std::exception& e) {
+            common::err() << "Error: " << e.what() << std::endl;
+            exit_code = 1;
+        }
+    }
+
+    std::string out_text = out_stream.str();
+    std::string err_text = err_stream.str();
+    std::string response;
+    response.reserve(12 + out_text.size() + err_text.size());
+    append_u32(response, static_cast<uint32_t>(exit_code));
+    append_u32(response, static_cast<uint32_t>(out_text.size()));
+    response += out_text;
+    append_u32(response, static_cast<uint32_t>(err_text.size()));
+    response += err_text;
+    return response;
+}
+
+class ConnectionRegistry {
+public:
+    void add(int fd) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_fds.insert(fd);
+    }
+
+    void remove(int fd) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_fds.erase(fd);
+    }
+
+    // Wakes up workers blocked on idle connections so the pool can drain
+    void shutdown_all() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (int fd : m_fds) {
+            ::shutdown(fd, SHUT_RDWR);
+        }
+    }
+
+private:
+    std::mutex m_mutex;
+    std::set<int> m_fds;
+};
+
+void serve_connection(int fd, ConnectionRegistry& registry) {
+    std::string request;
+    while (read_frame(fd, request, max_request_size)) {
+        if (!write_frame(fd, execute_request(request))) {
+            break;
+        }
+    }
+    registry.remove(fd);
+    ::close(fd);
+}
+
+} // namespace
+#endif
+
+void register_serve_command(cppParse::Parser& program) {
+    program.add_argument(std::vector<std::string>{"--connect"}).takes_value().help("Run the command through a server listening on this socket");
+
+    auto& serve_parser = program.add_subparser("serve");
+    serve_parser.add_description("Serve commands over a Unix domain socket from a warm process.");
+    serve_parser.add_argument(std::vector<std::string>{"--socket"}).takes_value().help("Path of the Unix domain socket to listen on.").required();
+    serve_parser.add_argument(std::vector<std::string>{"--workers"}).takes_value().help("Number of connections served concurrently (0 = one per CPU).");
+}
+
+int run_server(const ServeOptions& options) {
+#if defined(_WIN32)
+    (void)options;
+    throw std::runtime_error("serve is not supported on this platform.");
+#else
+    sockaddr_un address = make_address(options.socket_path);
+
+    base_directory_fd = ::open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (base_directory_fd < 0) {
+        throw std::runtime_error(std::string("Failed to open the working directory: ") + std::strerror(errno));
+    }
+
+    int listen_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        std::string message = std::strerror(errno);
+        ::close(base_directory_fd);
+        throw std::runtime_error("Failed to create socket: " + message);
+    }
+
+    // Remove a stale socket left behind by a previous server, but never a regular file
+    struct stat st;
+    if (::lstat(options.socket_path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+        ::unlink(options.socket_path.c_str());
+    }
+
+    mode_t previous_umask = ::umask(0177); // Socket is only reachable by its owner
+    int bind_result = ::bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    ::umask(previous_umask);
+    if (bind_result != 0 || ::listen(listen_fd, 128) != 0) {
+        std::string message = std::strerror(errno);
+        ::close(listen_fd);
+        ::close(base_directory_fd);
+        throw std::runtime_error("Failed to listen on '" + options.socket_path + "': " + message);
+    }
+
+    // Workers inherit a mask with the stop signals blocked, so only this thread
+    // receives them and its accept() returns with EINTR.
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr);
+
+    ConnectionRegistry registry;
+    {
+        size_t workers = options.workers == 0 ? common::default_worker_count() : options.workers;
+        common::ThreadPool pool(workers);
+
+        struct sigaction action;
+        std::memset(&action, 0, sizeof(action));
+        action.sa_handler = handle_stop_signal;
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = 0; // No SA_RESTART: accept() must return on a signal
+        sigaction(SIGINT, &action, nullptr);
+        sigaction(SIGTERM, &action, nullptr);
+        stop_requested = 0;
+        pthread_sigmask(SIG_UNBLOCK, &stop_signals, nullptr);
+
+        common::out() << "Listening on " << options.socket_path << " with " << pool.size() << " workers" << '\n';
+        common::flush_output();
+
+        while (!stop_requested) {
+            int client_fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client_fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                common::err() << "accept failed: " << std::strerror(errno) << std::endl;
+                break;
+            }
+            registry.add(client_fd);
+            pool.submit([client_fd, &registry] { serve_connection(client_fd, registry); });
+        }
+
+        registry.shutdown_all();
+    }
+
+    ::close(listen_fd);
+    ::close(base_directory_fd);
+    ::unlink(options.socket_path.c_str());
+    return 0;
+#endif
+}
+
+int run_client(const std::string& socket_path, const std::vector<std::string>& args) {
+#if defined(_WIN32)
+    (void)socket_path;
+    (void)args;
+    throw std::runtime_error("--connect is not supported on this platform.");
+#else
+    sockaddr_un address = make_address(socket_path);
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        throw std::runtime_error(std::string("Failed to create socket: ") + std::strerror(errno));
+    }
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        std::string message = std::strerror(errno);
+        ::close(fd);
+        throw std::runtime_error("Failed to connect to '" + socket_path + "': " + message);
+    }
+
+    std::string request;
+    char cwd[4096];
+    if (::getcwd(cwd, sizeof(cwd)) != nullptr) {
+        request += cwd;
+    }
+    request += '\0';
+    for (const auto& arg : args) {
+        request += arg;
+        request += '\0';
+    }
+
+    std::string response;
+    bool ok = write_frame(fd, request) && read_frame(fd, response, max_response_size);
+    ::close(fd);
+    if (!ok || response.size() < 8) {
+        throw std::runtime_error("No valid response from server at '" + socket_path + "'.");
+    }
+
+    int exit_code = static_cast<int>(decode_u32(response.data()));
+    size_t offset = 4;
+    uint32_t out_size = decode_u32(response.data() + offset);
+    offset += 4;
+    if (offset + out_size + 4 > response.size()) {
+        throw std::runtime_error("Malformed response from server.");
+    }
+    common::out() << response.substr(offset, out_size);
+    offset += out_size;
+    uint32_t err_size = decode_u32(response.data() + offset);
+    offset += 4;
+    if (offset + err_size > response.size()) {
+        throw std::runtime_error("Malformed response from server.");
+    }
+    common::err() << response.substr(offset, err_size);
+    return exit_code;
+#endif
+}
+
+} // namespace allin1::cli
@@ -0,0 +1,187 @@
+#include "common/atomic_file.hpp"
+#include "common/stats.hpp"
+#include "common/trace.hpp"
+
+#include <cstdio>
+#include <random>
+#include <string_view>
+#include <system_error>
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <fcntl.h>
+#include <stdio.h> // renameat
+#include <unistd.h>
+#endif
+
+namespace allin1::common {
+
+namespace {
+
+[[noreturn]] void throw_errno(const std::string& what, const std::filesystem::path& path, int error_code) {
+    record_error(error_code);
+    throw std::filesystem::filesystem_error(what, path, std::error_code(error_code, std::system_category()));
+}
+
+// Creates the hidden file exclusively, so two writers never share one
+std::filesystem::path create_hidden_file(const std::filesystem::path& path, unsigned int mode) {
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        std::filesystem::path temp_path = hidden_temp_path(path);
+#if defined(_WIN32)
+        (void)mode;
+        std::error_code ec;
+        if (!std::filesystem::exists(temp_path, ec)) {
+            return temp_path;
+        }
+#else
+        int fd;
+        {
+            ScopedOpTimer timer(StatOp::Open);
+            fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, static_cast<mode_t>(mode));
+        }
+        if (fd >= 0) {
+            ::close(fd);
+            return temp_path;
+        }
+        if (errno != EEXIST) {
+            throw_errno("Failed to create temporary file", temp_path, errno);
+        }
+#endif
+    }
+    throw_errno("Failed to find a free temporary name", path, EEXIST);
+}
+
+} // namespace
+
+std::filesystem::path hidden_temp_path(const std::filesystem::path& path) {
+    thread_local std::mt19937_64 generator{std::random_device{}()};
+    char suffix[16];
+    std::snprintf(suffix, sizeof(suffix), "%08x", static_cast<unsigned int>(generator()));
+    std::string filename = path.filename().string();
+    std::string name;
+    name.reserve(filename.size() + 16);
+    name.append(".").append(filename).append(".allin1-").append(suffix);
+    return path.has_parent_path() ? path.parent_path() / name : std::filesystem::path(name);
+}
+
+bool is_hidden_temp_name(const std::string& name) {
+    constexpr std::string_view marker = ".allin1-";
+    constexpr size_t suffix_length = 8;
+    if (name.size() < 1 + 1 + marker.size() + suffix_length || name[0] != '.') {
+        return false;
+    }
+    size_t suffix_start = name.size() - suffix_length;
+    if (name.compare(suffix_start - marker.size(), marker.size(), marker) != 0) {
+        return false;
+    }
+    for (size_t i = suffix_start; i < name.size(); ++i) {
+        char c = name[i];
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#if !defined(_WIN32)
+int replace_symlink_at(int dir_fd, const std::string& name, const std::string& target) {
+    std::string temp_name;
+    {
+        ScopedOpTimer timer(StatOp::Symlink);
+        while (true) {
+            temp_name = hidden_temp_path(name).string();
+            if (::symlinkat(target.c_str(), dir_fd, temp_name.c_str()) == 0) {
+                break;
+            }
+            if (errno != EEXIST) {
+                return errno;
+            }
+        }
+    }
+    ScopedOpTimer timer(StatOp::Rename);
+    if (::renameat(dir_fd, temp_name.c_str(), dir_fd, name.c_str()) != 0) {
+        int error_code = errno;
+        ::unlinkat(dir_fd, temp_name.c_str(), 0);
+        return error_code;
+    }
+    return 0;
+}
+#endif
+
+AtomicFile::AtomicFile(std::filesystem::path path, unsigned int mode) : m_path(std::move(path)) {
+    TraceScope trace("atomic_file.open", m_path.string());
+#if defined(__linux__) && defined(O_TMPFILE)
+    std::filesystem::path directory = m_path.has_parent_path() ? m_path.parent_path() : std::filesystem::path(".");
+    {
+        ScopedOpTimer timer(StatOp::Open);
+        m_fd = ::open(directory.c_str(), O_TMPFILE | O_WRONLY | O_CLOEXEC, static_cast<mode_t>(mode));
+    }
+    if (m_fd >= 0) {
+        // Writers reopen the inode through its /proc link; without /proc it cannot be linked either
+        std::filesystem::path proc_path = "/proc/self/fd/" + std::to_string(m_fd);
+        if (::access(proc_path.c_str(), F_OK) == 0) {
+            m_write_path = std::move(proc_path);
+            m_anonymous = true;
+            return;
+        }
+        ::close(m_fd);
+        m_fd = -1;
+    }
+#endif
+    m_write_path = create_hidden_file(m_path, mode);
+}
+
+AtomicFile::~AtomicFile() {
+#if !defined(_WIN32)
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+#endif
+    if (!m_committed && !m_anonymous) {
+        std::error_code ec;
+        std::filesystem::remove(m_write_path, ec);
+    }
+}
+
+void AtomicFile::commit() {
+    TraceScope trace("atomic_file.commit", m_path.string());
+    ScopedOpTimer timer(StatOp::Rename);
+#if !defined(_WIN32)
+    if (m_anonymous) {
+        if (::linkat(AT_FDCWD, m_write_path.c_str(), AT_FDCWD, m_path.c_str(), AT_SYMLINK_FOLLOW) != 0) {
+            if (errno != EEXIST) {
+                throw_errno("Failed to link file into place", m_path, errno);
+            }
+            // linkat never replaces; link under a hidden name and rename that over the old file
+            std::filesystem::path temp_path;
+            while (true) {
+                temp_path = hidden_temp_path(m_path);
+                if (::linkat(AT_FDCWD, m_write_path.c_str(), AT_FDCWD, temp_path.c_str(), AT_SYMLINK_FOLLOW) == 0) {
+                    break;
+                }
+                if (errno != EEXIST) {
+                    throw_errno("Failed to link file into place", temp_path, errno);
+                }
+            }
+            if (::rename(temp_path.c_str(), m_path.c_str()) != 0) {
+                int error_code = errno;
+                ::unlink(temp_path.c_str());
+                throw_errno("Failed to replace file", m_path, error_code);
+            }
+        }
+        ::close(m_fd);
+        m_fd = -1;
+        m_committed = true;
+        return;
+    }
+#endif
+    std::error_code ec;
+    std::filesystem::rename(m_write_path, m_path, ec);
+    if (ec) {
+        record_error(ec.value());
+        throw std::filesystem::filesystem_error("Failed to replace file", m_write_path, m_path, ec);
+    }
+    m_committed = true;
+}
+
+} // namespace allin1::common
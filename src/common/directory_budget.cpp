@@ -0,0 +1,59 @@
+#include "common/directory_budget.hpp"
+#include "common/platform.hpp"
+
+#include <algorithm>
+
+namespace allin1::common {
+
+namespace {
+
+// Even under a tiny limit a few directories must be open for the walk to move
+constexpr size_t min_open_directories = 4;
+constexpr size_t max_open_directories = 4096;
+
+} // namespace
+
+DirectoryBudget::DirectoryBudget(size_t fds_per_directory, size_t reserved_fds) {
+    size_t limit = get_open_file_limit();
+    size_t available = limit > reserved_fds ? limit - reserved_fds : 0;
+    m_capacity = std::clamp(available / std::max<size_t>(fds_per_directory, 1), min_open_directories, max_open_directories);
+}
+
+void DirectoryBudget::acquire() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_open;
+}
+
+bool DirectoryBudget::acquire_or_defer(std::function<void()> open_later) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_open < m_capacity) {
+        ++m_open;
+        return true;
+    }
+    m_deferred.push_back(std::move(open_later));
+    return false;
+}
+
+std::function<void()> DirectoryBudget::release() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_deferred.empty() || m_open > m_capacity) {
+        --m_open; // Slots taken over the cap by take_stalled() are not handed on
+        return {};
+    }
+    std::function<void()> next = std::move(m_deferred.back());
+    m_deferred.pop_back();
+    return next;
+}
+
+std::function<void()> DirectoryBudget::take_stalled() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_deferred.empty()) {
+        return {};
+    }
+    ++m_open;
+    std::function<void()> next = std::move(m_deferred.back());
+    m_deferred.pop_back();
+    return next;
+}
+
+} // namespace allin1::common
@@ -0,0 +1,274 @@
+#include "common/durability.hpp"
+#include "common/error_utils.hpp"
+#include "common/stats.hpp"
+#include "common/thread_pool.hpp"
+#include "common/trace.hpp"
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <set>
+#include <system_error>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace allin1::common {
+
+namespace detail {
+std::atomic<bool> durable_enabled_flag{false};
+}
+
+namespace {
+
+// Entries tracked before the tracking thread flushes them itself
+constexpr size_t auto_flush_entries = 4096;
+// Entries on one filesystem from which a single syncfs is cheaper than syncing each one
+constexpr size_t syncfs_min_entries = 256;
+// Syncs in flight at once; they wait on the device, not the CPU
+constexpr size_t sync_workers = 16;
+constexpr size_t max_recorded_errors = 1000;
+
+struct Tracker {
+    std::mutex flush_mutex;     // Held while entries are taken and synced, so a flush never returns early
+    std::mutex mutex;
+    std::set<std::string> files;
+    std::set<std::string> directories;
+    std::vector<std::string> pending_errors;    // From automatic flushes
+    std::atomic<int> deferred{0};
+};
+
+Tracker& tracker() {
+    static Tracker instance;
+    return instance;
+}
+
+std::string absolute_path(const std::filesystem::path& path) {
+    std::error_code ec;
+    std::filesystem::path absolute = std::filesystem::absolute(path, ec);
+    return (ec ? path : absolute).lexically_normal().string();
+}
+
+struct SyncEntry {
+    std::string path;
+    bool directory;
+};
+
+// Returns an empty string on success (or if the entry is gone), otherwise the reason
+std::string sync_entry(const SyncEntry& entry) {
+#if defined(_WIN32)
+    if (entry.directory) {
+        return {}; // NTFS commits directory changes through its own journal
+    }
+    HANDLE handle = CreateFileA(entry.path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        DWORD error_code = GetLastError();
+        return error_code == ERROR_FILE_NOT_FOUND ? std::string() : get_system_error_message(error_code);
+    }
+    bool flushed;
+    {
+        ScopedOpTimer timer(StatOp::Fsync);
+        flushed = FlushFileBuffers(handle) != 0;
+    }
+    DWORD error_code = GetLastError();
+    CloseHandle(handle);
+    return flushed ? std::string() : get_system_error_message(error_code);
+#else
+    int fd;
+    {
+        ScopedOpTimer timer(StatOp::Open);
+        fd = ::open(entry.path.c_str(), O_RDONLY | O_CLOEXEC | (entry.directory ? O_DIRECTORY : 0));
+    }
+    if (fd < 0) {
+        int error_code = errno;
+        return error_code == ENOENT ? std::string() : get_system_error_message(static_cast<unsigned long>(error_code));
+    }
+    int result;
+    int error_code = 0;
+    {
+        ScopedOpTimer timer(StatOp::Fsync);
+        result = entry.directory ? ::fsync(fd) : ::fdatasync(fd);
+        error_code = errno;
+    }
+    ::close(fd);
+    if (result != 0) {
+        record_error(error_code);
+        return get_system_error_message(static_cast<unsigned long>(error_code));
+    }
+    return {};
+#endif
+}
+
+// Syncs entries with up to sync_workers calls in flight; errors are appended
+void sync_parallel(const std::vector<SyncEntry>& entries, std::vector<std::string>& errors) {
+    if (entries.empty()) {
+        return;
+    }
+    std::vector<std::string> reasons(entries.size());
+    {
+        ThreadPool pool(std::min(sync_workers, entries.size()));
+        for (size_t i = 0; i < entries.size(); ++i) {
+            pool.submit([&entries, &reasons, i] { reasons[i] = sync_entry(entries[i]); });
+        }
+        pool.wait_idle();
+    }
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (!reasons[i].empty() && errors.size() < max_recorded_errors) {
+            errors.push_back(entries[i].path + ": " + reasons[i]);
+        }
+    }
+}
+
+DurableFlushResult flush_entries(const std::set<std::string>& files, const std::set<std::string>& directories) {
+    TraceScope trace("durable.flush");
+    DurableFlushResult result;
+    std::vector<SyncEntry> file_entries;
+    std::vector<SyncEntry> directory_entries;
+
+#if defined(__linux__)
+    // Group by filesystem so one crowded filesystem can be synced as a whole
+    std::map<dev_t, std::vector<SyncEntry>> by_device;
+    auto group = [&by_device, &file_entries, &directory_entries](const std::string& path, bool directory) {
+        struct stat st;
+        if (::lstat(path.c_str(), &st) != 0) {
+            (directory ? directory_entries : file_entries).push_back({path, directory});
+            return;
+        }
+        by_device[st.st_dev].push_back({path, directory});
+    };
+    for (const auto& path : files) group(path, false);
+    for (const auto& path : directories) group(path, true);
+
+    for (auto& [device, entries] : by_device) {
+        if (entries.size() >= syncfs_min_entries) {
+            TraceScope syncfs_trace("durable.syncfs");
+            int fd = ::open(entries.front().path.c_str(), O_RDONLY | O_CLOEXEC);
+            int synced = -1;
+            if (fd >= 0) {
+                ScopedOpTimer timer(StatOp::Fsync);
+                synced = ::syncfs(fd);
+                ::close(fd);
+            }
+            if (synced == 0) {
+                ++result.filesystems;
+                continue;
+            }
+        }
+        for (auto& entry : entries) {
+            (entry.directory ? directory_entries : file_entries).push_back(std::move(entry));
+        }
+    }
+#else
+    for (const auto& path : files) file_entries.push_back({path, false});
+    for (const auto& path : directories) directory_entries.push_back({path, true});
+#endif
+
+    // Data first, so no directory entry can become durable before the data it names
+    sync_parallel(file_entries, result.errors);
+    sync_parallel(directory_entries, result.errors);
+    result.files = file_entries.size();
+    result.directories = directory_entries.size();
+    return result;
+}
+
+// Called with the tracker mutex held; once enough entries pile up, releases it and syncs them
+void flush_if_full(std::unique_lock<std::mutex>& lock) {
+    Tracker& state = tracker();
+    if (state.files.size() + state.directories.size() < auto_flush_entries) {
+        return;
+    }
+    lock.unlock();
+    std::lock_guard<std::mutex> flush_lock(state.flush_mutex);
+    std::set<std::string> files;
+    std::set<std::string> directories;
+    lock.lock();
+    files.swap(state.files);
+    directories.swap(state.directories);
+    lock.unlock();
+
+    DurableFlushResult result = flush_entries(files, directories);
+    if (!result.ok()) {
+        std::lock_guard<std::mutex> relock(state.mutex);
+        for (auto& error : result.errors) {
+            if (state.pending_errors.size() < max_recorded_errors) {
+                state.pending_errors.push_back(std::move(error));
+            }
+        }
+    }
+}
+
+} // namespace
+
+namespace detail {
+
+void track_durable_file(const std::filesystem::path& path) {
+    std::string absolute = absolute_path(path);
+    std::unique_lock<std::mutex> lock(tracker().mutex);
+    tracker().files.insert(std::move(absolute));
+    flush_if_full(lock);
+}
+
+void track_durable_directory(const std::filesystem::path& path) {
+    std::string absolute = absolute_path(path);
+    std::unique_lock<std::mutex> lock(tracker().mutex);
+    tracker().directories.insert(std::move(absolute));
+    flush_if_full(lock);
+}
+
+void track_durable_entry(const std::filesystem::path& path) {
+    std::filesystem::path directory = std::filesystem::path(absolute_path(path)).parent_path();
+    std::unique_lock<std::mutex> lock(tracker().mutex);
+    // Syncing an unchanged ancestor is cheap; stop where an earlier entry already reached
+    while (!directory.empty() && tracker().directories.insert(directory.string()).second) {
+        std::filesystem::path parent = directory.parent_path();
+        if (parent == directory) {
+            break;
+        }
+        directory = std::move(parent);
+    }
+    flush_if_full(lock);
+}
+
+} // namespace detail
+
+void enable_durable() {
+    detail::durable_enabled_flag.store(true, std::memory_order_relaxed);
+}
+
+DurableFlushResult flush_durable() {
+    Tracker& state = tracker();
+    std::lock_guard<std::mutex> flush_lock(state.flush_mutex);
+    std::set<std::string> files;
+    std::set<std::string> directories;
+    std::vector<std::string> pending_errors;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        files.swap(state.files);
+        directories.swap(state.directories);
+        pending_errors.swap(state.pending_errors);
+    }
+
+    DurableFlushResult result = flush_entries(files, directories);
+    result.errors.insert(result.errors.begin(), pending_errors.begin(), pending_errors.end());
+    return result;
+}
+
+ScopedDurableBatch::ScopedDurableBatch() {
+    tracker().deferred.fetch_add(1, std::memory_order_relaxed);
+}
+
+ScopedDurableBatch::~ScopedDurableBatch() {
+    tracker().deferred.fetch_sub(1, std::memory_order_relaxed);
+}
+
+bool durable_flush_deferred() {
+    return tracker().deferred.load(std::memory_order_relaxed) > 0;
+}
+
+} // namespace allin1::common
@@ -1,4 +1,5 @@
 #include "common/error_utils.hpp"
+#include "common/stats.hpp"
 #include <map>
 
 #ifdef _WIN32
@@ -77,4 +78,16 @@ std::string get_contextual_error_message(unsigned long error_code) {
     return "";
 }
 
+IOCreateError make_errno_error(const std::string& what, const std::filesystem::path& path, unsigned long error_code,
+                               const std::string& suggestion) {
+    record_error(static_cast<int>(error_code));
+    std::string message = what + " '" + path.string() + "'. Code: " + std::to_string(error_code) + ": " +
+                          get_system_error_message(error_code);
+    std::string hint = suggestion.empty() ? get_contextual_error_message(error_code) : suggestion;
+    if (!hint.empty()) {
+        message += ". Suggestion: " + hint;
+    }
+    return IOCreateError(message);
+}
+
 } // namespace allin1::common
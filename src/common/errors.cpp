@@ -6,6 +6,8 @@ StringSizeParseError::StringSizeParseError(const std::string& message) : std::ru
 
 HexByteParseError::HexByteParseError(const std::string& message) : std::runtime_error(message) {}
 
+CommandLineParseError::CommandLineParseError(const std::string& message) : std::runtime_error(message) {}
+
 IOCreateError::IOCreateError(const std::string& message) : std::runtime_error(message) {}
 
 PermissionError::PermissionError(const std::string& message) : std::runtime_error(message) {}
@@ -0,0 +1,570 @@
+#include "common/hash.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstring>
+#include <stdexcept>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define ALLIN1_HASH_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+namespace allin1::common {
+
+namespace {
+
+constexpr char hex_digits[] = "0123456789abcdef";
+
+std::string to_hex(const unsigned char* bytes, size_t size) {
+    std::string hex(size * 2, '0');
+    for (size_t i = 0; i < size; ++i) {
+        hex[2 * i] = hex_digits[bytes[i] >> 4];
+        hex[2 * i + 1] = hex_digits[bytes[i] & 0x0F];
+    }
+    return hex;
+}
+
+std::string to_hex(uint64_t value, int bytes) {
+    unsigned char buffer[8];
+    for (int i = 0; i < bytes; ++i) {
+        buffer[i] = static_cast<unsigned char>(value >> (8 * (bytes - 1 - i)));
+    }
+    return to_hex(buffer, static_cast<size_t>(bytes));
+}
+
+inline uint64_t load64(const unsigned char* p) {
+    uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value; // Little-endian hosts only, like the rest of the binary formats here
+}
+
+inline uint32_t load32(const unsigned char* p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// ---------------------------------------------------------------------------
+// CRC-32C
+// ---------------------------------------------------------------------------
+
+constexpr uint32_t crc32c_poly = 0x82F63B78; // Castagnoli, bit-reversed
+
+// Slicing-by-8 tables: table[k][b] is the CRC of byte b followed by k zero bytes
+struct Crc32cTables {
+    uint32_t table[8][256];
+
+    Crc32cTables() {
+        for (uint32_t b = 0; b < 256; ++b) {
+            uint32_t crc = b;
+            for (int i = 0; i < 8; ++i) {
+                crc = (crc >> 1) ^ (crc & 1 ? crc32c_poly : 0);
+            }
+            table[0][b] = crc;
+        }
+        for (uint32_t b = 0; b < 256; ++b) {
+            for (int k = 1; k < 8; ++k) {
+                table[k][b] = (table[k - 1][b] >> 8) ^ table[0][table[k - 1][b] & 0xFF];
+            }
+        }
+    }
+};
+
+const Crc32cTables& crc32c_tables() {
+    static const Crc32cTables tables;
+    return tables;
+}
+
+uint32_t crc32c_software(uint32_t crc, const unsigned char* p, size_t size) {
+    const auto& t = crc32c_tables().table;
+    uint32_t c = ~crc;
+    while (size > 0 && (reinterpret_cast<uintptr_t>(p) & 7) != 0) {
+        c = (c >> 8) ^ t[0][(c ^ *p++) & 0xFF];
+        --size;
+    }
+    while (size >= 8) {
+        uint64_t word = load64(p) ^ c;
+        c = t[7][word & 0xFF] ^ t[6][(word >> 8) & 0xFF] ^ t[5][(word >> 16) & 0xFF] ^ t[4][(word >> 24) & 0xFF] ^
+            t[3][(word >> 32) & 0xFF] ^ t[2][(word >> 40) & 0xFF] ^ t[1][(word >> 48) & 0xFF] ^ t[0][word >> 56];
+        p += 8;
+        size -= 8;
+    }
+    while (size > 0) {
+        c = (c >> 8) ^ t[0][(c ^ *p++) & 0xFF];
+        --size;
+    }
+    return ~c;
+}
+
+// Polynomial arithmetic modulo the CRC polynomial (reflected), as in zlib's crc32_combine
+uint32_t multiply_mod_p(uint32_t a, uint32_t b) {
+    uint32_t m = 1u << 31;
+    uint32_t product = 0;
+    while (true) {
+        if (a & m) {
+            product ^= b;
+            if ((a & (m - 1)) == 0) break;
+        }
+        m >>= 1;
+        b = b & 1 ? (b >> 1) ^ crc32c_poly : b >> 1;
+    }
+    return product;
+}
+
+// x^(2^k) mod p for k = 0..31; the sequence repeats with period 32
+struct PowerTable {
+    uint32_t power[32];
+
+    PowerTable() {
+        uint32_t p = 1u << 30; // x^1
+        power[0] = p;
+        for (int k = 1; k < 32; ++k) {
+            power[k] = p = multiply_mod_p(p, p);
+        }
+    }
+};
+
+// x^(8 * length) mod p: the operator that appends length zero bytes to a CRC
+uint32_t zeros_operator(uint64_t length) {
+    static const PowerTable table;
+    uint32_t p = 1u << 31; // x^0
+    int k = 3;             // 8 * length = length << 3
+    while (length) {
+        if (length & 1) {
+            p = multiply_mod_p(table.power[k & 31], p);
+        }
+        length >>= 1;
+        ++k;
+    }
+    return p;
+}
+
+#if defined(ALLIN1_HASH_X86)
+constexpr size_t crc32c_stripe_bytes = 8192;
+
+// Three independent crc32 chains hide the instruction's 3-cycle latency; the
+// partial CRCs are merged with a precomputed shift operator.
+__attribute__((target("sse4.2")))
+uint32_t crc32c_sse42(uint32_t crc, const unsigned char* p, size_t size) {
+    static const uint32_t stripe_shift = zeros_operator(crc32c_stripe_bytes);
+    uint64_t c = ~crc;
+    while (size > 0 && (reinterpret_cast<uintptr_t>(p) & 7) != 0) {
+        c = _mm_crc32_u8(static_cast<uint32_t>(c), *p++);
+        --size;
+    }
+    while (size >= 3 * crc32c_stripe_bytes) {
+        uint64_t c1 = 0xFFFFFFFF;
+        uint64_t c2 = 0xFFFFFFFF;
+        for (size_t i = 0; i < crc32c_stripe_bytes; i += 8) {
+            c = _mm_crc32_u64(c, load64(p + i));
+            c1 = _mm_crc32_u64(c1, load64(p + crc32c_stripe_bytes + i));
+            c2 = _mm_crc32_u64(c2, load64(p + 2 * crc32c_stripe_bytes + i));
+        }
+        uint32_t merged = multiply_mod_p(stripe_shift, ~static_cast<uint32_t>(c)) ^ ~static_cast<uint32_t>(c1);
+        merged = multiply_mod_p(stripe_shift, merged) ^ ~static_cast<uint32_t>(c2);
+        c = ~merged;
+        p += 3 * crc32c_stripe_bytes;
+        size -= 3 * crc32c_stripe_bytes;
+    }
+    while (size >= 8) {
+        c = _mm_crc32_u64(c, load64(p));
+        p += 8;
+        size -= 8;
+    }
+    while (size > 0) {
+        c = _mm_crc32_u8(static_cast<uint32_t>(c), *p++);
+        --size;
+    }
+    return ~static_cast<uint32_t>(c);
+}
+
+bool cpu_has_sse42() {
+    static const bool supported = __builtin_cpu_supports("sse4.2");
+    return supported;
+}
+
+bool cpu_has_sha() {
+    static const bool supported = [] {
+        unsigned int eax, ebx, ecx, edx;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSE4_1) || !(ecx & bit_SSSE3)) {
+            return false;
+        }
+        if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+            return false;
+        }
+        return (ebx & (1u << 29)) != 0;
+    }();
+    return supported;
+}
+#endif
+
+class Crc32cHasher : public Hasher {
+public:
+    void update(const void* data, size_t size) override {
+        m_crc = crc32c(m_crc, data, size);
+    }
+
+    std::string hex_digest() override {
+        return crc32c_hex(m_crc);
+    }
+
+private:
+    uint32_t m_crc = 0;
+};
+
+// ---------------------------------------------------------------------------
+// XXH64
+// ---------------------------------------------------------------------------
+
+constexpr uint64_t xxh_prime1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t xxh_prime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t xxh_prime3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t xxh_prime4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t xxh_prime5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t xxh_round(uint64_t acc, uint64_t input) {
+    acc += input * xxh_prime2;
+    acc = rotl64(acc, 31);
+    return acc * xxh_prime1;
+}
+
+inline uint64_t xxh_merge_round(uint64_t acc, uint64_t value) {
+    acc ^= xxh_round(0, value);
+    return acc * xxh_prime1 + xxh_prime4;
+}
+
+class Xxh64Hasher : public Hasher {
+public:
+    void update(const void* data, size_t size) override {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        m_total += size;
+
+        if (m_buffered + size < sizeof(m_buffer)) {
+            std::memcpy(m_buffer + m_buffered, p, size);
+            m_buffered += size;
+            return;
+        }
+        if (m_buffered > 0) {
+            size_t fill = sizeof(m_buffer) - m_buffered;
+            std::memcpy(m_buffer + m_buffered, p, fill);
+            consume(m_buffer);
+            p += fill;
+            size -= fill;
+            m_buffered = 0;
+        }
+        while (size >= sizeof(m_buffer)) {
+            consume(p);
+            p += sizeof(m_buffer);
+            size -= sizeof(m_buffer);
+        }
+        std::memcpy(m_buffer, p, size);
+        m_buffered = size;
+    }
+
+    std::string hex_digest() override {
+        uint64_t h;
+        if (m_total >= sizeof(m_buffer)) {
+            h = rotl64(m_v[0], 1) + rotl64(m_v[1], 7) + rotl64(m_v[2], 12) + rotl64(m_v[3], 18);
+            for (uint64_t v : m_v) {
+                h = xxh_merge_round(h, v);
+            }
+        } else {
+            h = xxh_prime5; // seed 0
+        }
+        h += m_total;
+
+        const unsigned char* p = m_buffer;
+        size_t remaining = m_buffered;
+        while (remaining >= 8) {
+            h ^= xxh_round(0, load64(p));
+            h = rotl64(h, 27) * xxh_prime1 + xxh_prime4;
+            p += 8;
+            remaining -= 8;
+        }
+        if (remaining >= 4) {
+            h ^= static_cast<uint64_t>(load32(p)) * xxh_prime1;
+            h = rotl64(h, 23) * xxh_prime2 + xxh_prime3;
+            p += 4;
+            remaining -= 4;
+        }
+        while (remaining > 0) {
+            h ^= (*p++) * xxh_prime5;
+            h = rotl64(h, 11) * xxh_prime1;
+            --remaining;
+        }
+
+        h ^= h >> 33;
+        h *= xxh_prime2;
+        h ^= h >> 29;
+        h *= xxh_prime3;
+        h ^= h >> 32;
+        return to_hex(h, 8);
+    }
+
+private:
+    void consume(const unsigned char* stripe) {
+        m_v[0] = xxh_round(m_v[0], load64(stripe));
+        m_v[1] = xxh_round(m_v[1], load64(stripe + 8));
+        m_v[2] = xxh_round(m_v[2], load64(stripe + 16));
+        m_v[3] = xxh_round(m_v[3], load64(stripe + 24));
+    }
+
+    uint64_t m_v[4] = {xxh_prime1 + xxh_prime2, xxh_prime2, 0, 0 - xxh_prime1};
+    unsigned char m_buffer[32];
+    size_t m_buffered = 0;
+    uint64_t m_total = 0;
+};
+
+// ---------------------------------------------------------------------------
+// SHA-256
+// ---------------------------------------------------------------------------
+
+alignas(16) constexpr uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+inline uint32_t rotr32(uint32_t x, int r) {
+    return (x >> r) | (x << (32 - r));
+}
+
+inline uint32_t load_be32(const unsigned char* p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+}
+
+void sha256_blocks_portable(uint32_t state[8], const unsigned char* data, size_t blocks) {
+    uint32_t w[64];
+    while (blocks--) {
+        for (int i = 0; i < 16; ++i) {
+            w[i] = load_be32(data + 4 * i);
+        }
+        for (int i = 16; i < 64; ++i) {
+            uint32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; ++i) {
+            uint32_t s1 = rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25);
+            uint32_t ch = (e & f) ^ (~e & g);
+            uint32_t t1 = h + s1 + ch + sha256_k[i] + w[i];
+            uint32_t s0 = rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22);
+            uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t t2 = s0 + maj;
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+        data += 64;
+    }
+}
+
+#if defined(ALLIN1_HASH_X86)
+// SHA extensions: sha256rnds2 performs two rounds on the state held as ABEF/CDGH
+// vectors; sha256msg1/msg2 compute the message schedule four words at a time.
+__attribute__((target("sha,sse4.1,ssse3")))
+void sha256_blocks_shani(uint32_t state[8], const unsigned char* data, size_t blocks) {
+    const __m128i byte_swap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    __m128i tmp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0]));
+    __m128i state1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4]));
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);            // CDAB
+    state1 = _mm_shuffle_epi32(state1, 0x1B);      // EFGH
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8); // ABEF
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);   // CDGH
+
+    while (blocks--) {
+        __m128i abef_save = state0;
+        __m128i cdgh_save = state1;
+
+        __m128i w[16];
+        for (int g = 0; g < 4; ++g) {
+            w[g] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * g)), byte_swap);
+        }
+        for (int g = 4; g < 16; ++g) {
+            __m128i x = _mm_add_epi32(_mm_sha256msg1_epu32(w[g - 4], w[g - 3]), _mm_alignr_epi8(w[g - 1], w[g - 2], 4));
+            w[g] = _mm_sha256msg2_epu32(x, w[g - 1]);
+        }
+        for (int g = 0; g < 16; ++g) {
+            __m128i msg = _mm_add_epi32(w[g], _mm_load_si128(reinterpret_cast<const __m128i*>(&sha256_k[4 * g])));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            msg = _mm_shuffle_epi32(msg, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+        }
+
+        state0 = _mm_add_epi32(state0, abef_save);
+        state1 = _mm_add_epi32(state1, cdgh_save);
+        data += 64;
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);         // FEBA
+    state1 = _mm_shuffle_epi32(state1, 0xB1);      // DCHG
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);   // DCBA
+    state1 = _mm_alignr_epi8(state1, tmp, 8);      // HGFE
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), state1);
+}
+#endif
+
+using Sha256Blocks = void (*)(uint32_t*, const unsigned char*, size_t);
+
+Sha256Blocks sha256_blocks() {
+#if defined(ALLIN1_HASH_X86)
+    if (cpu_has_sha()) {
+        return sha256_blocks_shani;
+    }
+#endif
+    return sha256_blocks_portable;
+}
+
+class Sha256Hasher : public Hasher {
+public:
+    void update(const void* data, size_t size) override {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        m_total += size;
+        if (m_buffered > 0) {
+            size_t fill = std::min(size, sizeof(m_buffer) - m_buffered);
+            std::memcpy(m_buffer + m_buffered, p, fill);
+            m_buffered += fill;
+            p += fill;
+            size -= fill;
+            if (m_buffered < sizeof(m_buffer)) {
+                return;
+            }
+            m_blocks(m_state, m_buffer, 1);
+            m_buffered = 0;
+        }
+        if (size >= 64) {
+            m_blocks(m_state, p, size / 64);
+            p += size - size % 64;
+            size %= 64;
+        }
+        std::memcpy(m_buffer, p, size);
+        m_buffered = size;
+    }
+
+    std::string hex_digest() override {
+        uint64_t bit_length = m_total * 8;
+        unsigned char padding[72] = {0x80};
+        size_t pad = (m_buffered < 56 ? 56 : 120) - m_buffered;
+        for (int i = 0; i < 8; ++i) {
+            padding[pad + i] = static_cast<unsigned char>(bit_length >> (56 - 8 * i));
+        }
+        update(padding, pad + 8);
+
+        unsigned char digest[32];
+        for (int i = 0; i < 8; ++i) {
+            digest[4 * i] = static_cast<unsigned char>(m_state[i] >> 24);
+            digest[4 * i + 1] = static_cast<unsigned char>(m_state[i] >> 16);
+            digest[4 * i + 2] = static_cast<unsigned char>(m_state[i] >> 8);
+            digest[4 * i + 3] = static_cast<unsigned char>(m_state[i]);
+        }
+        return to_hex(digest, sizeof(digest));
+    }
+
+private:
+    Sha256Blocks m_blocks = sha256_blocks();
+    uint32_t m_state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    unsigned char m_buffer[64];
+    size_t m_buffered = 0;
+    uint64_t m_total = 0;
+};
+
+} // namespace
+
+HashAlgorithm parse_hash_algorithm(const std::string& name) {
+    std::string lower(name);
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    if (lower == "crc32c") return HashAlgorithm::Crc32c;
+    if (lower == "xxh64") return HashAlgorithm::Xxh64;
+    if (lower == "sha256") return HashAlgorithm::Sha256;
+    throw std::invalid_argument("Invalid hash algorithm: \"" + name + "\". Must be 'crc32c', 'xxh64', or 'sha256'.");
+}
+
+const char* hash_algorithm_name(HashAlgorithm algorithm) {
+    switch (algorithm) {
+        case HashAlgorithm::Crc32c: return "crc32c";
+        case HashAlgorithm::Xxh64: return "xxh64";
+        case HashAlgorithm::Sha256: return "sha256";
+    }
+    return "unknown";
+}
+
+const char* hash_algorithm_tag(HashAlgorithm algorithm) {
+    switch (algorithm) {
+        case HashAlgorithm::Crc32c: return "CRC32C";
+        case HashAlgorithm::Xxh64: return "XXH64";
+        case HashAlgorithm::Sha256: return "SHA256";
+    }
+    return "UNKNOWN";
+}
+
+const char* hash_implementation(HashAlgorithm algorithm) {
+    switch (algorithm) {
+        case HashAlgorithm::Crc32c:
+#if defined(ALLIN1_HASH_X86)
+            if (cpu_has_sse42()) return "sse4.2";
+#endif
+            return "slicing-by-8";
+        case HashAlgorithm::Xxh64:
+            return "portable";
+        case HashAlgorithm::Sha256:
+#if defined(ALLIN1_HASH_X86)
+            if (cpu_has_sha()) return "sha-ni";
+#endif
+            return "portable";
+    }
+    return "unknown";
+}
+
+std::unique_ptr<Hasher> make_hasher(HashAlgorithm algorithm) {
+    switch (algorithm) {
+        case HashAlgorithm::Crc32c: return std::make_unique<Crc32cHasher>();
+        case HashAlgorithm::Xxh64: return std::make_unique<Xxh64Hasher>();
+        case HashAlgorithm::Sha256: return std::make_unique<Sha256Hasher>();
+    }
+    throw std::invalid_argument("Unknown hash algorithm");
+}
+
+uint32_t crc32c(uint32_t crc, const void* data, size_t size) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+#if defined(ALLIN1_HASH_X86)
+    if (cpu_has_sse42()) {
+        return crc32c_sse42(crc, p, size);
+    }
+#endif
+    return crc32c_software(crc, p, size);
+}
+
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, uint64_t length2) {
+    return multiply_mod_p(zeros_operator(length2), crc1) ^ crc2;
+}
+
+std::string crc32c_hex(uint32_t crc) {
+    return to_hex(crc, 4);
+}
+
+} // namespace allin1::common
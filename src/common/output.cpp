@@ -0,0 +1,260 @@
+#include "common/output.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <streambuf>
+
+namespace allin1::common {
+
+namespace {
+
+// A stdout stream buffer that only hands data to stdio when its buffer is full
+// or on an explicit flush, instead of once per line.
+class BufferedStdoutBuf : public std::streambuf {
+public:
+    BufferedStdoutBuf() {
+        setp(m_buffer, m_buffer + sizeof(m_buffer));
+    }
+
+    ~BufferedStdoutBuf() override {
+        sync();
+    }
+
+protected:
+    int_type overflow(int_type ch) override {
+        write_pending();
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    std::streamsize xsputn(const char* data, std::streamsize count) override {
+        if (count > epptr() - pptr()) {
+            write_pending();
+            if (count >= static_cast<std::streamsize>(sizeof(m_buffer))) {
+                std::fwrite(data, 1, static_cast<size_t>(count), stdout);
+                return count;
+            }
+        }
+        std::memcpy(pptr(), data, static_cast<size_t>(count));
+        pbump(static_cast<int>(count));
+        return count;
+    }
+
+    int sync() override {
+        write_pending();
+        return std::fflush(stdout) == 0 ? 0 : -1;
+    }
+
+private:
+    void write_pending() {
+        if (pptr() > pbase()) {
+            std::fwrite(pbase(), 1, static_cast<size_t>(pptr() - pbase()), stdout);
+            setp(m_buffer, m_buffer + sizeof(m_buffer));
+        }
+    }
+
+    char m_buffer[64 * 1024];
+};
+
+struct StdoutSink {
+    BufferedStdoutBuf buffer;
+    std::ostream stream{&buffer};
+
+    StdoutSink() {
+        // Anything written to stderr first flushes pending stdout, keeping the two in order
+        std::cerr.tie(&stream);
+    }
+
+    ~StdoutSink() {
+        std::cerr.tie(&std::cout);
+        stream.flush();
+    }
+};
+
+StdoutSink& stdout_sink() {
+    static StdoutSink sink;
+    return sink;
+}
+
+thread_local std::ostream* current_out = nullptr;
+thread_local std::ostream* current_err = nullptr;
+thread_local OutputFormat current_format = OutputFormat::Text;
+thread_local uint64_t* current_record_count = nullptr;
+
+std::mutex emit_mutex;
+
+} // namespace
+
+OutputFormat parse_output_format(const std::string& format) {
+    if (format == "text") return OutputFormat::Text;
+    if (format == "json") return OutputFormat::Json;
+    if (format == "ndjson") return OutputFormat::Ndjson;
+    throw std::invalid_argument("Invalid output format: \"" + format + "\". Must be 'text', 'json', or 'ndjson'.");
+}
+
+std::ostream& out() {
+    return current_out ? *current_out : stdout_sink().stream;
+}
+
+std::ostream& err() {
+    if (!current_err) {
+        stdout_sink(); // Make sure stderr is tied to the buffered stdout stream
+        return std::cerr;
+    }
+    return *current_err;
+}
+
+void flush_output() {
+    out().flush();
+}
+
+ScopedOutputRedirect::ScopedOutputRedirect(std::ostream& out_stream, std::ostream& err_stream)
+    : m_previous_out(current_out), m_previous_err(current_err) {
+    current_out = &out_stream;
+    current_err = &err_stream;
+}
+
+ScopedOutputRedirect::~ScopedOutputRedirect() {
+    current_out = m_previous_out;
+    current_err = m_previous_err;
+}
+
+OutputFormat output_format() {
+    return current_format;
+}
+
+ScopedOutputFormat::ScopedOutputFormat(OutputFormat format)
+    : m_previous_format(current_format), m_previous_record_count(current_record_count) {
+    current_format = format;
+    current_record_count = &m_record_count;
+}
+
+ScopedOutputFormat::~ScopedOutputFormat() {
+    if (current_format == OutputFormat::Json) {
+        std::lock_guard<std::mutex> lock(emit_mutex);
+        out() << (m_record_count == 0 ? "[]\n" : "\n]\n");
+    }
+    current_format = m_previous_format;
+    current_record_count = m_previous_record_count;
+}
+
+OutputContext current_output_context() {
+    return {&out(), &err(), current_format, current_record_count};
+}
+
+ScopedOutputContext::ScopedOutputContext(const OutputContext& context)
+    : m_previous{current_out, current_err, current_format, current_record_count} {
+    current_out = context.out;
+    current_err = context.err;
+    current_format = context.format;
+    current_record_count = context.record_count;
+}
+
+ScopedOutputContext::~ScopedOutputContext() {
+    current_out = m_previous.out;
+    current_err = m_previous.err;
+    current_format = m_previous.format;
+    current_record_count = m_previous.record_count;
+}
+
+void append_json_string(std::string& buffer, const std::string& value) {
+    static const char hex_digits[] = "0123456789abcdef";
+    buffer += '"';
+    for (unsigned char c : value) {
+        switch (c) {
+            case '"': buffer += "\\\""; break;
+            case '\\': buffer += "\\\\"; break;
+            case '\n': buffer += "\\n"; break;
+            case '\r': buffer += "\\r"; break;
+            case '\t': buffer += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    buffer += "\\u00";
+                    buffer += hex_digits[c >> 4];
+                    buffer += hex_digits[c & 0xF];
+                } else {
+                    buffer += static_cast<char>(c);
+                }
+        }
+    }
+    buffer += '"';
+}
+
+OutputRecord::OutputRecord(const std::string& event) {
+    m_json.reserve(128);
+    m_json = "{\"event\":";
+    append_json_string(m_json, event);
+}
+
+void OutputRecord::add_key(const std::string& key) {
+    m_json += ',';
+    append_json_string(m_json, key);
+    m_json += ':';
+}
+
+OutputRecord& OutputRecord::add(const std::string& key, const std::string& value) {
+    add_key(key);
+    append_json_string(m_json, value);
+    return *this;
+}
+
+OutputRecord& OutputRecord::add(const std::string& key, const char* value) {
+    return add(key, std::string(value));
+}
+
+OutputRecord& OutputRecord::add(const std::string& key, uint64_t value) {
+    add_key(key);
+    m_json += std::to_string(value);
+    return *this;
+}
+
+OutputRecord& OutputRecord::add(const std::string& key, int64_t value) {
+    add_key(key);
+    m_json += std::to_string(value);
+    return *this;
+}
+
+OutputRecord& OutputRecord::add(const std::string& key, double value) {
+    add_key(key);
+    if (!std::isfinite(value)) {
+        m_json += "null";
+        return *this;
+    }
+    char number[32];
+    std::snprintf(number, sizeof(number), "%.17g", value);
+    m_json += number;
+    return *this;
+}
+
+OutputRecord& OutputRecord::add(const std::string& key, bool value) {
+    add_key(key);
+    m_json += value ? "true" : "false";
+    return *this;
+}
+
+void emit(const OutputRecord& record) {
+    if (current_format == OutputFormat::Text) {
+        return;
+    }
+    std::string line = record.json();
+    std::lock_guard<std::mutex> lock(emit_mutex);
+    if (current_format == OutputFormat::Ndjson) {
+        line += '\n';
+        out() << line;
+    } else {
+        bool first = current_record_count == nullptr || *current_record_count == 0;
+        out() << (first ? "[\n" : ",\n") << line;
+    }
+    if (current_record_count) {
+        ++*current_record_count;
+    }
+}
+
+} // namespace allin1::common
@@ -0,0 +1,58 @@
+#include "common/page_cache.hpp"
+#include "common/stats.hpp"
+#include "common/trace.hpp"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace allin1::common {
+
+WriteBehind::WriteBehind(int fd, int source_fd, uint64_t window)
+    : m_fd(fd), m_source_fd(source_fd), m_window(window == 0 ? write_behind_window_bytes : window) {}
+
+void WriteBehind::advance(uint64_t offset) {
+    while (offset - m_started >= m_window) {
+#if defined(__linux__)
+        ::sync_file_range(m_fd, static_cast<off64_t>(m_started), static_cast<off64_t>(m_window), SYNC_FILE_RANGE_WRITE);
+#endif
+        if (m_started > m_dropped) {
+            drop(m_dropped, m_started - m_dropped);
+            m_dropped = m_started;
+        }
+        m_started += m_window;
+    }
+}
+
+void WriteBehind::finish() {
+    drop(m_dropped, 0); // A length of 0 extends to the end of the file
+    m_started = m_dropped = 0;
+}
+
+// Dirty pages cannot be dropped, so the range is written back and waited for first
+void WriteBehind::drop(uint64_t offset, uint64_t length) {
+#if defined(_WIN32)
+    (void)offset;
+    (void)length;
+#else
+    {
+        TraceScope trace("write_behind.wait");
+        ScopedOpTimer timer(StatOp::Fsync);
+#if defined(__linux__)
+        ::sync_file_range(m_fd, static_cast<off64_t>(offset), static_cast<off64_t>(length),
+                          SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+#else
+        ::fdatasync(m_fd);
+#endif
+    }
+#if defined(POSIX_FADV_DONTNEED)
+    ::posix_fadvise(m_fd, static_cast<off_t>(offset), static_cast<off_t>(length), POSIX_FADV_DONTNEED);
+    if (m_source_fd >= 0) {
+        ::posix_fadvise(m_source_fd, static_cast<off_t>(offset), static_cast<off_t>(length), POSIX_FADV_DONTNEED);
+    }
+#endif
+#endif
+}
+
+} // namespace allin1::common
@@ -0,0 +1,354 @@
+#include "common/perf_counters.hpp"
+#include "common/output.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace allin1::common {
+
+namespace detail {
+std::atomic<bool> perf_counters_enabled_flag{false};
+}
+
+namespace {
+
+constexpr size_t phase_count = static_cast<size_t>(PerfPhase::Count);
+
+struct PhaseTotals {
+    std::atomic<uint64_t> calls{0};
+    std::array<std::atomic<uint64_t>, perf_event_count> values{};
+};
+
+// Written only by the owning thread, merged by collect_perf_counters(). When
+// the thread exits its totals go back to the registry and the next new thread
+// adds on to them, so a long-running server that keeps starting pools holds no
+// more of them than it ever had threads running at once.
+struct ThreadTotals {
+    std::array<PhaseTotals, phase_count> phases;
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<ThreadTotals>> threads;
+    std::vector<std::shared_ptr<ThreadTotals>> idle; // Totals of exited threads, ready for reuse
+    bool available[perf_event_count] = {};
+    std::string unavailable_reason;
+};
+
+Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+// A thread's hold on its totals, given back when the thread exits
+struct TotalsLease {
+    std::shared_ptr<ThreadTotals> totals;
+
+    TotalsLease() {
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        if (!registry().idle.empty()) {
+            totals = std::move(registry().idle.back());
+            registry().idle.pop_back();
+            return;
+        }
+        totals = std::make_shared<ThreadTotals>();
+        registry().threads.push_back(totals);
+    }
+
+    ~TotalsLease() {
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        registry().idle.push_back(std::move(totals));
+    }
+
+    TotalsLease(const TotalsLease&) = delete;
+    TotalsLease& operator=(const TotalsLease&) = delete;
+};
+
+ThreadTotals& thread_totals() {
+    thread_local TotalsLease lease;
+    return *lease.totals;
+}
+
+inline void bump(std::atomic<uint64_t>& slot, uint64_t n) {
+    slot.store(slot.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+#if defined(__linux__)
+struct EventConfig {
+    uint32_t type;
+    uint64_t config;
+};
+
+constexpr EventConfig event_configs[perf_event_count] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+};
+
+int open_event(const EventConfig& event, int group_fd, bool exclude_kernel) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = event.type;
+    attr.config = event.config;
+    attr.disabled = group_fd < 0 ? 1 : 0; // The leader starts the whole group
+    attr.exclude_kernel = exclude_kernel ? 1 : 0;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, PERF_FLAG_FD_CLOEXEC));
+}
+
+// One counter group per thread, closed when the thread exits. Members are read
+// together with a single read() on the leader; slot maps each event to its
+// position in the group (or -1).
+class ThreadGroup {
+public:
+    ThreadGroup() {
+        m_slot.fill(-1);
+        std::array<int, perf_event_count> errors{};
+        // Kernel-side counting (needed for context switches) is tried first and
+        // dropped when perf_event_paranoid only allows user-space measurement.
+        for (bool exclude_kernel : {false, true}) {
+            for (size_t i = 0; i < perf_event_count; ++i) {
+                if (m_slot[i] >= 0) continue;
+                int fd = open_event(event_configs[i], m_leader, exclude_kernel);
+                if (fd < 0) {
+                    errors[i] = errno;
+                    continue;
+                }
+                if (m_leader < 0) m_leader = fd;
+                m_fds.push_back(fd);
+                m_slot[i] = m_members++;
+            }
+            if (m_leader >= 0) break;
+        }
+
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        for (size_t i = 0; i < perf_event_count; ++i) {
+            if (m_slot[i] >= 0) {
+                registry().available[i] = true;
+            } else if (registry().unavailable_reason.empty()) {
+                registry().unavailable_reason = std::string(perf_event_name(static_cast<PerfEvent>(i))) + ": " + std::strerror(errors[i]);
+            }
+        }
+        if (m_leader >= 0) {
+            ::ioctl(m_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ::ioctl(m_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+    }
+
+    ~ThreadGroup() {
+        for (int fd : m_fds) {
+            ::close(fd);
+        }
+    }
+
+    bool read(uint64_t (&values)[perf_event_count]) {
+        if (m_leader < 0) {
+            return false;
+        }
+        uint64_t buffer[3 + perf_event_count];
+        ssize_t expected = static_cast<ssize_t>((3 + m_members) * sizeof(uint64_t));
+        if (::read(m_leader, buffer, sizeof(buffer)) < expected) {
+            return false;
+        }
+        uint64_t time_enabled = buffer[1];
+        uint64_t time_running = buffer[2];
+        for (size_t i = 0; i < perf_event_count; ++i) {
+            if (m_slot[i] < 0) {
+                values[i] = 0;
+                continue;
+            }
+            uint64_t value = buffer[3 + m_slot[i]];
+            // Scale up if the group was multiplexed off the PMU part of the time
+            if (time_running > 0 && time_running < time_enabled) {
+                value = static_cast<uint64_t>(static_cast<double>(value) * time_enabled / time_running);
+            }
+            values[i] = value;
+        }
+        return true;
+    }
+
+private:
+    int m_leader = -1;
+    int m_members = 0;
+    std::vector<int> m_fds;
+    std::array<int, perf_event_count> m_slot;
+};
+#endif
+
+} // namespace
+
+namespace detail {
+
+bool read_perf_counters(uint64_t (&values)[perf_event_count]) {
+#if defined(__linux__)
+    thread_local ThreadGroup group;
+    return group.read(values);
+#else
+    (void)values;
+    return false;
+#endif
+}
+
+void add_perf_sample(PerfPhase phase, const uint64_t (&start)[perf_event_count], const uint64_t (&end)[perf_event_count]) {
+    PhaseTotals& totals = thread_totals().phases[static_cast<size_t>(phase)];
+    bump(totals.calls, 1);
+    for (size_t i = 0; i < perf_event_count; ++i) {
+        if (end[i] > start[i]) {
+            bump(totals.values[i], end[i] - start[i]);
+        }
+    }
+}
+
+} // namespace detail
+
+const char* perf_phase_name(PerfPhase phase) {
+    switch (phase) {
+        case PerfPhase::Create: return "create";
+        case PerfPhase::Fill: return "fill";
+        case PerfPhase::Permissions: return "permissions";
+        case PerfPhase::Symlink: return "symlink";
+        case PerfPhase::Shortcut: return "shortcut";
+        case PerfPhase::Copy: return "copy";
+        case PerfPhase::Checksum: return "checksum";
+        case PerfPhase::DiskUsage: return "disk_usage";
+        case PerfPhase::Dedupe: return "dedupe";
+        case PerfPhase::Sync: return "sync";
+        case PerfPhase::Remove: return "remove";
+        case PerfPhase::Count: break;
+    }
+    return "unknown";
+}
+
+const char* perf_event_name(PerfEvent event) {
+    switch (event) {
+        case PerfEvent::Cycles: return "cycles";
+        case PerfEvent::Instructions: return "instructions";
+        case PerfEvent::CacheMisses: return "cache_misses";
+        case PerfEvent::ContextSwitches: return "context_switches";
+        case PerfEvent::TaskClock: return "task_clock_ns";
+        case PerfEvent::Count: break;
+    }
+    return "unknown";
+}
+
+void enable_perf_counters() {
+    detail::perf_counters_enabled_flag.store(true, std::memory_order_relaxed);
+}
+
+size_t perf_counter_fds_per_thread() {
+#if defined(__linux__)
+    return perf_counters_enabled() ? perf_event_count : 0;
+#else
+    return 0;
+#endif
+}
+
+PerfCountersSummary collect_perf_counters() {
+    PerfCountersSummary summary;
+    std::array<PerfPhaseSummary, phase_count> phases{};
+
+    {
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        std::copy(std::begin(registry().available), std::end(registry().available), std::begin(summary.available));
+        summary.unavailable_reason = registry().unavailable_reason;
+        for (const auto& thread : registry().threads) {
+            for (size_t p = 0; p < phase_count; ++p) {
+                phases[p].calls += thread->phases[p].calls.load(std::memory_order_relaxed);
+                for (size_t i = 0; i < perf_event_count; ++i) {
+                    phases[p].values[i] += thread->phases[p].values[i].load(std::memory_order_relaxed);
+                }
+            }
+        }
+    }
+
+#if !defined(__linux__)
+    summary.unavailable_reason = "not supported on this platform";
+#endif
+    for (size_t p = 0; p < phase_count; ++p) {
+        if (phases[p].calls == 0) {
+            continue;
+        }
+        phases[p].phase = static_cast<PerfPhase>(p);
+        summary.phases.push_back(phases[p]);
+    }
+    return summary;
+}
+
+void report_perf_counters(const PerfCountersSummary& summary) {
+    bool any_available = std::find(std::begin(summary.available), std::end(summary.available), true) != std::end(summary.available);
+
+    if (output_format() != OutputFormat::Text) {
+        OutputRecord record("perf_counters");
+        if (!summary.unavailable_reason.empty()) {
+            record.add("unavailable_reason", summary.unavailable_reason);
+        }
+        for (const auto& phase : summary.phases) {
+            std::string prefix = std::string(perf_phase_name(phase.phase)) + "_";
+            record.add(prefix + "calls", phase.calls);
+            for (size_t i = 0; i < perf_event_count; ++i) {
+                if (summary.available[i]) {
+                    record.add(prefix + perf_event_name(static_cast<PerfEvent>(i)), phase.values[i]);
+                }
+            }
+        }
+        emit(record);
+        return;
+    }
+
+    std::ostream& os = out();
+    os << "Performance counters:\n";
+    if (!any_available) {
+        os << "  Unavailable";
+        if (!summary.unavailable_reason.empty()) {
+            os << ": " << summary.unavailable_reason << " (see /proc/sys/kernel/perf_event_paranoid)";
+        }
+        os << '\n';
+        return;
+    }
+    if (!summary.unavailable_reason.empty()) {
+        os << "  Some counters unavailable: " << summary.unavailable_reason << '\n';
+    }
+
+    os << "    " << std::left << std::setw(12) << "phase" << std::right << std::setw(8) << "calls";
+    for (size_t i = 0; i < perf_event_count; ++i) {
+        os << std::setw(18) << perf_event_name(static_cast<PerfEvent>(i));
+    }
+    os << std::setw(8) << "ipc" << '\n';
+    for (const auto& phase : summary.phases) {
+        os << "    " << std::left << std::setw(12) << perf_phase_name(phase.phase) << std::right << std::setw(8) << phase.calls;
+        for (size_t i = 0; i < perf_event_count; ++i) {
+            if (summary.available[i]) {
+                os << std::setw(18) << phase.values[i];
+            } else {
+                os << std::setw(18) << "n/a";
+            }
+        }
+        uint64_t cycles = phase.values[static_cast<size_t>(PerfEvent::Cycles)];
+        uint64_t instructions = phase.values[static_cast<size_t>(PerfEvent::Instructions)];
+        if (summary.available[static_cast<size_t>(PerfEvent::Cycles)] && summary.available[static_cast<size_t>(PerfEvent::Instructions)] && cycles > 0) {
+            os << std::setw(8) << std::fixed << std::setprecision(2) << static_cast<double>(instructions) / static_cast<double>(cycles);
+            os.unsetf(std::ios::floatfield);
+        } else {
+            os << std::setw(8) << "n/a";
+        }
+        os << '\n';
+    }
+}
+
+} // namespace allin1::common
@@ -1,6 +1,10 @@
 #include "common/permission_utils.hpp"
 #include "common/error_utils.hpp"
 #include "common/errors.hpp"
+#include "common/perf_counters.hpp"
+#include "common/rate_limit.hpp"
+#include "common/stats.hpp"
+#include "common/trace.hpp"
 
 #ifdef _WIN32
 #include <windows.h>
@@ -21,6 +25,10 @@
 #include <algorithm>
 #include <memory>
 #include <filesystem>
+#include <chrono>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 namespace allin1::common {
 
@@ -63,7 +71,7 @@ Permissions parse_permission_string(const std::string& perm_string) {
 }
 
 #ifdef _WIN32
-void set_single_win_permission(const std::string& path, const std::string& user, const Permissions& perms, bool output_enabled) {
+void set_single_win_permission(const std::string& path, const std::string& user, const Permissions& perms) {
     DWORD access_mask = 0;
     if (perms.read) access_mask |= FILE_GENERIC_READ;
     if (perms.write) access_mask |= FILE_GENERIC_WRITE;
@@ -105,39 +113,84 @@ void set_single_win_permission(const std::string& path, const std::string& user,
         throw PermissionError("SetNamedSecurityInfo failed: " + get_system_error_message(GetLastError()));
     }
 
-    if (output_enabled) std::cout << "Set permissions for " << user << " on " << path << std::endl;
     if(p_new_dacl) LocalFree(p_new_dacl);
     if(p_sd) LocalFree(p_sd);
 }
 #else
-void set_single_linux_permission(const std::string& path, const std::string& user, const Permissions& perms, bool output_enabled) {
+struct ResolvedUser {
+    uid_t uid;
+    gid_t gid;
+    std::chrono::steady_clock::time_point resolved_at;
+};
+
+// Resolves a user name or numeric uid to its uid and primary gid.
+// Results are cached for a short time so recursive runs and the daemon do not
+// hit /etc/passwd (or NSS) once per entry.
+ResolvedUser resolve_user(const std::string& user) {
+    static std::mutex cache_mutex;
+    static std::unordered_map<std::string, ResolvedUser> cache;
+    constexpr auto cache_ttl = std::chrono::seconds(30);
+
+    auto now = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        auto it = cache.find(user);
+        if (it != cache.end() && now - it->second.resolved_at < cache_ttl) {
+            return it->second;
+        }
+    }
+
+    TraceScope trace("permission.resolve_user", user);
+
+    // Reentrant lookups so batch commands can run on several threads at once
+    struct passwd pw_entry;
     struct passwd *pw = nullptr;
+    std::vector<char> pw_buffer(16384);
     bool is_numeric = !user.empty() && std::all_of(user.begin(), user.end(), ::isdigit);
 
     if (is_numeric) {
         try {
             uid_t uid = static_cast<uid_t>(std::stoul(user));
-            pw = getpwuid(uid);
+            getpwuid_r(uid, &pw_entry, pw_buffer.data(), pw_buffer.size(), &pw);
         } catch (const std::exception&) {
             pw = nullptr; // Treat conversion errors as 'user not found'
         }
     } else {
-        pw = getpwnam(user.c_str());
+        getpwnam_r(user.c_str(), &pw_entry, pw_buffer.data(), pw_buffer.size(), &pw);
     }
 
     if (!pw) {
         throw PermissionError("User '" + user + "' not found.");
     }
 
-    uid_t uid = pw->pw_uid;
-    gid_t gid = pw->pw_gid;
+    ResolvedUser resolved{pw->pw_uid, pw->pw_gid, now};
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    cache[user] = resolved;
+    return resolved;
+}
+
+void set_single_linux_permission(const std::string& path, const std::string& user, const Permissions& perms) {
+    ResolvedUser resolved = resolve_user(user);
+    uid_t uid = resolved.uid;
+    gid_t gid = resolved.gid;
 
-    if (chown(path.c_str(), uid, gid) != 0) {
+    int result;
+    {
+        ScopedOpTimer timer(StatOp::Chown);
+        result = chown(path.c_str(), uid, gid);
+    }
+    if (result != 0) {
+        record_error(errno);
         throw PermissionError("chown failed on '" + path + "': " + std::string(strerror(errno)));
     }
 
     struct stat st;
-    if (stat(path.c_str(), &st) != 0) {
+    {
+        ScopedOpTimer timer(StatOp::Stat);
+        result = stat(path.c_str(), &st);
+    }
+    if (result != 0) {
+        record_error(errno);
         throw PermissionError("stat failed on '" + path + "': " + std::string(strerror(errno)));
     }
 
@@ -147,50 +200,87 @@ void set_single_linux_permission(const std::string& path, const std::string& use
     if (perms.write) new_mode |= S_IWUSR;
     if (perms.execute) new_mode |= S_IXUSR;
 
-    if (chmod(path.c_str(), new_mode) != 0) {
+    {
+        ScopedOpTimer timer(StatOp::Chmod);
+        result = chmod(path.c_str(), new_mode);
+    }
+    if (result != 0) {
+        record_error(errno);
         throw PermissionError("chmod failed on '" + path + "': " + std::string(strerror(errno)));
     }
-    if (output_enabled) std::cout << "Set permissions for " << user << " on " << path << std::endl;
 }
 #endif
 
-void set_permissions(const std::string& path, const std::string& user, const Permissions& perms, bool recursive, bool output_enabled) {
-    std::filesystem::path fs_path(path);
-    if (!std::filesystem::exists(fs_path)) {
-        throw PermissionError("Path does not exist: " + path);
-    }
-
-    if (recursive && std::filesystem::is_directory(fs_path)) {
-        // Apply to the directory itself first
-        try {
+void set_single_permission(const std::string& path, const std::string& user, const Permissions& perms) {
 #ifdef _WIN32
-            set_single_win_permission(fs_path.string(), user, perms, output_enabled);
+    set_single_win_permission(path, user, perms);
 #else
-            set_single_linux_permission(fs_path.string(), user, perms, output_enabled);
+    set_single_linux_permission(path, user, perms);
 #endif
-        } catch (const PermissionError& e) {
-            std::cerr << "Error setting permission on directory " << fs_path.string() << ": " << e.what() << std::endl;
-        }
+}
 
+void set_permissions(const std::string& path, const std::string& user, const Permissions& perms, bool recursive, const PermissionEntryCallback& on_entry) {
+    TraceScope trace("permission.set", path);
+    ScopedPerfCounters counters(PerfPhase::Permissions);
+    std::filesystem::path fs_path(path);
+    std::error_code ec;
+    std::filesystem::file_status status = std::filesystem::status(fs_path, ec);
+    if (!std::filesystem::exists(status)) {
+        if (ec && ec != std::errc::no_such_file_or_directory) {
+            throw PermissionError("Cannot access '" + path + "': " + ec.message());
+        }
+        throw PermissionError("Path does not exist: " + path);
+    }
 
-        for (const auto& entry : std::filesystem::recursive_directory_iterator(fs_path)) {
+    if (recursive && std::filesystem::is_directory(status)) {
+        // Apply to the directory itself first, then report errors per entry and continue
+        auto apply = [&](const std::string& entry_path) {
+            TraceScope entry_trace("permission.entry", entry_path);
+            count(StatCounter::EntriesVisited);
+            throttle_ops();
             try {
-#ifdef _WIN32
-                set_single_win_permission(entry.path().string(), user, perms, output_enabled);
-#else
-                set_single_linux_permission(entry.path().string(), user, perms, output_enabled);
-#endif
+                set_single_permission(entry_path, user, perms);
+                if (on_entry) on_entry(entry_path, nullptr);
             } catch (const PermissionError& e) {
-                // Report error and continue to the next file
-                std::cerr << "Error setting permission on " << entry.path().string() << ": " << e.what() << std::endl;
+                if (on_entry) on_entry(entry_path, &e);
+            }
+        };
+
+        // A directory that cannot be listed is reported like any other failed
+        // entry; its siblings are still visited. Symlinks are not followed.
+        auto report_listing_error = [&](const std::filesystem::path& directory, const std::error_code& error) {
+            PermissionError failure("Cannot list '" + directory.string() + "': " + error.message());
+            record_error(error.value());
+            if (on_entry) on_entry(directory.string(), &failure);
+        };
+
+        apply(fs_path.string());
+        TraceScope traverse_trace("permission.traverse", path);
+        std::vector<std::filesystem::path> pending{fs_path};
+        while (!pending.empty()) {
+            std::filesystem::path directory = std::move(pending.back());
+            pending.pop_back();
+            std::filesystem::directory_iterator it(directory, ec);
+            if (ec) {
+                report_listing_error(directory, ec);
+                continue;
+            }
+            for (; it != std::filesystem::directory_iterator(); it.increment(ec)) {
+                apply(it->path().string());
+                std::error_code type_ec;
+                if (it->is_directory(type_ec) && !it->is_symlink(type_ec)) {
+                    pending.push_back(it->path());
+                }
+            }
+            if (ec) {
+                report_listing_error(directory, ec);
             }
         }
     } else {
-#ifdef _WIN32
-        set_single_win_permission(path, user, perms, output_enabled);
-#else
-        set_single_linux_permission(path, user, perms, output_enabled);
-#endif
+        count(StatCounter::EntriesVisited);
+        throttle_ops();
+        set_single_permission(path, user, perms);
+        if (on_entry) on_entry(path, nullptr);
     }
 }
 
@@ -3,14 +3,18 @@
 #include <fstream>
 #include <sstream>
 #include <algorithm>
+#include <cstdint>
 #include <vector>
 #include <stdexcept>
 
 #if defined(_WIN32)
 #include <windows.h>
 #include <winreg.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
 #elif defined(__linux__) || defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__) || defined(__sun)
 #include <sys/utsname.h>
+#include <sys/resource.h>
 #include <unistd.h>
 #include <limits.h>
 #endif
@@ -394,4 +398,76 @@ long long get_available_memory_bytes() {
 #endif
 }
 
+long long get_peak_rss_bytes() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return static_cast<long long>(counters.PeakWorkingSetSize);
+    }
+    return 0;
+#elif defined(__linux__)
+    std::ifstream status("/proc/self/status");
+    if (status.is_open()) {
+        std::string line;
+        while (std::getline(status, line)) {
+            if (line.rfind("VmHWM:", 0) == 0) {
+                std::stringstream ss(line);
+                std::string key;
+                long long value;
+                std::string unit;
+                ss >> key >> value >> unit;
+                if (unit == "kB") return value * 1024;
+            }
+        }
+    }
+    return 0;
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__) || defined(__sun)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#if defined(__APPLE__)
+        return static_cast<long long>(usage.ru_maxrss); // Already in bytes
+#else
+        return static_cast<long long>(usage.ru_maxrss) * 1024;
+#endif
+    }
+    return 0;
+#else
+    return 0;
+#endif
+}
+
+void get_process_cpu_seconds(double& user_seconds, double& system_seconds) {
+    user_seconds = 0;
+    system_seconds = 0;
+#if defined(_WIN32)
+    FILETIME creation_time, exit_time, kernel_time, user_time;
+    if (GetProcessTimes(GetCurrentProcess(), &creation_time, &exit_time, &kernel_time, &user_time)) {
+        auto to_seconds = [](const FILETIME& ft) {
+            ULARGE_INTEGER value;
+            value.LowPart = ft.dwLowDateTime;
+            value.HighPart = ft.dwHighDateTime;
+            return static_cast<double>(value.QuadPart) / 1e7; // 100 ns units
+        };
+        user_seconds = to_seconds(user_time);
+        system_seconds = to_seconds(kernel_time);
+    }
+#elif defined(__linux__) || defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__) || defined(__sun)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        user_seconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+        system_seconds = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    }
+#endif
+}
+
+size_t get_open_file_limit() {
+#if defined(__linux__) || defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__) || defined(__sun)
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY) {
+        return static_cast<size_t>(limit.rlim_cur);
+    }
+#endif
+    return SIZE_MAX;
+}
+
 } // namespace allin1::common
@@ -0,0 +1,88 @@
+#include "common/rate_limit.hpp"
+#include "common/trace.hpp"
+
+#include <algorithm>
+#include <thread>
+
+namespace allin1::common {
+
+namespace detail {
+std::atomic<bool> rate_limits_enabled_flag{false};
+}
+
+namespace {
+
+// Reservations less than this far ahead run immediately, so sleeps are long
+// enough for the scheduler to honour them accurately
+constexpr std::chrono::microseconds sleep_slack{2000};
+
+// Transfers are sized to take this long at the configured bandwidth
+constexpr uint64_t paced_chunks_per_second = 100;
+
+TokenBucket& byte_bucket() {
+    static TokenBucket bucket;
+    return bucket;
+}
+
+TokenBucket& op_bucket() {
+    static TokenBucket bucket;
+    return bucket;
+}
+
+} // namespace
+
+void TokenBucket::set_rate(uint64_t tokens_per_second) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_rate.store(tokens_per_second, std::memory_order_relaxed);
+    m_next = std::chrono::steady_clock::time_point{};
+}
+
+void TokenBucket::acquire(uint64_t tokens) {
+    uint64_t rate = m_rate.load(std::memory_order_relaxed);
+    if (rate == 0 || tokens == 0) {
+        return;
+    }
+    auto cost = std::chrono::nanoseconds(static_cast<int64_t>(static_cast<double>(tokens) * 1e9 / static_cast<double>(rate)));
+    auto now = std::chrono::steady_clock::now();
+
+    std::chrono::steady_clock::time_point start;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        start = std::max(m_next, now);
+        m_next = start + cost;
+    }
+    if (start - now > sleep_slack) {
+        TraceScope trace("rate_limit.wait");
+        std::this_thread::sleep_until(start);
+    }
+}
+
+namespace detail {
+
+void throttle(uint64_t bytes, uint64_t ops) {
+    if (ops != 0) {
+        op_bucket().acquire(ops);
+    }
+    if (bytes != 0) {
+        byte_bucket().acquire(bytes);
+    }
+}
+
+} // namespace detail
+
+void set_rate_limits(uint64_t max_bytes_per_second, uint64_t max_ops_per_second) {
+    byte_bucket().set_rate(max_bytes_per_second);
+    op_bucket().set_rate(max_ops_per_second);
+    detail::rate_limits_enabled_flag.store(max_bytes_per_second != 0 || max_ops_per_second != 0, std::memory_order_relaxed);
+}
+
+size_t paced_chunk_bytes(size_t preferred, size_t alignment) {
+    uint64_t rate = byte_bucket().rate();
+    if (rate == 0 || alignment == 0) {
+        return preferred;
+    }
+    uint64_t chunk = rate / paced_chunks_per_second / alignment * alignment;
+    return static_cast<size_t>(std::clamp<uint64_t>(chunk, alignment, std::max<uint64_t>(preferred, alignment)));
+}
+
+} // namespace allin1::common
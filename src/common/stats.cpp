@@ -0,0 +1,404 @@
+#include "common/stats.hpp"
+#include "common/error_utils.hpp"
+#include "common/output.hpp"
+#include "common/platform.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace allin1::common {
+
+namespace detail {
+std::atomic<bool> stats_enabled_flag{false};
+}
+
+namespace {
+
+constexpr size_t op_count = static_cast<size_t>(StatOp::Count);
+constexpr size_t counter_count = static_cast<size_t>(StatCounter::Count);
+
+// Log-linear histogram: values below 8 get exact buckets, larger values get 8
+// sub-buckets per power of two, i.e. at most 12.5% relative error.
+constexpr int sub_bucket_bits = 3;
+constexpr size_t sub_bucket_count = size_t{1} << sub_bucket_bits;
+constexpr size_t bucket_count = (64 - sub_bucket_bits + 1) * sub_bucket_count;
+constexpr size_t max_tracked_error = 256;
+
+size_t bucket_index(uint64_t value) {
+    if (value < sub_bucket_count) {
+        return static_cast<size_t>(value);
+    }
+    int msb = 63 - std::countl_zero(value);
+    int shift = msb - sub_bucket_bits;
+    size_t sub = static_cast<size_t>((value >> shift) & (sub_bucket_count - 1));
+    return static_cast<size_t>(shift + 1) * sub_bucket_count + sub;
+}
+
+uint64_t bucket_upper_bound(size_t index) {
+    if (index < sub_bucket_count) {
+        return index;
+    }
+    int shift = static_cast<int>(index / sub_bucket_count) - 1;
+    uint64_t lower = (sub_bucket_count + index % sub_bucket_count) << shift;
+    return lower + ((uint64_t{1} << shift) - 1);
+}
+
+// Every slot has a single writer (its thread), so a relaxed load and store is
+// enough and avoids a locked read-modify-write on the hot path.
+inline void bump(std::atomic<uint64_t>& slot, uint64_t n) {
+    slot.store(slot.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+struct OpHistogram {
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> total_ns{0};
+    std::atomic<uint64_t> max_ns{0};
+    std::array<std::atomic<uint64_t>, bucket_count> buckets{};
+};
+
+struct ThreadStats {
+    std::array<std::atomic<uint64_t>, counter_count> counters{};
+    std::array<OpHistogram, op_count> ops;
+    std::array<std::atomic<uint64_t>, max_tracked_error> errors{};
+    std::atomic<uint64_t> other_errors{0};
+};
+
+// A thread's slot goes back to the registry when the thread exits, counts
+// included, and the next new thread adds on to them. Totals therefore never
+// lose anything, while a long-running server that keeps starting pools holds
+// no more slots than it ever had threads running at once.
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<ThreadStats>> threads;
+    std::vector<std::shared_ptr<ThreadStats>> idle; // Slots of exited threads, ready for reuse
+    std::chrono::steady_clock::time_point started_at;
+    bool whole_run = false;  // Set by enable_stats(); never turned off again
+    size_t scoped_users = 0; // Live ScopedStats
+};
+
+// Raw, merged per-thread values; summaries and marks are both built from these
+struct OpTotals {
+    uint64_t count = 0;
+    uint64_t total_ns = 0;
+    uint64_t max_ns = 0;
+    std::array<uint64_t, bucket_count> buckets{};
+};
+
+} // namespace
+
+namespace detail {
+
+struct StatsTotals {
+    std::array<uint64_t, counter_count> counters{};
+    std::array<OpTotals, op_count> ops{};
+    std::map<int, uint64_t> errors;
+};
+
+} // namespace detail
+
+namespace {
+
+Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+// A thread's hold on a slot, given back when the thread exits
+struct SlotLease {
+    std::shared_ptr<ThreadStats> stats;
+
+    SlotLease() {
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        if (!registry().idle.empty()) {
+            stats = std::move(registry().idle.back());
+            registry().idle.pop_back();
+            return;
+        }
+        stats = std::make_shared<ThreadStats>();
+        registry().threads.push_back(stats);
+    }
+
+    ~SlotLease() {
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        registry().idle.push_back(std::move(stats));
+    }
+
+    SlotLease(const SlotLease&) = delete;
+    SlotLease& operator=(const SlotLease&) = delete;
+};
+
+ThreadStats& thread_stats() {
+    thread_local SlotLease lease;
+    return *lease.stats;
+}
+
+} // namespace
+
+namespace detail {
+
+void record_op_latency(StatOp op, uint64_t nanoseconds) {
+    OpHistogram& histogram = thread_stats().ops[static_cast<size_t>(op)];
+    bump(histogram.count, 1);
+    bump(histogram.total_ns, nanoseconds);
+    if (nanoseconds > histogram.max_ns.load(std::memory_order_relaxed)) {
+        histogram.max_ns.store(nanoseconds, std::memory_order_relaxed);
+    }
+    bump(histogram.buckets[bucket_index(nanoseconds)], 1);
+}
+
+} // namespace detail
+
+const char* stat_op_name(StatOp op) {
+    switch (op) {
+        case StatOp::Open: return "open";
+        case StatOp::Read: return "read";
+        case StatOp::Write: return "write";
+        case StatOp::Stat: return "stat";
+        case StatOp::Chown: return "chown";
+        case StatOp::Chmod: return "chmod";
+        case StatOp::Mkdir: return "mkdir";
+        case StatOp::Symlink: return "symlink";
+        case StatOp::Unlink: return "unlink";
+        case StatOp::Rename: return "rename";
+        case StatOp::Fsync: return "fsync";
+        case StatOp::Count: break;
+    }
+    return "unknown";
+}
+
+const char* stat_counter_name(StatCounter counter) {
+    switch (counter) {
+        case StatCounter::EntriesVisited: return "entries_visited";
+        case StatCounter::BytesRead: return "bytes_read";
+        case StatCounter::BytesWritten: return "bytes_written";
+        case StatCounter::Count: break;
+    }
+    return "unknown";
+}
+
+void enable_stats() {
+    std::lock_guard<std::mutex> lock(registry().mutex);
+    if (registry().whole_run) {
+        return;
+    }
+    registry().whole_run = true;
+    registry().started_at = std::chrono::steady_clock::now();
+    detail::stats_enabled_flag.store(true, std::memory_order_relaxed);
+}
+
+ScopedStats::ScopedStats() {
+    std::lock_guard<std::mutex> lock(registry().mutex);
+    ++registry().scoped_users;
+    detail::stats_enabled_flag.store(true, std::memory_order_relaxed);
+}
+
+ScopedStats::~ScopedStats() {
+    std::lock_guard<std::mutex> lock(registry().mutex);
+    if (--registry().scoped_users == 0 && !registry().whole_run) {
+        detail::stats_enabled_flag.store(false, std::memory_order_relaxed);
+    }
+}
+
+void count(StatCounter counter, uint64_t n) {
+    if (!stats_enabled()) {
+        return;
+    }
+    bump(thread_stats().counters[static_cast<size_t>(counter)], n);
+}
+
+void record_error(int error_code) {
+    if (!stats_enabled()) {
+        return;
+    }
+    ThreadStats& stats = thread_stats();
+    if (error_code >= 0 && static_cast<size_t>(error_code) < max_tracked_error) {
+        bump(stats.errors[static_cast<size_t>(error_code)], 1);
+    } else {
+        bump(stats.other_errors, 1);
+    }
+}
+
+namespace {
+
+std::unique_ptr<detail::StatsTotals> gather_totals() {
+    auto totals = std::make_unique<detail::StatsTotals>();
+    std::lock_guard<std::mutex> lock(registry().mutex);
+    for (const auto& thread : registry().threads) {
+        for (size_t i = 0; i < counter_count; ++i) {
+            totals->counters[i] += thread->counters[i].load(std::memory_order_relaxed);
+        }
+        for (size_t op = 0; op < op_count; ++op) {
+            const OpHistogram& histogram = thread->ops[op];
+            OpTotals& op_totals = totals->ops[op];
+            op_totals.count += histogram.count.load(std::memory_order_relaxed);
+            op_totals.total_ns += histogram.total_ns.load(std::memory_order_relaxed);
+            op_totals.max_ns = std::max(op_totals.max_ns, histogram.max_ns.load(std::memory_order_relaxed));
+            for (size_t b = 0; b < bucket_count; ++b) {
+                op_totals.buckets[b] += histogram.buckets[b].load(std::memory_order_relaxed);
+            }
+        }
+        for (size_t code = 0; code < max_tracked_error; ++code) {
+            uint64_t n = thread->errors[code].load(std::memory_order_relaxed);
+            if (n) totals->errors[static_cast<int>(code)] += n;
+        }
+        uint64_t other = thread->other_errors.load(std::memory_order_relaxed);
+        if (other) totals->errors[-1] += other;
+    }
+    return totals;
+}
+
+// Builds a summary of totals, minus baseline when there is one.
+StatsSummary summarize(detail::StatsTotals& totals, const detail::StatsTotals* baseline) {
+    StatsSummary summary;
+    if (baseline) {
+        for (size_t i = 0; i < counter_count; ++i) {
+            totals.counters[i] -= baseline->counters[i];
+        }
+        for (size_t op = 0; op < op_count; ++op) {
+            OpTotals& op_totals = totals.ops[op];
+            op_totals.count -= baseline->ops[op].count;
+            op_totals.total_ns -= baseline->ops[op].total_ns;
+            // The maximum is not kept per interval; bound it by the highest bucket that grew
+            uint64_t max_bound = 0;
+            for (size_t b = 0; b < bucket_count; ++b) {
+                op_totals.buckets[b] -= baseline->ops[op].buckets[b];
+                if (op_totals.buckets[b]) max_bound = bucket_upper_bound(b);
+            }
+            op_totals.max_ns = std::min(op_totals.max_ns, max_bound);
+        }
+        for (const auto& error : baseline->errors) {
+            auto it = totals.errors.find(error.first);
+            it->second -= error.second;
+            if (it->second == 0) totals.errors.erase(it);
+        }
+    }
+
+    std::copy(totals.counters.begin(), totals.counters.end(), summary.counters);
+    for (size_t op = 0; op < op_count; ++op) {
+        const OpTotals& op_totals = totals.ops[op];
+        if (op_totals.count == 0) {
+            continue;
+        }
+        OpSummary op_summary;
+        op_summary.op = static_cast<StatOp>(op);
+        op_summary.count = op_totals.count;
+        op_summary.total_ns = op_totals.total_ns;
+        op_summary.max_ns = op_totals.max_ns;
+        auto percentile = [&](double fraction) {
+            uint64_t rank = static_cast<uint64_t>(fraction * static_cast<double>(op_summary.count - 1)) + 1;
+            uint64_t seen = 0;
+            for (size_t b = 0; b < bucket_count; ++b) {
+                seen += op_totals.buckets[b];
+                if (seen >= rank) {
+                    return std::min(bucket_upper_bound(b), op_summary.max_ns);
+                }
+            }
+            return op_summary.max_ns;
+        };
+        op_summary.p50_ns = percentile(0.50);
+        op_summary.p90_ns = percentile(0.90);
+        op_summary.p99_ns = percentile(0.99);
+        summary.ops.push_back(op_summary);
+    }
+
+    summary.errors.assign(totals.errors.begin(), totals.errors.end());
+    get_process_cpu_seconds(summary.cpu_user_seconds, summary.cpu_system_seconds);
+    summary.peak_rss_bytes = get_peak_rss_bytes();
+    return summary;
+}
+
+} // namespace
+
+StatsMark mark_stats() {
+    StatsMark mark;
+    mark.taken_at = std::chrono::steady_clock::now();
+    mark.totals = gather_totals();
+    return mark;
+}
+
+StatsSummary collect_stats() {
+    std::chrono::steady_clock::time_point started_at;
+    {
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        started_at = registry().started_at;
+    }
+    StatsSummary summary = summarize(*gather_totals(), nullptr);
+    summary.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started_at).count();
+    return summary;
+}
+
+StatsSummary collect_stats(const StatsMark& mark) {
+    StatsSummary summary = summarize(*gather_totals(), mark.totals.get());
+    summary.whole_run = false;
+    summary.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - mark.taken_at).count();
+    return summary;
+}
+
+void report_stats(const StatsSummary& summary) {
+    if (output_format() != OutputFormat::Text) {
+        // For a single command the resource figures still cover the whole process
+        std::string resource_prefix = summary.whole_run ? "" : "process_";
+        OutputRecord record("stats");
+        record.add("wall_s", summary.wall_seconds)
+            .add(resource_prefix + "cpu_user_s", summary.cpu_user_seconds)
+            .add(resource_prefix + "cpu_system_s", summary.cpu_system_seconds)
+            .add(resource_prefix + "peak_rss_bytes", static_cast<int64_t>(summary.peak_rss_bytes));
+        for (size_t i = 0; i < counter_count; ++i) {
+            record.add(stat_counter_name(static_cast<StatCounter>(i)), summary.counters[i]);
+        }
+        for (const auto& op : summary.ops) {
+            std::string prefix = std::string(stat_op_name(op.op)) + "_";
+            record.add(prefix + "count", op.count)
+                .add(prefix + "total_ns", op.total_ns)
+                .add(prefix + "p50_ns", op.p50_ns)
+                .add(prefix + "p90_ns", op.p90_ns)
+                .add(prefix + "p99_ns", op.p99_ns)
+                .add(prefix + "max_ns", op.max_ns);
+        }
+        for (const auto& error : summary.errors) {
+            record.add("errno_" + (error.first < 0 ? std::string("other") : std::to_string(error.first)), error.second);
+        }
+        emit(record);
+        return;
+    }
+
+    std::ostream& os = out();
+    const char* resource_scope = summary.whole_run ? "" : " (whole process)";
+    os << (summary.whole_run ? "Run statistics:\n" : "Command statistics:\n");
+    os << std::fixed << std::setprecision(3);
+    os << "  Wall time: " << summary.wall_seconds << " s\n";
+    os << "  CPU time" << resource_scope << ": " << summary.cpu_user_seconds << " s user, " << summary.cpu_system_seconds << " s system\n";
+    os << "  Peak RSS" << resource_scope << ": " << summary.peak_rss_bytes / 1024 << " KiB\n";
+    os.unsetf(std::ios::floatfield);
+    for (size_t i = 0; i < counter_count; ++i) {
+        os << "  " << stat_counter_name(static_cast<StatCounter>(i)) << ": " << summary.counters[i] << '\n';
+    }
+    if (!summary.ops.empty()) {
+        os << "  Operation latency (ns):\n";
+        os << "    " << std::left << std::setw(10) << "op" << std::right
+           << std::setw(10) << "count" << std::setw(12) << "p50" << std::setw(12) << "p90"
+           << std::setw(12) << "p99" << std::setw(12) << "max" << '\n';
+        for (const auto& op : summary.ops) {
+            os << "    " << std::left << std::setw(10) << stat_op_name(op.op) << std::right
+               << std::setw(10) << op.count << std::setw(12) << op.p50_ns << std::setw(12) << op.p90_ns
+               << std::setw(12) << op.p99_ns << std::setw(12) << op.max_ns << '\n';
+        }
+    }
+    if (!summary.errors.empty()) {
+        os << "  Errors:\n";
+        for (const auto& error : summary.errors) {
+            if (error.first < 0) {
+                os << "    other: " << error.second << '\n';
+            } else {
+                os << "    " << error.first << " (" << get_system_error_message(static_cast<unsigned long>(error.first)) << "): " << error.second << '\n';
+            }
+        }
+    }
+}
+
+} // namespace allin1::common
@@ -78,4 +78,57 @@ unsigned char parse_hex_byte(const std::string& hex_str) {
     throw allin1::common::HexByteParseError("Internal error in parse_hex_byte: should not be reachable.");
 }
 
+// Splits a command line into arguments using POSIX shell quoting rules.
+// Throws a CommandLineParseError on an unterminated quote or trailing backslash.
+std::vector<std::string> split_command_line(const std::string& line) {
+    std::vector<std::string> args;
+    std::string current;
+    bool in_token = false;
+
+    for (size_t i = 0; i < line.size(); ++i) {
+        char c = line[i];
+        if (c == ' ' || c == '\t') {
+            if (in_token) {
+                args.push_back(std::move(current));
+                current.clear();
+                in_token = false;
+            }
+        } else if (c == '\'') {
+            in_token = true;
+            size_t end = line.find('\'', i + 1);
+            if (end == std::string::npos) {
+                throw allin1::common::CommandLineParseError("Unterminated single quote in: " + line);
+            }
+            current.append(line, i + 1, end - i - 1);
+            i = end;
+        } else if (c == '"') {
+            in_token = true;
+            for (++i; i < line.size() && line[i] != '"'; ++i) {
+                // Inside double quotes a backslash only escapes characters the shell treats specially
+                if (line[i] == '\\' && i + 1 < line.size() &&
+                    (line[i + 1] == '"' || line[i + 1] == '\\' || line[i + 1] == '$' || line[i + 1] == '`')) {
+                    ++i;
+                }
+                current += line[i];
+            }
+            if (i >= line.size()) {
+                throw allin1::common::CommandLineParseError("Unterminated double quote in: " + line);
+            }
+        } else if (c == '\\') {
+            if (i + 1 >= line.size()) {
+                throw allin1::common::CommandLineParseError("Trailing backslash in: " + line);
+            }
+            in_token = true;
+            current += line[++i];
+        } else {
+            in_token = true;
+            current += c;
+        }
+    }
+    if (in_token) {
+        args.push_back(std::move(current));
+    }
+    return args;
+}
+
 } // namespace allin1::common
@@ -0,0 +1,71 @@
+#include "common/thread_pool.hpp"
+
+namespace allin1::common {
+
+ThreadPool::ThreadPool(size_t thread_count) {
+    if (thread_count == 0) {
+        thread_count = 1;
+    }
+    m_workers.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+        m_workers.emplace_back([this] { worker_loop(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_task_available.notify_all();
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back(std::move(task));
+    }
+    m_task_available.notify_one();
+}
+
+void ThreadPool::wait_idle() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this] { return m_tasks.empty() && m_active == 0; });
+}
+
+void ThreadPool::worker_loop() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_task_available.wait(lock, [this] { return m_stopping || !m_tasks.empty(); });
+            if (m_tasks.empty()) {
+                return; // Stopping and nothing left to run
+            }
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+            ++m_active;
+        }
+
+        task();
+        task = nullptr; // Release captured state before the task counts as finished
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            --m_active;
+            if (m_tasks.empty() && m_active == 0) {
+                m_idle.notify_all();
+            }
+        }
+    }
+}
+
+size_t default_worker_count() {
+    unsigned int hw = std::thread::hardware_concurrency();
+    return hw == 0 ? 1 : static_cast<size_t>(hw);
+}
+
+} // namespace allin1::common
@@ -0,0 +1,177 @@
+#include "common/trace.hpp"
+#include "common/output.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace allin1::common {
+
+namespace detail {
+std::atomic<bool> trace_enabled_flag{false};
+}
+
+namespace {
+
+constexpr size_t ring_capacity = size_t{1} << 15; // Events kept per thread
+constexpr size_t detail_capacity = 64;
+
+struct TraceEvent {
+    const char* name;
+    const char* category;
+    uint64_t start_ns;
+    uint64_t end_ns;
+    char detail[detail_capacity];
+};
+
+// Single-producer ring: only the owning thread writes, and it publishes each
+// event by advancing head with release semantics. When the thread exits its
+// ring, events included, goes back to the registry and the next new thread
+// records on after them, so a long-running server that keeps starting threads
+// holds no more rings than it ever had threads running at once, and pool
+// workers' events still make it into the file.
+struct ThreadTrace {
+    uint32_t tid = 0;
+    std::atomic<uint64_t> head{0};
+    std::unique_ptr<TraceEvent[]> events{new TraceEvent[ring_capacity]};
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<ThreadTrace>> threads;
+    std::vector<std::shared_ptr<ThreadTrace>> idle; // Rings of exited threads, ready for reuse
+    std::string path;
+    uint64_t started_ns = 0;
+};
+
+Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+// A thread's hold on a ring, given back when the thread exits
+struct RingLease {
+    std::shared_ptr<ThreadTrace> trace;
+
+    RingLease() {
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        if (!registry().idle.empty()) {
+            trace = std::move(registry().idle.back());
+            registry().idle.pop_back();
+            return;
+        }
+        trace = std::make_shared<ThreadTrace>();
+        trace->tid = static_cast<uint32_t>(registry().threads.size() + 1);
+        registry().threads.push_back(trace);
+    }
+
+    ~RingLease() {
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        registry().idle.push_back(std::move(trace));
+    }
+
+    RingLease(const RingLease&) = delete;
+    RingLease& operator=(const RingLease&) = delete;
+};
+
+ThreadTrace& thread_trace() {
+    thread_local RingLease lease;
+    return *lease.trace;
+}
+
+void append_microseconds(std::string& buffer, uint64_t nanoseconds) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%llu.%03llu",
+                  static_cast<unsigned long long>(nanoseconds / 1000),
+                  static_cast<unsigned long long>(nanoseconds % 1000));
+    buffer += text;
+}
+
+} // namespace
+
+namespace detail {
+
+void record_trace_event(const char* name, const char* category, uint64_t start_ns, uint64_t end_ns, std::string_view detail) {
+    ThreadTrace& trace = thread_trace();
+    uint64_t head = trace.head.load(std::memory_order_relaxed);
+    TraceEvent& event = trace.events[head & (ring_capacity - 1)];
+    event.name = name;
+    event.category = category;
+    event.start_ns = start_ns;
+    event.end_ns = end_ns;
+    size_t length = std::min(detail.size(), detail_capacity - 1);
+    std::memcpy(event.detail, detail.data(), length);
+    event.detail[length] = '\0';
+    trace.head.store(head + 1, std::memory_order_release);
+}
+
+} // namespace detail
+
+void enable_trace(const std::string& path) {
+    std::lock_guard<std::mutex> lock(registry().mutex);
+    if (trace_enabled()) {
+        return;
+    }
+    registry().path = path;
+    registry().started_ns = detail::trace_clock_ns();
+    detail::trace_enabled_flag.store(true, std::memory_order_release);
+}
+
+void write_trace() {
+    std::string json;
+    std::string path;
+    uint64_t dropped = 0;
+    {
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        path = registry().path;
+        uint64_t started_ns = registry().started_ns;
+
+        json.reserve(4096);
+        json += "{\"traceEvents\":[\n";
+        json += "{\"ph\":\"M\",\"pid\":1,\"tid\":0,\"name\":\"process_name\",\"args\":{\"name\":\"AllIn1\"}}";
+        for (const auto& thread : registry().threads) {
+            json += ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":" + std::to_string(thread->tid) +
+                    ",\"name\":\"thread_name\",\"args\":{\"name\":\"thread " + std::to_string(thread->tid) + "\"}}";
+
+            uint64_t head = thread->head.load(std::memory_order_acquire);
+            uint64_t first = head > ring_capacity ? head - ring_capacity : 0;
+            dropped += first;
+            for (uint64_t i = first; i < head; ++i) {
+                const TraceEvent& event = thread->events[i & (ring_capacity - 1)];
+                json += ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":";
+                json += std::to_string(thread->tid);
+                json += ",\"cat\":";
+                append_json_string(json, event.category);
+                json += ",\"name\":";
+                append_json_string(json, event.name);
+                json += ",\"ts\":";
+                append_microseconds(json, event.start_ns >= started_ns ? event.start_ns - started_ns : 0);
+                json += ",\"dur\":";
+                append_microseconds(json, event.end_ns - event.start_ns);
+                if (event.detail[0] != '\0') {
+                    json += ",\"args\":{\"detail\":";
+                    append_json_string(json, event.detail);
+                    json += '}';
+                }
+                json += '}';
+            }
+        }
+    }
+    json += "\n],\"displayTimeUnit\":\"ns\",\"otherData\":{\"dropped_events\":" + std::to_string(dropped) + "}}\n";
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        throw std::runtime_error("Failed to open trace file '" + path + "'.");
+    }
+    file.write(json.data(), static_cast<std::streamsize>(json.size()));
+    if (!file) {
+        throw std::runtime_error("Failed to write trace file '" + path + "'.");
+    }
+}
+
+} // namespace allin1::common
@@ -0,0 +1,959 @@
+#include "io/checksum.hpp"
+#include "common/atomic_file.hpp"
+#include "common/error_utils.hpp"
+#include "common/errors.hpp"
+#include "common/output.hpp"
+#include "common/perf_counters.hpp"
+#include "common/stats.hpp"
+#include "common/thread_pool.hpp"
+#include "common/trace.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#else
+#include <cerrno>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <sys/xattr.h>
+#endif
+
+namespace allin1::io {
+
+namespace {
+
+// Files are read with pread(2) into a per-worker aligned buffer rather than
+// mapped: a file truncated while it is being hashed then yields a short read
+// instead of SIGBUS, and readahead is driven by POSIX_FADV_SEQUENTIAL.
+constexpr size_t read_buffer_bytes = 1024 * 1024;
+constexpr size_t read_buffer_alignment = 4096;
+
+// Partial CRC-32C results can be combined, so files of at least two chunks are
+// split across workers. The other algorithms hash a file on a single worker.
+constexpr uint64_t chunk_bytes = 64ull * 1024 * 1024;
+constexpr size_t max_recorded_errors = 1000;
+
+// Digests are cached per algorithm in the xattr user.allin1.<algorithm>, or in
+// a sidecar file in the same directory where xattrs cannot be written.
+constexpr const char* cache_xattr_prefix = "user.allin1.";
+constexpr const char* cache_xattr_version = "v2";
+// Slack between the clock read before an xattr is written and the ctime the write gives the file
+constexpr int64_t cache_ctime_margin_ns = 2000000;
+constexpr const char* cache_sidecar_name = ".allin1.checksums";
+constexpr const char* cache_sidecar_header = "# allin1 checksum cache v1";
+
+// Identifies one version of a file's contents for the digest cache
+struct CacheKey {
+    uint64_t ino = 0;
+    uint64_t size = 0;
+    int64_t mtime_ns = 0;
+    int64_t ctime_ns = 0;
+};
+
+struct ChecksumEntry {
+    std::string display_path;           // As walked, or as listed in the manifest
+    std::filesystem::path file;
+    common::HashAlgorithm algorithm = common::HashAlgorithm::Sha256;
+    std::string manifest_path;          // Path written to the manifest
+    std::string expected;               // Digest listed in the manifest (verification only)
+    uint64_t size = 0;                  // Size when planned, then the bytes actually hashed
+    std::string digest;
+    std::string error;
+    bool cached = false;                // digest came from the cache; nothing was read
+    bool keyed = false;                 // key was taken from the open file, so the digest may be cached
+    CacheKey key;
+
+    // Set when the file is hashed in chunks; one slot per chunk
+    std::vector<uint32_t> chunk_crcs;
+    std::vector<uint64_t> chunk_hashed;
+    std::vector<std::string> chunk_errors;
+};
+
+unsigned char* read_buffer() {
+    struct AlignedBuffer {
+        unsigned char* data = nullptr;
+        AlignedBuffer() {
+#if defined(_WIN32)
+            data = static_cast<unsigned char*>(_aligned_malloc(read_buffer_bytes, read_buffer_alignment));
+#else
+            void* memory = nullptr;
+            if (::posix_memalign(&memory, read_buffer_alignment, read_buffer_bytes) == 0) {
+                data = static_cast<unsigned char*>(memory);
+            }
+#endif
+            if (!data) {
+                throw std::bad_alloc();
+            }
+        }
+        ~AlignedBuffer() {
+#if defined(_WIN32)
+            _aligned_free(data);
+#else
+            std::free(data);
+#endif
+        }
+    };
+    thread_local AlignedBuffer buffer;
+    return buffer.data;
+}
+
+#if !defined(_WIN32)
+int64_t ctime_of(const struct stat& st) {
+#if defined(__APPLE__)
+    return static_cast<int64_t>(st.st_ctimespec.tv_sec) * 1000000000 + st.st_ctimespec.tv_nsec;
+#else
+    return static_cast<int64_t>(st.st_ctim.tv_sec) * 1000000000 + st.st_ctim.tv_nsec;
+#endif
+}
+#endif
+
+class InputFile {
+public:
+    explicit InputFile(const std::filesystem::path& path) : m_path(path) {
+#if defined(_WIN32)
+        m_stream.open(path, std::ios::binary);
+        if (!m_stream) {
+            throw common::IOCreateError("Failed to open '" + path.string() + "'.");
+        }
+#else
+        {
+            common::ScopedOpTimer timer(common::StatOp::Open);
+            m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        }
+        if (m_fd < 0) {
+            throw common::make_errno_error("Failed to open", path, errno);
+        }
+#if defined(POSIX_FADV_SEQUENTIAL)
+        ::posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+#endif
+    }
+
+    ~InputFile() {
+#if !defined(_WIN32)
+        if (m_fd >= 0) ::close(m_fd);
+#endif
+    }
+
+    InputFile(const InputFile&) = delete;
+    InputFile& operator=(const InputFile&) = delete;
+
+    // Returns false where the digest cache is not supported
+    bool cache_key(CacheKey& key) {
+#if defined(_WIN32)
+        (void)key;
+        return false;
+#else
+        struct stat st;
+        {
+            common::ScopedOpTimer timer(common::StatOp::Stat);
+            if (::fstat(m_fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+                return false;
+            }
+        }
+        key.ino = static_cast<uint64_t>(st.st_ino);
+        key.size = static_cast<uint64_t>(st.st_size);
+#if defined(__APPLE__)
+        key.mtime_ns = static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+        key.mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+        key.ctime_ns = ctime_of(st);
+        return true;
+#endif
+    }
+
+#if !defined(_WIN32)
+    // The file's current ctime in nanoseconds, or -1 if it cannot be read
+    int64_t current_ctime_ns() {
+        struct stat st;
+        common::ScopedOpTimer timer(common::StatOp::Stat);
+        return ::fstat(m_fd, &st) == 0 ? ctime_of(st) : -1;
+    }
+#endif
+
+#if !defined(_WIN32)
+    int fd() const { return m_fd; }
+#endif
+
+    // Returns the bytes read; 0 at end of file
+    size_t read_at(unsigned char* buffer, size_t size, uint64_t offset) {
+        common::ScopedOpTimer timer(common::StatOp::Read);
+#if defined(_WIN32)
+        m_stream.clear();
+        m_stream.seekg(static_cast<std::streamoff>(offset));
+        m_stream.read(reinterpret_cast<char*>(buffer), static_cast<std::streamsize>(size));
+        if (m_stream.bad()) {
+            throw common::IOCreateError("Failed to read '" + m_path.string() + "'.");
+        }
+        return static_cast<size_t>(m_stream.gcount());
+#else
+        while (true) {
+            ssize_t n = ::pread(m_fd, buffer, size, static_cast<off_t>(offset));
+            if (n >= 0) {
+                return static_cast<size_t>(n);
+            }
+            if (errno != EINTR) {
+                throw common::make_errno_error("Failed to read", m_path, errno);
+            }
+        }
+#endif
+    }
+
+private:
+    std::filesystem::path m_path;
+#if defined(_WIN32)
+    std::ifstream m_stream;
+#else
+    int m_fd = -1;
+#endif
+};
+
+// Feeds up to length bytes starting at offset to consume; returns the bytes read
+template <typename Consume>
+uint64_t read_range(InputFile& file, uint64_t offset, uint64_t length, Consume consume) {
+    unsigned char* buffer = read_buffer();
+    uint64_t total = 0;
+    while (total < length) {
+        size_t request = static_cast<size_t>(std::min<uint64_t>(read_buffer_bytes, length - total));
+        size_t n = file.read_at(buffer, request, offset + total);
+        if (n == 0) {
+            break;
+        }
+        common::count(common::StatCounter::BytesRead, n);
+        consume(buffer, n);
+        total += n;
+    }
+    return total;
+}
+
+// Persists digests across runs so unchanged files are not read again.
+//
+// Both are keyed on (inode, size, mtime, ctime); ctime catches content
+// rewritten with its old mtime restored. The sidecar records the ctime itself.
+// Writing the xattr moves the file's ctime, so it records a bound instead: the
+// clock just before the write plus a small margin. The write is undone if it
+// left the ctime past that bound, and flush() waits until the clock has passed
+// every bound, so any later change to the file gives it a ctime beyond its
+// entry's. Cache failures never fail the run.
+class DigestCache {
+public:
+    bool lookup(InputFile& file, const ChecksumEntry& entry, std::string& digest) {
+        common::TraceScope trace("checksum.cache_lookup", entry.display_path);
+#if defined(__linux__)
+        std::string name = std::string(cache_xattr_prefix) + common::hash_algorithm_name(entry.algorithm);
+        char value[256];
+        ssize_t length = ::fgetxattr(file.fd(), name.c_str(), value, sizeof(value) - 1);
+        if (length > 0) {
+            value[length] = '\0';
+            std::istringstream in(value);
+            std::string version;
+            CacheKey cached;
+            std::string cached_digest;
+            if (in >> version >> cached.ino >> cached.size >> cached.mtime_ns >> cached.ctime_ns >> cached_digest &&
+                version == cache_xattr_version && cached.ino == entry.key.ino && cached.size == entry.key.size &&
+                cached.mtime_ns == entry.key.mtime_ns && entry.key.ctime_ns <= cached.ctime_ns) {
+                digest = cached_digest;
+                return true;
+            }
+        }
+#else
+        (void)file;
+#endif
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Sidecar& sidecar = load_sidecar(entry.file.parent_path());
+        auto it = sidecar.records.find(record_name(entry));
+        if (it == sidecar.records.end()) {
+            return false;
+        }
+        const CacheKey& cached = it->second.key;
+        if (cached.ino != entry.key.ino || cached.size != entry.key.size ||
+            cached.mtime_ns != entry.key.mtime_ns || cached.ctime_ns != entry.key.ctime_ns) {
+            return false;
+        }
+        digest = it->second.digest;
+        return true;
+    }
+
+    void store(InputFile& file, const ChecksumEntry& entry) {
+#if !defined(_WIN32)
+        if (file.current_ctime_ns() != entry.key.ctime_ns) {
+            return; // Changed while it was hashed, so the digest may not match any version of it
+        }
+#endif
+#if defined(__linux__)
+        std::string name = std::string(cache_xattr_prefix) + common::hash_algorithm_name(entry.algorithm);
+        int64_t ctime_bound = realtime_ns() + cache_ctime_margin_ns;
+        std::string value = std::string(cache_xattr_version) + " " + std::to_string(entry.key.ino) + " " +
+                            std::to_string(entry.key.size) + " " + std::to_string(entry.key.mtime_ns) + " " +
+                            std::to_string(ctime_bound) + " " + entry.digest;
+        if (::fsetxattr(file.fd(), name.c_str(), value.data(), value.size(), 0) == 0) {
+            int64_t ctime_ns = file.current_ctime_ns();
+            if (ctime_ns >= 0 && ctime_ns <= ctime_bound) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_max_ctime_bound = std::max(m_max_ctime_bound, ctime_bound);
+                return;
+            }
+            ::fremovexattr(file.fd(), name.c_str()); // Its own write went past the bound
+        }
+#else
+        (void)file;
+#endif
+        if (entry.file.filename().string().find('\n') != std::string::npos) {
+            return; // Not representable in the sidecar's line format
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Sidecar& sidecar = load_sidecar(entry.file.parent_path());
+        sidecar.records[record_name(entry)] = {entry.key, entry.digest};
+        sidecar.dirty = true;
+    }
+
+    // Rewrites the sidecars that gained entries. A sidecar that cannot be
+    // written is returned as a failure; the digests were still computed.
+    std::vector<EntryError> flush() {
+        common::TraceScope trace("checksum.cache_flush");
+#if defined(__linux__)
+        // Timestamps come from the coarse clock at worst, so once it has passed
+        // every bound no later change can be stamped within one
+        while (coarse_realtime_ns() <= m_max_ctime_bound) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+#endif
+        std::vector<EntryError> failures;
+        for (auto& [directory, sidecar] : m_sidecars) {
+            if (!sidecar.dirty) {
+                continue;
+            }
+            std::string content = std::string(cache_sidecar_header) + "\n";
+            for (const auto& [name, record] : sidecar.records) {
+                content += std::to_string(record.key.ino) + " " + std::to_string(record.key.size) + " " +
+                           std::to_string(record.key.mtime_ns) + " " + std::to_string(record.key.ctime_ns) + " " +
+                           record.digest + " " + name + "\n";
+            }
+            // Published in one step under a name of its own, so neither a concurrent
+            // reader nor another run rewriting the same sidecar sees a partial index
+            std::filesystem::path path = directory / cache_sidecar_name;
+            try {
+                common::AtomicFile file(path);
+                std::ofstream out(file.write_path(), std::ios::binary | std::ios::trunc);
+                out.write(content.data(), static_cast<std::streamsize>(content.size()));
+                out.close();
+                if (!out) {
+                    throw common::IOCreateError("Failed to write '" + file.write_path().string() + "'.");
+                }
+                file.commit();
+                common::count(common::StatCounter::BytesWritten, content.size());
+            } catch (const std::filesystem::filesystem_error& e) {
+                common::record_error(e.code().value());
+                failures.push_back({path.string(), "Failed to update checksum cache: " + e.code().message()});
+            } catch (const std::exception& e) {
+                failures.push_back({path.string(), "Failed to update checksum cache: " + std::string(e.what())});
+            }
+        }
+        return failures;
+    }
+
+private:
+    struct Record {
+        CacheKey key;
+        std::string digest;
+    };
+
+    struct Sidecar {
+        std::map<std::string, Record> records;   // "<algorithm>/<file name>"
+        bool dirty = false;
+    };
+
+    static std::string record_name(const ChecksumEntry& entry) {
+        return std::string(common::hash_algorithm_name(entry.algorithm)) + "/" + entry.file.filename().string();
+    }
+
+    // Loads the directory's sidecar on first use; m_mutex must be held
+    Sidecar& load_sidecar(const std::filesystem::path& directory) {
+        auto [it, inserted] = m_sidecars.try_emplace(directory);
+        if (!inserted) {
+            return it->second;
+        }
+        std::ifstream in(directory / cache_sidecar_name);
+        std::string line;
+        if (!in || !std::getline(in, line) || line != cache_sidecar_header) {
+            return it->second;
+        }
+        while (std::getline(in, line)) {
+            std::istringstream fields(line);
+            Record record;
+            if (!(fields >> record.key.ino >> record.key.size >> record.key.mtime_ns >> record.key.ctime_ns >> record.digest)) {
+                continue;
+            }
+            fields.get(); // The separator before the name, which may itself contain spaces
+            std::string name;
+            std::getline(fields, name);
+            if (!name.empty()) {
+                it->second.records[name] = std::move(record);
+            }
+        }
+        return it->second;
+    }
+
+#if defined(__linux__)
+    static int64_t realtime_ns() {
+        struct timespec now;
+        ::clock_gettime(CLOCK_REALTIME, &now);
+        return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+    }
+
+    static int64_t coarse_realtime_ns() {
+        struct timespec now;
+        ::clock_gettime(CLOCK_REALTIME_COARSE, &now);
+        return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+    }
+#endif
+
+    std::mutex m_mutex;
+    std::map<std::filesystem::path, Sidecar> m_sidecars;
+    int64_t m_max_ctime_bound = 0;          // Latest bound written to an xattr
+};
+
+// Looks entry up in the cache. On a hit the digest is taken from it and true is returned.
+bool use_cached_digest(DigestCache* cache, InputFile& file, ChecksumEntry& entry) {
+    if (!cache || !file.cache_key(entry.key)) {
+        return false;
+    }
+    entry.keyed = true;
+    if (!cache->lookup(file, entry, entry.digest)) {
+        return false;
+    }
+    entry.size = entry.key.size;
+    entry.cached = true;
+    common::count(common::StatCounter::EntriesVisited);
+    return true;
+}
+
+void hash_whole_file(ChecksumEntry& entry, DigestCache* cache) {
+    common::TraceScope trace("checksum.file", entry.display_path);
+    try {
+        InputFile file(entry.file);
+        if (use_cached_digest(cache, file, entry)) {
+            return;
+        }
+        auto hasher = common::make_hasher(entry.algorithm);
+        entry.size = read_range(file, 0, std::numeric_limits<uint64_t>::max(), [&](const unsigned char* data, size_t size) {
+            hasher->update(data, size);
+        });
+        entry.digest = hasher->hex_digest();
+        common::count(common::StatCounter::EntriesVisited);
+        if (cache && entry.keyed && entry.size == entry.key.size) {
+            cache->store(file, entry);
+        }
+    } catch (const std::exception& e) {
+        entry.error = e.what();
+    }
+}
+
+void hash_chunk(ChecksumEntry& entry, size_t index) {
+    common::TraceScope trace("checksum.chunk", entry.display_path);
+    try {
+        InputFile file(entry.file);
+        uint32_t crc = 0;
+        entry.chunk_hashed[index] = read_range(file, index * chunk_bytes, chunk_bytes, [&](const unsigned char* data, size_t size) {
+            crc = common::crc32c(crc, data, size);
+        });
+        entry.chunk_crcs[index] = crc;
+    } catch (const std::exception& e) {
+        entry.chunk_errors[index] = e.what();
+    }
+}
+
+void finish_chunks(ChecksumEntry& entry, DigestCache* cache) {
+    uint64_t expected_size = entry.size;
+    entry.size = 0;
+    uint32_t crc = 0;
+    for (size_t i = 0; i < entry.chunk_crcs.size(); ++i) {
+        if (!entry.chunk_errors[i].empty()) {
+            entry.error = entry.chunk_errors[i];
+            return;
+        }
+        uint64_t chunk_size = std::min(chunk_bytes, expected_size - i * chunk_bytes);
+        if (entry.chunk_hashed[i] != chunk_size) {
+            entry.error = "File changed size while being hashed";
+            return;
+        }
+        crc = i == 0 ? entry.chunk_crcs[i] : common::crc32c_combine(crc, entry.chunk_crcs[i], chunk_size);
+        entry.size += chunk_size;
+    }
+    entry.digest = common::crc32c_hex(crc);
+    common::count(common::StatCounter::EntriesVisited);
+    if (cache && entry.keyed && entry.size == entry.key.size) {
+        try {
+            InputFile file(entry.file);
+            cache->store(file, entry);
+        } catch (const std::exception&) {
+            // Only the cache entry is lost
+        }
+    }
+}
+
+void hash_entries(std::vector<ChecksumEntry>& entries, size_t workers, DigestCache* cache) {
+    common::ThreadPool pool(workers);
+    std::vector<ChecksumEntry*> chunked;
+
+    for (auto& entry : entries) {
+        if (!entry.error.empty()) {
+            continue;
+        }
+        if (pool.size() > 1 && entry.algorithm == common::HashAlgorithm::Crc32c && entry.size >= 2 * chunk_bytes) {
+            try {
+                InputFile file(entry.file);
+                if (use_cached_digest(cache, file, entry)) {
+                    continue;
+                }
+            } catch (const std::exception& e) {
+                entry.error = e.what();
+                continue;
+            }
+            size_t chunks = static_cast<size_t>((entry.size + chunk_bytes - 1) / chunk_bytes);
+            entry.chunk_crcs.resize(chunks);
+            entry.chunk_hashed.resize(chunks);
+            entry.chunk_errors.resize(chunks);
+            for (size_t i = 0; i < chunks; ++i) {
+                pool.submit([&entry, i] { hash_chunk(entry, i); });
+            }
+            chunked.push_back(&entry);
+            continue;
+        }
+        pool.submit([&entry, cache] { hash_whole_file(entry, cache); });
+    }
+    pool.wait_idle();
+
+    for (ChecksumEntry* entry : chunked) {
+        finish_chunks(*entry, cache);
+    }
+}
+
+std::filesystem::path normalized_absolute(const std::filesystem::path& path) {
+    std::error_code ec;
+    std::filesystem::path absolute = std::filesystem::absolute(path, ec);
+    return (ec ? path : absolute).lexically_normal();
+}
+
+// Sets walk_complete to false when a directory could not be listed; its
+// failure is one of the entries returned
+std::vector<ChecksumEntry> collect_entries(const ChecksumOptions& options, bool& walk_complete) {
+    common::TraceScope trace("checksum.walk", options.path.string());
+    std::vector<ChecksumEntry> entries;
+    std::filesystem::path manifest_file = options.manifest.empty() ? std::filesystem::path() : normalized_absolute(options.manifest);
+    std::filesystem::path manifest_base = manifest_file.parent_path();
+
+    auto add_entry = [&](const std::filesystem::path& file, uint64_t size) {
+        ChecksumEntry entry;
+        entry.display_path = file.string();
+        entry.file = file;
+        entry.algorithm = options.algorithm;
+        entry.size = size;
+        if (!manifest_file.empty()) {
+            std::filesystem::path relative = normalized_absolute(file).lexically_relative(manifest_base);
+            entry.manifest_path = (relative.empty() ? file : relative).generic_string();
+        }
+        entries.push_back(std::move(entry));
+    };
+
+    std::error_code ec;
+    std::filesystem::file_status status = std::filesystem::status(options.path, ec);
+    if (ec) {
+        throw common::make_errno_error("Failed to access", options.path, ec.value());
+    }
+    if (!std::filesystem::is_directory(status)) {
+        uint64_t size = std::filesystem::file_size(options.path, ec);
+        add_entry(options.path, ec ? 0 : size);
+        return entries;
+    }
+    if (!options.recursive) {
+        throw common::IOCreateError("'" + options.path.string() + "' is a directory. Use --recursive to hash the files below it.");
+    }
+
+    // Each directory is listed on its own, so one that cannot be opened or read
+    // is reported under its path and the rest of the tree is still walked
+    std::vector<std::filesystem::path> pending{options.path};
+    while (!pending.empty()) {
+        std::filesystem::path directory = std::move(pending.back());
+        pending.pop_back();
+        std::filesystem::directory_iterator it(directory, ec);
+        for (; !ec && it != std::filesystem::directory_iterator(); it.increment(ec)) {
+            const std::filesystem::directory_entry& dir_entry = *it;
+            std::error_code entry_ec;
+            if (dir_entry.is_symlink(entry_ec)) {
+                continue;
+            }
+            if (dir_entry.is_directory(entry_ec)) {
+                pending.push_back(dir_entry.path());
+                continue;
+            }
+            if (!dir_entry.is_regular_file(entry_ec)) {
+                continue;
+            }
+            if (dir_entry.path().filename() == cache_sidecar_name) {
+                continue;
+            }
+            if (!manifest_file.empty() && normalized_absolute(dir_entry.path()) == manifest_file) {
+                continue; // A manifest being rewritten inside the tree is not part of it
+            }
+            uint64_t size = dir_entry.file_size(entry_ec);
+            add_entry(dir_entry.path(), entry_ec ? 0 : size);
+        }
+        if (ec) {
+            ChecksumEntry failed;
+            failed.display_path = directory.string();
+            failed.error = "Failed to read directory: " + ec.message();
+            common::record_error(ec.value());
+            entries.push_back(std::move(failed));
+            walk_complete = false;
+            ec.clear();
+        }
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const ChecksumEntry& a, const ChecksumEntry& b) {
+        return a.display_path < b.display_path;
+    });
+    return entries;
+}
+
+bool is_hex_digest(const std::string& text) {
+    return !text.empty() && std::all_of(text.begin(), text.end(), [](unsigned char c) { return std::isxdigit(c) != 0; });
+}
+
+std::string to_lower(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return text;
+}
+
+// Escapes a path for a manifest line the way coreutils does: backslashes,
+// newlines and carriage returns become \\, \n and \r, and a line holding
+// such a path starts with a backslash. Returns true if anything was escaped.
+bool escape_manifest_path(const std::string& path, std::string& escaped) {
+    escaped.clear();
+    escaped.reserve(path.size());
+    bool changed = false;
+    for (char c : path) {
+        switch (c) {
+            case '\\': escaped += "\\\\"; changed = true; break;
+            case '\n': escaped += "\\n"; changed = true; break;
+            case '\r': escaped += "\\r"; changed = true; break;
+            default: escaped += c; break;
+        }
+    }
+    return changed;
+}
+
+// Reverses escape_manifest_path. Returns false on an unknown escape sequence.
+bool unescape_manifest_path(const std::string& escaped, std::string& path) {
+    path.clear();
+    path.reserve(escaped.size());
+    for (size_t i = 0; i < escaped.size(); ++i) {
+        if (escaped[i] != '\\') {
+            path += escaped[i];
+            continue;
+        }
+        if (++i == escaped.size()) {
+            return false;
+        }
+        switch (escaped[i]) {
+            case '\\': path += '\\'; break;
+            case 'n': path += '\n'; break;
+            case 'r': path += '\r'; break;
+            default: return false;
+        }
+    }
+    return true;
+}
+
+// Parses "TAG (path) = digest" (BSD style, as written by --manifest and `sha256sum --tag`)
+bool parse_tagged_line(const std::string& line, std::string& tag, std::string& path, std::string& digest) {
+    size_t open = line.find(" (");
+    size_t close = line.rfind(") = ");
+    if (open == std::string::npos || open == 0 || close == std::string::npos || close < open + 2) {
+        return false;
+    }
+    tag = line.substr(0, open);
+    path = line.substr(open + 2, close - open - 2);
+    digest = line.substr(close + 4);
+    return std::all_of(tag.begin(), tag.end(), [](unsigned char c) { return std::isalnum(c) != 0; }) && is_hex_digest(digest);
+}
+
+// Parses "digest  path" or "digest *path" (GNU coreutils style)
+bool parse_plain_line(const std::string& line, std::string& path, std::string& digest) {
+    size_t space = line.find(' ');
+    if (space == std::string::npos || space + 2 > line.size() || (line[space + 1] != ' ' && line[space + 1] != '*')) {
+        return false;
+    }
+    digest = line.substr(0, space);
+    path = line.substr(space + 2);
+    return is_hex_digest(digest) && !path.empty();
+}
+
+std::vector<ChecksumEntry> read_manifest(const ChecksumOptions& options) {
+    common::TraceScope trace("checksum.manifest", options.path.string());
+    std::ifstream in(options.path);
+    if (!in) {
+        throw common::make_errno_error("Failed to open manifest", options.path, errno);
+    }
+    std::filesystem::path base = options.path.parent_path();
+
+    std::vector<ChecksumEntry> entries;
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(in, line)) {
+        ++line_number;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        // A leading backslash marks a line whose path is escaped
+        bool escaped = line[0] == '\\';
+        if (escaped) {
+            line.erase(0, 1);
+        }
+
+        ChecksumEntry entry;
+        std::string tag;
+        std::string path;
+        std::string digest;
+        bool parsed = true;
+        if (parse_tagged_line(line, tag, path, digest)) {
+            try {
+                entry.algorithm = common::parse_hash_algorithm(tag);
+            } catch (const std::invalid_argument&) {
+                entry.error = "Unsupported algorithm '" + tag + "'";
+            }
+        } else if (parse_plain_line(line, path, digest)) {
+            entry.algorithm = options.algorithm;
+        } else {
+            parsed = false;
+        }
+        if (parsed && escaped) {
+            std::string unescaped;
+            parsed = unescape_manifest_path(path, unescaped);
+            path = std::move(unescaped);
+        }
+        if (!parsed) {
+            entry.display_path = options.path.string() + ":" + std::to_string(line_number);
+            entry.error = "Malformed manifest line";
+            entries.push_back(std::move(entry));
+            continue;
+        }
+
+        std::filesystem::path file(path);
+        entry.display_path = path;
+        entry.file = file.is_absolute() ? file : base / file;
+        entry.expected = to_lower(digest);
+        std::error_code ec;
+        uint64_t size = std::filesystem::file_size(entry.file, ec);
+        entry.size = ec ? 0 : size;
+        entries.push_back(std::move(entry));
+    }
+    if (in.bad()) {
+        throw common::IOCreateError("Failed to read manifest '" + options.path.string() + "'.");
+    }
+    return entries;
+}
+
+void write_manifest(const std::filesystem::path& manifest, const std::vector<ChecksumEntry>& entries) {
+    common::TraceScope trace("checksum.manifest", manifest.string());
+    std::string content;
+    std::string escaped;
+    for (const auto& entry : entries) {
+        if (!entry.error.empty()) {
+            continue;
+        }
+        if (escape_manifest_path(entry.manifest_path, escaped)) {
+            content += '\\';
+        }
+        content += common::hash_algorithm_tag(entry.algorithm);
+        content += " (";
+        content += escaped;
+        content += ") = ";
+        content += entry.digest;
+        content += '\n';
+    }
+
+    std::ofstream out(manifest, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw common::make_errno_error("Failed to create manifest", manifest, errno);
+    }
+    out.write(content.data(), static_cast<std::streamsize>(content.size()));
+    out.close();
+    if (!out) {
+        throw common::IOCreateError("Failed to write manifest '" + manifest.string() + "'.");
+    }
+    common::count(common::StatCounter::BytesWritten, content.size());
+}
+
+} // namespace
+
+OperationResult perform_checksum(const ChecksumOptions& options) {
+    common::ScopedPerfCounters counters(common::PerfPhase::Checksum);
+    auto start_time = std::chrono::steady_clock::now();
+    OperationResult result;
+
+    std::vector<ChecksumEntry> entries;
+    bool walk_complete = true;
+    std::vector<EntryError> cache_failures;
+    try {
+        entries = options.verify ? read_manifest(options) : collect_entries(options, walk_complete);
+        DigestCache cache;
+        hash_entries(entries, options.jobs == 0 ? common::default_worker_count() : options.jobs, options.use_cache ? &cache : nullptr);
+        cache_failures = cache.flush();
+        // A manifest missing part of the tree would later verify as if it covered all of it
+        if (!options.verify && !options.manifest.empty() && walk_complete) {
+            write_manifest(options.manifest, entries);
+        }
+    } catch (const common::IOCreateError&) {
+        throw;
+    } catch (const std::filesystem::filesystem_error& e) {
+        common::record_error(e.code().value());
+        throw common::IOCreateError("Filesystem error: " + std::string(e.what()));
+    } catch (const std::exception& e) {
+        throw common::IOCreateError("An unexpected error occurred: " + std::string(e.what()));
+    }
+
+    for (auto& entry : entries) {
+        ++result.entries_processed;
+        if (!entry.cached) {
+            result.bytes_read += entry.size;
+        }
+        if (entry.error.empty() && options.verify && entry.digest != entry.expected) {
+            entry.error = "Checksum mismatch (expected " + entry.expected + ", got " + entry.digest + ")";
+        }
+        if (!entry.error.empty()) {
+            ++result.entries_failed;
+            if (result.errors.size() < max_recorded_errors) {
+                result.errors.push_back({entry.display_path, entry.error});
+            }
+            if (options.progress) {
+                options.progress({ProgressKind::EntryFailed, entry.display_path, 0, entry.error});
+            }
+            continue;
+        }
+        if (options.progress) {
+            options.progress({options.verify ? ProgressKind::Verified : ProgressKind::Hashed, entry.display_path, entry.size, entry.digest});
+        }
+    }
+    // The cache only saves work on later runs, so failing to update it does not fail this one
+    if (options.progress) {
+        for (const auto& failure : cache_failures) {
+            options.progress({ProgressKind::Warning, failure.path, 0, failure.message});
+        }
+    }
+    result.elapsed = std::chrono::steady_clock::now() - start_time;
+    return result;
+}
+
+void handle_checksum(
+    const std::string& path,
+    const std::string& algorithm,
+    bool recursive,
+    const std::string& manifest,
+    bool verify,
+    bool use_cache,
+    const std::string& jobs,
+    bool output_enabled
+) {
+    common::TraceScope trace("checksum");
+    bool text_output = output_enabled && common::output_format() == common::OutputFormat::Text;
+
+    ChecksumOptions options;
+    options.path = path;
+    options.recursive = recursive;
+    options.verify = verify;
+    options.manifest = manifest;
+    options.use_cache = use_cache;
+    if (!algorithm.empty()) {
+        try {
+            options.algorithm = common::parse_hash_algorithm(algorithm);
+        } catch (const std::invalid_argument& e) {
+            throw common::IOCreateError(e.what());
+        }
+    }
+    if (!jobs.empty()) {
+        try {
+            options.jobs = std::stoul(jobs);
+        } catch (const std::exception&) {
+            throw common::IOCreateError("Invalid value for --jobs: \"" + jobs + "\"");
+        }
+    }
+    if (verify && !manifest.empty()) {
+        throw common::IOCreateError("--manifest cannot be combined with --verify; pass the manifest as the path to verify.");
+    }
+
+    if (text_output) {
+        common::out() << "Settings for io checksum:" << '\n';
+        common::out() << "  " << (verify ? "Manifest: " : "Path: ") << path << '\n';
+        common::out() << "  Algorithm: " << common::hash_algorithm_name(options.algorithm)
+                      << " (" << common::hash_implementation(options.algorithm) << ")" << '\n';
+        common::out() << "  Cache: " << (use_cache ? "true" : "false") << '\n';
+        if (!verify) {
+            common::out() << "  Recursive: " << (recursive ? "true" : "false") << '\n';
+            if (!manifest.empty()) {
+                common::out() << "  Manifest: " << manifest << '\n';
+            }
+        }
+    }
+
+    bool structured = common::output_format() != common::OutputFormat::Text;
+    options.progress = [text_output, structured, verify](const ProgressEvent& event) {
+        if (structured) {
+            emit_progress_record("checksum", event);
+        } else if (event.kind == ProgressKind::EntryFailed) {
+            if (verify) {
+                common::err() << event.path << ": FAILED (" << event.message << ")" << std::endl;
+            } else {
+                common::err() << "Error checksumming " << event.path << ": " << event.message << std::endl;
+            }
+        } else if (event.kind == ProgressKind::Warning) {
+            common::err() << "Warning: " << event.path << ": " << event.message << std::endl;
+        } else if (text_output && event.kind == ProgressKind::Hashed) {
+            common::out() << event.message << "  " << event.path << '\n';
+        } else if (text_output && event.kind == ProgressKind::Verified) {
+            common::out() << event.path << ": OK" << '\n';
+        }
+    };
+
+    OperationResult result = perform_checksum(options);
+    emit_result_record("checksum", result);
+
+    if (!result.ok()) {
+        throw common::IOCreateError(std::to_string(result.entries_failed) + " of " + std::to_string(result.entries_processed) +
+                                    (verify ? " files failed verification." : " files could not be hashed."));
+    }
+    if (text_output) {
+        common::out() << (verify ? "Verified " : "Hashed ") << result.entries_processed << " files (" << result.bytes_read << " bytes)";
+        if (!manifest.empty()) {
+            common::out() << ", manifest written to " << manifest;
+        }
+        common::out() << '\n';
+    }
+}
+
+} // namespace allin1::io
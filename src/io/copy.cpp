@@ -0,0 +1,922 @@
+#include "io/copy.hpp"
+#include "common/directory_budget.hpp"
+#include "common/error_utils.hpp"
+#include "common/durability.hpp"
+#include "common/errors.hpp"
+#include "common/output.hpp"
+#include "common/page_cache.hpp"
+#include "common/perf_counters.hpp"
+#include "common/stats.hpp"
+#include "common/thread_pool.hpp"
+#include "common/trace.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <linux/fs.h> // FICLONE
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#endif
+
+namespace allin1::io {
+
+namespace {
+
+// Kernel copies are issued in chunks of this size so progress can be reported
+constexpr uint64_t copy_chunk_bytes = 64ull * 1024 * 1024;
+constexpr size_t buffered_copy_bytes = 1024 * 1024;
+
+// Recursive copies hand small files to workers in batches so per-task overhead
+// is amortized; files at or above large_file_bytes get a task of their own.
+constexpr size_t max_batch_files = 64;
+constexpr uint64_t max_batch_bytes = 8ull * 1024 * 1024;
+constexpr uint64_t large_file_bytes = 8ull * 1024 * 1024;
+constexpr size_t queued_tasks_per_worker = 16;
+constexpr size_t max_recorded_errors = 1000;
+
+// Open directories are capped against RLIMIT_NOFILE. Each holds a source and a
+// destination fd, plus a listing while it is enumerated; each worker also holds
+// the two ends of the file it copies, and reserved_fds are left to the process.
+constexpr size_t fds_per_directory = 3;
+constexpr size_t fds_per_worker = 2;
+constexpr size_t reserved_fds = 32;
+
+#if !defined(_WIN32)
+class FileDescriptor {
+public:
+    explicit FileDescriptor(int fd = -1) : m_fd(fd) {}
+    ~FileDescriptor() {
+        if (m_fd >= 0) ::close(m_fd);
+    }
+    FileDescriptor(const FileDescriptor&) = delete;
+    FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+    int get() const { return m_fd; }
+
+    // Closes explicitly so errors reported at close time are not lost
+    int close() {
+        int result = ::close(m_fd);
+        m_fd = -1;
+        return result;
+    }
+
+private:
+    int m_fd;
+};
+
+// Tracks the bytes copied into one file and reports progress at a coarse interval
+struct FileProgress {
+    const ProgressCallback& callback;
+    const std::string& path;
+    uint64_t copied = 0;
+    uint64_t next_report = copy_chunk_bytes;
+    common::WriteBehind* write_behind = nullptr;   // Set in page-cache-neutral mode
+
+    // Kernel copies are issued in smaller steps when the page cache is being limited
+    uint64_t chunk_bytes() const {
+        return write_behind ? common::write_behind_window_bytes : copy_chunk_bytes;
+    }
+
+    void add(uint64_t bytes) {
+        copied += bytes;
+        common::count(common::StatCounter::BytesWritten, bytes);
+        if (write_behind) {
+            write_behind->advance(copied);
+        }
+        if (callback && copied >= next_report) {
+            callback({ProgressKind::BytesWritten, path, copied, {}});
+            next_report = copied + copy_chunk_bytes;
+        }
+    }
+};
+
+#if defined(__linux__)
+// Errors meaning "this mechanism does not apply here", as opposed to I/O failures
+bool is_unsupported(int error_code) {
+    return error_code == ENOSYS || error_code == EXDEV || error_code == EINVAL ||
+           error_code == EOPNOTSUPP || error_code == ENOTTY || error_code == EBADF ||
+           error_code == EPERM;
+}
+
+bool try_reflink(int in_fd, int out_fd) {
+    common::TraceScope trace("copy.reflink");
+    return ::ioctl(out_fd, FICLONE, in_fd) == 0;
+}
+
+// Returns false if nothing was copied and the kernel cannot do this copy, so
+// the caller can fall back. Throws on errors after data has been transferred.
+template <typename Transfer>
+bool kernel_copy(const char* trace_name, Transfer transfer, uint64_t size, FileProgress& progress, const std::filesystem::path& destination) {
+    common::TraceScope trace(trace_name);
+    uint64_t copied = 0;
+    while (copied < size) {
+        size_t request = static_cast<size_t>(std::min(progress.chunk_bytes(), size - copied));
+        ssize_t n;
+        {
+            common::ScopedOpTimer timer(common::StatOp::Write);
+            n = transfer(request);
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (copied == 0 && is_unsupported(errno)) return false;
+            throw common::make_errno_error("Failed to copy data to", destination, errno);
+        }
+        if (n == 0) {
+            // Source shrank, or a pseudo-file that reports a misleading size
+            if (copied == 0) return false;
+            break;
+        }
+        copied += static_cast<uint64_t>(n);
+        progress.add(static_cast<uint64_t>(n));
+    }
+    return true;
+}
+#endif
+
+void buffered_copy(int in_fd, int out_fd, FileProgress& progress, const std::filesystem::path& source, const std::filesystem::path& destination) {
+    common::TraceScope trace("copy.buffered");
+    std::unique_ptr<char[]> buffer(new char[buffered_copy_bytes]);
+    while (true) {
+        ssize_t n;
+        {
+            common::ScopedOpTimer timer(common::StatOp::Read);
+            n = ::read(in_fd, buffer.get(), buffered_copy_bytes);
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw common::make_errno_error("Failed to read from", source, errno);
+        }
+        if (n == 0) break;
+        common::count(common::StatCounter::BytesRead, static_cast<uint64_t>(n));
+
+        const char* data = buffer.get();
+        size_t remaining = static_cast<size_t>(n);
+        while (remaining > 0) {
+            ssize_t written;
+            {
+                common::ScopedOpTimer timer(common::StatOp::Write);
+                written = ::write(out_fd, data, remaining);
+            }
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                throw common::make_errno_error("Failed to write to", destination, errno);
+            }
+            data += written;
+            remaining -= static_cast<size_t>(written);
+            progress.add(static_cast<uint64_t>(written));
+        }
+    }
+}
+
+// Copies size bytes between two open files with the fastest mechanism available.
+CopyMethod copy_file_data(int in_fd, int out_fd, uint64_t size, FileProgress& progress,
+                          const std::filesystem::path& source, const std::filesystem::path& destination) {
+    // Pseudo-files report a size of 0, so those (and empty files) are read until EOF
+#if defined(__linux__)
+    if (size > 0 && try_reflink(in_fd, out_fd)) {
+        progress.add(size);
+        return CopyMethod::Reflink;
+    }
+    if (size > 0 && kernel_copy("copy.copy_file_range", [&](size_t request) {
+            return ::copy_file_range(in_fd, nullptr, out_fd, nullptr, request, 0);
+        }, size, progress, destination)) {
+        return CopyMethod::CopyFileRange;
+    }
+    if (size > 0 && kernel_copy("copy.sendfile", [&](size_t request) {
+            return ::sendfile(out_fd, in_fd, nullptr, request);
+        }, size, progress, destination)) {
+        return CopyMethod::Sendfile;
+    }
+#else
+    (void)size;
+#endif
+    buffered_copy(in_fd, out_fd, progress, source, destination);
+    return CopyMethod::Buffered;
+}
+
+CopyMethod copy_file_posix(const CopyOptions& options, const std::filesystem::path& destination, OperationResult& result) {
+    const std::filesystem::path& source = options.source;
+    const std::string destination_str = destination.string();
+
+    int in_fd;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Open);
+        in_fd = ::open(source.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    FileDescriptor in(in_fd);
+    if (in.get() < 0) {
+        throw common::make_errno_error("Failed to open source file", source, errno);
+    }
+
+    struct stat source_stat;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Stat);
+        if (::fstat(in.get(), &source_stat) != 0) {
+            throw common::make_errno_error("Failed to stat source file", source, errno);
+        }
+    }
+    if (!S_ISREG(source_stat.st_mode)) {
+        throw common::IOCreateError("Source is not a regular file: '" + source.string() + "'.");
+    }
+
+    struct stat destination_stat;
+    if (::stat(destination.c_str(), &destination_stat) == 0 &&
+        destination_stat.st_dev == source_stat.st_dev && destination_stat.st_ino == source_stat.st_ino) {
+        throw common::IOCreateError("Source and destination are the same file: '" + source.string() + "'.");
+    }
+
+    int out_fd;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Open);
+        out_fd = ::open(destination.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, source_stat.st_mode & 07777);
+    }
+    FileDescriptor out(out_fd);
+    if (out.get() < 0) {
+        throw common::make_errno_error("Failed to create destination file", destination, errno);
+    }
+
+    std::optional<common::WriteBehind> write_behind;
+    FileProgress progress{options.progress, destination_str};
+    if (options.no_cache) {
+        progress.write_behind = &write_behind.emplace(out_fd, in_fd);
+    }
+    CopyMethod method = copy_file_data(in_fd, out_fd, static_cast<uint64_t>(source_stat.st_size), progress, source, destination);
+    result.bytes_written = progress.copied;
+    if (write_behind) {
+        write_behind->finish();
+    }
+
+    // open() only applies the mode to a new file, and then minus the umask; an
+    // overwritten file would keep its own. Set after the data, as writing clears set-ID bits.
+    {
+        common::ScopedOpTimer timer(common::StatOp::Chmod);
+        if (::fchmod(out_fd, source_stat.st_mode & 07777) != 0) {
+            throw common::make_errno_error("Failed to set mode", destination, errno);
+        }
+    }
+
+    if (out.close() != 0) {
+        throw common::make_errno_error("Failed to finish writing", destination, errno);
+    }
+    return method;
+}
+
+class TreeCopy;
+
+// A directory being copied. Every task working below it holds a reference, so
+// when the last one finishes the destructor can apply the directory's own mode
+// and timestamps, which writing its entries would otherwise disturb.
+struct DirNode {
+    TreeCopy* tree = nullptr;
+    std::shared_ptr<DirNode> parent;
+    int source_fd = -1;
+    int destination_fd = -1;
+    std::string source_path;
+    std::string destination_path;
+    struct stat source_stat;
+
+    ~DirNode();
+};
+
+struct FileEntry {
+    std::string name;
+    struct stat source_stat;
+};
+
+// Copies a directory tree with a pool of workers. Directories are enumerated
+// by workers as well; each one is created before any task that copies into it
+// is queued. Entries are opened relative to their parent's directory fds, so
+// paths are only built for messages. The task queue is capped: once it is
+// full, the thread that wanted to queue work runs it instead, which keeps
+// memory bounded however large the tree is. Open directories are capped too:
+// past the DirectoryBudget a subdirectory is entered only once another one is
+// finished, which keeps the fds bounded.
+class TreeCopy {
+public:
+    TreeCopy(const CopyOptions& options, size_t workers)
+        : m_options(options),
+          m_pool(workers),
+          m_output_context(common::current_output_context()),
+          m_max_queued(m_pool.size() * queued_tasks_per_worker),
+          m_budget(fds_per_directory, reserved_fds + m_pool.size() * (fds_per_worker + common::perf_counter_fds_per_thread())) {
+        if (m_options.progress) {
+            m_progress = [this](const ProgressEvent& event) { report(event); };
+        }
+    }
+
+    OperationResult run(const std::filesystem::path& source, const std::filesystem::path& destination);
+    void finish_directory(DirNode& node);
+    void directory_closed();
+
+private:
+    void report(const ProgressEvent& event) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_options.progress(event);
+    }
+
+    void succeed() {
+        m_entries.fetch_add(1, std::memory_order_relaxed);
+        common::count(common::StatCounter::EntriesVisited);
+    }
+
+    void fail(const std::string& path, const std::string& message) {
+        m_entries.fetch_add(1, std::memory_order_relaxed);
+        m_failed.fetch_add(1, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_errors.size() < max_recorded_errors) {
+                m_errors.push_back({path, message});
+            }
+        }
+        if (m_progress) {
+            m_progress({ProgressKind::EntryFailed, path, 0, message});
+        }
+    }
+
+    void fail_errno(const std::string& what, const std::string& path, int error_code) {
+        common::record_error(error_code);
+        fail(path, what + ": " + common::get_system_error_message(static_cast<unsigned long>(error_code)));
+    }
+
+    void schedule(std::function<void()> task);
+    void queue(std::function<void()> task);
+    void run_task(const std::function<void()>& task);
+    void enter_directory(const std::shared_ptr<DirNode>& parent, const std::string& name, const struct stat& source_stat);
+    void open_and_copy_directory(const std::shared_ptr<DirNode>& parent, const std::string& name, const struct stat& source_stat);
+    std::shared_ptr<DirNode> open_directory(const std::shared_ptr<DirNode>& parent, const std::string& name, const struct stat& source_stat);
+    void copy_directory(const std::shared_ptr<DirNode>& node);
+    void copy_files(const std::shared_ptr<DirNode>& node, const std::vector<FileEntry>& files);
+    void copy_file(DirNode& node, const FileEntry& file);
+    void copy_symlink(DirNode& node, const std::string& name, const struct stat& source_stat);
+    bool apply_metadata(int fd, const struct stat& source_stat, const std::string& path);
+
+    const CopyOptions& m_options;
+    common::ThreadPool m_pool;
+    common::OutputContext m_output_context;
+    size_t m_max_queued;
+    std::atomic<size_t> m_queued{0};
+    common::DirectoryBudget m_budget;
+    ProgressCallback m_progress;         // Serialized wrapper around m_options.progress
+
+    std::atomic<uint64_t> m_entries{0};
+    std::atomic<uint64_t> m_failed{0};
+    std::atomic<uint64_t> m_bytes{0};
+    std::mutex m_mutex;                  // Guards m_errors and calls into m_options.progress
+    std::vector<EntryError> m_errors;
+
+    dev_t m_destination_dev = 0;         // The destination root is skipped if it lies inside the source
+    ino_t m_destination_ino = 0;
+};
+
+DirNode::~DirNode() {
+    if (tree) {
+        tree->finish_directory(*this);
+    }
+    if (source_fd >= 0) ::close(source_fd);
+    if (destination_fd >= 0) ::close(destination_fd);
+    if (tree) {
+        tree->directory_closed();
+    }
+}
+
+void TreeCopy::run_task(const std::function<void()>& task) {
+    try {
+        task();
+    } catch (const std::exception& e) {
+        fail({}, e.what());
+    }
+}
+
+void TreeCopy::schedule(std::function<void()> task) {
+    if (m_queued.load(std::memory_order_relaxed) >= m_max_queued) {
+        run_task(task); // Caller runs: keeps the queue, and memory, bounded
+        return;
+    }
+    queue(std::move(task));
+}
+
+void TreeCopy::queue(std::function<void()> task) {
+    m_queued.fetch_add(1, std::memory_order_relaxed);
+    m_pool.submit([this, task = std::move(task)] {
+        m_queued.fetch_sub(1, std::memory_order_relaxed);
+        common::ScopedOutputContext context(m_output_context);
+        run_task(task);
+    });
+}
+
+// Applies ownership, mode and timestamps through an open fd, so no path is resolved again.
+// Ownership is only changed when it differs and silently kept when not permitted.
+bool TreeCopy::apply_metadata(int fd, const struct stat& source_stat, const std::string& path) {
+    common::TraceScope trace("copy.metadata");
+    if (source_stat.st_uid != ::geteuid() || source_stat.st_gid != ::getegid()) {
+        common::ScopedOpTimer timer(common::StatOp::Chown);
+        if (::fchown(fd, source_stat.st_uid, source_stat.st_gid) != 0 && errno != EPERM) {
+            fail_errno("Failed to set owner", path, errno);
+            return false;
+        }
+    }
+    {
+        common::ScopedOpTimer timer(common::StatOp::Chmod);
+        if (::fchmod(fd, source_stat.st_mode & 07777) != 0) {
+            fail_errno("Failed to set mode", path, errno);
+            return false;
+        }
+    }
+    struct timespec times[2] = {source_stat.st_atim, source_stat.st_mtim};
+    if (::futimens(fd, times) != 0) {
+        fail_errno("Failed to set timestamps", path, errno);
+        return false;
+    }
+    return true;
+}
+
+// Called once a directory's fds are closed; a deferred directory takes over its slot.
+// It is always queued, never run here, since this runs from a DirNode destructor.
+void TreeCopy::directory_closed() {
+    if (auto next = m_budget.release()) {
+        queue(std::move(next));
+    }
+}
+
+void TreeCopy::finish_directory(DirNode& node) {
+    try {
+        apply_metadata(node.destination_fd, node.source_stat, node.destination_path);
+    } catch (const std::exception& e) {
+        fail(node.destination_path, e.what());
+    }
+}
+
+void TreeCopy::enter_directory(const std::shared_ptr<DirNode>& parent, const std::string& name, const struct stat& source_stat) {
+    if (!m_budget.acquire_or_defer([this, parent, name, source_stat] { open_and_copy_directory(parent, name, source_stat); })) {
+        return; // Entered once another directory is closed
+    }
+    if (auto child = open_directory(parent, name, source_stat)) {
+        schedule([this, child] { copy_directory(child); });
+    } else {
+        directory_closed();
+    }
+}
+
+// Runs a deferred subdirectory, whose slot in the budget is already taken.
+void TreeCopy::open_and_copy_directory(const std::shared_ptr<DirNode>& parent, const std::string& name, const struct stat& source_stat) {
+    if (auto child = open_directory(parent, name, source_stat)) {
+        copy_directory(child);
+    } else {
+        directory_closed();
+    }
+}
+
+std::shared_ptr<DirNode> TreeCopy::open_directory(const std::shared_ptr<DirNode>& parent, const std::string& name, const struct stat& source_stat) {
+    std::string source_path = parent->source_path + "/" + name;
+    std::string destination_path = parent->destination_path + "/" + name;
+
+    int result;
+    {
+        // Owner-only until finished, so the copy is never exposed with looser permissions
+        common::ScopedOpTimer timer(common::StatOp::Mkdir);
+        result = ::mkdirat(parent->destination_fd, name.c_str(), S_IRWXU);
+    }
+    if (result != 0 && errno != EEXIST) {
+        fail_errno("Failed to create directory", destination_path, errno);
+        return nullptr;
+    }
+
+    int source_fd;
+    int destination_fd;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Open);
+        source_fd = ::openat(parent->source_fd, name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    }
+    if (source_fd < 0) {
+        fail_errno("Failed to open directory", source_path, errno);
+        return nullptr;
+    }
+    {
+        common::ScopedOpTimer timer(common::StatOp::Open);
+        destination_fd = ::openat(parent->destination_fd, name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    }
+    if (destination_fd < 0) {
+        int error_code = errno;
+        ::close(source_fd);
+        fail_errno("Failed to open directory", destination_path, error_code);
+        return nullptr;
+    }
+
+    auto node = std::make_shared<DirNode>();
+    node->parent = parent;
+    node->source_fd = source_fd;
+    node->destination_fd = destination_fd;
+    node->source_path = std::move(source_path);
+    node->destination_path = std::move(destination_path);
+    node->source_stat = source_stat;
+    node->tree = this;
+    common::track_directory(node->destination_path);
+
+    succeed();
+    if (m_progress) {
+        m_progress({ProgressKind::Created, node->destination_path, 0, {}});
+    }
+    return node;
+}
+
+void TreeCopy::copy_directory(const std::shared_ptr<DirNode>& node) {
+    common::TraceScope trace("copy.directory", node->source_path);
+
+    int listing_fd = ::dup(node->source_fd); // fdopendir takes ownership; the node keeps its own fd
+    DIR* dir = listing_fd >= 0 ? ::fdopendir(listing_fd) : nullptr;
+    if (!dir) {
+        int error_code = errno;
+        if (listing_fd >= 0) ::close(listing_fd);
+        fail_errno("Failed to read directory", node->source_path, error_code);
+        return;
+    }
+
+    std::vector<FileEntry> batch;
+    uint64_t batch_bytes = 0;
+    auto flush_batch = [&] {
+        if (batch.empty()) return;
+        schedule([this, node, files = std::move(batch)] { copy_files(node, files); });
+        batch.clear();
+        batch_bytes = 0;
+    };
+
+    while (true) {
+        errno = 0;
+        dirent* entry = ::readdir(dir);
+        if (!entry) {
+            if (errno != 0) {
+                fail_errno("Failed to read directory", node->source_path, errno);
+            }
+            break;
+        }
+        const char* name = entry->d_name;
+        if (std::strcmp(name, ".") == 0 || std::strcmp(name, "..") == 0) {
+            continue;
+        }
+
+        struct stat source_stat;
+        int result;
+        {
+            common::ScopedOpTimer timer(common::StatOp::Stat);
+            result = ::fstatat(node->source_fd, name, &source_stat, AT_SYMLINK_NOFOLLOW);
+        }
+        if (result != 0) {
+            fail_errno("Failed to stat", node->source_path + "/" + name, errno);
+            continue;
+        }
+
+        if (S_ISDIR(source_stat.st_mode)) {
+            if (source_stat.st_dev == m_destination_dev && source_stat.st_ino == m_destination_ino) {
+                continue; // Never copy the destination into itself
+            }
+            enter_directory(node, name, source_stat);
+        } else if (S_ISREG(source_stat.st_mode)) {
+            uint64_t size = static_cast<uint64_t>(source_stat.st_size);
+            if (size >= large_file_bytes) {
+                schedule([this, node, file = FileEntry{name, source_stat}] { copy_files(node, {file}); });
+                continue;
+            }
+            batch.push_back({name, source_stat});
+            batch_bytes += size;
+            if (batch.size() >= max_batch_files || batch_bytes >= max_batch_bytes) {
+                flush_batch();
+            }
+        } else if (S_ISLNK(source_stat.st_mode)) {
+            copy_symlink(*node, name, source_stat);
+        } else if (S_ISFIFO(source_stat.st_mode)) {
+            if (::mkfifoat(node->destination_fd, name, source_stat.st_mode & 07777) != 0 && errno != EEXIST) {
+                fail_errno("Failed to create FIFO", node->destination_path + "/" + name, errno);
+            } else {
+                succeed();
+            }
+        } else {
+            fail(node->source_path + "/" + name, "Unsupported file type, skipped");
+        }
+    }
+    ::closedir(dir);
+    flush_batch();
+}
+
+void TreeCopy::copy_files(const std::shared_ptr<DirNode>& node, const std::vector<FileEntry>& files) {
+    common::TraceScope trace("copy.batch", node->destination_path);
+    for (const auto& file : files) {
+        try {
+            copy_file(*node, file);
+        } catch (const std::exception& e) {
+            fail(node->destination_path + "/" + file.name, e.what());
+        }
+    }
+}
+
+void TreeCopy::copy_file(DirNode& node, const FileEntry& file) {
+    std::string source_path = node.source_path + "/" + file.name;
+    std::string destination_path = node.destination_path + "/" + file.name;
+
+    int in_fd;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Open);
+        in_fd = ::openat(node.source_fd, file.name.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    }
+    FileDescriptor in(in_fd);
+    if (in_fd < 0) {
+        fail_errno("Failed to open", source_path, errno);
+        return;
+    }
+
+    int out_fd;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Open);
+        out_fd = ::openat(node.destination_fd, file.name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    }
+    FileDescriptor out(out_fd);
+    if (out_fd < 0) {
+        fail_errno("Failed to create", destination_path, errno);
+        return;
+    }
+
+    std::optional<common::WriteBehind> write_behind;
+    FileProgress progress{m_progress, destination_path};
+    if (m_options.no_cache) {
+        progress.write_behind = &write_behind.emplace(out_fd, in_fd);
+    }
+    CopyMethod method = copy_file_data(in_fd, out_fd, static_cast<uint64_t>(file.source_stat.st_size), progress, source_path, destination_path);
+    m_bytes.fetch_add(progress.copied, std::memory_order_relaxed);
+    if (write_behind) {
+        write_behind->finish();
+    }
+
+    if (!apply_metadata(out_fd, file.source_stat, destination_path)) {
+        return;
+    }
+    if (out.close() != 0) {
+        fail_errno("Failed to finish writing", destination_path, errno);
+        return;
+    }
+    common::track_file(destination_path);
+
+    succeed();
+    if (m_progress) {
+        m_progress({ProgressKind::Copied, destination_path, progress.copied, copy_method_name(method)});
+    }
+}
+
+void TreeCopy::copy_symlink(DirNode& node, const std::string& name, const struct stat& source_stat) {
+    std::string destination_path = node.destination_path + "/" + name;
+
+    std::vector<char> target(static_cast<size_t>(source_stat.st_size > 0 ? source_stat.st_size : 4095) + 1);
+    ssize_t length = ::readlinkat(node.source_fd, name.c_str(), target.data(), target.size());
+    if (length < 0) {
+        fail_errno("Failed to read link", node.source_path + "/" + name, errno);
+        return;
+    }
+    target[std::min(static_cast<size_t>(length), target.size() - 1)] = '\0';
+
+    int result;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Symlink);
+        result = ::symlinkat(target.data(), node.destination_fd, name.c_str());
+        if (result != 0 && errno == EEXIST && ::unlinkat(node.destination_fd, name.c_str(), 0) == 0) {
+            result = ::symlinkat(target.data(), node.destination_fd, name.c_str());
+        }
+    }
+    if (result != 0) {
+        fail_errno("Failed to create symlink", destination_path, errno);
+        return;
+    }
+
+    if (source_stat.st_uid != ::geteuid() || source_stat.st_gid != ::getegid()) {
+        ::fchownat(node.destination_fd, name.c_str(), source_stat.st_uid, source_stat.st_gid, AT_SYMLINK_NOFOLLOW);
+    }
+    struct timespec times[2] = {source_stat.st_atim, source_stat.st_mtim};
+    ::utimensat(node.destination_fd, name.c_str(), times, AT_SYMLINK_NOFOLLOW);
+
+    succeed();
+    if (m_progress) {
+        m_progress({ProgressKind::Linked, destination_path, 0, {}});
+    }
+}
+
+OperationResult TreeCopy::run(const std::filesystem::path& source, const std::filesystem::path& destination) {
+    auto root = std::make_shared<DirNode>();
+    root->source_path = source.string();
+    root->destination_path = destination.string();
+
+    root->source_fd = ::open(source.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root->source_fd < 0) {
+        throw common::make_errno_error("Failed to open source directory", source, errno);
+    }
+    if (::fstat(root->source_fd, &root->source_stat) != 0) {
+        throw common::make_errno_error("Failed to stat source directory", source, errno);
+    }
+    if (::mkdir(destination.c_str(), S_IRWXU) != 0 && errno != EEXIST) {
+        throw common::make_errno_error("Failed to create directory", destination, errno);
+    }
+    root->destination_fd = ::open(destination.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root->destination_fd < 0) {
+        throw common::make_errno_error("Failed to open destination directory", destination, errno);
+    }
+
+    struct stat destination_stat;
+    if (::fstat(root->destination_fd, &destination_stat) == 0) {
+        if (destination_stat.st_dev == root->source_stat.st_dev && destination_stat.st_ino == root->source_stat.st_ino) {
+            throw common::IOCreateError("Source and destination are the same directory: '" + source.string() + "'.");
+        }
+        m_destination_dev = destination_stat.st_dev;
+        m_destination_ino = destination_stat.st_ino;
+    }
+
+    root->tree = this;
+    m_budget.acquire();
+    common::track_directory(root->destination_path);
+    succeed();
+    if (m_progress) {
+        m_progress({ProgressKind::Created, root->destination_path, 0, {}});
+    }
+
+    schedule([this, root] { copy_directory(root); });
+    root.reset();
+    m_pool.wait_idle();
+    // Directories deferred below a chain of open ones deeper than the budget
+    while (auto next = m_budget.take_stalled()) {
+        queue(std::move(next));
+        m_pool.wait_idle();
+    }
+
+    OperationResult result;
+    result.entries_processed = m_entries.load();
+    result.entries_failed = m_failed.load();
+    result.bytes_written = m_bytes.load();
+    result.errors = std::move(m_errors);
+    return result;
+}
+#endif
+
+} // namespace
+
+const char* copy_method_name(CopyMethod method) {
+    switch (method) {
+        case CopyMethod::Reflink: return "reflink";
+        case CopyMethod::CopyFileRange: return "copy_file_range";
+        case CopyMethod::Sendfile: return "sendfile";
+        case CopyMethod::Platform: return "platform";
+        case CopyMethod::Buffered: return "buffered";
+    }
+    return "unknown";
+}
+
+#if !defined(_WIN32)
+CopyMethod copy_file_contents(int in_fd, int out_fd, uint64_t size, const std::filesystem::path& source,
+                              const std::filesystem::path& destination, uint64_t& bytes_copied) {
+    ProgressCallback no_progress;
+    std::string path = destination.string();
+    FileProgress progress{no_progress, path};
+    CopyMethod method = copy_file_data(in_fd, out_fd, size, progress, source, destination);
+    bytes_copied += progress.copied;
+    return method;
+}
+#endif
+
+OperationResult perform_copy(const CopyOptions& options) {
+    common::ScopedPerfCounters counters(common::PerfPhase::Copy);
+    auto start_time = std::chrono::steady_clock::now();
+    OperationResult result;
+
+    std::filesystem::path destination = options.destination;
+    CopyMethod method = CopyMethod::Buffered;
+    try {
+        {
+            common::TraceScope trace("copy.resolve_path");
+            std::error_code ec;
+            if (std::filesystem::is_directory(destination, ec)) {
+                std::filesystem::path name = options.source.has_filename() ? options.source.filename() : options.source.parent_path().filename();
+                destination /= name;
+            }
+        }
+
+        if (options.recursive) {
+            std::error_code ec;
+            if (!std::filesystem::is_directory(options.source, ec)) {
+                throw common::IOCreateError("Source is not a directory: '" + options.source.string() + "'.");
+            }
+#if defined(_WIN32)
+            std::filesystem::copy(options.source, destination,
+                                  std::filesystem::copy_options::recursive |
+                                  std::filesystem::copy_options::copy_symlinks |
+                                  std::filesystem::copy_options::overwrite_existing);
+            result.entries_processed = 1;
+#else
+            size_t workers = options.jobs == 0 ? common::default_worker_count() : options.jobs;
+            TreeCopy tree(options, workers);
+            result = tree.run(options.source, destination);
+#endif
+            common::track_new_entry(destination);
+            result.elapsed = std::chrono::steady_clock::now() - start_time;
+            return result;
+        }
+
+#if defined(_WIN32)
+        {
+            common::ScopedOpTimer timer(common::StatOp::Write);
+            if (!CopyFileW(options.source.c_str(), destination.c_str(), FALSE)) {
+                throw common::make_errno_error("Failed to copy file to", destination, static_cast<int>(GetLastError()));
+            }
+        }
+        method = CopyMethod::Platform;
+        result.bytes_written = std::filesystem::file_size(destination);
+        common::count(common::StatCounter::BytesWritten, result.bytes_written);
+#else
+        method = copy_file_posix(options, destination, result);
+#endif
+        common::track_file(destination);
+        common::track_new_entry(destination);
+    } catch (const common::IOCreateError&) {
+        throw;
+    } catch (const std::filesystem::filesystem_error& e) {
+        common::record_error(e.code().value());
+        throw common::IOCreateError("Filesystem error: " + std::string(e.what()));
+    } catch (const std::exception& e) {
+        throw common::IOCreateError("An unexpected error occurred: " + std::string(e.what()));
+    }
+
+    result.entries_processed = 1;
+    common::count(common::StatCounter::EntriesVisited);
+    if (options.progress) {
+        options.progress({ProgressKind::Copied, destination.string(), result.bytes_written, copy_method_name(method)});
+    }
+    result.elapsed = std::chrono::steady_clock::now() - start_time;
+    return result;
+}
+
+void handle_copy(
+    const std::string& source,
+    const std::string& destination,
+    bool recursive,
+    const std::string& jobs,
+    bool no_cache,
+    bool output_enabled
+) {
+    common::TraceScope trace("copy");
+    bool text_output = output_enabled && common::output_format() == common::OutputFormat::Text;
+    if (text_output) {
+        common::out() << "Settings for io copy:" << '\n';
+        common::out() << "  Source: " << source << '\n';
+        common::out() << "  Destination: " << destination << '\n';
+        common::out() << "  Recursive: " << (recursive ? "true" : "false") << '\n';
+        if (no_cache) common::out() << "  No Cache: true" << '\n';
+    }
+
+    CopyOptions options;
+    options.source = source;
+    options.destination = destination;
+    options.recursive = recursive;
+    options.no_cache = no_cache;
+    if (!jobs.empty()) {
+        try {
+            options.jobs = std::stoul(jobs);
+        } catch (const std::exception&) {
+            throw common::IOCreateError("Invalid value for --jobs: \"" + jobs + "\"");
+        }
+    }
+    bool structured = common::output_format() != common::OutputFormat::Text;
+    options.progress = [&source, text_output, structured, recursive](const ProgressEvent& event) {
+        if (structured) {
+            emit_progress_record("copy", event);
+        } else if (event.kind == ProgressKind::EntryFailed) {
+            common::err() << "Error copying " << event.path << ": " << event.message << std::endl;
+        } else if (text_output && event.kind == ProgressKind::Copied) {
+            common::out() << "File copied: " << (recursive ? event.path : source + " -> " + event.path)
+                          << " (" << event.bytes << " bytes, " << event.message << ")" << '\n';
+        }
+    };
+
+    OperationResult result = perform_copy(options);
+    emit_result_record("copy", result);
+
+    if (!result.ok()) {
+        throw common::IOCreateError(std::to_string(result.entries_failed) + " of " + std::to_string(result.entries_processed) + " entries could not be copied.");
+    }
+    if (text_output && recursive) {
+        common::out() << "Copied " << result.entries_processed << " entries (" << result.bytes_written << " bytes) to " << destination << '\n';
+    }
+}
+
+} // namespace allin1::io
@@ -1,11 +1,24 @@
 #include "io/create.hpp"
 #include "common/string_utils.hpp"
+#include "common/atomic_file.hpp"
 #include "common/error_utils.hpp"
+#include "common/durability.hpp"
 #include "common/errors.hpp"
+#include "common/output.hpp"
+#include "common/page_cache.hpp"
+#include "common/perf_counters.hpp"
+#include "common/rate_limit.hpp"
+#include "common/stats.hpp"
+#include "common/trace.hpp"
 
 #include <iostream>
 #include <filesystem>
 #include <fstream>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <optional>
 #include <vector>
 #include <string>
 
@@ -13,114 +26,396 @@
 #include <windows.h> // For GetLastError()
 #else
 #include <cerrno> // For errno
+#include <fcntl.h>
+#include <unistd.h>
 #endif
 
 namespace allin1::io {
 
-void handle_create(
-    const std::string& type,
-    const std::string& path_str,
-    const std::string& name,
-    const std::string& fill_str,
-    const std::string& fill_size_str,
-    bool output_enabled
-) {
+namespace {
+
+unsigned long last_error_code() {
+#if defined(_WIN32)
+    return GetLastError();
+#else
+    return errno;
+#endif
+}
+
+// Fill progress is reported at this granularity rather than per buffer
+constexpr uint64_t progress_interval_bytes = 64ull * 1024 * 1024;
+
+// Read-back verification reads in large aligned blocks, as O_DIRECT requires
+constexpr size_t verify_buffer_bytes = 4 * 1024 * 1024;
+constexpr size_t verify_buffer_alignment = 4096;
+
+struct FillVerification {
+    uint64_t bytes_read = 0;
+    uint64_t mismatches = 0;            // Differing bytes, including missing or extra ones
+    uint64_t first_mismatch = std::numeric_limits<uint64_t>::max();
+    const char* method = "";            // How the page cache was bypassed
+};
+
+// Compares one block with the pattern. memcmp against a pattern block is
+// vectorized by the C library; bytes are only examined one by one in blocks
+// that actually differ.
+void compare_block(const unsigned char* data, const unsigned char* pattern, size_t size, uint64_t offset, FillVerification& verification) {
+    if (std::memcmp(data, pattern, size) == 0) {
+        return;
+    }
+    for (size_t i = 0; i < size; ++i) {
+        if (data[i] != pattern[i]) {
+            if (verification.mismatches == 0) {
+                verification.first_mismatch = offset + i;
+            }
+            ++verification.mismatches;
+        }
+    }
+}
+
+#if !defined(_WIN32)
+// Reads the whole file with pread into buffer. Returns false if nothing could
+// be read because the filesystem rejects O_DIRECT reads.
+bool read_back(int fd, bool direct, unsigned char* buffer, const unsigned char* pattern, uint64_t expected_size,
+               const std::filesystem::path& path, FillVerification& verification) {
+    uint64_t offset = 0;
+    while (true) {
+        ssize_t n;
+        {
+            common::ScopedOpTimer timer(common::StatOp::Read);
+            n = ::pread(fd, buffer, verify_buffer_bytes, static_cast<off_t>(offset));
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (direct && errno == EINVAL && offset == 0) return false;
+            throw common::make_errno_error("Failed to read back file", path, errno);
+        }
+        if (n == 0) break;
+        common::count(common::StatCounter::BytesRead, static_cast<uint64_t>(n));
+
+        size_t size = static_cast<size_t>(n);
+        size_t expected = offset < expected_size ? static_cast<size_t>(std::min<uint64_t>(size, expected_size - offset)) : 0;
+        compare_block(buffer, pattern, expected, offset, verification);
+        if (expected < size) {
+            // Bytes past the requested size
+            if (verification.mismatches == 0) {
+                verification.first_mismatch = offset + expected;
+            }
+            verification.mismatches += size - expected;
+        }
+        offset += size;
+    }
+    verification.bytes_read = offset;
+    if (offset < expected_size) {
+        if (verification.mismatches == 0) {
+            verification.first_mismatch = offset;
+        }
+        verification.mismatches += expected_size - offset;
+    }
+    return true;
+}
+#endif
+
+// Reads the file back from storage rather than from the page cache: with
+// O_DIRECT where the filesystem supports it, otherwise after writing the file
+// back and dropping its cached pages.
+FillVerification verify_fill(const std::filesystem::path& path, unsigned char fill_byte, uint64_t expected_size) {
+    common::TraceScope trace("create.verify", path.string());
+    FillVerification verification;
+    std::vector<unsigned char> pattern(verify_buffer_bytes, fill_byte);
+
+#if defined(_WIN32)
+    // FILE_FLAG_NO_BUFFERING would need sector-aligned reads; the data is read back through the cache
+    verification.method = "buffered";
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw common::make_errno_error("Failed to open file for verification", path, last_error_code());
+    }
+    std::vector<unsigned char> buffer(verify_buffer_bytes);
+    uint64_t offset = 0;
+    while (in) {
+        in.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+        size_t size = static_cast<size_t>(in.gcount());
+        if (size == 0) break;
+        common::count(common::StatCounter::BytesRead, size);
+        size_t expected = offset < expected_size ? static_cast<size_t>(std::min<uint64_t>(size, expected_size - offset)) : 0;
+        compare_block(buffer.data(), pattern.data(), expected, offset, verification);
+        if (expected < size) {
+            if (verification.mismatches == 0) verification.first_mismatch = offset + expected;
+            verification.mismatches += size - expected;
+        }
+        offset += size;
+    }
+    verification.bytes_read = offset;
+    if (offset < expected_size) {
+        if (verification.mismatches == 0) verification.first_mismatch = offset;
+        verification.mismatches += expected_size - offset;
+    }
+#else
+    void* memory = nullptr;
+    if (::posix_memalign(&memory, verify_buffer_alignment, verify_buffer_bytes) != 0) {
+        throw std::bad_alloc();
+    }
+    std::unique_ptr<unsigned char, decltype(&std::free)> buffer(static_cast<unsigned char*>(memory), &std::free);
+
+#if defined(O_DIRECT)
+    int direct_fd;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Open);
+        direct_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT);
+    }
+    if (direct_fd >= 0) {
+        verification.method = "O_DIRECT";
+        bool done = read_back(direct_fd, true, buffer.get(), pattern.data(), expected_size, path, verification);
+        ::close(direct_fd);
+        if (done) {
+            return verification;
+        }
+        verification = FillVerification{};
+    }
+#endif
+
+    int fd;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Open);
+        fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    if (fd < 0) {
+        throw common::make_errno_error("Failed to open file for verification", path, errno);
+    }
+    // Dirty pages cannot be dropped, so they are written back first
+    {
+        common::ScopedOpTimer timer(common::StatOp::Fsync);
+        ::fdatasync(fd);
+    }
+    verification.method = "fadvise";
+#if defined(POSIX_FADV_DONTNEED)
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
     try {
-        if (output_enabled) {
-            std::cout << "Settings for io create:" << std::endl;
-            std::cout << "  Type: " << type << std::endl;
-            std::cout << "  Path: " << path_str << std::endl;
-            std::cout << "  Name: " << name << std::endl;
-            if (!fill_str.empty()) std::cout << "  Fill: " << fill_str << std::endl;
-            if (!fill_size_str.empty()) std::cout << "  Fill Size: " << fill_size_str << std::endl;
+        read_back(fd, false, buffer.get(), pattern.data(), expected_size, path, verification);
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+    ::close(fd);
+#endif
+    return verification;
+}
+
+#if !defined(_WIN32)
+// Block size O_DIRECT writes are kept aligned to (a multiple of any logical block size)
+constexpr size_t direct_alignment = 4096;
+constexpr size_t uncached_fill_bytes = 4 * 1024 * 1024;
+
+// Writes the fill without leaving it in the page cache: with O_DIRECT from an
+// aligned buffer where the filesystem allows it, otherwise (and for an
+// unaligned tail) through the cache, flushed and dropped behind a fixed window.
+// The file is opened at write_path (a staging path for atomic creation).
+void fill_uncached(const CreateOptions& options, const std::filesystem::path& write_path, OperationResult& result) {
+    const std::filesystem::path& path = options.path;
+    common::TraceScope fill_trace("create.fill", path.string());
+    common::ScopedPerfCounters fill_counters(common::PerfPhase::Fill);
+
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    int fd = -1;
+    bool direct = false;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Open);
+#if defined(O_DIRECT)
+        fd = ::open(write_path.c_str(), flags | O_DIRECT, 0666);
+        direct = fd >= 0;
+#endif
+        if (fd < 0) {
+            fd = ::open(write_path.c_str(), flags, 0666);
         }
+    }
+    if (fd < 0) {
+        throw common::make_errno_error("Failed to create file", path, errno);
+    }
+    struct FdGuard {
+        int& fd;
+        ~FdGuard() {
+            if (fd >= 0) ::close(fd);
+        }
+    } fd_guard{fd};
 
-        std::filesystem::path full_path = std::filesystem::path(path_str) / name;
+    void* memory = nullptr;
+    if (::posix_memalign(&memory, direct_alignment, uncached_fill_bytes) != 0) {
+        throw std::bad_alloc();
+    }
+    std::unique_ptr<unsigned char, decltype(&std::free)> buffer(static_cast<unsigned char*>(memory), &std::free);
+    {
+        common::TraceScope trace("create.fill_buffer");
+        std::memset(buffer.get(), options.fill_byte, uncached_fill_bytes);
+    }
 
-        bool use_fill = !fill_str.empty();
-        bool use_fill_size = !fill_size_str.empty();
+    auto leave_direct_mode = [&] {
+#if defined(O_DIRECT)
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) & ~O_DIRECT);
+#endif
+        direct = false;
+    };
 
-        if (use_fill != use_fill_size) {
-            throw common::IOCreateError("--fill and --fill-size must be used together.");
+    common::WriteBehind write_behind(fd);
+    uint64_t next_progress = progress_interval_bytes;
+    while (result.bytes_written < options.fill_size) {
+        size_t chunk = common::paced_chunk_bytes(uncached_fill_bytes, direct_alignment);
+        size_t request = static_cast<size_t>(std::min<uint64_t>(chunk, options.fill_size - result.bytes_written));
+        if (direct && request % direct_alignment != 0) {
+            leave_direct_mode();
         }
+        common::throttle_ops();
+        common::throttle_bytes(request);
+        ssize_t written;
+        {
+            common::ScopedOpTimer timer(common::StatOp::Write);
+            written = ::write(fd, buffer.get(), request);
+        }
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            if (direct && errno == EINVAL) {
+                leave_direct_mode(); // Opened, but the filesystem rejects direct writes
+                continue;
+            }
+            throw common::make_errno_error("Failed to write to file", path, errno);
+        }
+        result.bytes_written += static_cast<uint64_t>(written);
+        common::count(common::StatCounter::BytesWritten, static_cast<uint64_t>(written));
+        if (!direct) {
+            write_behind.advance(result.bytes_written);
+        }
+        if (options.progress && result.bytes_written >= next_progress) {
+            options.progress({ProgressKind::BytesWritten, path.string(), result.bytes_written, {}});
+            next_progress += progress_interval_bytes;
+        }
+    }
+    write_behind.finish();
+
+    int result_code = ::close(fd);
+    fd = -1;
+    if (result_code != 0) {
+        throw common::make_errno_error("Failed to finish writing file", path, errno);
+    }
+}
+#endif
+
+} // namespace
 
-        if ((type == "directory") || (type == "folder")) {
-            if (use_fill) {
+OperationResult perform_create(const CreateOptions& options) {
+    common::ScopedPerfCounters counters(common::PerfPhase::Create);
+    auto start_time = std::chrono::steady_clock::now();
+    OperationResult result;
+    const std::filesystem::path& full_path = options.path;
+    const std::string full_path_str = full_path.string();
+    std::string published_with;
+
+    try {
+        if (options.type == CreateType::Directory) {
+            if (options.fill) {
                 throw common::IOCreateError("--fill and --fill-size can only be used with type 'file'.");
             }
-            std::filesystem::create_directories(full_path);
-            if (output_enabled) {
-                std::cout << "Directory created: " << full_path.string() << std::endl;
+            if (options.atomic) {
+                throw common::IOCreateError("--atomic can only be used with type 'file'.");
             }
-        } else if (type == "file") {
+            {
+                common::ScopedOpTimer timer(common::StatOp::Mkdir);
+                std::filesystem::create_directories(full_path);
+            }
+            common::track_new_entry(full_path);
+        } else {
             if (full_path.has_parent_path()) {
+                common::TraceScope trace("create.mkdir_parents", full_path_str);
+                common::ScopedOpTimer timer(common::StatOp::Mkdir);
                 std::filesystem::create_directories(full_path.parent_path());
             }
 
-            std::ofstream file(full_path, std::ios::binary | std::ios::out);
-            if (!file) {
-                unsigned long error_code = 0;
-#if defined(_WIN32)
-                error_code = GetLastError();
-#else
-                error_code = errno;
-#endif
-                std::string sys_msg = common::get_system_error_message(error_code);
-                std::string ctx_msg = common::get_contextual_error_message(error_code);
-                std::string final_msg = "Failed to create file '" + full_path.string() + "'. Code: " + std::to_string(error_code) + ": " + sys_msg;
-                if (!ctx_msg.empty()) {
-                    final_msg += ". Suggestion: " + ctx_msg;
-                }
-                throw common::IOCreateError(final_msg);
+            // Built out of sight and published complete by commit() below
+            std::optional<common::AtomicFile> atomic;
+            if (options.atomic) {
+                atomic.emplace(full_path);
             }
+            const std::filesystem::path& write_path = atomic ? atomic->write_path() : full_path;
 
-            if (use_fill) {
-                uint64_t size_bytes;
-                unsigned char fill_byte;
-                try {
-                    size_bytes = common::parse_size(fill_size_str);
-                    fill_byte = common::parse_hex_byte(fill_str);
-                } catch (const common::StringSizeParseError& e) {
-                    throw common::IOCreateError("Error parsing size argument: " + std::string(e.what()));
-                } catch (const common::HexByteParseError& e) {
-                    throw common::IOCreateError("Error parsing fill argument: " + std::string(e.what()));
+#if !defined(_WIN32)
+            if (options.fill && options.no_cache) {
+                fill_uncached(options, write_path, result);
+            } else
+#endif
+            {
+                std::ofstream file;
+                {
+                    common::ScopedOpTimer timer(common::StatOp::Open);
+                    file.open(write_path, std::ios::binary | std::ios::out);
+                }
+                if (!file) {
+                    throw common::make_errno_error("Failed to create file", full_path, last_error_code());
                 }
 
-                const size_t buffer_size = 4096;
-                std::vector<char> buffer(buffer_size, static_cast<char>(fill_byte));
-                
-                uint64_t remaining_bytes = size_bytes;
-                while (remaining_bytes > 0) {
-                    size_t bytes_to_write = std::min((uint64_t)buffer_size, remaining_bytes);
-                    file.write(buffer.data(), bytes_to_write);
-                    if (!file) {
-                         unsigned long error_code = 0;
-#if defined(_WIN32)
-                        error_code = GetLastError();
-#else
-                        error_code = errno;
-#endif
-                        std::string sys_msg = common::get_system_error_message(error_code);
-                        std::string ctx_msg = common::get_contextual_error_message(error_code);
-                        std::string final_msg = "Failed to write to file '" + full_path.string() + "'. Code: " + std::to_string(error_code) + ": " + sys_msg;
-                        if (!ctx_msg.empty()) {
-                            final_msg += ". Suggestion: " + ctx_msg;
+                if (options.fill) {
+                    common::TraceScope fill_trace("create.fill", full_path_str);
+                    common::ScopedPerfCounters fill_counters(common::PerfPhase::Fill);
+                    const size_t buffer_size = 4096;
+                    std::vector<char> buffer;
+                    {
+                        common::TraceScope trace("create.fill_buffer");
+                        buffer.assign(buffer_size, static_cast<char>(options.fill_byte));
+                    }
+
+                    uint64_t remaining_bytes = options.fill_size;
+                    uint64_t next_progress = progress_interval_bytes;
+                    while (remaining_bytes > 0) {
+                        size_t bytes_to_write = std::min((uint64_t)buffer_size, remaining_bytes);
+                        common::throttle_ops();
+                        common::throttle_bytes(bytes_to_write);
+                        {
+                            common::ScopedOpTimer timer(common::StatOp::Write);
+                            file.write(buffer.data(), bytes_to_write);
+                        }
+                        if (!file) {
+                            throw common::make_errno_error("Failed to write to file", full_path, last_error_code());
+                        }
+                        remaining_bytes -= bytes_to_write;
+                        result.bytes_written += bytes_to_write;
+                        common::count(common::StatCounter::BytesWritten, bytes_to_write);
+                        if (options.progress && result.bytes_written >= next_progress) {
+                            options.progress({ProgressKind::BytesWritten, full_path.string(), result.bytes_written, {}});
+                            next_progress += progress_interval_bytes;
                         }
-                        throw common::IOCreateError(final_msg);
                     }
-                    remaining_bytes -= bytes_to_write;
+                }
+
+                file.close();
+                if (!file) {
+                    throw common::make_errno_error("Failed to finish writing file", full_path, last_error_code());
+                }
+            }
+
+            if (options.verify) {
+                // Before publishing, so a bad fill never replaces a good file
+                FillVerification verification = verify_fill(write_path, options.fill_byte, options.fill_size);
+                result.bytes_read = verification.bytes_read;
+                if (verification.mismatches != 0) {
+                    throw common::IOCreateError("Verification of '" + full_path_str + "' failed: " +
+                                                std::to_string(verification.mismatches) + " of " + std::to_string(options.fill_size) +
+                                                " bytes differ from the fill pattern, first at offset " +
+                                                std::to_string(verification.first_mismatch) + ".");
+                }
+                if (options.progress) {
+                    options.progress({ProgressKind::Verified, full_path_str, verification.bytes_read, verification.method});
                 }
             }
-            if (output_enabled) {
-                std::cout << "File created: " << full_path.string() << std::endl;
+            if (atomic) {
+                atomic->commit();
+                published_with = atomic->method();
             }
-        } else {
-            throw common::IOCreateError("Invalid type: \"" + type + "\". Must be 'file', 'directory', or 'folder'.");
+            common::track_file(full_path);
+            common::track_new_entry(full_path);
         }
-
     } catch (const common::IOCreateError&) {
-        throw; // Re-throw to be caught in main
+        throw;
     } catch (const std::filesystem::filesystem_error& e) {
+        common::record_error(e.code().value());
         std::string sys_msg = common::get_system_error_message(e.code().value());
         std::string ctx_msg = common::get_contextual_error_message(e.code().value());
         std::string final_msg = "Filesystem error: " + std::string(e.what()) + ". " + sys_msg;
@@ -131,6 +426,103 @@ void handle_create(
     } catch (const std::exception& e) {
         throw common::IOCreateError("An unexpected error occurred: " + std::string(e.what()));
     }
+
+    result.entries_processed = 1;
+    common::count(common::StatCounter::EntriesVisited);
+    if (options.progress) {
+        options.progress({ProgressKind::Created, full_path.string(), result.bytes_written, published_with});
+    }
+    result.elapsed = std::chrono::steady_clock::now() - start_time;
+    return result;
+}
+
+void handle_create(
+    const std::string& type,
+    const std::string& path_str,
+    const std::string& name,
+    const std::string& fill_str,
+    const std::string& fill_size_str,
+    bool no_cache,
+    bool verify,
+    bool atomic,
+    bool output_enabled
+) {
+    common::TraceScope trace("create");
+    bool text_output = output_enabled && common::output_format() == common::OutputFormat::Text;
+    if (text_output) {
+        common::out() << "Settings for io create:" << '\n';
+        common::out() << "  Type: " << type << '\n';
+        common::out() << "  Path: " << path_str << '\n';
+        common::out() << "  Name: " << name << '\n';
+        if (!fill_str.empty()) common::out() << "  Fill: " << fill_str << '\n';
+        if (!fill_size_str.empty()) common::out() << "  Fill Size: " << fill_size_str << '\n';
+        if (no_cache) common::out() << "  No Cache: true" << '\n';
+        if (verify) common::out() << "  Verify: true" << '\n';
+        if (atomic) common::out() << "  Atomic: true" << '\n';
+    }
+
+    CreateOptions options;
+    {
+        common::TraceScope resolve_trace("create.resolve_path");
+        options.path = std::filesystem::path(path_str) / name;
+    }
+
+    bool use_fill = !fill_str.empty();
+    bool use_fill_size = !fill_size_str.empty();
+
+    if (use_fill != use_fill_size) {
+        throw common::IOCreateError("--fill and --fill-size must be used together.");
+    }
+
+    if ((type == "directory") || (type == "folder")) {
+        options.type = CreateType::Directory;
+    } else if (type == "file") {
+        options.type = CreateType::File;
+    } else {
+        throw common::IOCreateError("Invalid type: \"" + type + "\". Must be 'file', 'directory', or 'folder'.");
+    }
+
+    if (use_fill) {
+        try {
+            options.fill_size = common::parse_size(fill_size_str);
+            options.fill_byte = common::parse_hex_byte(fill_str);
+        } catch (const common::StringSizeParseError& e) {
+            throw common::IOCreateError("Error parsing size argument: " + std::string(e.what()));
+        } catch (const common::HexByteParseError& e) {
+            throw common::IOCreateError("Error parsing fill argument: " + std::string(e.what()));
+        }
+        options.fill = true;
+    }
+    if (verify && !use_fill) {
+        throw common::IOCreateError("--verify can only be used with --fill and --fill-size.");
+    }
+    if (no_cache && !use_fill) {
+        throw common::IOCreateError("--no-cache can only be used with --fill and --fill-size.");
+    }
+    options.no_cache = no_cache;
+    options.verify = verify;
+    options.atomic = atomic;
+
+    options.progress = [&options, text_output](const ProgressEvent& event) {
+        emit_progress_record("create", event);
+        if (text_output && event.kind == ProgressKind::Verified) {
+            common::out() << "File verified: " << event.path << " (" << event.bytes << " bytes read back, " << event.message << ")" << '\n';
+        }
+        if (!text_output || event.kind != ProgressKind::Created) {
+            return;
+        }
+        if (options.type == CreateType::Directory) {
+            common::out() << "Directory created: " << event.path << '\n';
+        } else {
+            common::out() << "File created: " << event.path;
+            if (!event.message.empty()) {
+                common::out() << " (published with " << event.message << ")";
+            }
+            common::out() << '\n';
+        }
+    };
+
+    emit_result_record("create", perform_create(options));
 }
 
 } // namespace allin1::io
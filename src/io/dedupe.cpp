@@ -0,0 +1,803 @@
+#include "io/dedupe.hpp"
+#include "common/atomic_file.hpp"
+#include "common/directory_budget.hpp"
+#include "common/durability.hpp"
+#include "common/error_utils.hpp"
+#include "common/errors.hpp"
+#include "common/output.hpp"
+#include "common/perf_counters.hpp"
+#include "common/stats.hpp"
+#include "common/string_utils.hpp"
+#include "common/thread_pool.hpp"
+#include "common/trace.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <linux/fs.h> // FIDEDUPERANGE
+#include <sys/ioctl.h>
+#endif
+
+namespace allin1::io {
+
+namespace {
+
+// Read from each end of a file by the second stage
+constexpr uint64_t end_block_bytes = 4096;
+constexpr size_t read_buffer_bytes = 1 << 20;
+// Longest range handed to FIDEDUPERANGE at once; btrfs caps a request at 16 MiB
+constexpr uint64_t dedupe_chunk_bytes = 16ull << 20;
+constexpr size_t max_recorded_errors = 1000;
+constexpr size_t queued_tasks_per_worker = 16;
+constexpr size_t inode_map_shards = 64;
+// The walk holds one descriptor per directory queued or being listed
+constexpr size_t fds_per_directory = 1;
+constexpr size_t reserved_fds = 32;
+
+#if !defined(_WIN32)
+struct DedupeFile {
+    std::vector<std::string> names;     // Every name of this inode below the root, sorted
+    uint64_t dev = 0;
+    uint64_t ino = 0;
+    uint64_t size = 0;
+    int64_t mtime_ns = 0;               // As found by the walk; a file that moves on is not linked
+    int64_t ctime_ns = 0;
+    std::string ends_digest;            // Hash of the first and last blocks (of all of it when small)
+    std::string digest;                 // Hash of the whole file
+    uint64_t bytes_read = 0;
+    std::string error;
+
+    const std::string& path() const { return names.front(); }
+    bool fully_read_by_ends() const { return size <= 2 * end_block_bytes; }
+};
+
+int64_t to_ns(const struct timespec& ts) {
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// True while st still describes file as it was found and hashed
+bool unchanged_since_walk(const DedupeFile& file, const struct stat& st) {
+    return static_cast<uint64_t>(st.st_ino) == file.ino && static_cast<uint64_t>(st.st_size) == file.size &&
+           to_ns(st.st_mtim) == file.mtime_ns && to_ns(st.st_ctim) == file.ctime_ns;
+}
+
+unsigned char* read_buffer() {
+    thread_local std::unique_ptr<unsigned char[]> buffer(new unsigned char[read_buffer_bytes]);
+    return buffer.get();
+}
+
+class ReadFile {
+public:
+    ReadFile(const std::string& path, bool sequential) : m_path(path) {
+        {
+            common::ScopedOpTimer timer(common::StatOp::Open);
+            m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        }
+        if (m_fd < 0) {
+            throw common::make_errno_error("Failed to open", path, errno);
+        }
+#if defined(POSIX_FADV_SEQUENTIAL)
+        ::posix_fadvise(m_fd, 0, 0, sequential ? POSIX_FADV_SEQUENTIAL : POSIX_FADV_RANDOM);
+#else
+        (void)sequential;
+#endif
+    }
+
+    ~ReadFile() { ::close(m_fd); }
+
+    // Throws if the file is no longer the one the walk found, so a file written
+    // while it was hashed is never taken for a duplicate
+    void check_unchanged(const DedupeFile& file) const {
+        struct stat st;
+        if (::fstat(m_fd, &st) != 0) {
+            throw common::make_errno_error("Failed to stat", m_path, errno);
+        }
+        if (!unchanged_since_walk(file, st)) {
+            throw common::IOCreateError("File changed while being hashed");
+        }
+    }
+
+    ReadFile(const ReadFile&) = delete;
+    ReadFile& operator=(const ReadFile&) = delete;
+
+    // Feeds [offset, offset + length) to hasher; returns the bytes read
+    uint64_t hash_range(common::Hasher& hasher, uint64_t offset, uint64_t length) {
+        unsigned char* buffer = read_buffer();
+        uint64_t total = 0;
+        while (total < length) {
+            size_t request = static_cast<size_t>(std::min<uint64_t>(read_buffer_bytes, length - total));
+            ssize_t n;
+            {
+                common::ScopedOpTimer timer(common::StatOp::Read);
+                n = ::pread(m_fd, buffer, request, static_cast<off_t>(offset + total));
+            }
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw common::make_errno_error("Failed to read", m_path, errno);
+            }
+            if (n == 0) {
+                break;
+            }
+            common::count(common::StatCounter::BytesRead, static_cast<uint64_t>(n));
+            hasher.update(buffer, static_cast<size_t>(n));
+            total += static_cast<uint64_t>(n);
+        }
+        return total;
+    }
+
+private:
+    std::string m_path;
+    int m_fd = -1;
+};
+
+// Stage two: the first and last blocks, which tell most same-size files apart
+// (differing headers, trailers or lengths of padding) for two small reads
+void hash_ends(DedupeFile& file, common::HashAlgorithm algorithm) {
+    common::TraceScope trace("dedupe.ends", file.path());
+    try {
+        ReadFile input(file.path(), false);
+        auto hasher = common::make_hasher(algorithm);
+        if (file.fully_read_by_ends()) {
+            file.bytes_read += input.hash_range(*hasher, 0, file.size);
+            file.ends_digest = hasher->hex_digest();
+            file.digest = file.ends_digest; // Nothing left to read in stage three
+        } else {
+            file.bytes_read += input.hash_range(*hasher, 0, end_block_bytes);
+            file.bytes_read += input.hash_range(*hasher, file.size - end_block_bytes, end_block_bytes);
+            file.ends_digest = hasher->hex_digest();
+        }
+        input.check_unchanged(file);
+    } catch (const std::exception& e) {
+        file.error = e.what();
+    }
+}
+
+// Stage three
+void hash_whole(DedupeFile& file, common::HashAlgorithm algorithm) {
+    common::TraceScope trace("dedupe.full", file.path());
+    try {
+        ReadFile input(file.path(), true);
+        auto hasher = common::make_hasher(algorithm);
+        uint64_t read = input.hash_range(*hasher, 0, file.size);
+        file.bytes_read += read;
+        if (read != file.size) {
+            file.error = "File changed size while being hashed";
+            return;
+        }
+        input.check_unchanged(file);
+        file.digest = hasher->hex_digest();
+        common::count(common::StatCounter::EntriesVisited);
+    } catch (const std::exception& e) {
+        file.error = e.what();
+    }
+}
+
+// Runs stage on every file with a pool of workers, largest files first so a
+// big file started last does not leave the other cores idle at the end
+void run_stage(std::vector<DedupeFile*>& files, size_t workers, const std::function<void(DedupeFile&)>& stage) {
+    std::sort(files.begin(), files.end(), [](const DedupeFile* a, const DedupeFile* b) { return a->size > b->size; });
+    common::ThreadPool pool(std::min(workers, files.size()));
+    for (DedupeFile* file : files) {
+        pool.submit([file, &stage] { stage(*file); });
+    }
+    pool.wait_idle();
+}
+
+// Splits files into runs of two or more that agree on key, dropping the rest
+template <typename Key>
+std::vector<std::vector<DedupeFile*>> group_by(std::vector<DedupeFile*> files, Key key) {
+    std::sort(files.begin(), files.end(), [&key](const DedupeFile* a, const DedupeFile* b) {
+        return std::make_tuple(key(*a), a->path()) < std::make_tuple(key(*b), b->path());
+    });
+    std::vector<std::vector<DedupeFile*>> groups;
+    for (size_t begin = 0; begin < files.size();) {
+        size_t end = begin + 1;
+        while (end < files.size() && key(*files[end]) == key(*files[begin])) {
+            ++end;
+        }
+        if (end - begin > 1) {
+            groups.emplace_back(files.begin() + static_cast<std::ptrdiff_t>(begin), files.begin() + static_cast<std::ptrdiff_t>(end));
+        }
+        begin = end;
+    }
+    return groups;
+}
+
+std::vector<DedupeFile*> flatten(const std::vector<std::vector<DedupeFile*>>& groups) {
+    std::vector<DedupeFile*> files;
+    for (const auto& group : groups) {
+        files.insert(files.end(), group.begin(), group.end());
+    }
+    return files;
+}
+
+// Regular files below root, one per inode, with all their names. Walks the
+// tree in the manner of du: workers list directories opened relative to their
+// parent, each entry costs one fstatat, the task queue is capped with the
+// caller running work itself once it is full, and open directories are capped
+// by a DirectoryBudget. A directory that cannot be opened or listed is
+// recorded as a failure and the rest of the tree is still examined.
+class DedupeWalk {
+public:
+    DedupeWalk(const DedupeOptions& options, size_t workers)
+        : m_options(options),
+          m_pool(workers),
+          m_output_context(common::current_output_context()),
+          m_max_queued(m_pool.size() * queued_tasks_per_worker),
+          m_budget(fds_per_directory, reserved_fds + m_pool.size() * (1 + common::perf_counter_fds_per_thread())) {}
+
+    // Failures are returned rather than reported, so the caller can report
+    // them in a stable order
+    OperationResult run(std::vector<DedupeFile>& files);
+
+private:
+    void fail_errno(const std::string& what, const std::string& path, int error_code) {
+        common::record_error(error_code);
+        m_failed.fetch_add(1, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_errors.size() < max_recorded_errors) {
+            m_errors.push_back({path, what + ": " + common::get_system_error_message(static_cast<unsigned long>(error_code))});
+        }
+    }
+
+    void schedule(std::function<void()> task);
+    void queue(std::function<void()> task);
+    void run_task(const std::function<void()>& task);
+    void directory_closed();
+    void enter_directory(int dir_fd, const std::string& parent_path, const char* name);
+    void open_and_scan_directory(const std::string& path);
+    bool first_visit(int fd, const std::string& path);
+    void scan_directory(int fd, const std::string& path);
+    void add_file(const struct stat& st, std::string path);
+
+    struct Shard {
+        std::mutex mutex;
+        std::map<std::pair<uint64_t, uint64_t>, DedupeFile> inodes;
+    };
+
+    const DedupeOptions& m_options;
+    common::ThreadPool m_pool;
+    common::OutputContext m_output_context;
+    size_t m_max_queued;
+    std::atomic<size_t> m_queued{0};
+    common::DirectoryBudget m_budget;
+    std::array<Shard, inode_map_shards> m_shards;
+    std::mutex m_directories_mutex;
+    std::set<std::pair<uint64_t, uint64_t>> m_directories; // Listed so far, so bind mounts are entered once
+    std::atomic<uint64_t> m_failed{0};
+    std::mutex m_mutex;                 // Guards m_errors
+    std::vector<EntryError> m_errors;
+};
+
+void DedupeWalk::run_task(const std::function<void()>& task) {
+    try {
+        task();
+    } catch (const std::exception& e) {
+        m_failed.fetch_add(1, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_errors.size() < max_recorded_errors) {
+            m_errors.push_back({{}, e.what()});
+        }
+    }
+}
+
+void DedupeWalk::schedule(std::function<void()> task) {
+    if (m_queued.load(std::memory_order_relaxed) >= m_max_queued) {
+        run_task(task); // Caller runs: keeps the queue, and memory, bounded
+        return;
+    }
+    queue(std::move(task));
+}
+
+void DedupeWalk::queue(std::function<void()> task) {
+    m_queued.fetch_add(1, std::memory_order_relaxed);
+    m_pool.submit([this, task = std::move(task)] {
+        m_queued.fetch_sub(1, std::memory_order_relaxed);
+        common::ScopedOutputContext context(m_output_context);
+        run_task(task);
+    });
+}
+
+// Called once a directory is closed; a deferred directory takes over its slot
+void DedupeWalk::directory_closed() {
+    if (auto next = m_budget.release()) {
+        queue(std::move(next));
+    }
+}
+
+bool DedupeWalk::first_visit(int fd, const std::string& path) {
+    struct stat st;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Stat);
+        if (::fstat(fd, &st) != 0) {
+            fail_errno("Failed to stat directory", path, errno);
+            return false;
+        }
+    }
+    std::lock_guard<std::mutex> lock(m_directories_mutex);
+    return m_directories.emplace(static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino)).second;
+}
+
+void DedupeWalk::enter_directory(int dir_fd, const std::string& parent_path, const char* name) {
+    std::string path = parent_path + "/" + name;
+    // Deferred work outlives dir_fd, so it opens the directory by path instead
+    if (!m_budget.acquire_or_defer([this, path] { open_and_scan_directory(path); })) {
+        return;
+    }
+    int fd;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Open);
+        fd = ::openat(dir_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    }
+    if (fd < 0) {
+        if (errno != ENOENT) {
+            fail_errno("Failed to open directory", path, errno);
+        }
+        directory_closed();
+        return;
+    }
+    if (!first_visit(fd, path)) {
+        ::close(fd); // Reached again through a bind mount
+        directory_closed();
+        return;
+    }
+    schedule([this, fd, path] { scan_directory(fd, path); });
+}
+
+// Runs a deferred subdirectory, whose slot in the budget is already taken
+void DedupeWalk::open_and_scan_directory(const std::string& path) {
+    int fd;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Open);
+        fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    }
+    if (fd < 0) {
+        if (errno != ENOENT) {
+            fail_errno("Failed to open directory", path, errno);
+        }
+        directory_closed();
+        return;
+    }
+    if (!first_visit(fd, path)) {
+        ::close(fd);
+        directory_closed();
+        return;
+    }
+    scan_directory(fd, path);
+}
+
+void DedupeWalk::add_file(const struct stat& st, std::string path) {
+    std::pair<uint64_t, uint64_t> key(static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino));
+    Shard& shard = m_shards[(key.second ^ (key.first * 0x9E3779B97F4A7C15ull)) % inode_map_shards];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    DedupeFile& file = shard.inodes[key];
+    file.dev = key.first;
+    file.ino = key.second;
+    file.size = static_cast<uint64_t>(st.st_size);
+    file.mtime_ns = to_ns(st.st_mtim);
+    file.ctime_ns = to_ns(st.st_ctim);
+    file.names.push_back(std::move(path));
+}
+
+// Lists the directory open at fd, which it takes ownership of
+void DedupeWalk::scan_directory(int fd, const std::string& path) {
+    common::TraceScope trace("dedupe.directory", path);
+    DIR* dir = ::fdopendir(fd);
+    if (!dir) {
+        fail_errno("Failed to read directory", path, errno);
+        ::close(fd);
+        directory_closed();
+        return;
+    }
+    int dir_fd = ::dirfd(dir);
+    uint64_t entries = 0;
+    while (true) {
+        errno = 0;
+        dirent* entry = ::readdir(dir);
+        if (!entry) {
+            if (errno != 0) {
+                fail_errno("Failed to read directory", path, errno);
+            }
+            break;
+        }
+        const char* name = entry->d_name;
+        if (std::strcmp(name, ".") == 0 || std::strcmp(name, "..") == 0) {
+            continue;
+        }
+        unsigned char type = entry->d_type;
+        if (type == DT_DIR) {
+            enter_directory(dir_fd, path, name);
+            continue;
+        }
+        if (type != DT_REG && type != DT_UNKNOWN) {
+            continue; // Symlinks are not followed; devices and sockets have no contents
+        }
+        struct stat st;
+        {
+            common::ScopedOpTimer timer(common::StatOp::Stat);
+            if (::fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                if (errno != ENOENT) { // Removed since it was listed
+                    fail_errno("Failed to stat", path + "/" + name, errno);
+                }
+                continue;
+            }
+        }
+        if (S_ISDIR(st.st_mode)) {
+            enter_directory(dir_fd, path, name); // d_type was DT_UNKNOWN
+        } else if (S_ISREG(st.st_mode) && static_cast<uint64_t>(st.st_size) >= m_options.min_size) {
+            add_file(st, path + "/" + name);
+            ++entries;
+        }
+    }
+    ::closedir(dir);
+    directory_closed();
+    common::count(common::StatCounter::EntriesVisited, entries);
+}
+
+OperationResult DedupeWalk::run(std::vector<DedupeFile>& files) {
+    common::TraceScope trace("dedupe.walk", m_options.path.string());
+    std::string path = m_options.path.string();
+    if (path.size() > 1 && path.back() == '/') {
+        path.pop_back();
+    }
+    int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        throw common::make_errno_error("Failed to read directory", m_options.path.string(), errno);
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        int error_code = errno;
+        ::close(fd);
+        throw common::make_errno_error("Failed to stat directory", m_options.path.string(), error_code);
+    }
+    m_directories.emplace(static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino));
+    m_budget.acquire();
+
+    schedule([this, fd, path] { scan_directory(fd, path); });
+    m_pool.wait_idle();
+
+    for (auto& shard : m_shards) {
+        for (auto& [key, file] : shard.inodes) {
+            std::sort(file.names.begin(), file.names.end());
+            files.push_back(std::move(file));
+        }
+    }
+    std::sort(files.begin(), files.end(), [](const DedupeFile& a, const DedupeFile& b) { return a.path() < b.path(); });
+    OperationResult result;
+    result.entries_failed = m_failed.load();
+    result.errors = std::move(m_errors);
+    return result;
+}
+
+// Points name at kept's inode without it ever going missing: the link is
+// made under a hidden name and renamed over name. Returns 0 or errno.
+int replace_with_hardlink(const DedupeFile& kept, const std::string& name) {
+    std::filesystem::path temporary = common::hidden_temp_path(name);
+    if (::link(kept.path().c_str(), temporary.c_str()) != 0) {
+        return errno;
+    }
+    common::ScopedOpTimer timer(common::StatOp::Rename);
+    if (::rename(temporary.c_str(), name.c_str()) != 0) {
+        int error_code = errno;
+        ::unlink(temporary.c_str());
+        return error_code;
+    }
+    common::track_new_entry(name);
+    return 0;
+}
+
+// Shares duplicate's extents with kept's. The kernel locks both files and
+// compares the ranges itself, so a file changed since it was hashed is left alone.
+void share_extents(const DedupeFile& kept, const DedupeFile& duplicate) {
+#if defined(__linux__) && defined(FIDEDUPERANGE)
+    int fd;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Open);
+        // Writable where possible; since Linux 4.19 the owner may also dedupe a read-only fd
+        fd = ::open(duplicate.path().c_str(), O_RDWR | O_CLOEXEC);
+        if (fd < 0 && (errno == EACCES || errno == EPERM || errno == ETXTBSY)) {
+            fd = ::open(duplicate.path().c_str(), O_RDONLY | O_CLOEXEC);
+        }
+    }
+    if (fd < 0) {
+        throw common::make_errno_error("Failed to open", duplicate.path(), errno);
+    }
+    // The request ends in a flexible array of destinations; this one has a single entry
+    alignas(file_dedupe_range) unsigned char request_buffer[sizeof(file_dedupe_range) + sizeof(file_dedupe_range_info)];
+    auto* request = reinterpret_cast<file_dedupe_range*>(request_buffer);
+    file_dedupe_range_info& info = request->info[0];
+    int source_fd = ::open(kept.path().c_str(), O_RDONLY | O_CLOEXEC);
+    if (source_fd < 0) {
+        int error_code = errno;
+        ::close(fd);
+        throw common::make_errno_error("Failed to open", kept.path(), error_code);
+    }
+    uint64_t offset = 0;
+    while (offset < duplicate.size) {
+        std::memset(request_buffer, 0, sizeof(request_buffer));
+        request->src_offset = offset;
+        request->src_length = std::min(dedupe_chunk_bytes, duplicate.size - offset);
+        request->dest_count = 1;
+        info.dest_fd = fd;
+        info.dest_offset = offset;
+        if (::ioctl(source_fd, FIDEDUPERANGE, request) != 0) {
+            int error_code = errno;
+            ::close(source_fd);
+            ::close(fd);
+            if (error_code == EOPNOTSUPP || error_code == EINVAL || error_code == ENOTTY) {
+                common::record_error(error_code);
+                throw common::IOCreateError("The filesystem of '" + duplicate.path() + "' does not support sharing extents");
+            }
+            throw common::make_errno_error("Failed to share extents with", duplicate.path(), error_code);
+        }
+        if (info.status != FILE_DEDUPE_RANGE_SAME) {
+            ::close(source_fd);
+            ::close(fd);
+            if (info.status == FILE_DEDUPE_RANGE_DIFFERS) {
+                throw common::IOCreateError("'" + duplicate.path() + "' changed since it was hashed");
+            }
+            throw common::make_errno_error("Failed to share extents with", duplicate.path(), -info.status);
+        }
+        if (info.bytes_deduped == 0) {
+            break;  // Cannot make progress (e.g. an unaligned tail the filesystem refuses)
+        }
+        offset += info.bytes_deduped;
+    }
+    ::close(source_fd);
+    ::close(fd);
+#else
+    (void)kept;
+    (void)duplicate;
+    throw common::IOCreateError("Sharing extents is not supported on this OS.");
+#endif
+}
+#endif
+
+} // namespace
+
+OperationResult perform_dedupe(const DedupeOptions& options, DedupeReport& report) {
+    common::ScopedPerfCounters counters(common::PerfPhase::Dedupe);
+    auto start_time = std::chrono::steady_clock::now();
+    OperationResult result;
+#if defined(_WIN32)
+    (void)options;
+    (void)report;
+    throw common::IOCreateError("Deduplication is not supported on Windows.");
+#else
+    common::HashAlgorithm algorithm = options.algorithm.value_or(
+        options.action == DedupeAction::Hardlink ? common::HashAlgorithm::Sha256 : common::HashAlgorithm::Xxh64);
+    // A hard link deletes the duplicate on the strength of its digest alone; with
+    // reflinks the kernel compares the bytes itself
+    if (options.action == DedupeAction::Hardlink && algorithm != common::HashAlgorithm::Sha256) {
+        throw common::IOCreateError(std::string("Hard linking needs sha256; ") + common::hash_algorithm_name(algorithm) +
+                                    " collisions would delete files that differ.");
+    }
+    size_t workers = options.jobs == 0 ? common::default_worker_count() : options.jobs;
+
+    std::vector<DedupeFile> files;
+    std::vector<std::vector<DedupeFile*>> sets;
+    OperationResult walked;
+    try {
+        DedupeWalk walk(options, workers);
+        walked = walk.run(files);
+        std::vector<DedupeFile*> all;
+        for (auto& file : files) {
+            all.push_back(&file);
+        }
+        report.files = files.size();
+
+        // Stage one needs no reads at all
+        std::vector<DedupeFile*> candidates = flatten(group_by(all, [](const DedupeFile& f) { return f.size; }));
+        report.same_size = candidates.size();
+        {
+            common::TraceScope trace("dedupe.stage_ends");
+            run_stage(candidates, workers, [algorithm](DedupeFile& f) { hash_ends(f, algorithm); });
+        }
+
+        auto readable = [](std::vector<DedupeFile*> group) {
+            group.erase(std::remove_if(group.begin(), group.end(), [](const DedupeFile* f) { return !f->error.empty(); }), group.end());
+            return group;
+        };
+        candidates = flatten(group_by(readable(candidates), [](const DedupeFile& f) { return std::make_pair(f.size, f.ends_digest); }));
+        report.same_ends = candidates.size();
+        std::vector<DedupeFile*> unread;
+        for (DedupeFile* file : candidates) {
+            if (!file->fully_read_by_ends()) {
+                unread.push_back(file);
+            }
+        }
+        {
+            common::TraceScope trace("dedupe.stage_full");
+            run_stage(unread, workers, [algorithm](DedupeFile& f) { hash_whole(f, algorithm); });
+        }
+        sets = group_by(readable(candidates), [](const DedupeFile& f) { return std::make_pair(f.size, f.digest); });
+    } catch (const common::IOCreateError&) {
+        throw;
+    } catch (const std::filesystem::filesystem_error& e) {
+        common::record_error(e.code().value());
+        throw common::IOCreateError("Filesystem error: " + std::string(e.what()));
+    } catch (const std::exception& e) {
+        throw common::IOCreateError("An unexpected error occurred: " + std::string(e.what()));
+    }
+
+    auto fail = [&](const std::string& path, const std::string& message) {
+        ++result.entries_failed;
+        if (result.errors.size() < max_recorded_errors) {
+            result.errors.push_back({path, message});
+        }
+        if (options.progress) {
+            options.progress({ProgressKind::EntryFailed, path, 0, message});
+        }
+    };
+
+    // Walk failures first, sorted so they are reported in a stable order
+    std::sort(walked.errors.begin(), walked.errors.end(), [](const EntryError& a, const EntryError& b) { return a.path < b.path; });
+    for (const auto& error : walked.errors) {
+        fail(error.path, error.message);
+    }
+    result.entries_failed += walked.entries_failed - walked.errors.size();
+
+    result.entries_processed = files.size();
+    for (const auto& file : files) {
+        result.bytes_read += file.bytes_read;
+        if (!file.error.empty()) {
+            fail(file.path(), file.error);
+        }
+    }
+
+    std::sort(sets.begin(), sets.end(), [](const auto& a, const auto& b) { return a.front()->path() < b.front()->path(); });
+    for (const auto& set : sets) {
+        DedupeFile& kept = *set.front();        // Smallest path, as grouped
+        ++report.duplicate_sets;
+        for (size_t i = 1; i < set.size(); ++i) {
+            const DedupeFile& duplicate = *set[i];
+            ++report.duplicates;
+            report.duplicate_bytes += duplicate.size;
+            if (options.progress) {
+                options.progress({ProgressKind::Duplicate, duplicate.path(), duplicate.size, kept.path()});
+            }
+            if (options.action == DedupeAction::Report || duplicate.dev != kept.dev) {
+                continue;
+            }
+
+            common::TraceScope trace("dedupe.replace", duplicate.path());
+            try {
+                if (options.action == DedupeAction::Hardlink) {
+                    // Both files are checked before any name is replaced, since
+                    // each replacement moves the ctime of both
+                    struct stat st;
+                    if (::lstat(kept.path().c_str(), &st) != 0 || !unchanged_since_walk(kept, st)) {
+                        throw common::IOCreateError("'" + kept.path() + "' changed since it was hashed");
+                    }
+                    for (const auto& name : duplicate.names) {
+                        if (::lstat(name.c_str(), &st) != 0 || !unchanged_since_walk(duplicate, st)) {
+                            throw common::IOCreateError("'" + name + "' changed since it was hashed");
+                        }
+                    }
+                    for (const auto& name : duplicate.names) {
+                        if (int error_code = replace_with_hardlink(kept, name)) {
+                            throw common::make_errno_error("Failed to replace", name, error_code);
+                        }
+                    }
+                    // The new links moved the kept file's ctime; take it as the
+                    // new baseline for the next duplicate in the set
+                    if (::lstat(kept.path().c_str(), &st) == 0 && static_cast<uint64_t>(st.st_ino) == kept.ino) {
+                        kept.ctime_ns = to_ns(st.st_ctim);
+                    }
+                } else {
+                    share_extents(kept, duplicate);
+                }
+                ++report.replaced;
+                if (options.progress) {
+                    options.progress({ProgressKind::Linked, duplicate.path(), duplicate.size,
+                                      options.action == DedupeAction::Hardlink ? "hardlink" : "reflink"});
+                }
+            } catch (const std::exception& e) {
+                fail(duplicate.path(), e.what());
+            }
+        }
+    }
+#endif
+    result.elapsed = std::chrono::steady_clock::now() - start_time;
+    return result;
+}
+
+void handle_dedupe(
+    const std::string& path,
+    bool hardlink,
+    bool reflink,
+    const std::string& algorithm,
+    const std::string& min_size,
+    const std::string& jobs,
+    bool output_enabled
+) {
+    common::TraceScope trace("dedupe");
+    if (hardlink && reflink) {
+        throw common::IOCreateError("--hardlink and --reflink cannot be combined.");
+    }
+
+    DedupeOptions options;
+    options.path = path;
+    options.action = hardlink ? DedupeAction::Hardlink : reflink ? DedupeAction::Reflink : DedupeAction::Report;
+    if (!algorithm.empty()) {
+        try {
+            options.algorithm = common::parse_hash_algorithm(algorithm);
+        } catch (const std::invalid_argument& e) {
+            throw common::IOCreateError(e.what());
+        }
+    }
+    if (!min_size.empty()) {
+        try {
+            options.min_size = common::parse_size(min_size);
+        } catch (const std::exception&) {
+            throw common::IOCreateError("Invalid value for --min-size: \"" + min_size + "\"");
+        }
+    }
+    if (!jobs.empty()) {
+        try {
+            options.jobs = std::stoul(jobs);
+        } catch (const std::exception&) {
+            throw common::IOCreateError("Invalid value for --jobs: \"" + jobs + "\"");
+        }
+    }
+
+    bool text_output = output_enabled && common::output_format() == common::OutputFormat::Text;
+    if (text_output) {
+        common::out() << "Settings for io dedupe:" << '\n';
+        common::out() << "  Path: " << path << '\n';
+        common::out() << "  Action: " << (hardlink ? "hardlink" : reflink ? "reflink" : "report") << '\n';
+        common::out() << "  Min size: " << options.min_size << '\n';
+    }
+
+    bool structured = common::output_format() != common::OutputFormat::Text;
+    options.progress = [text_output, structured](const ProgressEvent& event) {
+        if (structured) {
+            emit_progress_record("dedupe", event);
+        } else if (event.kind == ProgressKind::EntryFailed) {
+            common::err() << "Error deduplicating " << event.path << ": " << event.message << std::endl;
+        } else if (text_output && event.kind == ProgressKind::Duplicate) {
+            common::out() << event.path << ": duplicate of " << event.message << " (" << event.bytes << " bytes)" << '\n';
+        } else if (text_output && event.kind == ProgressKind::Linked) {
+            common::out() << "Replaced by " << event.message << ": " << event.path << '\n';
+        }
+    };
+
+    DedupeReport report;
+    OperationResult result = perform_dedupe(options, report);
+    emit_result_record("dedupe", result);
+
+    if (text_output) {
+        common::out() << "Examined " << report.files << " files: " << report.same_size << " share a size, " << report.same_ends
+                      << " also their first and last blocks; " << report.duplicates << " duplicates in " << report.duplicate_sets
+                      << " sets (" << report.duplicate_bytes << " bytes), " << report.replaced << " replaced, "
+                      << result.bytes_read << " bytes read" << '\n';
+    }
+    if (!result.ok()) {
+        throw common::IOCreateError(std::to_string(result.entries_failed) + " files or directories could not be read or deduplicated.");
+    }
+}
+
+} // namespace allin1::io
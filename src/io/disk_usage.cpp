@@ -0,0 +1,660 @@
+#include "io/disk_usage.hpp"
+#include "common/directory_budget.hpp"
+#include "common/error_utils.hpp"
+#include "common/errors.hpp"
+#include "common/output.hpp"
+#include "common/perf_counters.hpp"
+#include "common/stats.hpp"
+#include "common/thread_pool.hpp"
+#include "common/trace.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+#endif
+
+namespace allin1::io {
+
+namespace {
+
+constexpr size_t queued_tasks_per_worker = 16;
+constexpr size_t max_recorded_errors = 1000;
+constexpr size_t inode_set_shards = 64;
+// A directory holds one descriptor from being opened until it has been listed
+constexpr size_t fds_per_directory = 1;
+constexpr size_t reserved_fds = 32;
+
+#if !defined(_WIN32)
+struct EntryStat {
+    uint64_t dev = 0;
+    uint64_t ino = 0;
+    uint64_t nlink = 0;
+    uint64_t size = 0;
+    uint64_t allocated = 0;
+    bool is_directory = false;
+};
+
+#if defined(STATX_TYPE)
+std::atomic<bool> statx_unsupported{false};
+#endif
+
+// Returns 0 or the errno of the failure. Uses statx with only the fields du
+// needs where the kernel has it, and fstatat otherwise.
+int stat_entry(int dir_fd, const char* name, int flags, EntryStat& out) {
+    common::ScopedOpTimer timer(common::StatOp::Stat);
+#if defined(STATX_TYPE)
+    if (!statx_unsupported.load(std::memory_order_relaxed)) {
+        struct statx stx;
+        if (::statx(dir_fd, name, flags | AT_STATX_DONT_SYNC, STATX_TYPE | STATX_NLINK | STATX_INO | STATX_SIZE | STATX_BLOCKS, &stx) == 0) {
+            out.dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+            out.ino = stx.stx_ino;
+            out.nlink = stx.stx_nlink;
+            out.size = stx.stx_size;
+            out.allocated = stx.stx_blocks * 512;
+            out.is_directory = S_ISDIR(stx.stx_mode);
+            return 0;
+        }
+        if (errno != ENOSYS) {
+            return errno;
+        }
+        statx_unsupported.store(true, std::memory_order_relaxed);
+    }
+#endif
+    struct stat st;
+    if (::fstatat(dir_fd, name, &st, flags) != 0) {
+        return errno;
+    }
+    out.dev = static_cast<uint64_t>(st.st_dev);
+    out.ino = static_cast<uint64_t>(st.st_ino);
+    out.nlink = static_cast<uint64_t>(st.st_nlink);
+    out.size = static_cast<uint64_t>(st.st_size);
+    out.allocated = static_cast<uint64_t>(st.st_blocks) * 512;
+    out.is_directory = S_ISDIR(st.st_mode);
+    return 0;
+}
+
+size_t inode_shard(uint64_t dev, uint64_t ino) {
+    return (ino ^ (dev * 0x9E3779B97F4A7C15ull)) % inode_set_shards;
+}
+
+// (dev, inode) pairs seen so far, sharded so workers rarely contend
+class InodeSet {
+public:
+    // True the first time a pair is inserted
+    bool insert(uint64_t dev, uint64_t ino) {
+        Shard& shard = m_shards[inode_shard(dev, ino)];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.inodes.emplace(dev, ino).second;
+    }
+
+private:
+    struct Shard {
+        std::mutex mutex;
+        std::set<std::pair<uint64_t, uint64_t>> inodes;
+    };
+    std::array<Shard, inode_set_shards> m_shards;
+};
+
+// Files with more than one link, each kept at the lexicographically smallest
+// of its names seen so far, so which name a file is charged to does not
+// depend on the order workers reach them
+class LinkedFiles {
+public:
+    struct File {
+        std::string path;
+        uint64_t allocated = 0;
+        uint64_t apparent = 0;
+    };
+
+    // True the first time the file is offered
+    bool offer(uint64_t dev, uint64_t ino, std::string path, uint64_t allocated, uint64_t apparent) {
+        Shard& shard = m_shards[inode_shard(dev, ino)];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto [it, inserted] = shard.files.try_emplace({dev, ino});
+        if (inserted || path < it->second.path) {
+            it->second = {std::move(path), allocated, apparent};
+        }
+        return inserted;
+    }
+
+    // Only once the walk has finished
+    template <typename Fn>
+    void for_each(Fn&& fn) const {
+        for (const Shard& shard : m_shards) {
+            for (const auto& [inode, file] : shard.files) {
+                fn(file);
+            }
+        }
+    }
+
+private:
+    struct Shard {
+        std::mutex mutex;
+        std::map<std::pair<uint64_t, uint64_t>, File> files;
+    };
+    std::array<Shard, inode_set_shards> m_shards;
+};
+
+// The largest subtrees seen so far. Offers below the current floor are
+// turned away without taking the lock.
+class LargestSubtrees {
+public:
+    explicit LargestSubtrees(size_t capacity, bool by_apparent) : m_capacity(capacity), m_by_apparent(by_apparent) {}
+
+    void offer(const std::string& path, uint64_t allocated, uint64_t apparent, uint64_t entries) {
+        uint64_t key = m_by_apparent ? apparent : allocated;
+        if (m_capacity == 0 || key < m_floor.load(std::memory_order_relaxed)) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_heap.size() == m_capacity) {
+            if (key <= rank(m_heap.front())) {
+                return;
+            }
+            std::pop_heap(m_heap.begin(), m_heap.end(), greater());
+            m_heap.pop_back();
+        }
+        m_heap.push_back({path, allocated, apparent, entries});
+        std::push_heap(m_heap.begin(), m_heap.end(), greater());
+        if (m_heap.size() == m_capacity) {
+            m_floor.store(rank(m_heap.front()), std::memory_order_relaxed);
+        }
+    }
+
+    // Replaces the totals of subtrees that were offered before their hard
+    // links were charged. Only once the walk has finished.
+    void adjust(const std::map<std::string, SubtreeUsage>& adjusted) {
+        m_heap.erase(std::remove_if(m_heap.begin(), m_heap.end(),
+                                    [&](const SubtreeUsage& usage) { return adjusted.count(usage.path) != 0; }),
+                     m_heap.end());
+        std::make_heap(m_heap.begin(), m_heap.end(), greater());
+        m_floor.store(0, std::memory_order_relaxed);
+        for (const auto& [path, usage] : adjusted) {
+            offer(path, usage.allocated_bytes, usage.apparent_bytes, usage.entries);
+        }
+    }
+
+    std::vector<SubtreeUsage> take() {
+        std::sort_heap(m_heap.begin(), m_heap.end(), greater());
+        return std::move(m_heap);
+    }
+
+private:
+    uint64_t rank(const SubtreeUsage& usage) const { return m_by_apparent ? usage.apparent_bytes : usage.allocated_bytes; }
+
+    // Heap order: the smallest kept subtree is at the front
+    struct Greater {
+        const LargestSubtrees* owner;
+        bool operator()(const SubtreeUsage& a, const SubtreeUsage& b) const { return owner->rank(a) > owner->rank(b); }
+    };
+    Greater greater() const { return {this}; }
+
+    size_t m_capacity;
+    bool m_by_apparent;
+    std::atomic<uint64_t> m_floor{0};
+    std::mutex m_mutex;
+    std::vector<SubtreeUsage> m_heap;
+};
+
+class DiskUsageWalk;
+
+// A directory being measured. It lives until every directory below it has
+// finished, then adds its totals to its parent's on destruction.
+struct UsageDir {
+    DiskUsageWalk* walk = nullptr;
+    std::shared_ptr<UsageDir> parent;
+    std::string display_path;
+    int fd = -1;                        // Open until the directory has been listed
+    std::atomic<uint64_t> allocated{0};
+    std::atomic<uint64_t> apparent{0};
+    std::atomic<uint64_t> entries{0};
+    std::atomic<bool> holds_links{false}; // Some file with several links has a name below
+
+    ~UsageDir();
+};
+
+// Walks the tree in the manner of the recursive copy: workers list
+// directories, the task queue is capped with the caller running work itself
+// once it is full, and open directories are capped by a DirectoryBudget.
+class DiskUsageWalk {
+public:
+    DiskUsageWalk(const DiskUsageOptions& options, size_t workers)
+        : m_options(options),
+          m_pool(workers),
+          m_output_context(common::current_output_context()),
+          m_max_queued(m_pool.size() * queued_tasks_per_worker),
+          m_budget(fds_per_directory, reserved_fds + m_pool.size() * (1 + common::perf_counter_fds_per_thread())),
+          m_largest(options.top, options.apparent_size) {}
+
+    OperationResult run(DiskUsageReport& report);
+
+    // Called as each directory's subtree completes
+    void finish(UsageDir& node) {
+        uint64_t allocated = node.allocated.load(std::memory_order_relaxed);
+        uint64_t apparent = node.apparent.load(std::memory_order_relaxed);
+        uint64_t entries = node.entries.load(std::memory_order_relaxed);
+        if (!node.parent) {
+            m_total = {node.display_path, allocated, apparent, entries};
+            return;
+        }
+        if (node.holds_links.load(std::memory_order_relaxed)) {
+            // Kept whole, since the top list may not hold it, until the links are charged
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_linked_subtrees[node.display_path] = {node.display_path, allocated, apparent, entries};
+            node.parent->holds_links.store(true, std::memory_order_relaxed);
+        }
+        node.parent->allocated.fetch_add(allocated, std::memory_order_relaxed);
+        node.parent->apparent.fetch_add(apparent, std::memory_order_relaxed);
+        node.parent->entries.fetch_add(entries, std::memory_order_relaxed);
+        m_largest.offer(node.display_path, allocated, apparent, entries);
+    }
+
+private:
+    void report(const ProgressEvent& event) {
+        if (!m_options.progress) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_options.progress(event);
+    }
+
+    void fail(const std::string& path, const std::string& message) {
+        m_failed.fetch_add(1, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_errors.size() < max_recorded_errors) {
+                m_errors.push_back({path, message});
+            }
+        }
+        report({ProgressKind::EntryFailed, path, 0, message});
+    }
+
+    void fail_errno(const std::string& what, const std::string& path, int error_code) {
+        common::record_error(error_code);
+        fail(path, what + ": " + common::get_system_error_message(static_cast<unsigned long>(error_code)));
+    }
+
+    void charge_linked_files();
+    void schedule(std::function<void()> task);
+    void queue(std::function<void()> task);
+    void run_task(const std::function<void()>& task);
+    void directory_closed();
+    void scan_directory(const std::shared_ptr<UsageDir>& node);
+    void enter_directory(const std::shared_ptr<UsageDir>& node, int dir_fd, const char* name);
+    std::shared_ptr<UsageDir> open_directory(const std::shared_ptr<UsageDir>& node, int dir_fd, const char* name, std::string display_path);
+
+    const DiskUsageOptions& m_options;
+    common::ThreadPool m_pool;
+    common::OutputContext m_output_context;
+    size_t m_max_queued;
+    std::atomic<size_t> m_queued{0};
+    common::DirectoryBudget m_budget;
+    uint64_t m_root_dev = 0;
+
+    LinkedFiles m_files;                // Files with more than one link, charged once the walk is done
+    InodeSet m_directories;             // Directories listed so far
+    LargestSubtrees m_largest;
+    SubtreeUsage m_total;
+    std::map<std::string, SubtreeUsage> m_linked_subtrees; // Subtrees holding names of m_files, without them
+
+    std::atomic<uint64_t> m_hard_links_skipped{0};
+    std::atomic<uint64_t> m_examined{0};
+    std::atomic<uint64_t> m_failed{0};
+    std::mutex m_mutex;                  // Guards m_errors, m_linked_subtrees and calls into m_options.progress
+    std::vector<EntryError> m_errors;
+};
+
+UsageDir::~UsageDir() {
+    if (fd >= 0) ::close(fd);
+    try {
+        walk->finish(*this);
+    } catch (const std::exception&) {
+        // Only this subtree's place in the top list is lost
+    }
+}
+
+void DiskUsageWalk::run_task(const std::function<void()>& task) {
+    try {
+        task();
+    } catch (const std::exception& e) {
+        fail({}, e.what());
+    }
+}
+
+void DiskUsageWalk::schedule(std::function<void()> task) {
+    if (m_queued.load(std::memory_order_relaxed) >= m_max_queued) {
+        run_task(task); // Caller runs: keeps the queue, and memory, bounded
+        return;
+    }
+    queue(std::move(task));
+}
+
+void DiskUsageWalk::queue(std::function<void()> task) {
+    m_queued.fetch_add(1, std::memory_order_relaxed);
+    m_pool.submit([this, task = std::move(task)] {
+        m_queued.fetch_sub(1, std::memory_order_relaxed);
+        common::ScopedOutputContext context(m_output_context);
+        run_task(task);
+    });
+}
+
+// Called once a directory's descriptor is closed; a deferred directory takes over its slot
+void DiskUsageWalk::directory_closed() {
+    if (auto next = m_budget.release()) {
+        queue(std::move(next));
+    }
+}
+
+// Opens the directory name below node and schedules it for listing, or defers
+// that until another directory has been listed
+void DiskUsageWalk::enter_directory(const std::shared_ptr<UsageDir>& node, int dir_fd, const char* name) {
+    std::string display_path = node->display_path + "/" + name;
+    // Deferred work outlives dir_fd, so it opens the directory by path instead
+    if (!m_budget.acquire_or_defer([this, node, display_path] {
+            if (auto child = open_directory(node, AT_FDCWD, display_path.c_str(), display_path)) {
+                scan_directory(child);
+            }
+        })) {
+        return;
+    }
+    if (auto child = open_directory(node, dir_fd, name, std::move(display_path))) {
+        schedule([this, child] { scan_directory(child); });
+    }
+}
+
+// Opens a directory whose slot in the budget is taken and counts the directory
+// itself into its own subtree. Gives the slot back if nothing is to be listed.
+std::shared_ptr<UsageDir> DiskUsageWalk::open_directory(const std::shared_ptr<UsageDir>& node, int dir_fd, const char* name,
+                                                        std::string display_path) {
+    int fd;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Open);
+        fd = ::openat(dir_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    }
+    if (fd < 0) {
+        if (errno != ENOENT) {
+            fail_errno("Failed to open directory", display_path, errno);
+        }
+        directory_closed();
+        return nullptr;
+    }
+    EntryStat st;
+    if (int error_code = stat_entry(fd, "", AT_EMPTY_PATH, st)) {
+        ::close(fd);
+        directory_closed();
+        fail_errno("Failed to stat directory", display_path, error_code);
+        return nullptr;
+    }
+    if ((m_options.one_file_system && st.dev != m_root_dev) || !m_directories.insert(st.dev, st.ino)) {
+        ::close(fd); // Another filesystem, or reached again through a bind mount
+        directory_closed();
+        return nullptr;
+    }
+    m_examined.fetch_add(1, std::memory_order_relaxed);
+    auto child = std::make_shared<UsageDir>();
+    child->walk = this;
+    child->parent = node;
+    child->display_path = std::move(display_path);
+    child->fd = fd;
+    child->allocated.store(st.allocated, std::memory_order_relaxed);
+    child->apparent.store(st.size, std::memory_order_relaxed);
+    child->entries.store(1, std::memory_order_relaxed);
+    return child;
+}
+
+void DiskUsageWalk::scan_directory(const std::shared_ptr<UsageDir>& node) {
+    common::TraceScope trace("du.directory", node->display_path);
+
+    DIR* dir = ::fdopendir(node->fd);
+    if (!dir) {
+        fail_errno("Failed to read directory", node->display_path, errno);
+        ::close(node->fd);
+        node->fd = -1;
+        directory_closed();
+        return;
+    }
+    node->fd = -1; // Owned by dir from here on
+    int dir_fd = ::dirfd(dir);
+
+    // Summed locally and published once, so files cost no shared writes
+    uint64_t allocated = 0;
+    uint64_t apparent = 0;
+    uint64_t entries = 0;
+    bool holds_links = false;
+    while (true) {
+        errno = 0;
+        dirent* entry = ::readdir(dir);
+        if (!entry) {
+            if (errno != 0) {
+                fail_errno("Failed to read directory", node->display_path, errno);
+            }
+            break;
+        }
+        const char* name = entry->d_name;
+        if (std::strcmp(name, ".") == 0 || std::strcmp(name, "..") == 0) {
+            continue;
+        }
+        if (entry->d_type == DT_DIR) {
+            enter_directory(node, dir_fd, name);
+            continue;
+        }
+
+        EntryStat st;
+        if (int error_code = stat_entry(dir_fd, name, AT_SYMLINK_NOFOLLOW, st)) {
+            if (error_code != ENOENT) { // Removed since it was listed
+                fail_errno("Failed to stat", node->display_path + "/" + name, error_code);
+            }
+            continue;
+        }
+        if (st.is_directory) {
+            enter_directory(node, dir_fd, name); // d_type was DT_UNKNOWN
+            continue;
+        }
+        m_examined.fetch_add(1, std::memory_order_relaxed);
+        if (st.nlink > 1) {
+            if (!m_files.offer(st.dev, st.ino, node->display_path + "/" + name, st.allocated, st.size)) {
+                m_hard_links_skipped.fetch_add(1, std::memory_order_relaxed);
+            }
+            holds_links = true;
+            continue;
+        }
+        allocated += st.allocated;
+        apparent += st.size;
+        ++entries;
+    }
+    ::closedir(dir);
+    directory_closed();
+
+    node->allocated.fetch_add(allocated, std::memory_order_relaxed);
+    node->apparent.fetch_add(apparent, std::memory_order_relaxed);
+    node->entries.fetch_add(entries, std::memory_order_relaxed);
+    if (holds_links) {
+        node->holds_links.store(true, std::memory_order_relaxed);
+    }
+    common::count(common::StatCounter::EntriesVisited, entries);
+}
+
+// Adds each file with several links to the total and to every subtree above
+// its smallest name, then lets those subtrees compete for the top list again
+void DiskUsageWalk::charge_linked_files() {
+    size_t root_length = m_total.path.size();
+    m_files.for_each([&](const LinkedFiles::File& file) {
+        m_total.allocated_bytes += file.allocated;
+        m_total.apparent_bytes += file.apparent;
+        ++m_total.entries;
+        for (size_t slash = file.path.find('/', root_length + 1); slash != std::string::npos;
+             slash = file.path.find('/', slash + 1)) {
+            auto subtree = m_linked_subtrees.find(file.path.substr(0, slash));
+            if (subtree == m_linked_subtrees.end()) {
+                continue;
+            }
+            subtree->second.allocated_bytes += file.allocated;
+            subtree->second.apparent_bytes += file.apparent;
+            ++subtree->second.entries;
+        }
+    });
+    m_largest.adjust(m_linked_subtrees);
+}
+
+OperationResult DiskUsageWalk::run(DiskUsageReport& report) {
+    std::string display_path = m_options.path.string();
+    if (display_path.size() > 1 && display_path.back() == '/') {
+        display_path.pop_back();
+    }
+    int fd = ::open(display_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        int error_code = errno;
+        common::record_error(error_code);
+        throw common::IOCreateError("Failed to open directory '" + m_options.path.string() + "': " +
+                                    common::get_system_error_message(static_cast<unsigned long>(error_code)));
+    }
+    EntryStat st;
+    if (int error_code = stat_entry(fd, "", AT_EMPTY_PATH, st)) {
+        ::close(fd);
+        common::record_error(error_code);
+        throw common::IOCreateError("Failed to stat directory '" + m_options.path.string() + "': " +
+                                    common::get_system_error_message(static_cast<unsigned long>(error_code)));
+    }
+    m_root_dev = st.dev;
+    m_directories.insert(st.dev, st.ino);
+    m_examined.fetch_add(1, std::memory_order_relaxed);
+
+    auto root = std::make_shared<UsageDir>();
+    root->walk = this;
+    root->display_path = std::move(display_path);
+    root->fd = fd;
+    root->allocated.store(st.allocated, std::memory_order_relaxed);
+    root->apparent.store(st.size, std::memory_order_relaxed);
+    root->entries.store(1, std::memory_order_relaxed);
+    m_budget.acquire();
+
+    schedule([this, root] { scan_directory(root); });
+    root.reset();
+    m_pool.wait_idle();
+    charge_linked_files();
+
+    report.total = std::move(m_total);
+    report.largest = m_largest.take();
+    report.hard_links_skipped = m_hard_links_skipped.load();
+
+    OperationResult result;
+    result.entries_processed = m_examined.load();
+    result.entries_failed = m_failed.load();
+    result.errors = std::move(m_errors);
+    return result;
+}
+#endif
+
+} // namespace
+
+OperationResult perform_disk_usage(const DiskUsageOptions& options, DiskUsageReport& report) {
+    common::ScopedPerfCounters counters(common::PerfPhase::DiskUsage);
+    auto start_time = std::chrono::steady_clock::now();
+#if defined(_WIN32)
+    (void)options;
+    (void)report;
+    throw common::IOCreateError("Disk usage is not supported on Windows.");
+#else
+    size_t workers = options.jobs == 0 ? common::default_worker_count() : options.jobs;
+    DiskUsageWalk walk(options, workers);
+    OperationResult result = walk.run(report);
+    result.elapsed = std::chrono::steady_clock::now() - start_time;
+    return result;
+#endif
+}
+
+void handle_disk_usage(
+    const std::string& path,
+    const std::string& top,
+    bool one_file_system,
+    bool apparent_size,
+    const std::string& jobs,
+    bool output_enabled
+) {
+    common::TraceScope trace("du");
+    bool text_output = output_enabled && common::output_format() == common::OutputFormat::Text;
+    if (text_output) {
+        common::out() << "Settings for io du:" << '\n';
+        common::out() << "  Path: " << path << '\n';
+        common::out() << "  One file system: " << (one_file_system ? "true" : "false") << '\n';
+        common::out() << "  Size: " << (apparent_size ? "apparent" : "allocated") << '\n';
+    }
+
+    DiskUsageOptions options;
+    options.path = path;
+    options.one_file_system = one_file_system;
+    options.apparent_size = apparent_size;
+    if (!top.empty()) {
+        try {
+            options.top = std::stoul(top);
+        } catch (const std::exception&) {
+            throw common::IOCreateError("Invalid value for --top: \"" + top + "\"");
+        }
+    }
+    if (!jobs.empty()) {
+        try {
+            options.jobs = std::stoul(jobs);
+        } catch (const std::exception&) {
+            throw common::IOCreateError("Invalid value for --jobs: \"" + jobs + "\"");
+        }
+    }
+    bool structured = common::output_format() != common::OutputFormat::Text;
+    options.progress = [structured](const ProgressEvent& event) {
+        if (structured) {
+            emit_progress_record("du", event);
+        } else if (event.kind == ProgressKind::EntryFailed) {
+            common::err() << "Error measuring " << event.path << ": " << event.message << std::endl;
+        }
+    };
+
+    DiskUsageReport report;
+    OperationResult result = perform_disk_usage(options, report);
+    for (const auto& subtree : report.largest) {
+        if (structured) {
+            common::emit(common::OutputRecord("subtree")
+                             .add("path", subtree.path)
+                             .add("allocated", subtree.allocated_bytes)
+                             .add("apparent", subtree.apparent_bytes)
+                             .add("entries", subtree.entries));
+        } else if (text_output) {
+            common::out() << (apparent_size ? subtree.apparent_bytes : subtree.allocated_bytes) << '\t' << subtree.path << '\n';
+        }
+    }
+    if (structured) {
+        common::emit(common::OutputRecord("usage")
+                         .add("path", report.total.path)
+                         .add("allocated", report.total.allocated_bytes)
+                         .add("apparent", report.total.apparent_bytes)
+                         .add("entries", report.total.entries)
+                         .add("hard_links_skipped", report.hard_links_skipped));
+    }
+    emit_result_record("du", result);
+
+    if (text_output) {
+        common::out() << "Total for " << path << ": " << report.total.allocated_bytes << " bytes allocated, "
+                      << report.total.apparent_bytes << " bytes apparent, " << report.total.entries << " entries ("
+                      << report.hard_links_skipped << " extra hard links not counted)" << '\n';
+    }
+    if (!result.ok()) {
+        throw common::IOCreateError(std::to_string(result.entries_failed) + " entries could not be measured; the totals exclude them.");
+    }
+}
+
+} // namespace allin1::io
@@ -1,8 +1,20 @@
 #include "io/io.hpp"
 #include "io/create.hpp"
+#include "io/remove.hpp"
+#include "io/copy.hpp"
+#include "io/checksum.hpp"
+#include "io/dedupe.hpp"
+#include "io/disk_usage.hpp"
 #include "io/symlink.hpp"
+#include "io/symlink_audit.hpp"
+#include "io/symlink_mirror.hpp"
 #include "io/shortcut.hpp"
+#include "io/shortcut_index.hpp"
+#include "io/sync.hpp"
 #include "io/permission.hpp"
+#include "cppParse/help_formatter.hpp"
+#include "common/output.hpp"
+#include <stdexcept>
 #include <vector>
 
 namespace allin1::io {
@@ -15,18 +27,84 @@ void register_io_commands(cppParse::Parser& io_parser) {
     create_parser.add_argument(std::vector<std::string>{"name"}).help("The name of the file or directory to create").required();
     create_parser.add_argument(std::vector<std::string>{"--fill"}).takes_value().help("Fill the file with a certain hex code (e.g., 0xFF)");
     create_parser.add_argument(std::vector<std::string>{"--fill-size"}).takes_value().help("The size to initialize the file to (e.g., 1K, 2M, 3G)");
+    create_parser.add_argument(std::vector<std::string>{"--no-cache"}).store_true().help("Stream the fill without growing the page cache (O_DIRECT where supported).");
+    create_parser.add_argument(std::vector<std::string>{"--verify"}).store_true().help("Read the filled file back, bypassing the page cache, and compare it with the fill pattern.");
+    create_parser.add_argument(std::vector<std::string>{"--atomic"}).store_true().help("Build the file out of sight and publish it under its name only once it is complete.");
+
+    auto& remove_parser = io_parser.add_subparser("remove");
+    remove_parser.add_description("Remove a file or directory.");
+    remove_parser.add_argument(std::vector<std::string>{"path"}).help("The file, symlink or directory to remove.").required();
+    remove_parser.add_argument(std::vector<std::string>{"--recursive"}).store_true().help("Remove a directory with everything below it, emptying sibling subdirectories in parallel.");
+    remove_parser.add_argument(std::vector<std::string>{"--background"}).store_true().help("With --recursive, move the directory out of the way at once and delete it in a detached process.");
+    remove_parser.add_argument(std::vector<std::string>{"--jobs"}).takes_value().help("Number of parallel workers for --recursive (0 = one per CPU).");
+
+    auto& copy_parser = io_parser.add_subparser("copy");
+    copy_parser.add_description("Copy a file, using reflinks or in-kernel copies where possible.");
+    copy_parser.add_argument(std::vector<std::string>{"source"}).help("The file to copy.").required();
+    copy_parser.add_argument(std::vector<std::string>{"destination"}).help("The file or existing directory to copy to.").required();
+    copy_parser.add_argument(std::vector<std::string>{"--recursive"}).store_true().help("Copy a directory tree, preserving modes, owners, timestamps and symlinks.");
+    copy_parser.add_argument(std::vector<std::string>{"--no-cache"}).store_true().help("Stream the data without growing the page cache by more than a small window.");
+    copy_parser.add_argument(std::vector<std::string>{"--jobs"}).takes_value().help("Number of parallel workers for --recursive (0 = one per CPU).");
+
+    auto& checksum_parser = io_parser.add_subparser("checksum");
+    checksum_parser.add_description("Compute file checksums, optionally writing or verifying a manifest.");
+    checksum_parser.add_argument(std::vector<std::string>{"path"}).help("The file or directory to hash, or the manifest to check with --verify.").required();
+    checksum_parser.add_argument(std::vector<std::string>{"--algorithm"}).takes_value().help("Hash algorithm: crc32c, xxh64 or sha256 (default).");
+    checksum_parser.add_argument(std::vector<std::string>{"--recursive"}).store_true().help("Hash every regular file below a directory.");
+    checksum_parser.add_argument(std::vector<std::string>{"--manifest"}).takes_value().help("Write the checksums to this manifest file.");
+    checksum_parser.add_argument(std::vector<std::string>{"--verify"}).store_true().help("Treat path as a manifest and verify the files it lists.");
+    checksum_parser.add_argument(std::vector<std::string>{"--cache"}).store_true().help("Reuse digests cached in user.allin1.* xattrs for unchanged files, and cache new ones.");
+    checksum_parser.add_argument(std::vector<std::string>{"--jobs"}).takes_value().help("Number of parallel workers (0 = one per CPU).");
+
+    auto& dedupe_parser = io_parser.add_subparser("dedupe");
+    dedupe_parser.add_description("Find files with identical contents, optionally replacing the copies by links.");
+    dedupe_parser.add_argument(std::vector<std::string>{"path"}).help("The directory to search.").required();
+    dedupe_parser.add_argument(std::vector<std::string>{"--hardlink"}).store_true().help("Replace each duplicate by a hard link to the file kept (duplicates take on its owner, mode and times).");
+    dedupe_parser.add_argument(std::vector<std::string>{"--reflink"}).store_true().help("Share the kept file's extents with each duplicate (FIDEDUPERANGE; btrfs, XFS).");
+    dedupe_parser.add_argument(std::vector<std::string>{"--algorithm"}).takes_value().help("Hash algorithm: crc32c, xxh64 or sha256 (default sha256 with --hardlink, otherwise xxh64).");
+    dedupe_parser.add_argument(std::vector<std::string>{"--min-size"}).takes_value().help("Ignore files smaller than this (e.g., 4K; default 1 byte).");
+    dedupe_parser.add_argument(std::vector<std::string>{"--jobs"}).takes_value().help("Number of parallel readers (0 = one per CPU).");
+
+    auto& du_parser = io_parser.add_subparser("du");
+    du_parser.add_description("Measure the disk space used by a directory tree, counting hard links once.");
+    du_parser.add_argument(std::vector<std::string>{"path"}).help("The directory to measure.").required();
+    du_parser.add_argument(std::vector<std::string>{"--top"}).takes_value().help("Number of largest subdirectories to list (default 10, 0 = totals only).");
+    du_parser.add_argument(std::vector<std::string>{"--one-file-system"}).store_true().help("Do not descend into directories on other filesystems.");
+    du_parser.add_argument(std::vector<std::string>{"--apparent-size"}).store_true().help("Rank by file sizes instead of allocated space (sparse files count in full).");
+    du_parser.add_argument(std::vector<std::string>{"--jobs"}).takes_value().help("Number of parallel workers (0 = one per CPU).");
+
+    auto& sync_parser = io_parser.add_subparser("sync");
+    sync_parser.add_description("Mirror a directory tree incrementally, copying only what changed since the last sync.");
+    sync_parser.add_argument(std::vector<std::string>{"source"}).help("The directory to mirror.").required();
+    sync_parser.add_argument(std::vector<std::string>{"destination"}).help("The directory to bring up to date (created if missing).").required();
+    sync_parser.add_argument(std::vector<std::string>{"--delete"}).store_true().help("Remove destination entries that are not in the source.");
+    sync_parser.add_argument(std::vector<std::string>{"--rescan"}).store_true().help("Ignore the index kept in the destination and compare every directory.");
+    sync_parser.add_argument(std::vector<std::string>{"--delta-min-size"}).takes_value().help("Update changed files at least this large block by block in place (e.g., 64M; default 16M).");
+    sync_parser.add_argument(std::vector<std::string>{"--jobs"}).takes_value().help("Number of parallel workers (0 = one per CPU).");
 
     auto& symlink_parser = io_parser.add_subparser("symlink");
     symlink_parser.add_description("Create a symbolic link.");
-    symlink_parser.add_argument(std::vector<std::string>{"target_path"}).help("The original file or directory to link to.").required();
-    symlink_parser.add_argument(std::vector<std::string>{"link_path"}).help("The path where the symlink will be created.").required();
+    symlink_parser.add_argument(std::vector<std::string>{"target_path"}).help("The original file or directory to link to (with --audit, the tree to scan).").required();
+    symlink_parser.add_argument(std::vector<std::string>{"link_path"}).help("The path where the symlink will be created (not used with --audit).");
     symlink_parser.add_argument(std::vector<std::string>{"--directory"}).store_true().help("Specify if the target is a directory (Windows only).");
+    symlink_parser.add_argument(std::vector<std::string>{"--mirror"}).store_true().help("Mirror the tree at target_path into link_path: directories are created, every other entry becomes a relative symlink.");
+    symlink_parser.add_argument(std::vector<std::string>{"--incremental"}).store_true().help("With --mirror, retarget changed links and remove links whose source is gone.");
+    symlink_parser.add_argument(std::vector<std::string>{"--audit"}).store_true().help("Scan the tree at target_path for dangling and looping symlinks.");
+    symlink_parser.add_argument(std::vector<std::string>{"--remove"}).store_true().help("With --audit, remove broken symlinks that were not retargeted.");
+    symlink_parser.add_argument(std::vector<std::string>{"--retarget"}).takes_value().help("With --audit, point broken symlinks whose target starts with OLD at NEW instead (OLD=NEW), if that resolves.");
+    symlink_parser.add_argument(std::vector<std::string>{"--jobs"}).takes_value().help("With --mirror or --audit, the number of parallel workers (0 = one per CPU).");
+    symlink_parser.add_argument(std::vector<std::string>{"--replace"}).store_true().help("Atomically switch an existing symlink to the new target; readers never see it missing.");
 
     auto& shortcut_parser = io_parser.add_subparser("shortcut");
     shortcut_parser.add_description("Create a platform-specific shortcut.");
-    shortcut_parser.add_argument(std::vector<std::string>{"target_path"}).help("The original file or directory to link to.").required();
-    shortcut_parser.add_argument(std::vector<std::string>{"link_path"}).help("The path where the shortcut will be created.").required();
+    shortcut_parser.add_argument(std::vector<std::string>{"target_path"}).help("The original file or directory to link to (not used with --manifest).");
+    shortcut_parser.add_argument(std::vector<std::string>{"link_path"}).help("The path where the shortcut will be created (not used with --manifest).");
     shortcut_parser.add_argument(std::vector<std::string>{"--description"}).takes_value().help("A description for the shortcut.");
+    shortcut_parser.add_argument(std::vector<std::string>{"--atomic"}).store_true().help("Write the .desktop file out of sight and publish it complete in one step (Linux).");
+    shortcut_parser.add_argument(std::vector<std::string>{"--manifest"}).takes_value().help("Create one shortcut per line of this file (target<TAB>link[<TAB>description]).");
+    shortcut_parser.add_argument(std::vector<std::string>{"--list"}).store_true().help("List the application shortcuts installed across the XDG data directories (Linux).");
+    shortcut_parser.add_argument(std::vector<std::string>{"--find"}).takes_value().help("List only the installed shortcuts whose id, name, comment, keywords or command contain this text.");
+    shortcut_parser.add_argument(std::vector<std::string>{"--jobs"}).takes_value().help("With --manifest, --list or --find, the number of parallel workers (0 = one per CPU).");
 
     auto& permission_parser = io_parser.add_subparser("permission");
     permission_parser.add_description("Set permissions for a user on a file or directory.");
@@ -36,4 +114,163 @@ void register_io_commands(cppParse::Parser& io_parser) {
     permission_parser.add_argument(std::vector<std::string>{"--recursive"}).store_true().help("Apply permissions recursively to subdirectories.");
 }
 
+void run_io_command(cppParse::Parser& io_parser, bool output_enabled) {
+    if (io_parser.is_subcommand_used("create")) {
+        auto& used_create_parser = io_parser.get_subparser("create");
+
+        std::string type = used_create_parser.get<std::string>("type");
+        std::string path = used_create_parser.get<std::string>("path");
+        std::string name = used_create_parser.get<std::string>("name");
+        std::string fill = used_create_parser.get<std::string>("fill");
+        std::string fill_size = used_create_parser.get<std::string>("fill-size");
+        bool no_cache = used_create_parser.get<bool>("no-cache");
+        bool verify = used_create_parser.get<bool>("verify");
+        bool atomic = used_create_parser.get<bool>("atomic");
+
+        handle_create(type, path, name, fill, fill_size, no_cache, verify, atomic, output_enabled);
+    } else if (io_parser.is_subcommand_used("remove")) {
+        auto& used_remove_parser = io_parser.get_subparser("remove");
+
+        std::string path = used_remove_parser.get<std::string>("path");
+        bool recursive = used_remove_parser.get<bool>("recursive");
+        bool background = used_remove_parser.get<bool>("background");
+        std::string jobs = used_remove_parser.get<std::string>("jobs");
+
+        handle_remove(path, recursive, background, jobs, output_enabled);
+    } else if (io_parser.is_subcommand_used("copy")) {
+        auto& used_copy_parser = io_parser.get_subparser("copy");
+
+        std::string source = used_copy_parser.get<std::string>("source");
+        std::string destination = used_copy_parser.get<std::string>("destination");
+        bool recursive = used_copy_parser.get<bool>("recursive");
+        std::string jobs = used_copy_parser.get<std::string>("jobs");
+        bool no_cache = used_copy_parser.get<bool>("no-cache");
+
+        handle_copy(source, destination, recursive, jobs, no_cache, output_enabled);
+    } else if (io_parser.is_subcommand_used("checksum")) {
+        auto& used_checksum_parser = io_parser.get_subparser("checksum");
+
+        std::string path = used_checksum_parser.get<std::string>("path");
+        std::string algorithm = used_checksum_parser.get<std::string>("algorithm");
+        bool recursive = used_checksum_parser.get<bool>("recursive");
+        std::string manifest = used_checksum_parser.get<std::string>("manifest");
+        bool verify = used_checksum_parser.get<bool>("verify");
+        bool use_cache = used_checksum_parser.get<bool>("cache");
+        std::string jobs = used_checksum_parser.get<std::string>("jobs");
+
+        handle_checksum(path, algorithm, recursive, manifest, verify, use_cache, jobs, output_enabled);
+    } else if (io_parser.is_subcommand_used("dedupe")) {
+        auto& used_dedupe_parser = io_parser.get_subparser("dedupe");
+
+        std::string path = used_dedupe_parser.get<std::string>("path");
+        bool hardlink = used_dedupe_parser.get<bool>("hardlink");
+        bool reflink = used_dedupe_parser.get<bool>("reflink");
+        std::string algorithm = used_dedupe_parser.get<std::string>("algorithm");
+        std::string min_size = used_dedupe_parser.get<std::string>("min-size");
+        std::string jobs = used_dedupe_parser.get<std::string>("jobs");
+
+        handle_dedupe(path, hardlink, reflink, algorithm, min_size, jobs, output_enabled);
+    } else if (io_parser.is_subcommand_used("du")) {
+        auto& used_du_parser = io_parser.get_subparser("du");
+
+        std::string path = used_du_parser.get<std::string>("path");
+        std::string top = used_du_parser.get<std::string>("top");
+        bool one_file_system = used_du_parser.get<bool>("one-file-system");
+        bool apparent_size = used_du_parser.get<bool>("apparent-size");
+        std::string jobs = used_du_parser.get<std::string>("jobs");
+
+        handle_disk_usage(path, top, one_file_system, apparent_size, jobs, output_enabled);
+    } else if (io_parser.is_subcommand_used("sync")) {
+        auto& used_sync_parser = io_parser.get_subparser("sync");
+
+        std::string source = used_sync_parser.get<std::string>("source");
+        std::string destination = used_sync_parser.get<std::string>("destination");
+        bool delete_extraneous = used_sync_parser.get<bool>("delete");
+        bool rescan = used_sync_parser.get<bool>("rescan");
+        std::string delta_min_size = used_sync_parser.get<std::string>("delta-min-size");
+        std::string jobs = used_sync_parser.get<std::string>("jobs");
+
+        handle_sync(source, destination, delete_extraneous, rescan, delta_min_size, jobs, output_enabled);
+    } else if (io_parser.is_subcommand_used("symlink")) {
+        auto& used_symlink_parser = io_parser.get_subparser("symlink");
+
+        std::string target_path = used_symlink_parser.get<std::string>("target_path");
+        std::string link_path = used_symlink_parser.get<std::string>("link_path");
+        bool is_directory = used_symlink_parser.get<bool>("directory");
+        bool replace = used_symlink_parser.get<bool>("replace");
+        std::string jobs = used_symlink_parser.get<std::string>("jobs");
+        bool remove = used_symlink_parser.get<bool>("remove");
+        std::string retarget = used_symlink_parser.get<std::string>("retarget");
+        bool audit = used_symlink_parser.get<bool>("audit");
+        bool mirror = used_symlink_parser.get<bool>("mirror");
+        bool incremental = used_symlink_parser.get<bool>("incremental");
+
+        if (audit && mirror) {
+            throw std::runtime_error("--audit and --mirror cannot be combined.");
+        } else if ((audit || mirror) && (replace || is_directory)) {
+            throw std::runtime_error("--replace and --directory cannot be combined with --audit or --mirror.");
+        } else if (!audit && (remove || !retarget.empty())) {
+            throw std::runtime_error("--remove and --retarget can only be used with --audit.");
+        } else if (!mirror && incremental) {
+            throw std::runtime_error("--incremental can only be used with --mirror.");
+        } else if (!audit && !mirror && !jobs.empty()) {
+            throw std::runtime_error("--jobs can only be used with --mirror or --audit.");
+        }
+
+        if (audit) {
+            if (!link_path.empty()) {
+                throw std::runtime_error("--audit takes only target_path, not link_path.");
+            }
+            handle_symlink_audit(target_path, remove, retarget, jobs, output_enabled);
+        } else if (link_path.empty()) {
+            throw std::runtime_error("Required positional argument missing: link_path");
+        } else if (mirror) {
+            handle_symlink_mirror(target_path, link_path, incremental, jobs, output_enabled);
+        } else {
+            handle_symlink(target_path, link_path, is_directory, replace, output_enabled);
+        }
+    } else if (io_parser.is_subcommand_used("shortcut")) {
+        auto& used_shortcut_parser = io_parser.get_subparser("shortcut");
+
+        std::string target_path = used_shortcut_parser.get<std::string>("target_path");
+        std::string link_path = used_shortcut_parser.get<std::string>("link_path");
+        std::string description = used_shortcut_parser.get<std::string>("description");
+        bool atomic = used_shortcut_parser.get<bool>("atomic");
+        std::string manifest = used_shortcut_parser.get<std::string>("manifest");
+        std::string find = used_shortcut_parser.get<std::string>("find");
+
+        if (used_shortcut_parser.get<bool>("list") || !find.empty()) {
+            if (!target_path.empty() || !manifest.empty() || atomic) {
+                throw std::runtime_error("--list and --find cannot be combined with target_path, link_path, --manifest or --atomic.");
+            }
+            std::string jobs = used_shortcut_parser.get<std::string>("jobs");
+            handle_shortcut_list(find, jobs, output_enabled);
+        } else if (!manifest.empty()) {
+            if (!target_path.empty() || !description.empty()) {
+                throw std::runtime_error("--manifest cannot be combined with target_path, link_path or --description.");
+            }
+            std::string jobs = used_shortcut_parser.get<std::string>("jobs");
+            handle_shortcut_manifest(manifest, atomic, jobs, output_enabled);
+        } else if (target_path.empty()) {
+            throw std::runtime_error("Required positional argument missing: target_path");
+        } else if (link_path.empty()) {
+            throw std::runtime_error("Required positional argument missing: link_path");
+        } else {
+            handle_shortcut(target_path, link_path, description, atomic, output_enabled);
+        }
+    } else if (io_parser.is_subcommand_used("permission")) {
+        auto& used_permission_parser = io_parser.get_subparser("permission");
+
+        std::string path = used_permission_parser.get<std::string>("path");
+        std::string user = used_permission_parser.get<std::string>("user");
+        std::string permissions = used_permission_parser.get<std::string>("permissions");
+        bool recursive = used_permission_parser.get<bool>("recursive");
+
+        handle_permission(path, user, permissions, recursive, output_enabled);
+    } else {
+        cppParse::HelpFormatter formatter(io_parser);
+        common::out() << formatter.format();
+    }
+}
+
 } // namespace allin1::io
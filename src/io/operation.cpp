@@ -0,0 +1,56 @@
+#include "io/operation.hpp"
+#include "common/output.hpp"
+
+namespace allin1::io {
+
+const char* progress_kind_name(ProgressKind kind) {
+    switch (kind) {
+        case ProgressKind::Created: return "created";
+        case ProgressKind::Linked: return "linked";
+        case ProgressKind::Removed: return "removed";
+        case ProgressKind::Broken: return "broken";
+        case ProgressKind::Copied: return "copied";
+        case ProgressKind::Hashed: return "hashed";
+        case ProgressKind::Verified: return "verified";
+        case ProgressKind::Duplicate: return "duplicate";
+        case ProgressKind::PermissionSet: return "permission_set";
+        case ProgressKind::BytesWritten: return "bytes_written";
+        case ProgressKind::EntryFailed: return "entry_failed";
+        case ProgressKind::Warning: return "warning";
+    }
+    return "unknown";
+}
+
+void emit_progress_record(const std::string& op, const ProgressEvent& event) {
+    if (common::output_format() == common::OutputFormat::Text) {
+        return;
+    }
+    common::OutputRecord record(progress_kind_name(event.kind));
+    record.add("op", op).add("path", event.path);
+    if (event.bytes != 0 || event.kind == ProgressKind::BytesWritten) {
+        record.add("bytes", event.bytes);
+    }
+    if (!event.message.empty()) {
+        record.add("message", event.message);
+    }
+    common::emit(record);
+}
+
+void emit_result_record(const std::string& op, const OperationResult& result) {
+    if (common::output_format() == common::OutputFormat::Text) {
+        return;
+    }
+    common::OutputRecord record("result");
+    record.add("op", op)
+        .add("ok", result.ok())
+        .add("entries", result.entries_processed)
+        .add("failed", result.entries_failed)
+        .add("bytes", result.bytes_written);
+    if (result.bytes_read != 0) {
+        record.add("bytes_read", result.bytes_read);
+    }
+    record.add("elapsed_ns", static_cast<int64_t>(result.elapsed.count()));
+    common::emit(record);
+}
+
+} // namespace allin1::io
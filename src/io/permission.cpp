@@ -1,11 +1,34 @@
 #include "io/permission.hpp"
 #include "common/permission_utils.hpp"
 #include "common/error_utils.hpp"
+#include "common/output.hpp"
 
 #include <iostream>
 
 namespace allin1::io {
 
+OperationResult perform_permission(const PermissionOptions& options) {
+    auto start_time = std::chrono::steady_clock::now();
+    OperationResult result;
+
+    common::set_permissions(options.path, options.user, options.permissions, options.recursive,
+        [&](const std::string& entry_path, const common::PermissionError* error) {
+            ++result.entries_processed;
+            if (error) {
+                ++result.entries_failed;
+                result.errors.push_back({entry_path, error->what()});
+                if (options.progress) {
+                    options.progress({ProgressKind::EntryFailed, entry_path, 0, error->what()});
+                }
+            } else if (options.progress) {
+                options.progress({ProgressKind::PermissionSet, entry_path, 0, {}});
+            }
+        });
+
+    result.elapsed = std::chrono::steady_clock::now() - start_time;
+    return result;
+}
+
 void handle_permission(
     const std::string& path,
     const std::string& user,
@@ -13,29 +36,42 @@ void handle_permission(
     bool recursive,
     bool output_enabled
 ) {
-    if (output_enabled) {
-        std::cout << "Settings for io permission:" << std::endl;
-        std::cout << "  Path: " << path << std::endl;
-        std::cout << "  User: " << user << std::endl;
-        std::cout << "  Permissions: " << perm_string << std::endl;
-        std::cout << "  Recursive: " << (recursive ? "true" : "false") << std::endl;
+    bool text_output = output_enabled && common::output_format() == common::OutputFormat::Text;
+    if (text_output) {
+        common::out() << "Settings for io permission:" << '\n';
+        common::out() << "  Path: " << path << '\n';
+        common::out() << "  User: " << user << '\n';
+        common::out() << "  Permissions: " << perm_string << '\n';
+        common::out() << "  Recursive: " << (recursive ? "true" : "false") << '\n';
     }
 
     try {
+        PermissionOptions options;
+        options.path = path;
+        options.user = user;
+        options.permissions = common::parse_permission_string(perm_string);
+        options.recursive = recursive;
+        bool structured = common::output_format() != common::OutputFormat::Text;
+        options.progress = [&user, text_output, structured](const ProgressEvent& event) {
+            if (structured) {
+                emit_progress_record("permission", event);
+            } else if (event.kind == ProgressKind::EntryFailed) {
+                common::err() << "Error setting permission on " << event.path << ": " << event.message << std::endl;
+            } else if (text_output) {
+                common::out() << "Set permissions for " << user << " on " << event.path << '\n';
+            }
+        };
 
-        common::Permissions perms = common::parse_permission_string(perm_string);
-
-
-        common::set_permissions(path, user, perms, recursive, output_enabled);
+        emit_result_record("permission", perform_permission(options));
 
-        if (output_enabled) {
-            std::cout << "Permission operation completed successfully." << std::endl;
+        if (text_output) {
+            common::out() << "Permission operation completed successfully." << '\n';
         }
 
     } catch (const common::PermissionError& e) {
-        std::cerr << "Permission Error: " << e.what() << std::endl;
+        common::err() << "Permission Error: " << e.what() << std::endl;
     } catch (const std::exception& e) {
-        std::cerr << "An unexpected error occurred: " << e.what() << std::endl;
+        common::err() << "An unexpected error occurred: " << e.what() << std::endl;
     }
 }
 
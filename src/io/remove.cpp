@@ -0,0 +1,644 @@
+#include "io/remove.hpp"
+#include "common/atomic_file.hpp"
+#include "common/directory_budget.hpp"
+#include "common/durability.hpp"
+#include "common/error_utils.hpp"
+#include "common/errors.hpp"
+#include "common/output.hpp"
+#include "common/perf_counters.hpp"
+#include "common/stats.hpp"
+#include "common/thread_pool.hpp"
+#include "common/trace.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <cstdio> // renameat2
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace allin1::io {
+
+namespace {
+
+constexpr size_t queued_tasks_per_worker = 16;
+constexpr size_t max_recorded_errors = 1000;
+// Entries other than directories are unlinked in batches of this many per
+// task, so a directory with millions of files is shared among the workers
+constexpr size_t unlinks_per_task = 512;
+// Niceness of the process deleting a tree in the background
+constexpr int background_priority = 10;
+// Open directories are capped against RLIMIT_NOFILE: each holds its fd, plus a
+// listing while it is read. Unlinking needs no fds of its own.
+constexpr size_t fds_per_directory = 2;
+constexpr size_t reserved_fds = 32;
+
+#if !defined(_WIN32)
+class RemoveWalk;
+
+// A directory being emptied. Every task working in it holds a reference, and
+// so does every subdirectory, so the directory is removed from its parent when
+// the last of them is done.
+struct RemoveDir {
+    RemoveWalk* walk = nullptr;
+    std::shared_ptr<RemoveDir> parent;
+    int parent_fd = -1;                     // The parent's fd, or for the root one the walk owns
+    std::string name;                       // Name in parent_fd
+    std::string path;                       // For messages
+    int fd = -1;
+    dev_t dev = 0;
+    std::atomic<bool> incomplete{false};    // Something below could not be removed, so neither can this
+
+    ~RemoveDir();
+};
+
+// Removes a directory tree with a pool of workers. The task queue is capped:
+// once it is full, the thread that wanted to queue work runs it instead, which
+// keeps memory bounded however large the tree is. Open directories are capped
+// by a DirectoryBudget.
+class RemoveWalk {
+public:
+    // held_fds: descriptors the caller keeps open elsewhere meanwhile
+    RemoveWalk(const RemoveOptions& options, size_t workers, size_t held_fds = 0)
+        : m_options(options),
+          m_pool(workers),
+          m_output_context(common::current_output_context()),
+          m_max_queued(m_pool.size() * queued_tasks_per_worker),
+          m_budget(fds_per_directory, reserved_fds + held_fds + m_pool.size() * common::perf_counter_fds_per_thread()) {}
+
+    // Removes the directory name in parent_fd with everything below it
+    OperationResult run(int parent_fd, const std::string& name, const std::string& path);
+    void finish_directory(RemoveDir& node);
+    void directory_closed();
+
+private:
+    void report(const ProgressEvent& event) {
+        if (m_options.progress) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_options.progress(event);
+        }
+    }
+
+    void fail(RemoveDir* node, const std::string& path, const std::string& message) {
+        m_failed.fetch_add(1, std::memory_order_relaxed);
+        if (node) {
+            node->incomplete.store(true, std::memory_order_relaxed);
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_errors.size() < max_recorded_errors) {
+                m_errors.push_back({path, message});
+            }
+        }
+        report({ProgressKind::EntryFailed, path, 0, message});
+    }
+
+    void fail_errno(RemoveDir* node, const std::string& what, const std::string& path, int error_code) {
+        common::record_error(error_code);
+        fail(node, path, what + ": " + common::get_system_error_message(static_cast<unsigned long>(error_code)));
+    }
+
+    void schedule(std::function<void()> task);
+    void queue(std::function<void()> task);
+    void run_task(const std::function<void()>& task);
+    void enter_directory(const std::shared_ptr<RemoveDir>& parent, int parent_fd, const std::string& name, const std::string& path);
+    void open_and_scan_directory(const std::shared_ptr<RemoveDir>& parent, int parent_fd, const std::string& name, const std::string& path);
+    std::shared_ptr<RemoveDir> open_directory(const std::shared_ptr<RemoveDir>& parent, int parent_fd, const std::string& name, const std::string& path);
+    void scan_directory(const std::shared_ptr<RemoveDir>& node);
+    void unlink_batch(const std::shared_ptr<RemoveDir>& node, const std::vector<std::string>& names);
+
+    const RemoveOptions& m_options;
+    common::ThreadPool m_pool;
+    common::OutputContext m_output_context;
+    size_t m_max_queued;
+    std::atomic<size_t> m_queued{0};
+    common::DirectoryBudget m_budget;
+
+    std::atomic<uint64_t> m_removed{0};
+    std::atomic<uint64_t> m_failed{0};
+    std::mutex m_mutex;                     // Guards m_errors and calls into m_options.progress
+    std::vector<EntryError> m_errors;
+};
+
+RemoveDir::~RemoveDir() {
+    if (fd >= 0) ::close(fd);
+    if (walk) {
+        walk->finish_directory(*this);
+        walk->directory_closed();
+    }
+}
+
+void RemoveWalk::run_task(const std::function<void()>& task) {
+    try {
+        task();
+    } catch (const std::exception& e) {
+        fail(nullptr, {}, e.what());
+    }
+}
+
+void RemoveWalk::schedule(std::function<void()> task) {
+    if (m_queued.load(std::memory_order_relaxed) >= m_max_queued) {
+        run_task(task); // Caller runs: keeps the queue, and memory, bounded
+        return;
+    }
+    queue(std::move(task));
+}
+
+void RemoveWalk::queue(std::function<void()> task) {
+    m_queued.fetch_add(1, std::memory_order_relaxed);
+    m_pool.submit([this, task = std::move(task)] {
+        m_queued.fetch_sub(1, std::memory_order_relaxed);
+        common::ScopedOutputContext context(m_output_context);
+        run_task(task);
+    });
+}
+
+void RemoveWalk::finish_directory(RemoveDir& node) {
+    if (node.incomplete.load(std::memory_order_relaxed)) {
+        if (node.parent) {
+            node.parent->incomplete.store(true, std::memory_order_relaxed);
+        }
+        return;
+    }
+    int result;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Unlink);
+        result = ::unlinkat(node.parent_fd, node.name.c_str(), AT_REMOVEDIR);
+    }
+    if (result != 0 && errno != ENOENT) {
+        int error_code = errno;
+        fail_errno(node.parent.get(), "Failed to remove directory", node.path, error_code);
+        return;
+    }
+    m_removed.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Called once a directory is closed; a deferred directory takes over its slot.
+// It is always queued, since this runs from a RemoveDir destructor.
+void RemoveWalk::directory_closed() {
+    if (auto next = m_budget.release()) {
+        queue(std::move(next));
+    }
+}
+
+void RemoveWalk::enter_directory(const std::shared_ptr<RemoveDir>& parent, int parent_fd, const std::string& name, const std::string& path) {
+    if (!m_budget.acquire_or_defer([this, parent, parent_fd, name, path] { open_and_scan_directory(parent, parent_fd, name, path); })) {
+        return; // Entered once another directory is closed
+    }
+    if (auto node = open_directory(parent, parent_fd, name, path)) {
+        schedule([this, node] { scan_directory(node); });
+    } else {
+        directory_closed();
+    }
+}
+
+// Runs a deferred directory, whose slot in the budget is already taken.
+void RemoveWalk::open_and_scan_directory(const std::shared_ptr<RemoveDir>& parent, int parent_fd, const std::string& name, const std::string& path) {
+    if (auto node = open_directory(parent, parent_fd, name, path)) {
+        scan_directory(node);
+    } else {
+        directory_closed();
+    }
+}
+
+std::shared_ptr<RemoveDir> RemoveWalk::open_directory(const std::shared_ptr<RemoveDir>& parent, int parent_fd, const std::string& name, const std::string& path) {
+    int fd;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Open);
+        fd = ::openat(parent_fd, name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    }
+    if (fd < 0) {
+        if (errno != ENOENT) {
+            fail_errno(parent.get(), "Failed to open directory", path, errno);
+        }
+        return nullptr;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        int error_code = errno;
+        ::close(fd);
+        fail_errno(parent.get(), "Failed to stat directory", path, error_code);
+        return nullptr;
+    }
+    if (parent && st.st_dev != parent->dev) {
+        ::close(fd);
+        fail(parent.get(), path, "Not removing a mount point");
+        return nullptr;
+    }
+
+    auto node = std::make_shared<RemoveDir>();
+    node->parent = parent;
+    node->parent_fd = parent_fd;
+    node->name = name;
+    node->path = path;
+    node->fd = fd;
+    node->dev = st.st_dev;
+    node->walk = this;
+    return node;
+}
+
+void RemoveWalk::scan_directory(const std::shared_ptr<RemoveDir>& node) {
+    common::TraceScope trace("remove.directory", node->path);
+
+    int listing_fd = ::dup(node->fd); // fdopendir takes ownership; the node keeps its own fd
+    DIR* dir = listing_fd >= 0 ? ::fdopendir(listing_fd) : nullptr;
+    if (!dir) {
+        int error_code = errno;
+        if (listing_fd >= 0) ::close(listing_fd);
+        fail_errno(node.get(), "Failed to read directory", node->path, error_code);
+        return;
+    }
+
+    // Unlinks run while the directory is still being read; entries removed
+    // meanwhile may or may not be listed again, and unlink_batch skips those
+    std::vector<std::string> batch;
+    batch.reserve(unlinks_per_task);
+    while (true) {
+        errno = 0;
+        dirent* entry = ::readdir(dir);
+        if (!entry) {
+            if (errno != 0) {
+                fail_errno(node.get(), "Failed to read directory", node->path, errno);
+            }
+            break;
+        }
+        const char* name = entry->d_name;
+        if (std::strcmp(name, ".") == 0 || std::strcmp(name, "..") == 0) {
+            continue;
+        }
+        if (entry->d_type == DT_DIR) {
+            enter_directory(node, node->fd, name, node->path + "/" + name);
+            continue;
+        }
+        batch.emplace_back(name); // DT_UNKNOWN too: unlink_batch finds out which are directories
+        if (batch.size() == unlinks_per_task) {
+            schedule([this, node, names = std::move(batch)] { unlink_batch(node, names); });
+            batch = {};
+            batch.reserve(unlinks_per_task);
+        }
+    }
+    ::closedir(dir);
+    if (!batch.empty()) {
+        unlink_batch(node, batch);
+    }
+}
+
+void RemoveWalk::unlink_batch(const std::shared_ptr<RemoveDir>& node, const std::vector<std::string>& names) {
+    common::TraceScope trace("remove.unlink", node->path);
+    uint64_t removed = 0;
+    for (const auto& name : names) {
+        int result;
+        {
+            common::ScopedOpTimer timer(common::StatOp::Unlink);
+            result = ::unlinkat(node->fd, name.c_str(), 0);
+        }
+        if (result == 0) {
+            ++removed;
+            continue;
+        }
+        int error_code = errno;
+        if (error_code == ENOENT) {
+            continue;
+        }
+        struct stat st;
+        if ((error_code == EISDIR || error_code == EPERM) && // POSIX allows EPERM for directories
+            ::fstatat(node->fd, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode)) {
+            enter_directory(node, node->fd, name, node->path + "/" + name);
+            continue;
+        }
+        fail_errno(node.get(), "Failed to remove", node->path + "/" + name, error_code);
+    }
+    m_removed.fetch_add(removed, std::memory_order_relaxed);
+    common::count(common::StatCounter::EntriesVisited, removed);
+}
+
+OperationResult RemoveWalk::run(int parent_fd, const std::string& name, const std::string& path) {
+    enter_directory(nullptr, parent_fd, name, path);
+    m_pool.wait_idle();
+    // Directories deferred below a chain of open ones deeper than the budget
+    while (auto next = m_budget.take_stalled()) {
+        queue(std::move(next));
+        m_pool.wait_idle();
+    }
+
+    OperationResult result;
+    result.entries_processed = m_removed.load() + m_failed.load();
+    result.entries_failed = m_failed.load();
+    result.errors = std::move(m_errors);
+    return result;
+}
+
+// Renames from to to within dir_fd unless to exists. Returns 0 or the errno of the failure.
+int rename_no_replace(int dir_fd, const char* from, const char* to) {
+    common::ScopedOpTimer timer(common::StatOp::Rename);
+#if defined(__linux__) && defined(RENAME_NOREPLACE)
+    if (::renameat2(dir_fd, from, dir_fd, to, RENAME_NOREPLACE) == 0) {
+        return 0;
+    }
+    if (errno != EINVAL && errno != ENOSYS) { // Filesystems without RENAME_NOREPLACE fall through
+        return errno;
+    }
+#endif
+    struct stat st;
+    if (::fstatat(dir_fd, to, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+        return EEXIST;
+    }
+    return ::renameat(dir_fd, from, dir_fd, to) == 0 ? 0 : errno;
+}
+
+// Deletes the tree at path from a new process started from this executable
+// (see run_background_remove), so that the deletion neither holds up the
+// command nor outlives it as a zombie, and is not killed along with the
+// terminal. Starting afresh instead of forking keeps the locks and threads of
+// this process, and every fd but the standard ones, out of it. Returns false
+// if it could not start.
+bool remove_in_background(const std::string& path, size_t workers) {
+#if defined(__linux__)
+    const char* executable = "/proc/self/exe";
+    std::string jobs = std::to_string(workers);
+    std::vector<char*> argv = {
+        const_cast<char*>(executable),
+        const_cast<char*>(background_remove_argument),
+        const_cast<char*>(path.c_str()),
+        jobs.data(),
+        nullptr
+    };
+
+    posix_spawn_file_actions_t actions;
+    ::posix_spawn_file_actions_init(&actions);
+    ::posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    ::posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    ::posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 34))
+    ::posix_spawn_file_actions_addclosefrom_np(&actions, STDERR_FILENO + 1); // Even fds opened without O_CLOEXEC
+#endif
+    posix_spawnattr_t attributes;
+    ::posix_spawnattr_init(&attributes);
+    sigset_t no_signals;
+    sigemptyset(&no_signals);
+    ::posix_spawnattr_setsigmask(&attributes, &no_signals);
+    ::posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGMASK);
+
+    pid_t child;
+    int error_code = ::posix_spawn(&child, executable, &actions, &attributes, argv.data(), environ);
+    ::posix_spawnattr_destroy(&attributes);
+    ::posix_spawn_file_actions_destroy(&actions);
+    if (error_code != 0) {
+        return false;
+    }
+    int status = 0;
+    while (::waitpid(child, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#else
+    (void)path;
+    (void)workers;
+    return false; // No way to start this executable again; the caller deletes in the foreground
+#endif
+}
+
+OperationResult remove_posix(const RemoveOptions& options, const std::string& path, int parent_fd, const std::string& name) {
+    OperationResult result;
+    struct stat st;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Stat);
+        if (::fstatat(parent_fd, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            throw common::make_errno_error("Failed to remove", path, errno);
+        }
+    }
+
+    if (!S_ISDIR(st.st_mode) || !options.recursive) {
+        int result_code;
+        {
+            common::ScopedOpTimer timer(common::StatOp::Unlink);
+            result_code = ::unlinkat(parent_fd, name.c_str(), S_ISDIR(st.st_mode) ? AT_REMOVEDIR : 0);
+        }
+        if (result_code != 0) {
+            if (errno == ENOTEMPTY || errno == EEXIST) {
+                throw common::IOCreateError("Failed to remove '" + path + "': the directory is not empty. Use --recursive to remove it with its contents.");
+            }
+            throw common::make_errno_error("Failed to remove", path, errno);
+        }
+        result.entries_processed = 1;
+        if (options.progress) {
+            options.progress({ProgressKind::Removed, path, 0, {}});
+        }
+        return result;
+    }
+
+    size_t workers = options.jobs == 0 ? common::default_worker_count() : options.jobs;
+    if (options.background) {
+        std::string trash;
+        int error_code = EEXIST;
+        for (int attempt = 0; attempt < 16 && error_code == EEXIST; ++attempt) {
+            trash = common::hidden_temp_path(name).string();
+            error_code = rename_no_replace(parent_fd, name.c_str(), trash.c_str());
+        }
+        if (error_code != 0) {
+            throw common::make_errno_error("Failed to move out of the way", path, error_code);
+        }
+        std::string trash_path = (std::filesystem::path(path).parent_path() / trash).string();
+        result.entries_processed = 1;
+        if (remove_in_background(std::filesystem::absolute(trash_path).string(), workers)) {
+            if (options.progress) {
+                options.progress({ProgressKind::Removed, path, 0, "moved to " + trash_path + ", deleting in the background"});
+            }
+            return result;
+        }
+        // No process to hand it to: path is gone already, so finish the job here
+        RemoveWalk walk(options, workers);
+        result = walk.run(parent_fd, trash, trash_path);
+    } else {
+        RemoveWalk walk(options, workers);
+        result = walk.run(parent_fd, name, path);
+    }
+    if (result.ok() && options.progress) {
+        options.progress({ProgressKind::Removed, path, 0, {}});
+    }
+    return result;
+}
+#endif
+
+} // namespace
+
+#if !defined(_WIN32)
+OperationResult remove_directory_at(int parent_fd, const std::string& name, const std::string& path, size_t jobs, size_t held_fds) {
+    RemoveOptions options;
+    options.recursive = true;
+    RemoveWalk walk(options, jobs, held_fds);
+    return walk.run(parent_fd, name, path);
+}
+#endif
+
+OperationResult perform_remove(const RemoveOptions& options) {
+    common::ScopedPerfCounters counters(common::PerfPhase::Remove);
+    auto start_time = std::chrono::steady_clock::now();
+
+    std::string path = options.path.string();
+    while (path.size() > 1 && path.back() == '/') {
+        path.pop_back();
+    }
+    std::filesystem::path target(path);
+    std::string name = target.filename().string();
+    if (name.empty() || name == "." || name == "..") {
+        throw common::IOCreateError("Refusing to remove '" + options.path.string() + "'.");
+    }
+    std::filesystem::path parent = target.has_parent_path() ? target.parent_path() : std::filesystem::path(".");
+
+#if defined(_WIN32)
+    if (options.background) {
+        throw common::IOCreateError("Removing in the background is not supported on Windows.");
+    }
+    std::error_code ec;
+    OperationResult result;
+    if (options.recursive) {
+        std::uintmax_t removed = std::filesystem::remove_all(target, ec);
+        result.entries_processed = removed == static_cast<std::uintmax_t>(-1) ? 0 : removed;
+    } else {
+        result.entries_processed = std::filesystem::remove(target, ec) ? 1 : 0;
+    }
+    if (ec) {
+        throw common::make_errno_error("Failed to remove", target, ec.value());
+    }
+    if (options.progress) {
+        options.progress({ProgressKind::Removed, path, 0, {}});
+    }
+#else
+    int parent_fd = ::open(parent.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (parent_fd < 0) {
+        throw common::make_errno_error("Failed to open directory", parent, errno);
+    }
+    OperationResult result;
+    try {
+        result = remove_posix(options, path, parent_fd, name);
+    } catch (...) {
+        ::close(parent_fd);
+        throw;
+    }
+    ::close(parent_fd);
+    common::track_directory(parent);
+#endif
+    result.elapsed = std::chrono::steady_clock::now() - start_time;
+    return result;
+}
+
+void run_background_remove(const char* path, const char* jobs) {
+#if defined(_WIN32)
+    (void)path;
+    (void)jobs;
+    std::exit(1);
+#else
+    // Anyone can run this executable with these arguments, so only what
+    // perform_remove hands over is accepted: an absolute path to a tree it
+    // renamed out of the way, and a worker count
+    std::filesystem::path target(path);
+    char* jobs_end = nullptr;
+    unsigned long job_count = std::strtoul(jobs, &jobs_end, 10);
+    if (!target.is_absolute() || !common::is_hidden_temp_name(target.filename().string()) ||
+        jobs[0] < '0' || jobs[0] > '9' || *jobs_end != '\0') {
+        common::err() << "Error: " << background_remove_argument << " is for internal use only." << std::endl;
+        std::exit(1);
+    }
+
+    // Nothing else runs in this process yet, so forking is safe. The caller
+    // only waits for this first process, which exits at once.
+    ::setsid();
+    pid_t child = ::fork();
+    if (child != 0) {
+        ::_exit(child < 0 ? 1 : 0);
+    }
+    ::setpriority(PRIO_PROCESS, 0, background_priority);
+    try {
+        int parent_fd = ::open(target.parent_path().c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (parent_fd >= 0) {
+            RemoveOptions quiet;
+            RemoveWalk walk(quiet, std::max<size_t>(job_count, 1));
+            walk.run(parent_fd, target.filename().string(), target.string());
+        }
+    } catch (...) {
+    }
+    ::_exit(0);
+#endif
+}
+
+void handle_remove(
+    const std::string& path,
+    bool recursive,
+    bool background,
+    const std::string& jobs,
+    bool output_enabled
+) {
+    common::TraceScope trace("remove");
+    bool text_output = output_enabled && common::output_format() == common::OutputFormat::Text;
+    if (text_output) {
+        common::out() << "Settings for io remove:" << '\n';
+        common::out() << "  Path: " << path << '\n';
+        common::out() << "  Recursive: " << (recursive ? "true" : "false") << '\n';
+        common::out() << "  Background: " << (background ? "true" : "false") << '\n';
+    }
+    if (background && !recursive) {
+        throw common::IOCreateError("--background can only be used with --recursive.");
+    }
+
+    RemoveOptions options;
+    options.path = path;
+    options.recursive = recursive;
+    options.background = background;
+    if (!jobs.empty()) {
+        try {
+            options.jobs = std::stoul(jobs);
+        } catch (const std::exception&) {
+            throw common::IOCreateError("Invalid value for --jobs: \"" + jobs + "\"");
+        }
+    }
+    bool structured = common::output_format() != common::OutputFormat::Text;
+    std::string removed_message;
+    options.progress = [&removed_message, structured](const ProgressEvent& event) {
+        if (event.kind == ProgressKind::Removed) {
+            removed_message = event.message;
+        }
+        if (structured) {
+            emit_progress_record("remove", event);
+        } else if (event.kind == ProgressKind::EntryFailed) {
+            common::err() << "Error removing " << event.path << ": " << event.message << std::endl;
+        }
+    };
+
+    OperationResult result = perform_remove(options);
+    emit_result_record("remove", result);
+
+    if (!result.ok()) {
+        throw common::IOCreateError(std::to_string(result.entries_failed) + " entries could not be removed; " +
+                                    std::to_string(result.entries_processed - result.entries_failed) + " were.");
+    }
+    if (text_output) {
+        if (removed_message.empty()) {
+            common::out() << "Removed " << result.entries_processed << " entries at " << path << '\n';
+        } else {
+            common::out() << "Removed " << path << ": " << removed_message << '\n';
+        }
+    }
+}
+
+} // namespace allin1::io
@@ -1,13 +1,24 @@
 #include "io/shortcut.hpp"
+#include "common/atomic_file.hpp"
 #include "common/platform.hpp"
 #include "common/error_utils.hpp"
+#include "common/durability.hpp"
 #include "common/errors.hpp"
+#include "common/perf_counters.hpp"
+#include "common/stats.hpp"
+#include "common/thread_pool.hpp"
+#include "common/trace.hpp"
+#include "common/output.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <filesystem>
 #include <fstream>
 #include <stdexcept>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
+#include <cerrno>
 
 #if defined(_WIN32)
 #include <windows.h>
@@ -16,22 +27,272 @@
 #include <objbase.h> // For CoInitializeEx, CoUninitialize
 #pragma comment(lib, "shell32.lib")
 #pragma comment(lib, "ole32.lib")
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #endif
 
 namespace allin1::io {
 
-void handle_shortcut(
-    const std::string& target_path_str,
-    const std::string& link_path_str,
-    const std::string& description,
-    bool output_enabled
-) {
-    if (output_enabled) {
-        std::cout << "Settings for io shortcut:" << std::endl;
-        std::cout << "  Target: " << target_path_str << std::endl;
-        std::cout << "  Link: " << link_path_str << std::endl;
-        std::cout << "  Description: " << description << std::endl;
+namespace {
+
+constexpr size_t manifest_entries_per_task = 64;
+constexpr size_t max_recorded_errors = 1000;
+
+#if defined(__linux__)
+// Appends a desktop entry "string" value, escaping the characters that would
+// otherwise end the line or be read as an escape.
+void append_desktop_value(std::string& out, const std::string& value) {
+    for (char c : value) {
+        switch (c) {
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default: out += c; break;
+        }
+    }
+}
+
+// Quotes target as the single argument of an Exec key, as the desktop entry
+// specification asks: an argument with reserved characters is put in double
+// quotes with '"', '`', '$' and '\\' escaped inside them, and '%' is doubled so
+// it is not read as a field code. The result is still a string value, escaped
+// once more by append_desktop_value.
+std::string quote_exec_argument(const std::string& target) {
+    static constexpr std::string_view reserved = " \t\n\"'\\><~|&;$*?#()`";
+    bool quote = target.empty() || target.find_first_of(reserved) != std::string::npos;
+    std::string quoted;
+    quoted.reserve(target.size() + 2);
+    if (quote) {
+        quoted += '"';
+    }
+    for (char c : target) {
+        if (c == '%') {
+            quoted += '%';
+        } else if (quote && (c == '"' || c == '`' || c == '$' || c == '\\')) {
+            quoted += '\\';
+        }
+        quoted += c;
+    }
+    if (quote) {
+        quoted += '"';
+    }
+    return quoted;
+}
+
+// Renders the whole entry into buffer, which is sized up front so the common
+// case (nothing to escape) never reallocates.
+void render_desktop_entry(std::string& buffer, const std::string& name, const std::string& exec, const std::string& comment) {
+    static constexpr char header[] = "[Desktop Entry]\nType=Application\nName=";
+    static constexpr char footer[] = "Terminal=false\nCategories=Utility;\n";
+    buffer.clear();
+    buffer.reserve(sizeof(header) + sizeof(footer) + name.size() + exec.size() + comment.size() + 32);
+    buffer += header;
+    append_desktop_value(buffer, name);
+    buffer += "\nExec=";
+    append_desktop_value(buffer, quote_exec_argument(exec));
+    buffer += '\n';
+    if (!comment.empty()) {
+        buffer += "Comment=";
+        append_desktop_value(buffer, comment);
+        buffer += '\n';
+    }
+    buffer += footer;
+}
+
+// Writes content to path with one open and one write. A new file is created
+// executable; an existing one is truncated and only gets the exec bits added
+// if it lacks them, which is the only case that costs extra system calls.
+void write_desktop_file(const std::filesystem::path& path, const std::string& content) {
+    bool replaced = false;
+    int fd;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Open);
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0755);
+        if (fd < 0 && errno == EEXIST) {
+            replaced = true;
+            fd = ::open(path.c_str(), O_WRONLY | O_TRUNC | O_CLOEXEC);
+        }
+    }
+    if (fd < 0) {
+        throw common::make_errno_error("Failed to create .desktop file", path.string(), errno);
+    }
+
+    size_t written = 0;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Write);
+        while (written < content.size()) {
+            ssize_t n = ::write(fd, content.data() + written, content.size() - written);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                int error_code = errno;
+                ::close(fd);
+                throw common::make_errno_error("Failed to write .desktop file", path.string(), error_code);
+            }
+            written += static_cast<size_t>(n);
+        }
+    }
+    common::count(common::StatCounter::BytesWritten, written);
+
+    if (replaced) {
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && (st.st_mode & 0111) != 0111) {
+            common::ScopedOpTimer timer(common::StatOp::Chmod);
+            if (::fchmod(fd, (st.st_mode & 07777) | 0111) != 0) {
+                int error_code = errno;
+                ::close(fd);
+                throw common::make_errno_error("Failed to set executable permissions on .desktop file", path.string(), error_code);
+            }
+        }
+    }
+    if (::close(fd) != 0 && errno != EINTR) {
+        throw common::make_errno_error("Failed to write .desktop file", path.string(), errno);
+    }
+}
+
+// Renders and writes "<link>.desktop" pointing at target and returns its path.
+// The parent directory must already exist.
+std::string write_desktop_entry(const std::filesystem::path& target, const std::filesystem::path& link,
+                                const std::string& description, bool atomic_publish, uint64_t& bytes_written) {
+    thread_local std::string buffer;
+    std::string desktop_path = link.string() + ".desktop";
+    {
+        common::TraceScope trace("shortcut.render", desktop_path);
+        render_desktop_entry(buffer, link.stem().string(), target.string(), description);
+    }
+
+    common::TraceScope trace("shortcut.write", desktop_path);
+    if (atomic_publish) {
+        common::AtomicFile file(desktop_path, 0755);
+        write_desktop_file(file.write_path(), buffer);
+        file.commit();
+    } else {
+        write_desktop_file(desktop_path, buffer);
+    }
+    bytes_written = buffer.size();
+    return desktop_path;
+}
+#endif
+
+struct ManifestEntry {
+    std::string display;                // As listed in the manifest, or "manifest:line" when malformed
+    std::filesystem::path target;
+    std::filesystem::path link;
+    std::string description;
+    std::string created_path;
+    uint64_t bytes = 0;
+    std::string error;
+};
+
+// Parses "target<TAB>link[<TAB>description]" lines; blank lines and lines
+// starting with '#' are skipped. Relative paths are taken relative to the
+// manifest's directory.
+std::vector<ManifestEntry> read_shortcut_manifest(const std::filesystem::path& manifest) {
+    common::TraceScope trace("shortcut.manifest", manifest.string());
+    std::ifstream in(manifest);
+    if (!in) {
+        throw common::make_errno_error("Failed to open manifest", manifest.string(), errno);
+    }
+    std::filesystem::path base = manifest.parent_path();
+    auto resolve = [&base](const std::string& field) {
+        std::filesystem::path path(field);
+        return path.is_absolute() ? path : base / path;
+    };
+
+    std::vector<ManifestEntry> entries;
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(in, line)) {
+        ++line_number;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        ManifestEntry entry;
+        size_t first_tab = line.find('\t');
+        size_t second_tab = first_tab == std::string::npos ? std::string::npos : line.find('\t', first_tab + 1);
+        std::string link = first_tab == std::string::npos ? std::string() : line.substr(first_tab + 1, second_tab - first_tab - 1);
+        if (first_tab == 0 || link.empty()) {
+            entry.display = manifest.string() + ":" + std::to_string(line_number);
+            entry.error = "Malformed manifest line (expected target<TAB>link[<TAB>description])";
+            entries.push_back(std::move(entry));
+            continue;
+        }
+        entry.display = link;
+        entry.target = resolve(line.substr(0, first_tab));
+        entry.link = resolve(link);
+        if (second_tab != std::string::npos) {
+            entry.description = line.substr(second_tab + 1);
+        }
+        entries.push_back(std::move(entry));
+    }
+    if (in.bad()) {
+        throw common::IOCreateError("Failed to read manifest '" + manifest.string() + "'.");
+    }
+    return entries;
+}
+
+// Creates every parent directory once, up front and serially, so the workers
+// only ever write files. Entries whose parent cannot be created are failed.
+void create_manifest_parents(std::vector<ManifestEntry>& entries) {
+    common::TraceScope trace("shortcut.mkdir_parents");
+    std::unordered_map<std::string, std::string> parent_errors;
+    for (auto& entry : entries) {
+        if (!entry.error.empty() || !entry.link.has_parent_path()) {
+            continue;
+        }
+        std::string parent = entry.link.parent_path().string();
+        auto [it, inserted] = parent_errors.try_emplace(parent);
+        if (inserted) {
+            std::error_code ec;
+            std::filesystem::create_directories(parent, ec);
+            if (ec) {
+                common::record_error(ec.value());
+                it->second = "Failed to create parent directories for shortcut: " + ec.message();
+            }
+        }
+        entry.error = it->second;
+    }
+}
+
+void create_manifest_entry(ManifestEntry& entry, bool atomic_publish) {
+    try {
+#if defined(__linux__)
+        entry.created_path = write_desktop_entry(entry.target, entry.link, entry.description, atomic_publish, entry.bytes);
+        common::track_file(entry.created_path);
+        common::track_new_entry(entry.created_path);
+        common::count(common::StatCounter::EntriesVisited);
+#else
+        ShortcutOptions options;
+        options.target = entry.target;
+        options.link = entry.link;
+        options.description = entry.description;
+        options.atomic = atomic_publish;
+        perform_shortcut(options);
+        entry.created_path = entry.link.string();
+#endif
+    } catch (const std::exception& e) {
+        entry.error = e.what();
     }
+}
+
+} // namespace
+
+OperationResult perform_shortcut(const ShortcutOptions& options) {
+    common::ScopedPerfCounters counters(common::PerfPhase::Shortcut);
+    auto start_time = std::chrono::steady_clock::now();
+    OperationResult result;
+    const std::string target_path_str = options.target.string();
+    const std::string link_path_str = options.link.string();
+    const std::string& description = options.description;
+    std::string created_path = link_path_str;
 
     try {
 #if defined(_WIN32)
@@ -107,15 +368,12 @@ void handle_shortcut(
         ppf->Release();
         psl->Release();
         CoUninitialize();
-
-        if (output_enabled) {
-            std::cout << "Windows shortcut created: " << link_path_str << " -> " << target_path_str << std::endl;
-        }
 #elif defined(__linux__)
         std::filesystem::path link_path(link_path_str);
         std::filesystem::path target_path(target_path_str);
 
         if (link_path.has_parent_path()) {
+            common::TraceScope trace("shortcut.mkdir_parents", link_path_str);
             std::error_code ec;
             std::filesystem::create_directories(link_path.parent_path(), ec);
             if (ec) {
@@ -123,45 +381,164 @@ void handle_shortcut(
             }
         }
 
-        std::ofstream desktop_file(link_path.string() + ".desktop");
-        if (!desktop_file.is_open()) {
-            throw common::IOCreateError("Failed to create .desktop file: " + link_path.string() + ".desktop");
-        }
+        created_path = write_desktop_entry(target_path, link_path, description, options.atomic, result.bytes_written);
+        common::track_file(created_path);
+        common::track_new_entry(created_path);
+#else
+        throw common::IOCreateError("Shortcut creation not supported on this OS.");
+#endif
+    } catch (const common::IOCreateError&) {
+        throw; // Re-throw to be caught in main
+    } catch (const std::filesystem::filesystem_error& e) {
+        throw common::IOCreateError("A filesystem error occurred: " + std::string(e.what()));
+    } catch (const std::exception& e) {
+        throw common::IOCreateError("An unexpected error occurred: " + std::string(e.what()));
+    }
 
-        desktop_file << "[Desktop Entry]\\n";
-        desktop_file << "Type=Application\\n";
-        desktop_file << "Name=" << link_path.stem().string() << "\\n";
-        desktop_file << "Exec=" << target_path.string() << "\\n";
-        if (!description.empty()) {
-            desktop_file << "Comment=" << description << "\\n";
-        }
-        desktop_file << "Terminal=false\\n";
-        desktop_file << "Categories=Utility;\\n";
-        desktop_file.close();
+    result.entries_processed = 1;
+    common::count(common::StatCounter::EntriesVisited);
+    if (options.progress) {
+        options.progress({ProgressKind::Created, created_path, 0, {}});
+    }
+    result.elapsed = std::chrono::steady_clock::now() - start_time;
+    return result;
+}
 
-        std::error_code ec;
-        std::filesystem::permissions(link_path.string() + ".desktop",
-                                      std::filesystem::perms::owner_exec |
-                                      std::filesystem::perms::group_exec |
-                                      std::filesystem::perms::others_exec,
-                                      std::filesystem::perm_options::add, ec);
-        if (ec) {
-            throw common::IOCreateError("Failed to set executable permissions on .desktop file: " + ec.message());
-        }
+void handle_shortcut(
+    const std::string& target_path_str,
+    const std::string& link_path_str,
+    const std::string& description,
+    bool atomic,
+    bool output_enabled
+) {
+    common::TraceScope trace("shortcut");
+    bool text_output = output_enabled && common::output_format() == common::OutputFormat::Text;
+    if (text_output) {
+        common::out() << "Settings for io shortcut:" << '\n';
+        common::out() << "  Target: " << target_path_str << '\n';
+        common::out() << "  Link: " << link_path_str << '\n';
+        common::out() << "  Description: " << description << '\n';
+        if (atomic) common::out() << "  Atomic: true" << '\n';
+    }
 
-        if (output_enabled) {
-            std::cout << "Linux .desktop shortcut created: " << link_path.string() << ".desktop -> " << target_path_str << std::endl;
+    ShortcutOptions options;
+    options.target = target_path_str;
+    options.link = link_path_str;
+    options.description = description;
+    options.atomic = atomic;
+    options.progress = [&target_path_str, text_output](const ProgressEvent& event) {
+        emit_progress_record("shortcut", event);
+        if (!text_output) {
+            return;
         }
+#if defined(_WIN32)
+        common::out() << "Windows shortcut created: " << event.path << " -> " << target_path_str << '\n';
 #else
-        throw common::IOCreateError("Shortcut creation not supported on this OS.");
+        common::out() << "Linux .desktop shortcut created: " << event.path << " -> " << target_path_str << '\n';
 #endif
+    };
+
+    emit_result_record("shortcut", perform_shortcut(options));
+}
+
+OperationResult perform_shortcut_manifest(const ShortcutManifestOptions& options) {
+    common::ScopedPerfCounters counters(common::PerfPhase::Shortcut);
+    auto start_time = std::chrono::steady_clock::now();
+    OperationResult result;
+
+    std::vector<ManifestEntry> entries;
+    try {
+        entries = read_shortcut_manifest(options.manifest);
+        create_manifest_parents(entries);
+
+        // Entries are handed out in slices so a worker's task costs a few
+        // hundred microseconds of file creation rather than one queue round trip each.
+        common::ThreadPool pool(options.jobs == 0 ? common::default_worker_count() : options.jobs);
+        for (size_t begin = 0; begin < entries.size(); begin += manifest_entries_per_task) {
+            size_t end = std::min(entries.size(), begin + manifest_entries_per_task);
+            pool.submit([&entries, begin, end, atomic = options.atomic] {
+                for (size_t i = begin; i < end; ++i) {
+                    if (entries[i].error.empty()) {
+                        create_manifest_entry(entries[i], atomic);
+                    }
+                }
+            });
+        }
+        pool.wait_idle();
     } catch (const common::IOCreateError&) {
-        throw; // Re-throw to be caught in main
+        throw;
     } catch (const std::filesystem::filesystem_error& e) {
-        throw common::IOCreateError("A filesystem error occurred: " + std::string(e.what()));
+        common::record_error(e.code().value());
+        throw common::IOCreateError("Filesystem error: " + std::string(e.what()));
     } catch (const std::exception& e) {
         throw common::IOCreateError("An unexpected error occurred: " + std::string(e.what()));
     }
+
+    for (const auto& entry : entries) {
+        ++result.entries_processed;
+        if (!entry.error.empty()) {
+            ++result.entries_failed;
+            if (result.errors.size() < max_recorded_errors) {
+                result.errors.push_back({entry.display, entry.error});
+            }
+            if (options.progress) {
+                options.progress({ProgressKind::EntryFailed, entry.display, 0, entry.error});
+            }
+            continue;
+        }
+        result.bytes_written += entry.bytes;
+        if (options.progress) {
+            options.progress({ProgressKind::Created, entry.created_path, entry.bytes, entry.target.string()});
+        }
+    }
+    result.elapsed = std::chrono::steady_clock::now() - start_time;
+    return result;
+}
+
+void handle_shortcut_manifest(
+    const std::string& manifest,
+    bool atomic,
+    const std::string& jobs,
+    bool output_enabled
+) {
+    common::TraceScope trace("shortcut.bulk");
+    bool text_output = output_enabled && common::output_format() == common::OutputFormat::Text;
+    if (text_output) {
+        common::out() << "Settings for io shortcut --manifest:" << '\n';
+        common::out() << "  Manifest: " << manifest << '\n';
+        if (atomic) common::out() << "  Atomic: true" << '\n';
+    }
+
+    ShortcutManifestOptions options;
+    options.manifest = manifest;
+    options.atomic = atomic;
+    if (!jobs.empty()) {
+        try {
+            options.jobs = std::stoul(jobs);
+        } catch (const std::exception&) {
+            throw common::IOCreateError("Invalid value for --jobs: \"" + jobs + "\"");
+        }
+    }
+    bool structured = common::output_format() != common::OutputFormat::Text;
+    options.progress = [text_output, structured](const ProgressEvent& event) {
+        if (structured) {
+            emit_progress_record("shortcut", event);
+        } else if (event.kind == ProgressKind::EntryFailed) {
+            common::err() << "Error creating shortcut " << event.path << ": " << event.message << std::endl;
+        } else if (text_output) {
+            common::out() << "Shortcut created: " << event.path << " -> " << event.message << '\n';
+        }
+    };
+
+    OperationResult result = perform_shortcut_manifest(options);
+    emit_result_record("shortcut", result);
+
+    if (!result.ok()) {
+        throw common::IOCreateError(std::to_string(result.entries_failed) + " of " + std::to_string(result.entries_processed) + " shortcuts could not be created.");
+    }
+    if (text_output) {
+        common::out() << "Created " << result.entries_processed << " shortcuts from " << manifest << '\n';
+    }
 }
 
 } // namespace allin1::io
@@ -0,0 +1,710 @@
+#include "io/shortcut_index.hpp"
+#include "common/atomic_file.hpp"
+#include "common/error_utils.hpp"
+#include "common/errors.hpp"
+#include "common/output.hpp"
+#include "common/perf_counters.hpp"
+#include "common/stats.hpp"
+#include "common/thread_pool.hpp"
+#include "common/trace.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+namespace allin1::io {
+
+namespace {
+
+// Files parsed per worker task when a changed directory is re-read
+constexpr size_t files_per_task = 32;
+// Anything larger is not a desktop entry worth parsing
+constexpr uint64_t max_desktop_file_bytes = 1 << 20;
+// Directory mtimes this recent are not trusted for the index (see read_directory)
+constexpr int64_t racy_window_ns = 2000000000;
+
+constexpr char index_magic[8] = {'A', '1', 'S', 'C', 'I', 'D', 'X', '\0'};
+constexpr uint32_t index_version = 2;
+
+#if !defined(_WIN32)
+// One .desktop file as recorded in the index
+struct IndexedFile {
+    enum Flags : uint8_t {
+        Valid = 1,              // Has a [Desktop Entry] group
+        Hidden = 2,
+        NoDisplay = 4,
+    };
+
+    std::string name;
+    int64_t mtime_ns = -1;              // Of the file as parsed; -1 if it must be parsed again
+    uint64_t size = 0;
+    uint8_t flags = 0;
+    std::string type;
+    std::string display_name;
+    std::string generic_name;
+    std::string comment;
+    std::string exec;
+    std::string keywords;
+};
+
+// One directory below an applications directory: its listing is valid while
+// its mtime and inode match, each file's entry while the file's mtime and size do
+struct DirectoryRecord {
+    int64_t mtime_ns = 0;
+    uint64_t dev = 0;
+    uint64_t ino = 0;
+    std::vector<std::string> subdirectories;
+    std::vector<IndexedFile> files;
+};
+
+using DirectoryIndex = std::unordered_map<std::string, DirectoryRecord>;
+
+int64_t mtime_ns(const struct stat& st) {
+    return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+// The mtime to record for st, or -1 if it is too recent to be trusted: a file
+// or directory changed within the last couple of seconds could change again
+// without its mtime moving on coarse-grained filesystems, so such a record is
+// read again by the next query.
+int64_t trusted_mtime_ns(const struct stat& st) {
+    struct timespec now;
+    ::clock_gettime(CLOCK_REALTIME, &now);
+    int64_t now_ns = static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+    return now_ns - mtime_ns(st) < racy_window_ns ? -1 : mtime_ns(st);
+}
+
+std::string_view trim(std::string_view text) {
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) {
+        text.remove_prefix(1);
+    }
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t' || text.back() == '\r')) {
+        text.remove_suffix(1);
+    }
+    return text;
+}
+
+// Copies a value out of the file, resolving the spec's escapes (\s \n \t \r \\)
+std::string unescape(std::string_view value) {
+    std::string out;
+    out.reserve(value.size());
+    for (size_t i = 0; i < value.size(); ++i) {
+        if (value[i] != '\\' || i + 1 == value.size()) {
+            out += value[i];
+            continue;
+        }
+        switch (value[++i]) {
+        case 's': out += ' '; break;
+        case 'n': out += '\n'; break;
+        case 't': out += '\t'; break;
+        case 'r': out += '\r'; break;
+        case '\\': out += '\\'; break;
+        default: out += '\\'; out += value[i]; break;
+        }
+    }
+    return out;
+}
+
+// Scans the [Desktop Entry] group of data. Keys and values are views into
+// data; only the fields kept are copied out, and the scan stops at the next group.
+void scan_desktop_entry(std::string_view data, IndexedFile& file) {
+    bool in_entry = false;
+    uint8_t seen = 0;   // Bit per kept key, so the first occurrence wins
+    auto keep = [&seen](uint8_t bit) {
+        bool first = (seen & bit) == 0;
+        seen |= bit;
+        return first;
+    };
+
+    while (!data.empty()) {
+        size_t end = data.find('\n');
+        std::string_view line = trim(data.substr(0, end));
+        data.remove_prefix(end == std::string_view::npos ? data.size() : end + 1);
+        if (line.empty() || line.front() == '#') {
+            continue;
+        }
+        if (line.front() == '[') {
+            if (in_entry) {
+                break;
+            }
+            in_entry = line == "[Desktop Entry]";
+            if (in_entry) {
+                file.flags |= IndexedFile::Valid;
+            }
+            continue;
+        }
+        size_t equals = line.find('=');
+        if (!in_entry || equals == std::string_view::npos) {
+            continue;
+        }
+        std::string_view key = trim(line.substr(0, equals));
+        std::string_view value = trim(line.substr(equals + 1));
+        if (key == "Type" && keep(1)) {
+            file.type = unescape(value);
+        } else if (key == "Name" && keep(2)) {
+            file.display_name = unescape(value);
+        } else if (key == "GenericName" && keep(4)) {
+            file.generic_name = unescape(value);
+        } else if (key == "Comment" && keep(8)) {
+            file.comment = unescape(value);
+        } else if (key == "Exec" && keep(16)) {
+            file.exec = unescape(value);
+        } else if (key == "Keywords" && keep(32)) {
+            file.keywords = unescape(value);
+        } else if (key == "Hidden" && value == "true") {
+            file.flags |= IndexedFile::Hidden;
+        } else if (key == "NoDisplay" && value == "true") {
+            file.flags |= IndexedFile::NoDisplay;
+        }
+    }
+}
+
+// Reads and scans one file; returns the bytes read. Unreadable files are
+// recorded as invalid, like files without a [Desktop Entry] group.
+uint64_t parse_desktop_file(const std::string& path, IndexedFile& file) {
+    thread_local std::string buffer;
+    int fd;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Open);
+        fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    if (fd < 0) {
+        common::record_error(errno);
+        return 0;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        return 0;
+    }
+    file.mtime_ns = trusted_mtime_ns(st);
+    file.size = static_cast<uint64_t>(st.st_size);
+    if (!S_ISREG(st.st_mode) || file.size > max_desktop_file_bytes) {
+        ::close(fd);
+        return 0;
+    }
+    buffer.resize(static_cast<size_t>(st.st_size));
+    size_t filled = 0;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Read);
+        while (filled < buffer.size()) {
+            ssize_t n = ::read(fd, buffer.data() + filled, buffer.size() - filled);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            filled += static_cast<size_t>(n);
+        }
+    }
+    ::close(fd);
+    common::count(common::StatCounter::BytesRead, filled);
+    scan_desktop_entry(std::string_view(buffer.data(), filled), file);
+    return filled;
+}
+
+void put_u32(std::string& out, uint32_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void put_u64(std::string& out, uint64_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void put_string(std::string& out, const std::string& value) {
+    put_u32(out, static_cast<uint32_t>(value.size()));
+    out += value;
+}
+
+// Smallest serialized IndexedFile: mtime, size, flags and six empty strings besides the name
+constexpr size_t min_file_record_bytes = sizeof(int64_t) + sizeof(uint64_t) + sizeof(uint8_t) + 7 * sizeof(uint32_t);
+
+// Reads fields back with bounds checks; any inconsistency throws and the index is discarded
+class IndexReader {
+public:
+    explicit IndexReader(std::string_view data) : m_data(data) {}
+
+    template <typename T>
+    T get() {
+        T value;
+        std::memcpy(&value, take(sizeof(T)).data(), sizeof(T));
+        return value;
+    }
+
+    std::string get_string() {
+        uint32_t size = get<uint32_t>();
+        return std::string(take(size));
+    }
+
+    std::string_view take(size_t size) {
+        if (size > m_data.size()) {
+            throw std::runtime_error("truncated shortcut index");
+        }
+        std::string_view part = m_data.substr(0, size);
+        m_data.remove_prefix(size);
+        return part;
+    }
+
+    bool done() const { return m_data.empty(); }
+    size_t remaining() const { return m_data.size(); }
+
+private:
+    std::string_view m_data;
+};
+
+DirectoryIndex load_index(const std::filesystem::path& cache_file) {
+    common::TraceScope trace("shortcut.index_load", cache_file.string());
+    DirectoryIndex index;
+    std::ifstream in(cache_file, std::ios::binary | std::ios::ate);
+    if (!in) {
+        return index;
+    }
+    std::string data(static_cast<size_t>(in.tellg()), '\0');
+    in.seekg(0);
+    if (!in.read(data.data(), static_cast<std::streamsize>(data.size()))) {
+        return index;
+    }
+    try {
+        IndexReader reader(data);
+        if (reader.take(sizeof(index_magic)) != std::string_view(index_magic, sizeof(index_magic)) ||
+            reader.get<uint32_t>() != index_version) {
+            return index;
+        }
+        uint32_t directories = reader.get<uint32_t>();
+        for (uint32_t d = 0; d < directories; ++d) {
+            std::string path = reader.get_string();
+            DirectoryRecord record;
+            record.mtime_ns = reader.get<int64_t>();
+            record.dev = reader.get<uint64_t>();
+            record.ino = reader.get<uint64_t>();
+            uint32_t subdirectories = reader.get<uint32_t>();
+            for (uint32_t i = 0; i < subdirectories; ++i) {
+                record.subdirectories.push_back(reader.get_string());
+            }
+            uint32_t files = reader.get<uint32_t>();
+            // Checked before allocating: a corrupt count must not reserve gigabytes
+            if (files > reader.remaining() / min_file_record_bytes) {
+                throw std::runtime_error("corrupt shortcut index");
+            }
+            record.files.resize(files);
+            for (auto& file : record.files) {
+                file.name = reader.get_string();
+                file.mtime_ns = reader.get<int64_t>();
+                file.size = reader.get<uint64_t>();
+                file.flags = reader.get<uint8_t>();
+                file.type = reader.get_string();
+                file.display_name = reader.get_string();
+                file.generic_name = reader.get_string();
+                file.comment = reader.get_string();
+                file.exec = reader.get_string();
+                file.keywords = reader.get_string();
+            }
+            index.emplace(std::move(path), std::move(record));
+        }
+        if (!reader.done()) {
+            index.clear();
+        }
+    } catch (const std::exception&) {
+        index.clear();
+    }
+    return index;
+}
+
+// Best effort: a cache that cannot be written only costs the next query a rescan
+void save_index(const std::filesystem::path& cache_file, const DirectoryIndex& index) {
+    common::TraceScope trace("shortcut.index_save", cache_file.string());
+    std::string data(index_magic, sizeof(index_magic));
+    put_u32(data, index_version);
+    put_u32(data, static_cast<uint32_t>(index.size()));
+    for (const auto& [path, record] : index) {
+        put_string(data, path);
+        put_u64(data, static_cast<uint64_t>(record.mtime_ns));
+        put_u64(data, record.dev);
+        put_u64(data, record.ino);
+        put_u32(data, static_cast<uint32_t>(record.subdirectories.size()));
+        for (const auto& subdirectory : record.subdirectories) {
+            put_string(data, subdirectory);
+        }
+        put_u32(data, static_cast<uint32_t>(record.files.size()));
+        for (const auto& file : record.files) {
+            put_string(data, file.name);
+            put_u64(data, static_cast<uint64_t>(file.mtime_ns));
+            put_u64(data, file.size);
+            data += static_cast<char>(file.flags);
+            put_string(data, file.type);
+            put_string(data, file.display_name);
+            put_string(data, file.generic_name);
+            put_string(data, file.comment);
+            put_string(data, file.exec);
+            put_string(data, file.keywords);
+        }
+    }
+
+    try {
+        std::error_code ec;
+        std::filesystem::create_directories(cache_file.parent_path(), ec);
+        common::AtomicFile file(cache_file, 0644);
+        std::ofstream out(file.write_path(), std::ios::binary | std::ios::trunc);
+        out.write(data.data(), static_cast<std::streamsize>(data.size()));
+        out.close();
+        if (out) {
+            file.commit();
+        }
+    } catch (const std::exception&) {
+    }
+}
+
+// A directory as visited, in precedence order
+struct VisitedDirectory {
+    const std::string* path;
+    const DirectoryRecord* record;
+    std::string id_prefix;              // "sub-" for applications/sub, per the desktop file ID rules
+};
+
+class ShortcutScanner {
+public:
+    ShortcutScanner(DirectoryIndex cached, size_t jobs) : m_cached(std::move(cached)), m_jobs(jobs) {}
+
+    void scan_root(const std::filesystem::path& applications) {
+        scan_directory(applications.lexically_normal().string(), std::string());
+    }
+
+    // Parses the files of every directory that was read again
+    uint64_t parse_pending() {
+        if (m_pending.empty()) {
+            return 0;
+        }
+        common::TraceScope trace("shortcut.parse");
+        std::vector<uint64_t> bytes(m_pending.size());
+        size_t workers = std::min(m_jobs == 0 ? common::default_worker_count() : m_jobs,
+                                  (m_pending.size() + files_per_task - 1) / files_per_task);
+        auto parse_range = [this, &bytes](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                auto& [directory, file] = m_pending[i];
+                bytes[i] = parse_desktop_file(*directory + "/" + file->name, *file);
+            }
+        };
+        if (workers <= 1) {
+            parse_range(0, m_pending.size());
+        } else {
+            common::ThreadPool pool(workers);
+            for (size_t begin = 0; begin < m_pending.size(); begin += files_per_task) {
+                size_t end = std::min(m_pending.size(), begin + files_per_task);
+                pool.submit([&parse_range, begin, end] { parse_range(begin, end); });
+            }
+            pool.wait_idle();
+        }
+        uint64_t total = 0;
+        for (uint64_t n : bytes) {
+            total += n;
+        }
+        return total;
+    }
+
+    const std::vector<VisitedDirectory>& visited() const { return m_visited; }
+    const DirectoryIndex& index() const { return m_index; }
+    size_t rescanned() const { return m_rescanned; }
+    // True if the index no longer matches what was cached and should be rewritten
+    bool changed() const { return m_rescanned != 0 || m_reparsed != 0 || m_index.size() != m_cached.size(); }
+
+private:
+    void scan_directory(const std::string& path, const std::string& id_prefix) {
+        struct stat st;
+        {
+            common::ScopedOpTimer timer(common::StatOp::Stat);
+            if (::stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+                return;
+            }
+        }
+        if (!m_seen.insert({static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino)}).second) {
+            return;     // Reached twice, through a symlink or a repeated data dir
+        }
+
+        auto [it, inserted] = m_index.try_emplace(path);
+        if (!inserted) {
+            return;
+        }
+        DirectoryRecord& record = it->second;
+        auto cached = m_cached.find(path);
+        if (cached != m_cached.end() && cached->second.mtime_ns == mtime_ns(st) &&
+            cached->second.dev == static_cast<uint64_t>(st.st_dev) && cached->second.ino == static_cast<uint64_t>(st.st_ino)) {
+            record = std::move(cached->second);
+            check_files(path, record);
+        } else {
+            read_directory(path, st, record);
+        }
+        m_visited.push_back({&it->first, &record, id_prefix});
+
+        for (const auto& subdirectory : record.subdirectories) {
+            scan_directory(path + "/" + subdirectory, id_prefix + subdirectory + "-");
+        }
+    }
+
+    // Files edited in place leave their directory's mtime alone, so the files of
+    // a directory taken from the index are checked with a stat each, and only
+    // those whose mtime or size moved are parsed again.
+    void check_files(const std::string& path, DirectoryRecord& record) {
+        if (record.files.empty()) {
+            return;
+        }
+        int dir_fd;
+        {
+            common::ScopedOpTimer timer(common::StatOp::Open);
+            dir_fd = ::open(path.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+        }
+        for (auto& file : record.files) {
+            struct stat st;
+            int result;
+            {
+                common::ScopedOpTimer timer(common::StatOp::Stat);
+                result = dir_fd < 0 ? -1 : ::fstatat(dir_fd, file.name.c_str(), &st, 0);
+            }
+            if (result == 0 && file.mtime_ns >= 0 && file.mtime_ns == mtime_ns(st) &&
+                file.size == static_cast<uint64_t>(st.st_size)) {
+                continue;
+            }
+            IndexedFile fresh;
+            fresh.name = std::move(file.name);
+            file = std::move(fresh);
+            ++m_reparsed;
+            m_pending.emplace_back(&m_index.find(path)->first, &file);
+        }
+        if (dir_fd >= 0) {
+            ::close(dir_fd);
+        }
+    }
+
+    void read_directory(const std::string& path, const struct stat& st, DirectoryRecord& record) {
+        common::TraceScope trace("shortcut.readdir", path);
+        ++m_rescanned;
+        record.mtime_ns = trusted_mtime_ns(st);
+        record.dev = static_cast<uint64_t>(st.st_dev);
+        record.ino = static_cast<uint64_t>(st.st_ino);
+
+        DIR* dir = ::opendir(path.c_str());
+        if (!dir) {
+            common::record_error(errno);
+            return;
+        }
+        while (struct dirent* entry = ::readdir(dir)) {
+            std::string_view name(entry->d_name);
+            if (name == "." || name == "..") {
+                continue;
+            }
+            unsigned char type = entry->d_type;
+            if (type == DT_UNKNOWN || type == DT_LNK) {
+                struct stat entry_st;
+                common::ScopedOpTimer timer(common::StatOp::Stat);
+                if (::fstatat(::dirfd(dir), entry->d_name, &entry_st, 0) != 0) {
+                    continue;
+                }
+                type = S_ISDIR(entry_st.st_mode) ? DT_DIR : S_ISREG(entry_st.st_mode) ? DT_REG : DT_UNKNOWN;
+            }
+            if (type == DT_DIR) {
+                record.subdirectories.emplace_back(name);
+            } else if (type == DT_REG && name.size() > 8 && name.substr(name.size() - 8) == ".desktop") {
+                record.files.emplace_back().name = std::string(name);
+            }
+        }
+        ::closedir(dir);
+        // Sorted so the listing, and the index, do not depend on readdir order
+        std::sort(record.subdirectories.begin(), record.subdirectories.end());
+        std::sort(record.files.begin(), record.files.end(), [](const IndexedFile& a, const IndexedFile& b) { return a.name < b.name; });
+        for (auto& file : record.files) {
+            m_pending.emplace_back(&m_index.find(path)->first, &file);
+        }
+    }
+
+    DirectoryIndex m_cached;
+    DirectoryIndex m_index;
+    size_t m_jobs;
+    size_t m_rescanned = 0;
+    size_t m_reparsed = 0;
+    std::set<std::pair<uint64_t, uint64_t>> m_seen;
+    std::vector<VisitedDirectory> m_visited;
+    std::vector<std::pair<const std::string*, IndexedFile*>> m_pending;
+};
+
+// Appends the absolute entries of a colon-separated XDG list; relative ones are ignored, as the spec asks
+void append_xdg_dirs(std::vector<std::filesystem::path>& dirs, const char* value, const char* fallback) {
+    std::string_view list = value && *value ? value : fallback;
+    while (!list.empty()) {
+        size_t colon = list.find(':');
+        std::filesystem::path dir(std::string(list.substr(0, colon)));
+        list.remove_prefix(colon == std::string_view::npos ? list.size() : colon + 1);
+        if (dir.is_absolute()) {
+            dirs.push_back(dir);
+        }
+    }
+}
+
+std::vector<std::filesystem::path> default_data_dirs() {
+    std::vector<std::filesystem::path> dirs;
+    const char* home = std::getenv("HOME");
+    const char* data_home = std::getenv("XDG_DATA_HOME");
+    if (data_home && *data_home) {
+        append_xdg_dirs(dirs, data_home, "");
+    } else if (home && *home) {
+        dirs.push_back(std::filesystem::path(home) / ".local" / "share");
+    }
+    append_xdg_dirs(dirs, std::getenv("XDG_DATA_DIRS"), "/usr/local/share:/usr/share");
+    return dirs;
+}
+
+std::filesystem::path default_cache_file() {
+    const char* cache_home = std::getenv("XDG_CACHE_HOME");
+    const char* home = std::getenv("HOME");
+    std::filesystem::path base;
+    if (cache_home && *cache_home && std::filesystem::path(cache_home).is_absolute()) {
+        base = cache_home;
+    } else if (home && *home) {
+        base = std::filesystem::path(home) / ".cache";
+    } else {
+        return {};
+    }
+    return base / "allin1" / "shortcut-index.bin";
+}
+
+bool contains_ignoring_case(const std::string& text, const std::string& query) {
+    auto equal = [](unsigned char a, unsigned char b) { return std::tolower(a) == std::tolower(b); };
+    return std::search(text.begin(), text.end(), query.begin(), query.end(), equal) != text.end();
+}
+
+bool matches(const ShortcutInfo& info, const std::string& query) {
+    for (const std::string* field : {&info.id, &info.name, &info.generic_name, &info.comment, &info.keywords, &info.exec}) {
+        if (contains_ignoring_case(*field, query)) {
+            return true;
+        }
+    }
+    return false;
+}
+#endif
+
+} // namespace
+
+OperationResult perform_shortcut_list(const ShortcutListOptions& options, ShortcutListing& listing) {
+    common::ScopedPerfCounters counters(common::PerfPhase::Shortcut);
+    auto start_time = std::chrono::steady_clock::now();
+    OperationResult result;
+#if defined(_WIN32)
+    (void)options;
+    (void)listing;
+    throw common::IOCreateError("Shortcut listing is not supported on this OS.");
+#else
+    std::filesystem::path cache_file = options.use_cache ? (options.cache_file.empty() ? default_cache_file() : options.cache_file)
+                                                         : std::filesystem::path();
+    std::vector<std::filesystem::path> data_dirs = options.data_dirs.empty() ? default_data_dirs() : options.data_dirs;
+
+    ShortcutScanner scanner(cache_file.empty() ? DirectoryIndex() : load_index(cache_file), options.jobs);
+    {
+        common::TraceScope trace("shortcut.scan");
+        for (const auto& dir : data_dirs) {
+            scanner.scan_root(dir / "applications");
+        }
+    }
+    result.bytes_read = scanner.parse_pending();
+    if (!cache_file.empty() && scanner.changed()) {
+        save_index(cache_file, scanner.index());
+    }
+
+    // Earlier directories shadow later ones, including with Hidden=true entries
+    std::unordered_set<std::string> seen;
+    for (const auto& directory : scanner.visited()) {
+        for (const auto& file : directory.record->files) {
+            std::string id = directory.id_prefix + file.name;
+            if (!(file.flags & IndexedFile::Valid) || !seen.insert(id).second || (file.flags & IndexedFile::Hidden) ||
+                file.type != "Application") {
+                continue;
+            }
+            ShortcutInfo info;
+            info.id = std::move(id);
+            info.path = *directory.path + "/" + file.name;
+            info.name = file.display_name;
+            info.generic_name = file.generic_name;
+            info.comment = file.comment;
+            info.exec = file.exec;
+            info.keywords = file.keywords;
+            info.no_display = (file.flags & IndexedFile::NoDisplay) != 0;
+            if (options.query.empty() || matches(info, options.query)) {
+                listing.shortcuts.push_back(std::move(info));
+            }
+        }
+    }
+    std::sort(listing.shortcuts.begin(), listing.shortcuts.end(), [](const ShortcutInfo& a, const ShortcutInfo& b) { return a.id < b.id; });
+    listing.directories = scanner.visited().size();
+    listing.directories_rescanned = scanner.rescanned();
+
+    result.entries_processed = listing.shortcuts.size();
+    common::count(common::StatCounter::EntriesVisited, listing.shortcuts.size());
+#endif
+    result.elapsed = std::chrono::steady_clock::now() - start_time;
+    return result;
+}
+
+void handle_shortcut_list(
+    const std::string& query,
+    const std::string& jobs,
+    bool output_enabled
+) {
+    common::TraceScope trace("shortcut.list");
+    bool text_output = output_enabled && common::output_format() == common::OutputFormat::Text;
+    if (text_output && !query.empty()) {
+        common::out() << "Settings for io shortcut --find:" << '\n';
+        common::out() << "  Query: " << query << '\n';
+    }
+
+    ShortcutListOptions options;
+    options.query = query;
+    if (!jobs.empty()) {
+        try {
+            options.jobs = std::stoul(jobs);
+        } catch (const std::exception&) {
+            throw common::IOCreateError("Invalid value for --jobs: \"" + jobs + "\"");
+        }
+    }
+
+    ShortcutListing listing;
+    OperationResult result = perform_shortcut_list(options, listing);
+    for (const auto& info : listing.shortcuts) {
+        if (common::output_format() != common::OutputFormat::Text) {
+            common::OutputRecord record("shortcut");
+            record.add("id", info.id).add("path", info.path).add("name", info.name).add("exec", info.exec);
+            if (!info.comment.empty()) {
+                record.add("comment", info.comment);
+            }
+            if (info.no_display) {
+                record.add("no_display", true);
+            }
+            common::emit(record);
+        } else if (text_output) {
+            common::out() << info.id << '\t' << info.name << '\t' << info.exec << '\n';
+        }
+    }
+    emit_result_record("shortcut", result);
+
+    if (text_output) {
+        common::out() << listing.shortcuts.size() << (query.empty() ? " shortcuts" : " matching shortcuts") << " in "
+                      << listing.directories << " directories (" << listing.directories_rescanned << " rescanned)" << '\n';
+    }
+}
+
+} // namespace allin1::io
@@ -1,59 +1,214 @@
 #include "io/symlink.hpp"
+#include "common/atomic_file.hpp"
 #include "common/platform.hpp"
 #include "common/error_utils.hpp"
+#include "common/durability.hpp"
 #include "common/errors.hpp"
+#include "common/perf_counters.hpp"
+#include "common/stats.hpp"
+#include "common/trace.hpp"
+#include "common/output.hpp"
 
 #include <iostream>
 #include <filesystem>
 #include <stdexcept>
+#include <vector>
 
 #if defined(_WIN32)
 #include <windows.h>
+#else
+#include <cerrno>
+#include <cstdio> // renameat2
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #endif
 
 namespace allin1::io {
 
-void handle_symlink(
-    const std::string& target_path_str,
-    const std::string& link_path_str,
-    bool is_directory,
-    bool output_enabled
-) {
-    std::filesystem::path target_path(target_path_str);
-    std::filesystem::path link_path(link_path_str);
+namespace {
 
-    if (output_enabled) {
-        std::cout << "Settings for io symlink:" << std::endl;
-        std::cout << "  Target: " << target_path_str << std::endl;
-        std::cout << "  Link: " << link_path_str << std::endl;
-        std::cout << "  Type: " << (is_directory ? "directory" : "file") << std::endl;
+void create_link(const std::filesystem::path& target, const std::filesystem::path& link, bool directory) {
+    common::ScopedOpTimer timer(common::StatOp::Symlink);
+#if defined(_WIN32)
+    DWORD flags = directory ? SYMBOLIC_LINK_FLAG_DIRECTORY : 0;
+    if (!CreateSymbolicLinkW(link.c_str(), target.c_str(), flags)) {
+        unsigned long error_code = GetLastError();
+        common::record_error(static_cast<int>(error_code));
+        std::string error_message = common::get_system_error_message(error_code);
+        throw common::IOCreateError("Failed to create symlink on Windows. Code: " + std::to_string(error_code) + ": " + error_message);
+    }
+#else
+    if (directory) {
+        std::filesystem::create_directory_symlink(target, link);
+    } else {
+        std::filesystem::create_symlink(target, link);
     }
+#endif
+}
 
-    try {
 #if defined(_WIN32)
-        DWORD flags = is_directory ? SYMBOLIC_LINK_FLAG_DIRECTORY : 0;
-        if (!CreateSymbolicLinkW(link_path.c_str(), target_path.c_str(), flags)) {
-            unsigned long error_code = GetLastError();
-            std::string error_message = common::get_system_error_message(error_code);
-            throw common::IOCreateError("Failed to create symlink on Windows. Code: " + std::to_string(error_code) + ": " + error_message);
-        }
+// Creates the new link under a hidden name, then moves it over the old one
+std::string replace_symlink(const SymlinkOptions& options) {
+    std::error_code ec;
+    std::filesystem::file_status status = std::filesystem::symlink_status(options.link, ec);
+    if (std::filesystem::exists(status) && !std::filesystem::is_symlink(status)) {
+        throw common::IOCreateError("Refusing to replace '" + options.link.string() + "': it exists and is not a symlink.");
+    }
+    std::string previous = std::filesystem::read_symlink(options.link, ec).string();
+    std::filesystem::path temp_path = common::hidden_temp_path(options.link);
+    create_link(options.target, temp_path, options.directory);
+    common::ScopedOpTimer timer(common::StatOp::Rename);
+    if (!MoveFileExW(temp_path.c_str(), options.link.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+        unsigned long error_code = GetLastError();
+        std::filesystem::remove(temp_path, ec);
+        throw common::make_errno_error("Failed to replace symlink", options.link, error_code);
+    }
+    return previous;
+}
 #else
-        if (is_directory) {
-            std::filesystem::create_directory_symlink(target_path, link_path);
-        } else {
-            std::filesystem::create_symlink(target_path, link_path);
+std::string read_link(const std::filesystem::path& path) {
+    std::vector<char> buffer(4096);
+    while (true) {
+        ssize_t length = ::readlink(path.c_str(), buffer.data(), buffer.size());
+        if (length < 0) {
+            return {};
+        }
+        if (static_cast<size_t>(length) < buffer.size()) {
+            return std::string(buffer.data(), static_cast<size_t>(length));
+        }
+        buffer.resize(buffer.size() * 2);
+    }
+}
+
+// Creates the new link under a hidden name next to the old one, then swaps it
+// in with one renameat2(RENAME_EXCHANGE): the old link stays intact under the
+// hidden name until the switch, which also tells us race-free what it pointed
+// to. Filesystems without exchange support get rename(2), which is just as
+// atomic for readers. Returns the previous target, or "" if there was no link.
+std::string replace_symlink(const SymlinkOptions& options) {
+    const std::filesystem::path& link = options.link;
+    struct stat link_stat;
+    if (::lstat(link.c_str(), &link_stat) == 0 && !S_ISLNK(link_stat.st_mode)) {
+        throw common::IOCreateError("Refusing to replace '" + link.string() + "': it exists and is not a symlink.");
+    }
+
+    std::filesystem::path temp_path;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Symlink);
+        while (true) {
+            temp_path = common::hidden_temp_path(link);
+            if (::symlink(options.target.c_str(), temp_path.c_str()) == 0) {
+                break;
+            }
+            if (errno != EEXIST) {
+                throw common::make_errno_error("Failed to create symlink", temp_path, errno);
+            }
+        }
+    }
+
+    common::ScopedOpTimer timer(common::StatOp::Rename);
+#if defined(RENAME_EXCHANGE)
+    if (::renameat2(AT_FDCWD, temp_path.c_str(), AT_FDCWD, link.c_str(), RENAME_EXCHANGE) == 0) {
+        std::string previous = read_link(temp_path);
+        if (::lstat(temp_path.c_str(), &link_stat) == 0 && !S_ISLNK(link_stat.st_mode)) {
+            // Something other than a link appeared since the check above; put it back
+            ::renameat2(AT_FDCWD, temp_path.c_str(), AT_FDCWD, link.c_str(), RENAME_EXCHANGE);
+            ::unlink(temp_path.c_str());
+            throw common::IOCreateError("Refusing to replace '" + link.string() + "': it exists and is not a symlink.");
         }
+        ::unlink(temp_path.c_str());
+        return previous;
+    }
+    if (errno != ENOENT && errno != EINVAL && errno != ENOSYS) {
+        int error_code = errno;
+        ::unlink(temp_path.c_str());
+        throw common::make_errno_error("Failed to replace symlink", link, error_code);
+    }
 #endif
-        if (output_enabled) {
-            std::cout << "Symlink created: " << link_path_str << " -> " << target_path_str << std::endl;
+    std::string previous = read_link(link);
+    if (::rename(temp_path.c_str(), link.c_str()) != 0) {
+        int error_code = errno;
+        ::unlink(temp_path.c_str());
+        throw common::make_errno_error("Failed to replace symlink", link, error_code);
+    }
+    return previous;
+}
+#endif
+
+} // namespace
+
+OperationResult perform_symlink(const SymlinkOptions& options) {
+    common::ScopedPerfCounters counters(common::PerfPhase::Symlink);
+    auto start_time = std::chrono::steady_clock::now();
+    OperationResult result;
+    const std::string link_path_str = options.link.string();
+    std::string previous_target;
+
+    try {
+        if (options.replace) {
+            common::TraceScope trace("symlink.replace", link_path_str);
+            previous_target = replace_symlink(options);
+        } else {
+            common::TraceScope trace("symlink.create", link_path_str);
+            create_link(options.target, options.link, options.directory);
         }
     } catch (const std::filesystem::filesystem_error& e) {
+        common::record_error(e.code().value());
         throw common::IOCreateError("Failed to create symlink: " + std::string(e.what()));
     } catch (const common::IOCreateError&) {
         throw; // Re-throw IOCreateError to be caught in main
     } catch (const std::exception& e) {
         throw common::IOCreateError("An unexpected error occurred: " + std::string(e.what()));
     }
+
+    common::track_new_entry(options.link);
+    result.entries_processed = 1;
+    common::count(common::StatCounter::EntriesVisited);
+    if (options.progress) {
+        options.progress({ProgressKind::Linked, options.link.string(), 0, previous_target});
+    }
+    result.elapsed = std::chrono::steady_clock::now() - start_time;
+    return result;
+}
+
+void handle_symlink(
+    const std::string& target_path_str,
+    const std::string& link_path_str,
+    bool is_directory,
+    bool replace,
+    bool output_enabled
+) {
+    common::TraceScope trace("symlink");
+    bool text_output = output_enabled && common::output_format() == common::OutputFormat::Text;
+    if (text_output) {
+        common::out() << "Settings for io symlink:" << '\n';
+        common::out() << "  Target: " << target_path_str << '\n';
+        common::out() << "  Link: " << link_path_str << '\n';
+        common::out() << "  Type: " << (is_directory ? "directory" : "file") << '\n';
+        if (replace) common::out() << "  Replace: true" << '\n';
+    }
+
+    SymlinkOptions options;
+    options.target = target_path_str;
+    options.link = link_path_str;
+    options.directory = is_directory;
+    options.replace = replace;
+    std::string previous_target;
+    options.progress = [&previous_target](const ProgressEvent& event) {
+        emit_progress_record("symlink", event);
+        previous_target = event.message;
+    };
+
+    emit_result_record("symlink", perform_symlink(options));
+
+    if (text_output) {
+        if (!previous_target.empty()) {
+            common::out() << "Symlink replaced: " << link_path_str << " -> " << target_path_str << " (was " << previous_target << ")" << '\n';
+        } else {
+            common::out() << "Symlink created: " << link_path_str << " -> " << target_path_str << '\n';
+        }
+    }
 }
 
 } // namespace allin1::io
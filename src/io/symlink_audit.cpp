@@ -0,0 +1,708 @@
+#include "io/symlink_audit.hpp"
+#include "common/atomic_file.hpp"
+#include "common/directory_budget.hpp"
+#include "common/durability.hpp"
+#include "common/error_utils.hpp"
+#include "common/errors.hpp"
+#include "common/output.hpp"
+#include "common/perf_counters.hpp"
+#include "common/platform.hpp"
+#include "common/stats.hpp"
+#include "common/thread_pool.hpp"
+#include "common/trace.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace allin1::io {
+
+namespace {
+
+// Links of one directory are checked by workers in batches of this size
+constexpr size_t max_batch_links = 256;
+constexpr size_t queued_tasks_per_worker = 16;
+constexpr size_t max_recorded_errors = 1000;
+// Target directories the cache keeps open at most. Within RLIMIT_NOFILE it gets
+// half of what is left after reserved_fds and the workers; the walk's open
+// directories are capped by a DirectoryBudget from the rest.
+constexpr size_t max_cached_directories = 8192;
+constexpr size_t cache_shards = 16;
+constexpr size_t fds_per_directory = 2;     // A scanned directory and its listing
+constexpr size_t fds_per_worker = 1;        // A repaired link's temporary
+constexpr size_t reserved_fds = 32;
+// Links followed while confirming a loop before giving up
+constexpr int max_chain_links = 64;
+
+#if !defined(_WIN32)
+#if defined(O_PATH)
+constexpr int directory_lookup_flags = O_PATH | O_DIRECTORY | O_CLOEXEC;
+#else
+constexpr int directory_lookup_flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+#endif
+
+// How a target directory resolved: an fd to look final components up in, or
+// the errno. Shared, so a directory evicted from the cache stays open for the
+// lookups still using it.
+struct CachedDirectory {
+    int fd = -1;
+    int error = 0;
+
+    ~CachedDirectory() {
+        if (fd >= 0) ::close(fd);
+    }
+};
+
+using CachedDirectoryRef = std::shared_ptr<const CachedDirectory>;
+
+// Directories that link targets live in, keyed by path. Farms and package
+// trees point thousands of links into a handful of directories; with the
+// directory held open, each link costs one lookup of its last component
+// rather than a walk of its whole path, which matters most over NFS. Each
+// shard keeps its least recently used entries out once full.
+class DirectoryCache {
+public:
+    explicit DirectoryCache(size_t capacity) : m_shard_capacity(capacity / cache_shards) {}
+
+    CachedDirectoryRef lookup(const std::string& path) {
+        Shard& shard = m_shards[std::hash<std::string>{}(path) % cache_shards];
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.entries.find(path);
+            if (it != shard.entries.end()) {
+                shard.order.splice(shard.order.begin(), shard.order, it->second.position);
+                return it->second.directory;
+            }
+        }
+        auto directory = std::make_shared<CachedDirectory>();
+        {
+            common::ScopedOpTimer timer(common::StatOp::Open);
+            directory->fd = ::open(path.c_str(), directory_lookup_flags);
+        }
+        if (directory->fd < 0) {
+            directory->error = errno;
+            if (directory->error == EMFILE || directory->error == ENFILE) {
+                return directory; // Says nothing about the directory, so not kept
+            }
+        }
+        if (m_shard_capacity == 0) {
+            return directory;
+        }
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto [it, inserted] = shard.entries.try_emplace(path);
+        if (!inserted) {
+            // Another worker got there first; ours is closed when dropped
+            shard.order.splice(shard.order.begin(), shard.order, it->second.position);
+            return it->second.directory;
+        }
+        shard.order.push_front(path);
+        it->second = {directory, shard.order.begin()};
+        if (shard.entries.size() > m_shard_capacity) {
+            shard.entries.erase(shard.order.back());
+            shard.order.pop_back();
+        }
+        return directory;
+    }
+
+private:
+    struct Entry {
+        CachedDirectoryRef directory;
+        std::list<std::string>::iterator position;
+    };
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<std::string, Entry> entries;
+        std::list<std::string> order;       // Most recently used first
+    };
+    size_t m_shard_capacity;
+    std::array<Shard, cache_shards> m_shards;
+};
+
+class SymlinkAudit;
+
+struct AuditDir {
+    SymlinkAudit* audit = nullptr;      // Released in the budget when closed
+    int fd = -1;
+    std::string path;                   // Absolute, so targets can be resolved from it
+    std::string display_path;
+    std::atomic<bool> changed{false};
+
+    ~AuditDir();
+};
+
+enum class LinkState {
+    Ok,
+    Dangling,
+    Loop,
+    Error
+};
+
+bool read_link_at(int dir_fd, const std::string& name, std::string& target) {
+    char buffer[4096];
+    ssize_t length = ::readlinkat(dir_fd, name.c_str(), buffer, sizeof(buffer));
+    if (length < 0 || static_cast<size_t>(length) >= sizeof(buffer)) {
+        return false;
+    }
+    target.assign(buffer, static_cast<size_t>(length));
+    return true;
+}
+
+std::string join_path(const std::string& directory, const std::string& relative) {
+    if (!relative.empty() && relative.front() == '/') return relative;
+    if (relative.empty()) return directory;
+    return directory == "/" ? "/" + relative : directory + "/" + relative;
+}
+
+// The directory part of a link target as a cache key. Leading ".." and "."
+// components are folded into the link's directory, which is a physical path,
+// so "../../lib" from any directory two levels deep shares one entry; the
+// rest is kept as written, since any of it may be a symlink itself.
+std::string target_directory(const std::string& directory, const std::string& relative) {
+    if (!relative.empty() && relative.front() == '/') {
+        return relative;
+    }
+    std::string base = directory;
+    size_t position = 0;
+    while (position < relative.size()) {
+        size_t end = relative.find('/', position);
+        if (end == std::string::npos) end = relative.size();
+        std::string_view component(relative.data() + position, end - position);
+        if (component == "..") {
+            size_t slash = base.rfind('/');
+            base.resize(slash == 0 || slash == std::string::npos ? 1 : slash);
+        } else if (component != "." && !component.empty()) {
+            break;
+        }
+        position = end + 1;
+    }
+    return position >= relative.size() ? base : join_path(base, relative.substr(position));
+}
+
+LinkState state_for_error(int error_code) {
+    if (error_code == ENOENT || error_code == ENOTDIR) return LinkState::Dangling;
+    if (error_code == ELOOP) return LinkState::Loop;
+    return LinkState::Error;
+}
+
+size_t cache_capacity(size_t workers) {
+    size_t limit = common::get_open_file_limit();
+    size_t reserve = reserved_fds + workers * (fds_per_worker + common::perf_counter_fds_per_thread());
+    return std::min(max_cached_directories, limit > reserve ? (limit - reserve) / 2 : 0);
+}
+
+// Scans a tree with a pool of workers in the manner of the recursive copy:
+// workers enumerate directories, the task queue is capped with the caller
+// running work itself once it is full, and open directories are capped by a
+// DirectoryBudget.
+class SymlinkAudit {
+public:
+    SymlinkAudit(const SymlinkAuditOptions& options, size_t workers)
+        : m_options(options),
+          m_pool(workers),
+          m_output_context(common::current_output_context()),
+          m_max_queued(m_pool.size() * queued_tasks_per_worker),
+          m_cache(cache_capacity(m_pool.size())),
+          m_budget(fds_per_directory, reserved_fds + m_pool.size() * (fds_per_worker + common::perf_counter_fds_per_thread()) + cache_capacity(m_pool.size())) {}
+
+    OperationResult run();
+    void directory_closed();
+
+private:
+    void report(const ProgressEvent& event) {
+        if (!m_options.progress) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_options.progress(event);
+    }
+
+    void fail(const std::string& path, const std::string& message) {
+        m_failed.fetch_add(1, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_errors.size() < max_recorded_errors) {
+                m_errors.push_back({path, message});
+            }
+        }
+        report({ProgressKind::EntryFailed, path, 0, message});
+    }
+
+    void fail_errno(const std::string& what, const std::string& path, int error_code) {
+        common::record_error(error_code);
+        fail(path, what + ": " + common::get_system_error_message(static_cast<unsigned long>(error_code)));
+    }
+
+    void schedule(std::function<void()> task);
+    void queue(std::function<void()> task);
+    void run_task(const std::function<void()>& task);
+    bool first_visit(const struct stat& st);
+    void enter_directory(const std::shared_ptr<AuditDir>& parent, const std::string& name);
+    void open_and_scan_directory(const std::shared_ptr<AuditDir>& parent, const std::string& name);
+    std::shared_ptr<AuditDir> open_directory(const std::shared_ptr<AuditDir>& parent, const std::string& name);
+    void scan_directory(const std::shared_ptr<AuditDir>& node);
+    void check_links(const std::shared_ptr<AuditDir>& node, const std::vector<std::string>& names);
+    void check_link(AuditDir& node, const std::string& name);
+    LinkState resolve(AuditDir& node, const std::string& name, const std::string& target, int& error_code);
+    bool confirm_loop(const std::string& link_path);
+
+    const SymlinkAuditOptions& m_options;
+    common::ThreadPool m_pool;
+    common::OutputContext m_output_context;
+    size_t m_max_queued;
+    std::atomic<size_t> m_queued{0};
+    DirectoryCache m_cache;
+    common::DirectoryBudget m_budget;
+
+    std::mutex m_visited_mutex;
+    std::set<std::pair<dev_t, ino_t>> m_visited;   // Directories scanned so far
+
+    std::atomic<uint64_t> m_links{0};
+    std::atomic<uint64_t> m_failed{0};
+    std::mutex m_mutex;                  // Guards m_errors and calls into m_options.progress
+    std::vector<EntryError> m_errors;
+};
+
+AuditDir::~AuditDir() {
+    if (changed.load(std::memory_order_relaxed)) {
+        common::track_directory(path);
+    }
+    if (fd >= 0) ::close(fd);
+    if (audit) {
+        audit->directory_closed();
+    }
+}
+
+void SymlinkAudit::run_task(const std::function<void()>& task) {
+    try {
+        task();
+    } catch (const std::exception& e) {
+        fail({}, e.what());
+    }
+}
+
+void SymlinkAudit::schedule(std::function<void()> task) {
+    if (m_queued.load(std::memory_order_relaxed) >= m_max_queued) {
+        run_task(task); // Caller runs: keeps the queue, and memory, bounded
+        return;
+    }
+    queue(std::move(task));
+}
+
+void SymlinkAudit::queue(std::function<void()> task) {
+    m_queued.fetch_add(1, std::memory_order_relaxed);
+    m_pool.submit([this, task = std::move(task)] {
+        m_queued.fetch_sub(1, std::memory_order_relaxed);
+        common::ScopedOutputContext context(m_output_context);
+        run_task(task);
+    });
+}
+
+bool SymlinkAudit::first_visit(const struct stat& st) {
+    std::lock_guard<std::mutex> lock(m_visited_mutex);
+    return m_visited.emplace(st.st_dev, st.st_ino).second;
+}
+
+// Called once a directory is closed; a deferred directory takes over its slot.
+// It is always queued, since this runs from an AuditDir destructor.
+void SymlinkAudit::directory_closed() {
+    if (auto next = m_budget.release()) {
+        queue(std::move(next));
+    }
+}
+
+void SymlinkAudit::enter_directory(const std::shared_ptr<AuditDir>& parent, const std::string& name) {
+    if (!m_budget.acquire_or_defer([this, parent, name] { open_and_scan_directory(parent, name); })) {
+        return; // Entered once another directory is closed
+    }
+    if (auto child = open_directory(parent, name)) {
+        schedule([this, child] { scan_directory(child); });
+    } else {
+        directory_closed();
+    }
+}
+
+// Runs a deferred subdirectory, whose slot in the budget is already taken.
+void SymlinkAudit::open_and_scan_directory(const std::shared_ptr<AuditDir>& parent, const std::string& name) {
+    if (auto child = open_directory(parent, name)) {
+        scan_directory(child);
+    } else {
+        directory_closed();
+    }
+}
+
+std::shared_ptr<AuditDir> SymlinkAudit::open_directory(const std::shared_ptr<AuditDir>& parent, const std::string& name) {
+    int fd;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Open);
+        fd = ::openat(parent->fd, name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    }
+    if (fd < 0) {
+        fail_errno("Failed to open directory", parent->display_path + "/" + name, errno);
+        return nullptr;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || !first_visit(st)) {
+        ::close(fd); // Reached again through a bind mount
+        return nullptr;
+    }
+    auto child = std::make_shared<AuditDir>();
+    child->fd = fd;
+    child->path = join_path(parent->path, name);
+    child->display_path = parent->display_path + "/" + name;
+    child->audit = this;
+    return child;
+}
+
+void SymlinkAudit::scan_directory(const std::shared_ptr<AuditDir>& node) {
+    common::TraceScope trace("symlink.audit_directory", node->display_path);
+
+    int listing_fd = ::dup(node->fd); // fdopendir takes ownership; the node keeps its own fd
+    DIR* dir = listing_fd >= 0 ? ::fdopendir(listing_fd) : nullptr;
+    if (!dir) {
+        int error_code = errno;
+        if (listing_fd >= 0) ::close(listing_fd);
+        fail_errno("Failed to read directory", node->display_path, error_code);
+        return;
+    }
+
+    std::vector<std::string> batch;
+    auto flush_batch = [&] {
+        if (batch.empty()) return;
+        schedule([this, node, names = std::move(batch)] { check_links(node, names); });
+        batch.clear();
+    };
+
+    while (true) {
+        errno = 0;
+        dirent* entry = ::readdir(dir);
+        if (!entry) {
+            if (errno != 0) {
+                fail_errno("Failed to read directory", node->display_path, errno);
+            }
+            break;
+        }
+        const char* name = entry->d_name;
+        if (std::strcmp(name, ".") == 0 || std::strcmp(name, "..") == 0) {
+            continue;
+        }
+
+        unsigned char type = entry->d_type;
+        if (type == DT_UNKNOWN) {
+            struct stat st;
+            common::ScopedOpTimer timer(common::StatOp::Stat);
+            if (::fstatat(node->fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                continue;
+            }
+            type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISLNK(st.st_mode) ? DT_LNK : DT_REG;
+        }
+
+        if (type == DT_LNK) {
+            batch.emplace_back(name);
+            if (batch.size() >= max_batch_links) {
+                flush_batch();
+            }
+        } else if (type == DT_DIR) {
+            enter_directory(node, name);
+        }
+    }
+    ::closedir(dir);
+    flush_batch();
+}
+
+void SymlinkAudit::check_links(const std::shared_ptr<AuditDir>& node, const std::vector<std::string>& names) {
+    common::TraceScope trace("symlink.audit_batch", node->display_path);
+    for (const auto& name : names) {
+        try {
+            check_link(*node, name);
+        } catch (const std::exception& e) {
+            fail(node->display_path + "/" + name, e.what());
+        }
+    }
+}
+
+// Resolves target as the kernel would from the link's directory, with the
+// directory part served by the cache
+LinkState SymlinkAudit::resolve(AuditDir& node, const std::string& name, const std::string& target, int& error_code) {
+    size_t slash = target.rfind('/');
+    std::string last = slash == std::string::npos ? target : target.substr(slash + 1);
+    struct stat st;
+    int result;
+
+    if (slash == std::string::npos || last.empty() || last == "." || last == "..") {
+        // Same directory, or nothing to split off: let the kernel walk it from the link
+        common::ScopedOpTimer timer(common::StatOp::Stat);
+        result = ::fstatat(node.fd, name.c_str(), &st, 0);
+        error_code = result == 0 ? 0 : errno;
+        return result == 0 ? LinkState::Ok : state_for_error(error_code);
+    }
+
+    std::string parent = slash == 0 ? "/" : target_directory(node.path, target.substr(0, slash));
+    CachedDirectoryRef directory = m_cache.lookup(parent);
+    if (directory->fd < 0) {
+        error_code = directory->error;
+        if (error_code != EMFILE && error_code != ENFILE) {
+            return state_for_error(error_code);
+        }
+        // Out of fds: let the kernel walk the whole target instead, which needs none
+        common::ScopedOpTimer timer(common::StatOp::Stat);
+        result = ::fstatat(node.fd, name.c_str(), &st, 0);
+        error_code = result == 0 ? 0 : errno;
+        return result == 0 ? LinkState::Ok : state_for_error(error_code);
+    }
+    {
+        common::ScopedOpTimer timer(common::StatOp::Stat);
+        result = ::fstatat(directory->fd, last.c_str(), &st, 0);
+    }
+    error_code = result == 0 ? 0 : errno;
+    return result == 0 ? LinkState::Ok : state_for_error(error_code);
+}
+
+// ELOOP also means "too many links" in a long but finite chain; following the
+// chain with a (dev, inode) set tells a real cycle apart
+bool SymlinkAudit::confirm_loop(const std::string& link_path) {
+    std::set<std::pair<dev_t, ino_t>> seen;
+    std::string current = link_path;
+    for (int i = 0; i < max_chain_links; ++i) {
+        struct stat st;
+        if (::lstat(current.c_str(), &st) != 0 || !S_ISLNK(st.st_mode)) {
+            return false;
+        }
+        if (!seen.emplace(st.st_dev, st.st_ino).second) {
+            return true;
+        }
+        std::string target;
+        if (!read_link_at(AT_FDCWD, current, target)) {
+            return false;
+        }
+        current = join_path(std::filesystem::path(current).parent_path().string(), target);
+    }
+    return false;
+}
+
+void SymlinkAudit::check_link(AuditDir& node, const std::string& name) {
+    std::string display_path = node.display_path + "/" + name;
+    m_links.fetch_add(1, std::memory_order_relaxed);
+    common::count(common::StatCounter::EntriesVisited);
+
+    std::string target;
+    if (!read_link_at(node.fd, name, target)) {
+        fail_errno("Failed to read link", display_path, errno);
+        return;
+    }
+
+    int error_code = 0;
+    LinkState state = target.empty() ? LinkState::Dangling : resolve(node, name, target, error_code);
+    if (state == LinkState::Ok) {
+        return;
+    }
+    if (state == LinkState::Error) {
+        fail_errno("Failed to resolve link", display_path, error_code);
+        return;
+    }
+
+    std::string reason;
+    if (state == LinkState::Dangling) {
+        reason = "dangling";
+    } else {
+        reason = confirm_loop(join_path(node.path, name)) ? "loop" : "too many levels of links";
+    }
+    report({ProgressKind::Broken, display_path, 0, reason + " -> " + target});
+
+    const std::string& from = m_options.retarget_from;
+    if (!from.empty() && target.compare(0, from.size(), from) == 0) {
+        std::string new_target = m_options.retarget_to + target.substr(from.size());
+        struct stat st;
+        bool resolves = ::fstatat(node.fd, new_target.c_str(), &st, 0) == 0;
+        if (resolves) {
+            if (int replace_error = common::replace_symlink_at(node.fd, name, new_target)) {
+                fail_errno("Failed to retarget link", display_path, replace_error);
+                return;
+            }
+            node.changed.store(true, std::memory_order_relaxed);
+            report({ProgressKind::Linked, display_path, 0, new_target});
+            return;
+        }
+    }
+
+    if (m_options.remove) {
+        int result;
+        {
+            common::ScopedOpTimer timer(common::StatOp::Unlink);
+            result = ::unlinkat(node.fd, name.c_str(), 0);
+        }
+        if (result != 0) {
+            fail_errno("Failed to remove link", display_path, errno);
+            return;
+        }
+        node.changed.store(true, std::memory_order_relaxed);
+        report({ProgressKind::Removed, display_path, 0, {}});
+        return;
+    }
+
+    // Left broken: counts as a failed entry, as a mismatch does for checksum verification
+    m_failed.fetch_add(1, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_errors.size() < max_recorded_errors) {
+        m_errors.push_back({display_path, reason + " -> " + target});
+    }
+}
+
+OperationResult SymlinkAudit::run() {
+    std::error_code ec;
+    // Physical, so ".." in link targets can be folded into it
+    std::filesystem::path root_path = std::filesystem::canonical(m_options.path, ec);
+    if (ec) {
+        root_path = std::filesystem::absolute(m_options.path, ec).lexically_normal();
+    }
+    std::string root_string = root_path.string();
+    if (root_string.size() > 1 && root_string.back() == '/') {
+        root_string.pop_back();
+    }
+
+    auto root = std::make_shared<AuditDir>();
+    root->fd = ::open(root_string.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root->fd < 0) {
+        int error_code = errno;
+        common::record_error(error_code);
+        throw common::IOCreateError("Failed to open directory '" + m_options.path.string() + "': " +
+                                    common::get_system_error_message(static_cast<unsigned long>(error_code)));
+    }
+    struct stat st;
+    if (::fstat(root->fd, &st) == 0) {
+        first_visit(st);
+    }
+    root->path = std::move(root_string);
+    root->display_path = m_options.path.string();
+    if (root->display_path.size() > 1 && root->display_path.back() == '/') {
+        root->display_path.pop_back();
+    }
+    root->audit = this;
+    m_budget.acquire();
+
+    schedule([this, root] { scan_directory(root); });
+    root.reset();
+    m_pool.wait_idle();
+    // Directories deferred below a chain of open ones deeper than the budget
+    while (auto next = m_budget.take_stalled()) {
+        queue(std::move(next));
+        m_pool.wait_idle();
+    }
+
+    OperationResult result;
+    result.entries_processed = m_links.load();
+    result.entries_failed = m_failed.load();
+    result.errors = std::move(m_errors);
+    return result;
+}
+#endif
+
+} // namespace
+
+OperationResult perform_symlink_audit(const SymlinkAuditOptions& options) {
+    common::ScopedPerfCounters counters(common::PerfPhase::Symlink);
+    auto start_time = std::chrono::steady_clock::now();
+#if defined(_WIN32)
+    (void)options;
+    throw common::IOCreateError("Symlink auditing is not supported on Windows.");
+#else
+    size_t workers = options.jobs == 0 ? common::default_worker_count() : options.jobs;
+    SymlinkAudit audit(options, workers);
+    OperationResult result = audit.run();
+    result.elapsed = std::chrono::steady_clock::now() - start_time;
+    return result;
+#endif
+}
+
+void handle_symlink_audit(
+    const std::string& path,
+    bool remove,
+    const std::string& retarget,
+    const std::string& jobs,
+    bool output_enabled
+) {
+    common::TraceScope trace("symlink.audit");
+    bool text_output = output_enabled && common::output_format() == common::OutputFormat::Text;
+    if (text_output) {
+        common::out() << "Settings for io symlink --audit:" << '\n';
+        common::out() << "  Path: " << path << '\n';
+        common::out() << "  Remove: " << (remove ? "true" : "false") << '\n';
+        if (!retarget.empty()) common::out() << "  Retarget: " << retarget << '\n';
+    }
+
+    SymlinkAuditOptions options;
+    options.path = path;
+    options.remove = remove;
+    if (!retarget.empty()) {
+        size_t separator = retarget.find('=');
+        if (separator == std::string::npos || separator == 0) {
+            throw common::IOCreateError("Invalid value for --retarget: \"" + retarget + "\". Expected OLD_PREFIX=NEW_PREFIX.");
+        }
+        options.retarget_from = retarget.substr(0, separator);
+        options.retarget_to = retarget.substr(separator + 1);
+    }
+    if (!jobs.empty()) {
+        try {
+            options.jobs = std::stoul(jobs);
+        } catch (const std::exception&) {
+            throw common::IOCreateError("Invalid value for --jobs: \"" + jobs + "\"");
+        }
+    }
+    bool structured = common::output_format() != common::OutputFormat::Text;
+    uint64_t broken = 0;
+    uint64_t retargeted = 0;
+    uint64_t removed = 0;
+    options.progress = [&, structured](const ProgressEvent& event) {
+        if (event.kind == ProgressKind::Broken) {
+            ++broken;
+        } else if (event.kind == ProgressKind::Linked) {
+            ++retargeted;
+        } else if (event.kind == ProgressKind::Removed) {
+            ++removed;
+        }
+        if (structured) {
+            emit_progress_record("symlink", event);
+        } else if (event.kind == ProgressKind::EntryFailed) {
+            common::err() << "Error auditing " << event.path << ": " << event.message << std::endl;
+        } else if (event.kind == ProgressKind::Broken) {
+            common::err() << event.path << ": BROKEN (" << event.message << ")" << std::endl;
+        } else if (text_output && event.kind == ProgressKind::Linked) {
+            common::out() << "Retargeted: " << event.path << " -> " << event.message << '\n';
+        } else if (text_output && event.kind == ProgressKind::Removed) {
+            common::out() << "Removed: " << event.path << '\n';
+        }
+    };
+
+    OperationResult result = perform_symlink_audit(options);
+    emit_result_record("symlink", result);
+
+    if (text_output) {
+        common::out() << "Audited " << result.entries_processed << " symlinks in " << path << ": " << broken << " broken, "
+                      << retargeted << " retargeted, " << removed << " removed" << '\n';
+    }
+    if (!result.ok()) {
+        throw common::IOCreateError(std::to_string(result.entries_failed) + " of " + std::to_string(result.entries_processed) + " symlinks are broken or could not be checked.");
+    }
+}
+
+} // namespace allin1::io
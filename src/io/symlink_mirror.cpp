@@ -0,0 +1,823 @@
+#include "io/symlink_mirror.hpp"
+#include "common/atomic_file.hpp"
+#include "common/directory_budget.hpp"
+#include "common/durability.hpp"
+#include "common/error_utils.hpp"
+#include "common/errors.hpp"
+#include "common/output.hpp"
+#include "common/perf_counters.hpp"
+#include "common/stats.hpp"
+#include "common/thread_pool.hpp"
+#include "common/trace.hpp"
+
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace allin1::io {
+
+namespace {
+
+// Entries of one directory are linked by workers in batches of this size, so a
+// single huge directory is spread over the pool as well
+constexpr size_t max_batch_entries = 512;
+constexpr size_t queued_tasks_per_worker = 16;
+constexpr size_t max_recorded_errors = 1000;
+
+// Open directory pairs are capped against RLIMIT_NOFILE: each holds two fds
+// plus a listing while it is read, and a worker pruning stale entries holds a
+// directory and its listing besides.
+constexpr size_t fds_per_directory = 3;
+constexpr size_t fds_per_worker = 2;
+constexpr size_t reserved_fds = 32;
+
+#if !defined(_WIN32)
+// Entry name to d_type; DT_UNKNOWN is resolved with fstatat when it matters
+using Listing = std::unordered_map<std::string, unsigned char>;
+
+// Reads a directory through a duplicate of fd. Returns 0 or the errno of the failure.
+int list_directory(int fd, const std::function<void(const char* name, unsigned char type)>& visit) {
+    int listing_fd = ::dup(fd); // fdopendir takes ownership; the caller keeps its own fd
+    DIR* dir = listing_fd >= 0 ? ::fdopendir(listing_fd) : nullptr;
+    if (!dir) {
+        int error_code = errno;
+        if (listing_fd >= 0) ::close(listing_fd);
+        return error_code;
+    }
+    int error_code = 0;
+    while (true) {
+        errno = 0;
+        dirent* entry = ::readdir(dir);
+        if (!entry) {
+            error_code = errno;
+            break;
+        }
+        if (std::strcmp(entry->d_name, ".") == 0 || std::strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        visit(entry->d_name, entry->d_type);
+    }
+    ::closedir(dir);
+    return error_code;
+}
+
+unsigned char resolve_type(int dir_fd, const char* name, unsigned char type) {
+    if (type != DT_UNKNOWN) {
+        return type;
+    }
+    struct stat st;
+    common::ScopedOpTimer timer(common::StatOp::Stat);
+    if (::fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+        return DT_UNKNOWN;
+    }
+    if (S_ISDIR(st.st_mode)) return DT_DIR;
+    if (S_ISLNK(st.st_mode)) return DT_LNK;
+    return DT_REG;
+}
+
+// Returns false if name is not a readable symlink
+bool read_link_at(int dir_fd, const std::string& name, std::string& target) {
+    char buffer[4096];
+    ssize_t length = ::readlinkat(dir_fd, name.c_str(), buffer, sizeof(buffer));
+    if (length < 0 || static_cast<size_t>(length) >= sizeof(buffer)) {
+        return false;
+    }
+    target.assign(buffer, static_cast<size_t>(length));
+    return true;
+}
+
+class SymlinkMirror;
+
+// A directory pair being mirrored. Tasks working below it hold a reference, so
+// both fds stay open, and every entry is created relative to them, until the
+// last task is done.
+struct MirrorDir {
+    SymlinkMirror* mirror = nullptr;            // Set once both fds are open; released in the budget when closed
+    int source_fd = -1;
+    int destination_fd = -1;
+    std::string source_path;
+    std::string destination_path;
+    std::string prefix;                         // Relative path from this destination directory to its source directory
+    bool fresh = false;                         // Created by this run, so known to be empty
+    std::shared_ptr<const Listing> existing;    // Destination entries found before linking (null when fresh)
+    std::atomic<bool> changed{false};
+
+    ~MirrorDir();
+};
+
+// Mirrors a tree with a pool of workers, in the manner of the recursive copy:
+// directories are enumerated by workers, each destination directory exists
+// before any task links into it, the task queue is capped with the caller
+// running work itself once it is full, and open directories are capped by a
+// DirectoryBudget.
+class SymlinkMirror {
+public:
+    SymlinkMirror(const SymlinkMirrorOptions& options, size_t workers)
+        : m_options(options),
+          m_pool(workers),
+          m_output_context(common::current_output_context()),
+          m_max_queued(m_pool.size() * queued_tasks_per_worker),
+          m_budget(fds_per_directory, reserved_fds + m_pool.size() * (fds_per_worker + common::perf_counter_fds_per_thread())) {}
+
+    OperationResult run();
+    void directory_closed();
+
+private:
+    void report(const ProgressEvent& event) {
+        if (!m_options.progress) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_options.progress(event);
+    }
+
+    void succeed() {
+        m_entries.fetch_add(1, std::memory_order_relaxed);
+        common::count(common::StatCounter::EntriesVisited);
+    }
+
+    void fail(const std::string& path, const std::string& message) {
+        m_entries.fetch_add(1, std::memory_order_relaxed);
+        m_failed.fetch_add(1, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_errors.size() < max_recorded_errors) {
+                m_errors.push_back({path, message});
+            }
+        }
+        report({ProgressKind::EntryFailed, path, 0, message});
+    }
+
+    void fail_errno(const std::string& what, const std::string& path, int error_code) {
+        common::record_error(error_code);
+        fail(path, what + ": " + common::get_system_error_message(static_cast<unsigned long>(error_code)));
+    }
+
+    void schedule(std::function<void()> task);
+    void queue(std::function<void()> task);
+    void run_task(const std::function<void()>& task);
+    void enter_directory(const std::shared_ptr<MirrorDir>& parent, const std::string& name);
+    void open_and_mirror_directory(const std::shared_ptr<MirrorDir>& parent, const std::string& name);
+    std::shared_ptr<MirrorDir> open_directory(const std::shared_ptr<MirrorDir>& parent, const std::string& name);
+    void mirror_directory(const std::shared_ptr<MirrorDir>& node);
+    void mirror_entries(const std::shared_ptr<MirrorDir>& node, const std::vector<std::string>& names);
+    void mirror_entry(MirrorDir& node, const std::string& name);
+    bool remove_stale_link(int dir_fd, const std::string& dir_path, const std::string& prefix, const std::string& name);
+    void remove_emptied_directory(int dir_fd, const std::string& dir_path, const std::string& name);
+    bool remove_stale(int dir_fd, const std::string& dir_path, const std::string& prefix, const std::string& name, unsigned char type);
+    bool remove_mirrored_directory(MirrorDir& node, const std::string& name);
+
+    const SymlinkMirrorOptions& m_options;
+    common::ThreadPool m_pool;
+    common::OutputContext m_output_context;
+    size_t m_max_queued;
+    std::atomic<size_t> m_queued{0};
+    common::DirectoryBudget m_budget;
+
+    std::atomic<uint64_t> m_entries{0};
+    std::atomic<uint64_t> m_failed{0};
+    std::mutex m_mutex;                  // Guards m_errors and calls into m_options.progress
+    std::vector<EntryError> m_errors;
+
+    dev_t m_destination_dev = 0;         // The destination root is skipped if it lies inside the source
+    ino_t m_destination_ino = 0;
+};
+
+MirrorDir::~MirrorDir() {
+    if (changed.load(std::memory_order_relaxed)) {
+        common::track_directory(destination_path);
+    }
+    if (source_fd >= 0) ::close(source_fd);
+    if (destination_fd >= 0) ::close(destination_fd);
+    if (mirror) {
+        mirror->directory_closed();
+    }
+}
+
+void SymlinkMirror::run_task(const std::function<void()>& task) {
+    try {
+        task();
+    } catch (const std::exception& e) {
+        fail({}, e.what());
+    }
+}
+
+void SymlinkMirror::schedule(std::function<void()> task) {
+    if (m_queued.load(std::memory_order_relaxed) >= m_max_queued) {
+        run_task(task); // Caller runs: keeps the queue, and memory, bounded
+        return;
+    }
+    queue(std::move(task));
+}
+
+void SymlinkMirror::queue(std::function<void()> task) {
+    m_queued.fetch_add(1, std::memory_order_relaxed);
+    m_pool.submit([this, task = std::move(task)] {
+        m_queued.fetch_sub(1, std::memory_order_relaxed);
+        common::ScopedOutputContext context(m_output_context);
+        run_task(task);
+    });
+}
+
+// Called once a directory pair is closed; a deferred directory takes over its
+// slot. It is always queued, since this runs from a MirrorDir destructor.
+void SymlinkMirror::directory_closed() {
+    if (auto next = m_budget.release()) {
+        queue(std::move(next));
+    }
+}
+
+void SymlinkMirror::enter_directory(const std::shared_ptr<MirrorDir>& parent, const std::string& name) {
+    if (!m_budget.acquire_or_defer([this, parent, name] { open_and_mirror_directory(parent, name); })) {
+        return; // Entered once another directory is closed
+    }
+    if (auto child = open_directory(parent, name)) {
+        schedule([this, child] { mirror_directory(child); });
+    } else {
+        directory_closed();
+    }
+}
+
+// Runs a deferred subdirectory, whose slot in the budget is already taken.
+void SymlinkMirror::open_and_mirror_directory(const std::shared_ptr<MirrorDir>& parent, const std::string& name) {
+    if (auto child = open_directory(parent, name)) {
+        mirror_directory(child);
+    } else {
+        directory_closed();
+    }
+}
+
+std::shared_ptr<MirrorDir> SymlinkMirror::open_directory(const std::shared_ptr<MirrorDir>& parent, const std::string& name) {
+    std::string destination_path = parent->destination_path + "/" + name;
+
+    unsigned char existing_type = DT_UNKNOWN;
+    bool exists = false;
+    if (parent->existing) {
+        auto it = parent->existing->find(name);
+        if (it != parent->existing->end()) {
+            exists = true;
+            existing_type = resolve_type(parent->destination_fd, name.c_str(), it->second);
+        }
+    }
+    if (exists && existing_type != DT_DIR) {
+        // A link the mirror made when the source was not a directory yet is replaced
+        std::string current;
+        if (!m_options.incremental || existing_type != DT_LNK ||
+            !read_link_at(parent->destination_fd, name, current) || current != parent->prefix + "/" + name) {
+            fail(destination_path, "Exists and is not a directory");
+            return nullptr;
+        }
+        int result;
+        {
+            common::ScopedOpTimer timer(common::StatOp::Unlink);
+            result = ::unlinkat(parent->destination_fd, name.c_str(), 0);
+        }
+        if (result != 0 && errno != ENOENT) {
+            fail_errno("Failed to remove symlink", destination_path, errno);
+            return nullptr;
+        }
+        report({ProgressKind::Removed, destination_path, 0, {}});
+        exists = false;
+    }
+    bool fresh = false;
+    if (!exists) {
+        int result;
+        {
+            common::ScopedOpTimer timer(common::StatOp::Mkdir);
+            result = ::mkdirat(parent->destination_fd, name.c_str(), 0777);
+        }
+        if (result == 0) {
+            fresh = true;
+        } else if (errno != EEXIST) {
+            fail_errno("Failed to create directory", destination_path, errno);
+            return nullptr;
+        }
+    }
+
+    int source_fd;
+    int destination_fd;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Open);
+        source_fd = ::openat(parent->source_fd, name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    }
+    if (source_fd < 0) {
+        fail_errno("Failed to open directory", parent->source_path + "/" + name, errno);
+        return nullptr;
+    }
+    {
+        common::ScopedOpTimer timer(common::StatOp::Open);
+        destination_fd = ::openat(parent->destination_fd, name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    }
+    if (destination_fd < 0) {
+        int error_code = errno;
+        ::close(source_fd);
+        fail_errno("Failed to open directory", destination_path, error_code);
+        return nullptr;
+    }
+
+    auto node = std::make_shared<MirrorDir>();
+    node->source_fd = source_fd;
+    node->destination_fd = destination_fd;
+    node->source_path = parent->source_path + "/" + name;
+    node->destination_path = std::move(destination_path);
+    node->prefix = "../" + parent->prefix + "/" + name;
+    node->fresh = fresh;
+    node->mirror = this;
+
+    succeed();
+    if (fresh) {
+        parent->changed.store(true, std::memory_order_relaxed);
+        report({ProgressKind::Created, node->destination_path, 0, {}});
+    }
+    return node;
+}
+
+void SymlinkMirror::mirror_directory(const std::shared_ptr<MirrorDir>& node) {
+    common::TraceScope trace("symlink.mirror_directory", node->source_path);
+
+    if (!node->fresh) {
+        auto existing = std::make_shared<Listing>();
+        int error_code = list_directory(node->destination_fd, [&existing](const char* name, unsigned char type) {
+            existing->emplace(name, type);
+        });
+        if (error_code != 0) {
+            fail_errno("Failed to read directory", node->destination_path, error_code);
+            return;
+        }
+        node->existing = std::move(existing);
+    }
+
+    bool prune = m_options.incremental && node->existing && !node->existing->empty();
+    std::unordered_set<std::string> source_names;
+    std::vector<std::string> subdirectories;
+    std::vector<std::string> batch;
+    auto flush_batch = [&] {
+        if (batch.empty()) return;
+        schedule([this, node, names = std::move(batch)] { mirror_entries(node, names); });
+        batch.clear();
+    };
+
+    int error_code = list_directory(node->source_fd, [&](const char* name, unsigned char type) {
+        if (prune) {
+            source_names.emplace(name);
+        }
+        if (resolve_type(node->source_fd, name, type) == DT_DIR) {
+            subdirectories.emplace_back(name);
+            return;
+        }
+        batch.emplace_back(name);
+        if (batch.size() >= max_batch_entries) {
+            flush_batch();
+        }
+    });
+    if (error_code != 0) {
+        // Nothing is pruned from a listing that may be incomplete
+        fail_errno("Failed to read directory", node->source_path, error_code);
+        prune = false;
+    }
+    flush_batch();
+
+    for (const auto& name : subdirectories) {
+        struct stat source_stat;
+        if (::fstatat(node->source_fd, name.c_str(), &source_stat, AT_SYMLINK_NOFOLLOW) == 0 &&
+            source_stat.st_dev == m_destination_dev && source_stat.st_ino == m_destination_ino) {
+            continue; // Never mirror the destination into itself
+        }
+        enter_directory(node, name);
+    }
+
+    if (prune) {
+        for (const auto& [name, type] : *node->existing) {
+            if (source_names.count(name) == 0 &&
+                remove_stale(node->destination_fd, node->destination_path, node->prefix, name, type)) {
+                node->changed.store(true, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+void SymlinkMirror::mirror_entries(const std::shared_ptr<MirrorDir>& node, const std::vector<std::string>& names) {
+    common::TraceScope trace("symlink.mirror_batch", node->destination_path);
+    for (const auto& name : names) {
+        try {
+            mirror_entry(*node, name);
+        } catch (const std::exception& e) {
+            fail(node->destination_path + "/" + name, e.what());
+        }
+    }
+}
+
+void SymlinkMirror::mirror_entry(MirrorDir& node, const std::string& name) {
+    std::string target = node.prefix + "/" + name;
+    auto create_link = [&] {
+        common::ScopedOpTimer timer(common::StatOp::Symlink);
+        return ::symlinkat(target.c_str(), node.destination_fd, name.c_str());
+    };
+
+    bool exists = false;
+    unsigned char existing_type = DT_UNKNOWN;
+    if (node.existing) {
+        auto it = node.existing->find(name);
+        if (it != node.existing->end()) {
+            exists = true;
+            existing_type = it->second;
+        }
+    }
+
+    if (!exists) {
+        if (create_link() == 0) {
+            node.changed.store(true, std::memory_order_relaxed);
+            succeed();
+            report({ProgressKind::Linked, node.destination_path + "/" + name, 0, "created"});
+            return;
+        }
+        if (errno != EEXIST) {
+            fail_errno("Failed to create symlink", node.destination_path + "/" + name, errno);
+            return;
+        }
+        existing_type = DT_UNKNOWN; // Appeared since the listing
+    }
+
+    existing_type = resolve_type(node.destination_fd, name.c_str(), existing_type);
+    if (existing_type == DT_DIR && m_options.incremental) {
+        // The source was a directory on an earlier run: take down what the mirror made there
+        if (!remove_mirrored_directory(node, name)) {
+            fail(node.destination_path + "/" + name, "Exists and is a directory with entries the mirror did not create");
+            return;
+        }
+        if (create_link() != 0) {
+            fail_errno("Failed to create symlink", node.destination_path + "/" + name, errno);
+            return;
+        }
+        node.changed.store(true, std::memory_order_relaxed);
+        succeed();
+        report({ProgressKind::Linked, node.destination_path + "/" + name, 0, "created"});
+        return;
+    }
+    std::string current;
+    if (existing_type != DT_LNK || !read_link_at(node.destination_fd, name, current)) {
+        fail(node.destination_path + "/" + name, "Exists and is not a symlink");
+        return;
+    }
+    if (current == target) {
+        succeed(); // Unchanged since the last run
+        return;
+    }
+    if (!m_options.incremental) {
+        fail(node.destination_path + "/" + name, "Exists and points to '" + current + "'");
+        return;
+    }
+    if (int error_code = common::replace_symlink_at(node.destination_fd, name, target)) {
+        fail_errno("Failed to replace symlink", node.destination_path + "/" + name, error_code);
+        return;
+    }
+    node.changed.store(true, std::memory_order_relaxed);
+    succeed();
+    report({ProgressKind::Linked, node.destination_path + "/" + name, 0, "retargeted"});
+}
+
+// Removes the link name in dir_fd if the mirror made it, i.e. it points exactly
+// where it would have been written. Returns true if it was removed.
+bool SymlinkMirror::remove_stale_link(int dir_fd, const std::string& dir_path, const std::string& prefix, const std::string& name) {
+    std::string path = dir_path + "/" + name;
+    std::string current;
+    if (!read_link_at(dir_fd, name, current) || current != prefix + "/" + name) {
+        return false; // Not ours
+    }
+    int result;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Unlink);
+        result = ::unlinkat(dir_fd, name.c_str(), 0);
+    }
+    if (result != 0) {
+        fail_errno("Failed to remove stale symlink", path, errno);
+        return false;
+    }
+    succeed();
+    report({ProgressKind::Removed, path, 0, {}});
+    return true;
+}
+
+// Removes the empty directory name in dir_fd after stale links below it were
+// removed. A directory that still holds something else is left in place.
+void SymlinkMirror::remove_emptied_directory(int dir_fd, const std::string& dir_path, const std::string& name) {
+    int result;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Unlink);
+        result = ::unlinkat(dir_fd, name.c_str(), AT_REMOVEDIR);
+    }
+    if (result != 0) {
+        if (errno != ENOTEMPTY && errno != EEXIST) {
+            fail_errno("Failed to remove directory", dir_path + "/" + name, errno);
+        }
+        return;
+    }
+    succeed();
+    report({ProgressKind::Removed, dir_path + "/" + name, 0, {}});
+}
+
+// Removes a destination entry whose source is gone, if the mirror made it: a
+// link exactly as it would have been written, or a directory that becomes
+// empty once such links below it are removed. Returns true if it was removed,
+// or for a directory if anything below it was.
+//
+// A stale tree may be arbitrarily deep, so it is walked from an explicit stack
+// holding only one directory open at a time, as the budget allows per worker:
+// going down opens the child and closes the parent, coming back up reopens the
+// parent through ".." and checks it is still the directory that was left.
+bool SymlinkMirror::remove_stale(int dir_fd, const std::string& dir_path, const std::string& prefix, const std::string& name, unsigned char type) {
+    type = resolve_type(dir_fd, name.c_str(), type);
+    if (type == DT_LNK) {
+        return remove_stale_link(dir_fd, dir_path, prefix, name);
+    }
+    if (type != DT_DIR) {
+        return false;
+    }
+
+    struct StaleFrame {
+        std::string name;                                           // Name in the parent
+        std::string path;
+        std::string prefix;                                         // Link prefix of the entries in this directory
+        std::vector<std::pair<std::string, unsigned char>> pending; // Entries not looked at yet
+        dev_t dev = 0;
+        ino_t ino = 0;
+        bool removed_any = false;
+    };
+
+    // Opens name in parent_fd and lists it onto the stack; returns its fd, or -1 after reporting why not
+    std::vector<StaleFrame> stack;
+    auto enter = [&](int parent_fd, const std::string& parent_path, const std::string& entry_prefix, const std::string& entry_name) {
+        std::string path = parent_path + "/" + entry_name;
+        int fd;
+        {
+            common::ScopedOpTimer timer(common::StatOp::Open);
+            fd = ::openat(parent_fd, entry_name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        }
+        if (fd < 0) {
+            fail_errno("Failed to open directory", path, errno);
+            return -1;
+        }
+        StaleFrame frame;
+        struct stat st;
+        {
+            common::ScopedOpTimer timer(common::StatOp::Stat);
+            if (::fstat(fd, &st) != 0) {
+                fail_errno("Failed to stat directory", path, errno);
+                ::close(fd);
+                return -1;
+            }
+        }
+        int error_code = list_directory(fd, [&frame](const char* child_name, unsigned char child_type) {
+            frame.pending.emplace_back(child_name, child_type);
+        });
+        if (error_code != 0) {
+            fail_errno("Failed to read directory", path, error_code);
+            ::close(fd);
+            return -1;
+        }
+        frame.name = entry_name;
+        frame.path = std::move(path);
+        frame.prefix = "../" + entry_prefix + "/" + entry_name;
+        frame.dev = st.st_dev;
+        frame.ino = st.st_ino;
+        stack.push_back(std::move(frame));
+        return fd;
+    };
+
+    int fd = enter(dir_fd, dir_path, prefix, name);
+    if (fd < 0) {
+        return false;
+    }
+    while (stack.size() > 1 || !stack.back().pending.empty()) {
+        StaleFrame& frame = stack.back();
+        if (!frame.pending.empty()) {
+            auto [entry_name, entry_type] = std::move(frame.pending.back());
+            frame.pending.pop_back();
+            entry_type = resolve_type(fd, entry_name.c_str(), entry_type);
+            if (entry_type == DT_LNK) {
+                frame.removed_any |= remove_stale_link(fd, frame.path, frame.prefix, entry_name);
+            } else if (entry_type == DT_DIR) {
+                std::string frame_path = frame.path;
+                std::string frame_prefix = frame.prefix;
+                int child_fd = enter(fd, frame_path, frame_prefix, entry_name); // May reallocate the stack
+                if (child_fd >= 0) {
+                    ::close(fd);
+                    fd = child_fd;
+                }
+            }
+            continue;
+        }
+
+        // Done with this directory: back up to its parent and remove it if the mirror emptied it
+        StaleFrame done = std::move(stack.back());
+        stack.pop_back();
+        StaleFrame& parent = stack.back();
+        int parent_fd;
+        {
+            common::ScopedOpTimer timer(common::StatOp::Open);
+            parent_fd = ::openat(fd, "..", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        }
+        ::close(fd);
+        struct stat st;
+        if (parent_fd >= 0) {
+            common::ScopedOpTimer timer(common::StatOp::Stat);
+            if (::fstat(parent_fd, &st) != 0 || st.st_dev != parent.dev || st.st_ino != parent.ino) {
+                ::close(parent_fd);
+                parent_fd = -1;
+                errno = ESTALE;
+            }
+        }
+        if (parent_fd < 0) {
+            // Moved while being pruned: what is left of it is no longer where the mirror put it
+            fail_errno("Failed to return to directory", parent.path, errno);
+            return true;
+        }
+        fd = parent_fd;
+        if (done.removed_any) {
+            parent.removed_any = true;
+            remove_emptied_directory(fd, parent.path, done.name);
+        }
+    }
+    ::close(fd);
+
+    if (!stack.back().removed_any) {
+        return false; // Directories the mirror did not empty are left alone
+    }
+    remove_emptied_directory(dir_fd, dir_path, name);
+    return true; // Its contents changed, whether or not it could be removed
+}
+
+// Removes the mirror's links below a destination directory, then the directory
+// itself. Returns false if it is left in place because it holds anything else.
+bool SymlinkMirror::remove_mirrored_directory(MirrorDir& node, const std::string& name) {
+    remove_stale(node.destination_fd, node.destination_path, node.prefix, name, DT_DIR);
+    int result;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Unlink);
+        result = ::unlinkat(node.destination_fd, name.c_str(), AT_REMOVEDIR);
+    }
+    if (result != 0) {
+        return errno == ENOENT; // Already removed by remove_stale
+    }
+    report({ProgressKind::Removed, node.destination_path + "/" + name, 0, {}});
+    return true;
+}
+
+OperationResult SymlinkMirror::run() {
+    std::error_code ec;
+    std::filesystem::path source = std::filesystem::canonical(m_options.source, ec);
+    if (ec || !std::filesystem::is_directory(source, ec)) {
+        throw common::IOCreateError("Source is not a directory: '" + m_options.source.string() + "'.");
+    }
+    bool created = std::filesystem::create_directories(m_options.destination, ec);
+    if (ec) {
+        common::record_error(ec.value());
+        throw common::IOCreateError("Failed to create directory '" + m_options.destination.string() + "': " + ec.message());
+    }
+    std::filesystem::path destination = std::filesystem::canonical(m_options.destination, ec);
+    if (ec) {
+        throw common::IOCreateError("Failed to resolve '" + m_options.destination.string() + "': " + ec.message());
+    }
+    std::filesystem::path inside = source.lexically_relative(destination);
+    if (source == destination || (!inside.empty() && *inside.begin() != "..")) {
+        throw common::IOCreateError("Source '" + source.string() + "' must not lie inside the destination.");
+    }
+
+    auto root = std::make_shared<MirrorDir>();
+    root->source_path = m_options.source.string();
+    root->destination_path = m_options.destination.string();
+    root->prefix = inside.string(); // Both paths are absolute, so this is never empty
+    root->fresh = created;
+    root->source_fd = ::open(source.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root->source_fd < 0) {
+        common::record_error(errno);
+        throw common::IOCreateError("Failed to open source directory '" + source.string() + "': " + common::get_system_error_message(errno));
+    }
+    root->destination_fd = ::open(destination.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root->destination_fd < 0) {
+        common::record_error(errno);
+        throw common::IOCreateError("Failed to open destination directory '" + destination.string() + "': " + common::get_system_error_message(errno));
+    }
+    struct stat destination_stat;
+    if (::fstat(root->destination_fd, &destination_stat) == 0) {
+        m_destination_dev = destination_stat.st_dev;
+        m_destination_ino = destination_stat.st_ino;
+    }
+    if (created) {
+        common::track_new_entry(m_options.destination);
+        report({ProgressKind::Created, root->destination_path, 0, {}});
+    }
+    root->mirror = this;
+    m_budget.acquire();
+
+    schedule([this, root] { mirror_directory(root); });
+    root.reset();
+    m_pool.wait_idle();
+    // Directories deferred below a chain of open ones deeper than the budget
+    while (auto next = m_budget.take_stalled()) {
+        queue(std::move(next));
+        m_pool.wait_idle();
+    }
+
+    OperationResult result;
+    result.entries_processed = m_entries.load();
+    result.entries_failed = m_failed.load();
+    result.errors = std::move(m_errors);
+    return result;
+}
+#endif
+
+} // namespace
+
+OperationResult perform_symlink_mirror(const SymlinkMirrorOptions& options) {
+    common::ScopedPerfCounters counters(common::PerfPhase::Symlink);
+    auto start_time = std::chrono::steady_clock::now();
+#if defined(_WIN32)
+    (void)options;
+    throw common::IOCreateError("Symlink mirroring is not supported on Windows.");
+#else
+    size_t workers = options.jobs == 0 ? common::default_worker_count() : options.jobs;
+    SymlinkMirror mirror(options, workers);
+    OperationResult result = mirror.run();
+    result.elapsed = std::chrono::steady_clock::now() - start_time;
+    return result;
+#endif
+}
+
+void handle_symlink_mirror(
+    const std::string& source,
+    const std::string& destination,
+    bool incremental,
+    const std::string& jobs,
+    bool output_enabled
+) {
+    common::TraceScope trace("symlink.mirror");
+    bool text_output = output_enabled && common::output_format() == common::OutputFormat::Text;
+    if (text_output) {
+        common::out() << "Settings for io symlink --mirror:" << '\n';
+        common::out() << "  Source: " << source << '\n';
+        common::out() << "  Destination: " << destination << '\n';
+        common::out() << "  Incremental: " << (incremental ? "true" : "false") << '\n';
+    }
+
+    SymlinkMirrorOptions options;
+    options.source = source;
+    options.destination = destination;
+    options.incremental = incremental;
+    if (!jobs.empty()) {
+        try {
+            options.jobs = std::stoul(jobs);
+        } catch (const std::exception&) {
+            throw common::IOCreateError("Invalid value for --jobs: \"" + jobs + "\"");
+        }
+    }
+    bool structured = common::output_format() != common::OutputFormat::Text;
+    uint64_t linked = 0;
+    uint64_t retargeted = 0;
+    uint64_t removed = 0;
+    options.progress = [&, text_output, structured](const ProgressEvent& event) {
+        if (event.kind == ProgressKind::Linked) {
+            ++(event.message == "retargeted" ? retargeted : linked);
+        } else if (event.kind == ProgressKind::Removed) {
+            ++removed;
+        }
+        if (structured) {
+            emit_progress_record("symlink", event);
+        } else if (event.kind == ProgressKind::EntryFailed) {
+            common::err() << "Error mirroring " << event.path << ": " << event.message << std::endl;
+        } else if (text_output && event.kind == ProgressKind::Linked) {
+            common::out() << "Symlink " << event.message << ": " << event.path << '\n';
+        } else if (text_output && event.kind == ProgressKind::Removed) {
+            common::out() << "Removed: " << event.path << '\n';
+        }
+    };
+
+    OperationResult result = perform_symlink_mirror(options);
+    emit_result_record("symlink", result);
+
+    if (!result.ok()) {
+        throw common::IOCreateError(std::to_string(result.entries_failed) + " of " + std::to_string(result.entries_processed) + " entries could not be mirrored.");
+    }
+    if (text_output) {
+        common::out() << "Mirrored " << result.entries_processed << " entries to " << destination << ": " << linked << " linked, "
+                      << retargeted << " retargeted, " << removed << " removed" << '\n';
+    }
+}
+
+} // namespace allin1::io
@@ -0,0 +1,1342 @@
+#include "io/sync.hpp"
+#include "io/copy.hpp"
+#include "io/remove.hpp"
+#include "common/atomic_file.hpp"
+#include "common/directory_budget.hpp"
+#include "common/durability.hpp"
+#include "common/error_utils.hpp"
+#include "common/errors.hpp"
+#include "common/hash.hpp"
+#include "common/output.hpp"
+#include "common/perf_counters.hpp"
+#include "common/stats.hpp"
+#include "common/string_utils.hpp"
+#include "common/thread_pool.hpp"
+#include "common/trace.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <ctime>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace allin1::io {
+
+namespace {
+
+constexpr size_t queued_tasks_per_worker = 16;
+constexpr size_t max_recorded_errors = 1000;
+// Files updated in place are compared and rewritten in blocks of this size
+constexpr uint64_t delta_block_bytes = 1024 * 1024;
+// Open directories are capped against RLIMIT_NOFILE: each holds its source and
+// destination fds plus a listing while it is read, and every worker may have
+// the two ends of the file it syncs open
+constexpr size_t fds_per_directory = 3;
+constexpr size_t fds_per_worker = 2;
+constexpr size_t reserved_fds = 32;
+// Entries changed this recently are not trusted by the index (see make_entry)
+constexpr int64_t racy_window_ns = 2000000000;
+
+constexpr char index_magic[8] = {'A', '1', 'S', 'Y', 'I', 'D', 'X', '\0'};
+constexpr uint32_t index_version = 2;
+
+#if !defined(_WIN32)
+enum class EntryType : uint8_t {
+    File = 1,
+    Directory = 2,
+    Symlink = 3
+};
+
+// A source entry as it was when the destination was last made to match it
+struct IndexEntry {
+    EntryType type = EntryType::File;
+    uint32_t mode = 0;
+    uint32_t uid = 0;
+    uint32_t gid = 0;
+    uint64_t ino = 0;
+    uint64_t size = 0;
+    int64_t mtime_ns = 0;
+    int64_t ctime_ns = 0;               // -1 when too recent to be trusted
+    bool pruned = false;                // Directories: the destination has no entries the source lacks
+    std::vector<uint64_t> block_hashes; // XXH64 of each block as written, for files updated in place
+};
+
+// Keyed by path relative to the source root ("" for the root itself)
+using SyncIndex = std::unordered_map<std::string, IndexEntry>;
+
+int64_t to_ns(const struct timespec& ts) {
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+int64_t now_ns() {
+    struct timespec now;
+    ::clock_gettime(CLOCK_REALTIME, &now);
+    return to_ns(now);
+}
+
+// The ctime moves with every write, chmod, chown and rename of an entry, so an
+// entry changed within the last couple of seconds could change again without
+// its ctime moving on coarse-grained filesystems; such an entry is recorded
+// as untrusted and looked at again next time.
+IndexEntry make_entry(EntryType type, const struct stat& st, int64_t now) {
+    IndexEntry entry;
+    entry.type = type;
+    entry.mode = static_cast<uint32_t>(st.st_mode & 07777);
+    entry.uid = static_cast<uint32_t>(st.st_uid);
+    entry.gid = static_cast<uint32_t>(st.st_gid);
+    entry.ino = static_cast<uint64_t>(st.st_ino);
+    entry.size = static_cast<uint64_t>(st.st_size);
+    entry.mtime_ns = to_ns(st.st_mtim);
+    entry.ctime_ns = now - to_ns(st.st_ctim) < racy_window_ns ? -1 : to_ns(st.st_ctim);
+    return entry;
+}
+
+bool is_unchanged(const IndexEntry& entry, EntryType type, const struct stat& st) {
+    return entry.ctime_ns >= 0 && entry.type == type &&
+           entry.ctime_ns == to_ns(st.st_ctim) && entry.mtime_ns == to_ns(st.st_mtim) &&
+           entry.ino == static_cast<uint64_t>(st.st_ino) && entry.size == static_cast<uint64_t>(st.st_size) &&
+           entry.mode == static_cast<uint32_t>(st.st_mode & 07777) &&
+           entry.uid == static_cast<uint32_t>(st.st_uid) && entry.gid == static_cast<uint32_t>(st.st_gid);
+}
+
+void put_u32(std::string& out, uint32_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void put_u64(std::string& out, uint64_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void put_string(std::string& out, const std::string& value) {
+    put_u32(out, static_cast<uint32_t>(value.size()));
+    out += value;
+}
+
+// Reads fields back with bounds checks; any inconsistency throws and the index is discarded
+class IndexReader {
+public:
+    explicit IndexReader(std::string_view data) : m_data(data) {}
+
+    template <typename T>
+    T get() {
+        T value;
+        std::memcpy(&value, take(sizeof(T)).data(), sizeof(T));
+        return value;
+    }
+
+    std::string get_string() {
+        uint32_t size = get<uint32_t>();
+        return std::string(take(size));
+    }
+
+    std::string_view take(size_t size) {
+        if (size > m_data.size()) {
+            throw std::runtime_error("truncated sync index");
+        }
+        std::string_view part = m_data.substr(0, size);
+        m_data.remove_prefix(size);
+        return part;
+    }
+
+    bool done() const { return m_data.empty(); }
+
+private:
+    std::string_view m_data;
+};
+
+// An index written for another source is ignored, as is one that cannot be read
+SyncIndex load_index(const std::filesystem::path& index_file, const std::string& source) {
+    common::TraceScope trace("sync.index_load", index_file.string());
+    SyncIndex index;
+    std::ifstream in(index_file, std::ios::binary | std::ios::ate);
+    if (!in) {
+        return index;
+    }
+    std::string data(static_cast<size_t>(in.tellg()), '\0');
+    in.seekg(0);
+    if (!in.read(data.data(), static_cast<std::streamsize>(data.size()))) {
+        return index;
+    }
+    common::count(common::StatCounter::BytesRead, data.size());
+    try {
+        IndexReader reader(data);
+        if (reader.take(sizeof(index_magic)) != std::string_view(index_magic, sizeof(index_magic)) ||
+            reader.get<uint32_t>() != index_version || reader.get_string() != source) {
+            return index;
+        }
+        uint64_t entries = reader.get<uint64_t>();
+        index.reserve(static_cast<size_t>(std::min<uint64_t>(entries, data.size())));
+        for (uint64_t i = 0; i < entries; ++i) {
+            std::string path = reader.get_string();
+            IndexEntry entry;
+            entry.type = static_cast<EntryType>(reader.get<uint8_t>());
+            entry.mode = reader.get<uint32_t>();
+            entry.uid = reader.get<uint32_t>();
+            entry.gid = reader.get<uint32_t>();
+            entry.ino = reader.get<uint64_t>();
+            entry.size = reader.get<uint64_t>();
+            entry.mtime_ns = reader.get<int64_t>();
+            entry.ctime_ns = reader.get<int64_t>();
+            entry.pruned = reader.get<uint8_t>() != 0;
+            uint32_t blocks = reader.get<uint32_t>();
+            if (blocks > data.size() / sizeof(uint64_t)) {
+                throw std::runtime_error("corrupt sync index");
+            }
+            entry.block_hashes.resize(blocks);
+            for (auto& hash : entry.block_hashes) {
+                hash = reader.get<uint64_t>();
+            }
+            index.emplace(std::move(path), std::move(entry));
+        }
+        if (!reader.done()) {
+            index.clear();
+        }
+    } catch (const std::exception&) {
+        index.clear();
+    }
+    return index;
+}
+
+// Throws std::filesystem::filesystem_error or common::IOCreateError on failure
+void save_index(const std::filesystem::path& index_file, const std::string& source, const SyncIndex& index) {
+    common::TraceScope trace("sync.index_save", index_file.string());
+    std::string data(index_magic, sizeof(index_magic));
+    put_u32(data, index_version);
+    put_string(data, source);
+    put_u64(data, index.size());
+    for (const auto& [path, entry] : index) {
+        put_string(data, path);
+        data += static_cast<char>(entry.type);
+        put_u32(data, entry.mode);
+        put_u32(data, entry.uid);
+        put_u32(data, entry.gid);
+        put_u64(data, entry.ino);
+        put_u64(data, entry.size);
+        put_u64(data, static_cast<uint64_t>(entry.mtime_ns));
+        put_u64(data, static_cast<uint64_t>(entry.ctime_ns));
+        data += static_cast<char>(entry.pruned ? 1 : 0);
+        put_u32(data, static_cast<uint32_t>(entry.block_hashes.size()));
+        for (uint64_t hash : entry.block_hashes) {
+            put_u64(data, hash);
+        }
+    }
+
+    common::AtomicFile file(index_file, 0600);
+    std::ofstream out(file.write_path(), std::ios::binary | std::ios::trunc);
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    out.close();
+    if (!out) {
+        throw common::make_errno_error("Failed to write", index_file, EIO);
+    }
+    common::count(common::StatCounter::BytesWritten, data.size());
+    file.commit();
+}
+
+// Reads the names in the directory open at fd, other than . and ..
+// Returns 0 or the errno of the failure.
+int list_directory(int fd, std::vector<std::string>& names) {
+    int listing_fd = ::dup(fd); // fdopendir takes ownership; the caller keeps its own fd
+    DIR* dir = listing_fd >= 0 ? ::fdopendir(listing_fd) : nullptr;
+    if (!dir) {
+        int error_code = errno;
+        if (listing_fd >= 0) ::close(listing_fd);
+        return error_code;
+    }
+    ::rewinddir(dir); // The duplicate shares its offset with fd
+    int error_code = 0;
+    while (true) {
+        errno = 0;
+        dirent* entry = ::readdir(dir);
+        if (!entry) {
+            error_code = errno;
+            break;
+        }
+        if (std::strcmp(entry->d_name, ".") != 0 && std::strcmp(entry->d_name, "..") != 0) {
+            names.emplace_back(entry->d_name);
+        }
+    }
+    ::closedir(dir);
+    return error_code;
+}
+
+// Returns the bytes read (short only at end of file), or -1 with errno set
+ssize_t read_block(int fd, char* buffer, size_t size, uint64_t offset) {
+    common::ScopedOpTimer timer(common::StatOp::Read);
+    size_t filled = 0;
+    while (filled < size) {
+        ssize_t n = ::pread(fd, buffer + filled, size - filled, static_cast<off_t>(offset + filled));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        filled += static_cast<size_t>(n);
+    }
+    common::count(common::StatCounter::BytesRead, filled);
+    return static_cast<ssize_t>(filled);
+}
+
+// Returns 0 or the errno of the failure
+int write_block(int fd, const char* buffer, size_t size, uint64_t offset) {
+    common::ScopedOpTimer timer(common::StatOp::Write);
+    size_t written = 0;
+    while (written < size) {
+        ssize_t n = ::pwrite(fd, buffer + written, size - written, static_cast<off_t>(offset + written));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return errno;
+        }
+        written += static_cast<size_t>(n);
+    }
+    common::count(common::StatCounter::BytesWritten, written);
+    return 0;
+}
+
+uint64_t block_hash(const char* data, size_t size) {
+    auto hasher = common::make_hasher(common::HashAlgorithm::Xxh64);
+    hasher->update(data, size);
+    return std::stoull(hasher->hex_digest(), nullptr, 16);
+}
+
+class SyncWalk;
+
+// A source directory and its counterpart in the destination. Tasks for its
+// entries hold a reference, so the directory is finished, and its metadata
+// applied after its entries were written, when the last of them is done.
+struct SyncDir {
+    SyncWalk* walk = nullptr;
+    std::shared_ptr<SyncDir> parent;
+    std::string relative;                   // Index key
+    std::string source_path;
+    std::string destination_path;
+    int source_fd = -1;
+    int destination_fd = -1;
+    struct stat source_stat;
+    bool created = false;                   // The destination directory was missing
+    bool pruned = false;                    // Holds no entries the source lacks, as of this sync
+    std::atomic<bool> modified{false};      // An entry of the destination directory was added, replaced or removed
+    std::atomic<bool> incomplete{false};    // An entry failed, so the listing must be read again next time
+
+    ~SyncDir();
+};
+
+class SyncWalk {
+public:
+    SyncWalk(const SyncOptions& options, size_t workers)
+        : m_options(options),
+          m_pool(workers),
+          m_output_context(common::current_output_context()),
+          m_max_queued(m_pool.size() * queued_tasks_per_worker),
+          m_budget(fds_per_directory, reserved_fds + m_pool.size() * (fds_per_worker + common::perf_counter_fds_per_thread())),
+          m_held_fds(m_budget.capacity() * fds_per_directory + m_pool.size() * fds_per_worker),
+          m_now(now_ns()) {}
+
+    OperationResult run(SyncReport& report);
+    void finish_directory(SyncDir& node);
+    void directory_closed();
+
+private:
+    void report(const ProgressEvent& event) {
+        if (m_options.progress) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_options.progress(event);
+        }
+    }
+
+    void fail(SyncDir* node, const std::string& path, const std::string& message) {
+        m_failed.fetch_add(1, std::memory_order_relaxed);
+        if (node) {
+            node->incomplete.store(true, std::memory_order_relaxed);
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_errors.size() < max_recorded_errors) {
+                m_errors.push_back({path, message});
+            }
+        }
+        report({ProgressKind::EntryFailed, path, 0, message});
+    }
+
+    void fail_errno(SyncDir* node, const std::string& what, const std::string& path, int error_code) {
+        common::record_error(error_code);
+        fail(node, path, what + ": " + common::get_system_error_message(static_cast<unsigned long>(error_code)));
+    }
+
+    const IndexEntry* indexed(const std::string& key) const {
+        auto it = m_index.find(key);
+        return it == m_index.end() ? nullptr : &it->second;
+    }
+
+    void record(std::string key, IndexEntry entry) {
+        std::lock_guard<std::mutex> lock(m_index_mutex);
+        m_next_index.insert_or_assign(std::move(key), std::move(entry));
+        m_index_changed = true;
+    }
+
+    static std::string child_key(const SyncDir& node, const std::string& name) {
+        return node.relative.empty() ? name : node.relative + "/" + name;
+    }
+
+    void schedule(std::function<void()> task);
+    void queue(std::function<void()> task);
+    void run_task(const std::function<void()>& task);
+    void scan_directory(const std::shared_ptr<SyncDir>& node);
+    bool remove_extraneous(SyncDir& node, const std::vector<std::string>& names);
+    bool remove_entry(SyncDir& node, const std::string& name);
+    void enter_directory(const std::shared_ptr<SyncDir>& parent, const std::string& name, const struct stat& source_stat);
+    void open_and_scan_directory(const std::shared_ptr<SyncDir>& parent, const std::string& name, const struct stat& source_stat);
+    std::shared_ptr<SyncDir> open_directory(const std::shared_ptr<SyncDir>& parent, const std::string& name, const struct stat& source_stat);
+    void sync_symlink(SyncDir& node, const std::string& name, const struct stat& source_stat);
+    void sync_file(SyncDir& node, const std::string& name, const struct stat& source_stat);
+    void copy_whole(SyncDir& node, const std::string& name, const struct stat& source_stat, bool replace_directory);
+    void update_blocks(SyncDir& node, const std::string& name, const struct stat& source_stat,
+                       const struct stat& destination_stat, const IndexEntry* previous);
+    void update_metadata(SyncDir& node, const std::string& name, const struct stat& source_stat,
+                         const struct stat& destination_stat, const IndexEntry* previous);
+    bool apply_metadata(SyncDir& node, int fd, const struct stat& source_stat, const std::string& path);
+
+    const SyncOptions& m_options;
+    common::ThreadPool m_pool;
+    common::OutputContext m_output_context;
+    size_t m_max_queued;
+    std::atomic<size_t> m_queued{0};
+    common::DirectoryBudget m_budget;
+    size_t m_held_fds;                      // Most this walk has open, directories and files
+    std::mutex m_remove_mutex;              // Serializes removal of directory trees
+    int64_t m_now;
+
+    SyncIndex m_index;                      // As loaded; read-only during the walk
+    std::unordered_map<std::string, std::vector<std::string>> m_children; // Indexed names per directory key
+    std::mutex m_index_mutex;               // Guards m_next_index and m_index_changed
+    SyncIndex m_next_index;
+    bool m_index_changed = false;           // Something other than an unchanged entry was recorded
+
+    std::atomic<uint64_t> m_examined{0};
+    std::atomic<uint64_t> m_unchanged{0};
+    std::atomic<uint64_t> m_listed{0};
+    std::atomic<uint64_t> m_copied{0};
+    std::atomic<uint64_t> m_delta_updated{0};
+    std::atomic<uint64_t> m_delta_blocks_written{0};
+    std::atomic<uint64_t> m_delta_blocks{0};
+    std::atomic<uint64_t> m_metadata_updated{0};
+    std::atomic<uint64_t> m_linked{0};
+    std::atomic<uint64_t> m_removed{0};
+    std::atomic<uint64_t> m_failed{0};
+    std::atomic<uint64_t> m_bytes_written{0};
+    std::atomic<uint64_t> m_bytes_read{0};
+    std::mutex m_mutex;                     // Guards m_errors and calls into m_options.progress
+    std::vector<EntryError> m_errors;
+
+    dev_t m_destination_dev = 0;            // Skipped should the source reach it through a bind mount
+    ino_t m_destination_ino = 0;
+};
+
+SyncDir::~SyncDir() {
+    if (walk) {
+        walk->finish_directory(*this);
+    }
+    if (source_fd >= 0) ::close(source_fd);
+    if (destination_fd >= 0) ::close(destination_fd);
+    if (walk) {
+        walk->directory_closed();
+    }
+}
+
+void SyncWalk::run_task(const std::function<void()>& task) {
+    try {
+        task();
+    } catch (const std::exception& e) {
+        fail(nullptr, {}, e.what());
+    }
+}
+
+void SyncWalk::schedule(std::function<void()> task) {
+    if (m_queued.load(std::memory_order_relaxed) >= m_max_queued) {
+        run_task(task); // Caller runs: keeps the queue, and memory, bounded
+        return;
+    }
+    queue(std::move(task));
+}
+
+void SyncWalk::queue(std::function<void()> task) {
+    m_queued.fetch_add(1, std::memory_order_relaxed);
+    m_pool.submit([this, task = std::move(task)] {
+        m_queued.fetch_sub(1, std::memory_order_relaxed);
+        common::ScopedOutputContext context(m_output_context);
+        run_task(task);
+    });
+}
+
+// Called once a directory's fds are closed; a deferred directory takes over its slot.
+// It is always queued, never run here, since this runs from a SyncDir destructor.
+void SyncWalk::directory_closed() {
+    if (auto next = m_budget.release()) {
+        queue(std::move(next));
+    }
+}
+
+// Removes name in node's destination directory, with everything below it if it
+// is a directory, and reports what could not be removed. Returns true once it is gone.
+bool SyncWalk::remove_entry(SyncDir& node, const std::string& name) {
+    std::string destination_path = node.destination_path + "/" + name;
+    int result;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Unlink);
+        result = ::unlinkat(node.destination_fd, name.c_str(), 0);
+    }
+    if (result == 0) {
+        m_removed.fetch_add(1, std::memory_order_relaxed);
+        node.modified.store(true, std::memory_order_relaxed);
+        return true;
+    }
+    if (errno != EISDIR && errno != EPERM) { // POSIX allows EPERM for directories
+        fail_errno(&node, "Failed to remove", destination_path, errno);
+        return false;
+    }
+    // The walk io remove uses: no recursion, and open directories capped. One
+    // tree at a time, in the fds this walk leaves free.
+    OperationResult removed;
+    {
+        std::lock_guard<std::mutex> lock(m_remove_mutex);
+        removed = remove_directory_at(node.destination_fd, name, destination_path, 1, m_held_fds);
+    }
+    m_removed.fetch_add(removed.entries_processed - removed.entries_failed, std::memory_order_relaxed);
+    if (removed.entries_processed > removed.entries_failed) {
+        node.modified.store(true, std::memory_order_relaxed);
+    }
+    for (const auto& error : removed.errors) {
+        fail(&node, error.path, error.message);
+    }
+    return removed.ok();
+}
+
+// Applies ownership, mode and timestamps through an open fd. Ownership is only
+// changed when it differs and silently kept when not permitted.
+bool SyncWalk::apply_metadata(SyncDir& node, int fd, const struct stat& source_stat, const std::string& path) {
+    common::TraceScope trace("sync.metadata");
+    if (source_stat.st_uid != ::geteuid() || source_stat.st_gid != ::getegid()) {
+        common::ScopedOpTimer timer(common::StatOp::Chown);
+        if (::fchown(fd, source_stat.st_uid, source_stat.st_gid) != 0 && errno != EPERM) {
+            fail_errno(&node, "Failed to set owner", path, errno);
+            return false;
+        }
+    }
+    {
+        common::ScopedOpTimer timer(common::StatOp::Chmod);
+        if (::fchmod(fd, source_stat.st_mode & 07777) != 0) {
+            fail_errno(&node, "Failed to set mode", path, errno);
+            return false;
+        }
+    }
+    struct timespec times[2] = {source_stat.st_atim, source_stat.st_mtim};
+    if (::futimens(fd, times) != 0) {
+        fail_errno(&node, "Failed to set timestamps", path, errno);
+        return false;
+    }
+    return true;
+}
+
+// The directory's own metadata is applied last, as writing its entries moves
+// its timestamps. A directory that failed somewhere is indexed as untrusted so
+// that the next run lists it again instead of relying on the index.
+void SyncWalk::finish_directory(SyncDir& node) {
+    try {
+        const IndexEntry* previous = indexed(node.relative);
+        bool unchanged = previous && is_unchanged(*previous, EntryType::Directory, node.source_stat);
+        bool modified = node.modified.load(std::memory_order_relaxed);
+        if (node.created || modified || !unchanged) {
+            bool applied = apply_metadata(node, node.destination_fd, node.source_stat, node.destination_path);
+            if (applied && previous && previous->ctime_ns >= 0 && !node.created && !modified) {
+                m_metadata_updated.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        if (modified) {
+            common::track_directory(node.destination_path);
+        }
+
+        IndexEntry entry = make_entry(EntryType::Directory, node.source_stat, m_now);
+        entry.pruned = node.pruned;
+        if (node.incomplete.load(std::memory_order_relaxed)) {
+            entry.ctime_ns = -1;
+            if (node.parent) {
+                node.parent->incomplete.store(true, std::memory_order_relaxed);
+            }
+        }
+        if (unchanged && entry.ctime_ns >= 0 && entry.pruned == previous->pruned) {
+            std::lock_guard<std::mutex> lock(m_index_mutex);
+            m_next_index.insert_or_assign(node.relative, std::move(entry));
+        } else {
+            record(node.relative, std::move(entry));
+        }
+    } catch (const std::exception& e) {
+        fail(&node, node.destination_path, e.what());
+    }
+}
+
+// Returns true once every extraneous entry is gone
+bool SyncWalk::remove_extraneous(SyncDir& node, const std::vector<std::string>& names) {
+    std::vector<std::string> present;
+    if (int error_code = list_directory(node.destination_fd, present)) {
+        fail_errno(&node, "Failed to read directory", node.destination_path, error_code);
+        return false;
+    }
+    bool pruned = true;
+    std::unordered_set<std::string_view> wanted(names.begin(), names.end());
+    for (const auto& name : present) {
+        if (wanted.count(name) != 0 || (node.relative.empty() && name == sync_index_name)) {
+            continue;
+        }
+        if (!remove_entry(node, name)) {
+            pruned = false;
+            continue;
+        }
+        report({ProgressKind::Removed, node.destination_path + "/" + name, 0, {}});
+    }
+    return pruned;
+}
+
+void SyncWalk::scan_directory(const std::shared_ptr<SyncDir>& node) {
+    common::TraceScope trace("sync.directory", node->source_path);
+
+    // An unchanged directory has the entries it had at the last sync, so the
+    // index stands in for reading it and nothing can have become extraneous
+    // since. One last listed by a sync without delete_extraneous may still
+    // hold entries removed from the source before then, so with
+    // delete_extraneous it is listed and compared once more.
+    const IndexEntry* previous = indexed(node->relative);
+    auto children = m_children.find(node->relative);
+    std::vector<std::string> listing;
+    const std::vector<std::string>* names = &listing;
+    node->pruned = node->created;
+    if (previous && is_unchanged(*previous, EntryType::Directory, node->source_stat) &&
+        (previous->pruned || !m_options.delete_extraneous)) {
+        node->pruned = node->pruned || previous->pruned;
+        if (children != m_children.end()) {
+            names = &children->second;
+        }
+    } else {
+        m_listed.fetch_add(1, std::memory_order_relaxed);
+        if (int error_code = list_directory(node->source_fd, listing)) {
+            fail_errno(node.get(), "Failed to read directory", node->source_path, error_code);
+            return;
+        }
+        if (node->relative.empty()) {
+            listing.erase(std::remove(listing.begin(), listing.end(), sync_index_name), listing.end());
+        }
+        if (m_options.delete_extraneous && !node->created) {
+            node->pruned = remove_extraneous(*node, listing);
+        }
+    }
+
+    std::vector<std::pair<std::string, IndexEntry>> unchanged;
+    for (const auto& name : *names) {
+        struct stat st;
+        int result;
+        {
+            common::ScopedOpTimer timer(common::StatOp::Stat);
+            result = ::fstatat(node->source_fd, name.c_str(), &st, AT_SYMLINK_NOFOLLOW);
+        }
+        if (result != 0) {
+            if (errno != ENOENT) { // Removed since it was listed
+                fail_errno(node.get(), "Failed to stat", node->source_path + "/" + name, errno);
+            }
+            continue;
+        }
+        m_examined.fetch_add(1, std::memory_order_relaxed);
+
+        if (S_ISDIR(st.st_mode)) {
+            if (st.st_dev != m_destination_dev || st.st_ino != m_destination_ino) { // Reached through a bind mount
+                enter_directory(node, name, st);
+            }
+            continue;
+        }
+        EntryType type;
+        if (S_ISREG(st.st_mode)) {
+            type = EntryType::File;
+        } else if (S_ISLNK(st.st_mode)) {
+            type = EntryType::Symlink;
+        } else {
+            continue; // Devices, FIFOs and sockets are not synced
+        }
+
+        std::string key = child_key(*node, name);
+        const IndexEntry* entry = indexed(key);
+        if (entry && is_unchanged(*entry, type, st)) {
+            unchanged.emplace_back(std::move(key), *entry);
+        } else if (type == EntryType::Symlink) {
+            sync_symlink(*node, name, st);
+        } else {
+            schedule([this, node, name, st] { sync_file(*node, name, st); });
+        }
+    }
+
+    common::count(common::StatCounter::EntriesVisited, names->size());
+    if (!unchanged.empty()) {
+        m_unchanged.fetch_add(unchanged.size(), std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(m_index_mutex);
+        for (auto& [key, entry] : unchanged) {
+            m_next_index.insert_or_assign(std::move(key), std::move(entry));
+        }
+    }
+}
+
+void SyncWalk::enter_directory(const std::shared_ptr<SyncDir>& parent, const std::string& name, const struct stat& source_stat) {
+    if (!m_budget.acquire_or_defer([this, parent, name, source_stat] { open_and_scan_directory(parent, name, source_stat); })) {
+        return; // Entered once another directory is closed
+    }
+    if (auto child = open_directory(parent, name, source_stat)) {
+        schedule([this, child] { scan_directory(child); });
+    } else {
+        directory_closed();
+    }
+}
+
+// Runs a deferred subdirectory, whose slot in the budget is already taken.
+void SyncWalk::open_and_scan_directory(const std::shared_ptr<SyncDir>& parent, const std::string& name, const struct stat& source_stat) {
+    if (auto child = open_directory(parent, name, source_stat)) {
+        scan_directory(child);
+    } else {
+        directory_closed();
+    }
+}
+
+std::shared_ptr<SyncDir> SyncWalk::open_directory(const std::shared_ptr<SyncDir>& parent, const std::string& name, const struct stat& source_stat) {
+    std::string source_path = parent->source_path + "/" + name;
+    std::string destination_path = parent->destination_path + "/" + name;
+
+    int source_fd;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Open);
+        source_fd = ::openat(parent->source_fd, name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    }
+    if (source_fd < 0) {
+        fail_errno(parent.get(), "Failed to open directory", source_path, errno);
+        return nullptr;
+    }
+    auto node = std::make_shared<SyncDir>();
+    node->source_fd = source_fd; // Closed by the node from here on
+    node->parent = parent;
+    node->relative = child_key(*parent, name);
+    node->source_path = std::move(source_path);
+    node->destination_path = std::move(destination_path);
+    node->source_stat = source_stat;
+
+    {
+        common::ScopedOpTimer timer(common::StatOp::Open);
+        node->destination_fd = ::openat(parent->destination_fd, name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    }
+    int error_code = node->destination_fd < 0 ? errno : 0;
+    if (error_code == ENOTDIR || error_code == ELOOP) {
+        // A file or symlink is in the way
+        if (!remove_entry(*parent, name)) {
+            return nullptr;
+        }
+        error_code = ENOENT;
+    }
+    if (error_code == ENOENT) {
+        int result;
+        {
+            // Owner-only until finished, so the copy is never exposed with looser permissions
+            common::ScopedOpTimer timer(common::StatOp::Mkdir);
+            result = ::mkdirat(parent->destination_fd, name.c_str(), S_IRWXU);
+        }
+        if (result != 0) {
+            fail_errno(parent.get(), "Failed to create directory", node->destination_path, errno);
+            return nullptr;
+        }
+        node->created = true;
+        parent->modified.store(true, std::memory_order_relaxed);
+        {
+            common::ScopedOpTimer timer(common::StatOp::Open);
+            node->destination_fd = ::openat(parent->destination_fd, name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        }
+        error_code = node->destination_fd < 0 ? errno : 0;
+    }
+    if (error_code != 0) {
+        fail_errno(parent.get(), "Failed to open directory", node->destination_path, error_code);
+        return nullptr;
+    }
+
+    node->walk = this;
+    if (node->created) {
+        report({ProgressKind::Created, node->destination_path, 0, {}});
+    }
+    return node;
+}
+
+void SyncWalk::sync_symlink(SyncDir& node, const std::string& name, const struct stat& source_stat) {
+    std::string destination_path = node.destination_path + "/" + name;
+
+    std::vector<char> target(static_cast<size_t>(source_stat.st_size > 0 ? source_stat.st_size : 4095) + 1);
+    ssize_t length = ::readlinkat(node.source_fd, name.c_str(), target.data(), target.size());
+    if (length < 0) {
+        fail_errno(&node, "Failed to read link", node.source_path + "/" + name, errno);
+        return;
+    }
+    target[std::min(static_cast<size_t>(length), target.size() - 1)] = '\0';
+
+    int error_code = common::replace_symlink_at(node.destination_fd, name, target.data());
+    if (error_code == EISDIR || error_code == ENOTEMPTY || error_code == EEXIST) {
+        // A directory is in the way
+        if (!remove_entry(node, name)) {
+            return;
+        }
+        error_code = common::replace_symlink_at(node.destination_fd, name, target.data());
+    }
+    if (error_code != 0) {
+        fail_errno(&node, "Failed to create symlink", destination_path, error_code);
+        return;
+    }
+    node.modified.store(true, std::memory_order_relaxed);
+
+    if (source_stat.st_uid != ::geteuid() || source_stat.st_gid != ::getegid()) {
+        ::fchownat(node.destination_fd, name.c_str(), source_stat.st_uid, source_stat.st_gid, AT_SYMLINK_NOFOLLOW);
+    }
+    struct timespec times[2] = {source_stat.st_atim, source_stat.st_mtim};
+    ::utimensat(node.destination_fd, name.c_str(), times, AT_SYMLINK_NOFOLLOW);
+    common::track_file(destination_path);
+
+    record(child_key(node, name), make_entry(EntryType::Symlink, source_stat, m_now));
+    m_linked.fetch_add(1, std::memory_order_relaxed);
+    report({ProgressKind::Linked, destination_path, 0, {}});
+}
+
+// Picks the cheapest way to bring one changed (or unindexed) file up to date
+void SyncWalk::sync_file(SyncDir& node, const std::string& name, const struct stat& source_stat) {
+    common::TraceScope trace("sync.file", name);
+    std::string key = child_key(node, name);
+    const IndexEntry* previous = indexed(key);
+
+    struct stat destination_stat;
+    int result;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Stat);
+        result = ::fstatat(node.destination_fd, name.c_str(), &destination_stat, AT_SYMLINK_NOFOLLOW);
+    }
+    if (result != 0) {
+        if (errno != ENOENT) {
+            fail_errno(&node, "Failed to stat", node.destination_path + "/" + name, errno);
+            return;
+        }
+        copy_whole(node, name, source_stat, false);
+        return;
+    }
+    if (!S_ISREG(destination_stat.st_mode)) {
+        copy_whole(node, name, source_stat, S_ISDIR(destination_stat.st_mode));
+        return;
+    }
+
+    // Same size and mtime as at the last sync, or without an index as the
+    // destination: the contents are taken as unchanged, unless the entry was
+    // indexed as untrusted, when they could have been rewritten within the same
+    // mtime and are compared instead
+    uint64_t size = static_cast<uint64_t>(source_stat.st_size);
+    bool same_stat = previous
+        ? previous->type == EntryType::File && previous->ino == static_cast<uint64_t>(source_stat.st_ino) &&
+          previous->size == size && previous->mtime_ns == to_ns(source_stat.st_mtim) &&
+          previous->size == static_cast<uint64_t>(destination_stat.st_size)
+        : size == static_cast<uint64_t>(destination_stat.st_size) &&
+          to_ns(source_stat.st_mtim) == to_ns(destination_stat.st_mtim);
+    if (same_stat && (!previous || previous->ctime_ns >= 0)) {
+        update_metadata(node, name, source_stat, destination_stat, previous);
+    } else if (same_stat || (size >= m_options.delta_min_size && destination_stat.st_size > 0)) {
+        update_blocks(node, name, source_stat, destination_stat, previous);
+    } else {
+        copy_whole(node, name, source_stat, false);
+    }
+}
+
+void SyncWalk::update_metadata(SyncDir& node, const std::string& name, const struct stat& source_stat,
+                               const struct stat& destination_stat, const IndexEntry* previous) {
+    IndexEntry entry = make_entry(EntryType::File, source_stat, m_now);
+    if (previous) {
+        entry.block_hashes = previous->block_hashes;
+    }
+    bool owner_matches = (destination_stat.st_uid == source_stat.st_uid && destination_stat.st_gid == source_stat.st_gid) ||
+                         ::geteuid() != 0; // Not ours to change
+    if ((destination_stat.st_mode & 07777) == (source_stat.st_mode & 07777) && owner_matches &&
+        to_ns(destination_stat.st_mtim) == to_ns(source_stat.st_mtim)) {
+        m_unchanged.fetch_add(1, std::memory_order_relaxed);
+        record(child_key(node, name), std::move(entry));
+        return;
+    }
+
+    std::string destination_path = node.destination_path + "/" + name;
+    int fd;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Open);
+        fd = ::openat(node.destination_fd, name.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    }
+    if (fd < 0) {
+        fail_errno(&node, "Failed to open", destination_path, errno);
+        return;
+    }
+    bool applied = apply_metadata(node, fd, source_stat, destination_path);
+    ::close(fd);
+    if (!applied) {
+        return;
+    }
+    common::track_file(destination_path);
+    m_metadata_updated.fetch_add(1, std::memory_order_relaxed);
+    record(child_key(node, name), std::move(entry));
+}
+
+// Copies into a hidden name next to the destination and renames it over the
+// old file, so readers see either the old or the new contents
+void SyncWalk::copy_whole(SyncDir& node, const std::string& name, const struct stat& source_stat, bool replace_directory) {
+    std::string source_path = node.source_path + "/" + name;
+    std::string destination_path = node.destination_path + "/" + name;
+
+    int in_fd;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Open);
+        in_fd = ::openat(node.source_fd, name.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    }
+    if (in_fd < 0) {
+        fail_errno(&node, "Failed to open", source_path, errno);
+        return;
+    }
+
+    std::string temp_name = common::hidden_temp_path(name).string();
+    int out_fd;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Open);
+        out_fd = ::openat(node.destination_fd, temp_name.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    }
+    if (out_fd < 0) {
+        int error_code = errno;
+        ::close(in_fd);
+        fail_errno(&node, "Failed to create", destination_path, error_code);
+        return;
+    }
+
+    auto discard = [&] {
+        ::unlinkat(node.destination_fd, temp_name.c_str(), 0);
+    };
+    uint64_t copied = 0;
+    CopyMethod method;
+    try {
+        method = copy_file_contents(in_fd, out_fd, static_cast<uint64_t>(source_stat.st_size), source_path, destination_path, copied);
+    } catch (...) {
+        ::close(in_fd);
+        ::close(out_fd);
+        discard();
+        throw;
+    }
+    ::close(in_fd);
+    m_bytes_written.fetch_add(copied, std::memory_order_relaxed);
+    m_bytes_read.fetch_add(copied, std::memory_order_relaxed);
+
+    if (!apply_metadata(node, out_fd, source_stat, destination_path)) {
+        ::close(out_fd);
+        discard();
+        return;
+    }
+    if (::close(out_fd) != 0) {
+        fail_errno(&node, "Failed to finish writing", destination_path, errno);
+        discard();
+        return;
+    }
+
+    if (replace_directory && !remove_entry(node, name)) {
+        discard();
+        return;
+    }
+    int result;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Rename);
+        result = ::renameat(node.destination_fd, temp_name.c_str(), node.destination_fd, name.c_str());
+    }
+    if (result != 0) {
+        fail_errno(&node, "Failed to replace", destination_path, errno);
+        discard();
+        return;
+    }
+    node.modified.store(true, std::memory_order_relaxed);
+    common::track_file(destination_path);
+
+    record(child_key(node, name), make_entry(EntryType::File, source_stat, m_now));
+    m_copied.fetch_add(1, std::memory_order_relaxed);
+    report({ProgressKind::Copied, destination_path, copied, copy_method_name(method)});
+}
+
+// Rewrites only the blocks of a large destination file that differ from the
+// source. Blocks are compared with the hashes recorded when the file was last
+// written, which spares reading the destination, or with its data when there
+// are none or the file no longer has the size they describe. The update is in
+// place: should it fail part way, the file is left out of the index and the
+// next run compares it again.
+void SyncWalk::update_blocks(SyncDir& node, const std::string& name, const struct stat& source_stat,
+                             const struct stat& destination_stat, const IndexEntry* previous) {
+    common::TraceScope trace("sync.delta", name);
+    std::string source_path = node.source_path + "/" + name;
+    std::string destination_path = node.destination_path + "/" + name;
+
+    int in_fd;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Open);
+        in_fd = ::openat(node.source_fd, name.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    }
+    if (in_fd < 0) {
+        fail_errno(&node, "Failed to open", source_path, errno);
+        return;
+    }
+    int out_fd;
+    {
+        common::ScopedOpTimer timer(common::StatOp::Open);
+        out_fd = ::openat(node.destination_fd, name.c_str(), O_RDWR | O_NOFOLLOW | O_CLOEXEC);
+    }
+    if (out_fd < 0) {
+        int error_code = errno;
+        ::close(in_fd);
+        fail_errno(&node, "Failed to open", destination_path, error_code);
+        return;
+    }
+    auto close_both = [&] {
+        ::close(in_fd);
+        ::close(out_fd);
+    };
+
+    uint64_t size = static_cast<uint64_t>(source_stat.st_size);
+    uint64_t destination_size = static_cast<uint64_t>(destination_stat.st_size);
+    const std::vector<uint64_t>* known = nullptr;
+    if (previous && previous->type == EntryType::File && previous->size == destination_size &&
+        previous->block_hashes.size() == (destination_size + delta_block_bytes - 1) / delta_block_bytes) {
+        known = &previous->block_hashes;
+    }
+
+    thread_local std::vector<char> source_block;
+    thread_local std::vector<char> destination_block;
+    source_block.resize(delta_block_bytes);
+    destination_block.resize(delta_block_bytes);
+
+    uint64_t blocks = (size + delta_block_bytes - 1) / delta_block_bytes;
+    std::vector<uint64_t> hashes(static_cast<size_t>(blocks));
+    uint64_t rewritten = 0;
+    uint64_t written = 0;
+    uint64_t read = 0;
+    for (uint64_t block = 0; block < blocks; ++block) {
+        uint64_t offset = block * delta_block_bytes;
+        size_t length = static_cast<size_t>(std::min(delta_block_bytes, size - offset));
+        ssize_t n = read_block(in_fd, source_block.data(), length, offset);
+        if (n < 0 || static_cast<size_t>(n) != length) {
+            int error_code = n < 0 ? errno : EAGAIN; // A short read means the source shrank under us
+            close_both();
+            fail_errno(&node, "Failed to read from", source_path, error_code);
+            return;
+        }
+        read += length;
+        hashes[block] = block_hash(source_block.data(), length);
+
+        bool differs;
+        if (known) {
+            differs = block >= known->size() || (*known)[block] != hashes[block] ||
+                      offset + length > destination_size;
+        } else if (offset + length > destination_size) {
+            differs = true;
+        } else {
+            n = read_block(out_fd, destination_block.data(), length, offset);
+            if (n < 0) {
+                int error_code = errno;
+                close_both();
+                fail_errno(&node, "Failed to read from", destination_path, error_code);
+                return;
+            }
+            read += static_cast<uint64_t>(n);
+            differs = static_cast<size_t>(n) != length || std::memcmp(source_block.data(), destination_block.data(), length) != 0;
+        }
+        if (differs) {
+            if (int error_code = write_block(out_fd, source_block.data(), length, offset)) {
+                close_both();
+                fail_errno(&node, "Failed to write to", destination_path, error_code);
+                return;
+            }
+            written += length;
+            ++rewritten;
+        }
+    }
+    ::close(in_fd);
+    m_bytes_written.fetch_add(written, std::memory_order_relaxed);
+    m_bytes_read.fetch_add(read, std::memory_order_relaxed);
+
+    if (destination_size != size && ::ftruncate(out_fd, static_cast<off_t>(size)) != 0) {
+        int error_code = errno;
+        ::close(out_fd);
+        fail_errno(&node, "Failed to truncate", destination_path, error_code);
+        return;
+    }
+    if (!apply_metadata(node, out_fd, source_stat, destination_path)) {
+        ::close(out_fd);
+        return;
+    }
+    if (::close(out_fd) != 0) {
+        fail_errno(&node, "Failed to finish writing", destination_path, errno);
+        return;
+    }
+    common::track_file(destination_path);
+
+    IndexEntry entry = make_entry(EntryType::File, source_stat, m_now);
+    entry.block_hashes = std::move(hashes);
+    record(child_key(node, name), std::move(entry));
+    m_delta_updated.fetch_add(1, std::memory_order_relaxed);
+    m_delta_blocks_written.fetch_add(rewritten, std::memory_order_relaxed);
+    m_delta_blocks.fetch_add(blocks, std::memory_order_relaxed);
+    report({ProgressKind::Copied, destination_path, written,
+            "delta (" + std::to_string(rewritten) + " of " + std::to_string(blocks) + " blocks)"});
+}
+
+OperationResult SyncWalk::run(SyncReport& report) {
+    std::string source_path = m_options.source.string();
+    std::string destination_path = m_options.destination.string();
+    for (std::string* path : {&source_path, &destination_path}) {
+        while (path->size() > 1 && path->back() == '/') {
+            path->pop_back();
+        }
+    }
+
+    // Nested trees would have extraneous entries remove the source itself, or
+    // every sync change the source it reads
+    std::string source_key = std::filesystem::canonical(m_options.source).string();
+    std::string destination_key = std::filesystem::weakly_canonical(m_options.destination).string();
+    auto contains = [](const std::string& outer, const std::string& inner) {
+        return inner.compare(0, outer.size(), outer) == 0 &&
+               (outer == "/" || inner.size() == outer.size() || inner[outer.size()] == '/');
+    };
+    if (contains(destination_key, source_key)) {
+        throw common::IOCreateError("The source must not lie inside the destination: '" + source_path + "'.");
+    }
+    if (contains(source_key, destination_key)) {
+        throw common::IOCreateError("The destination must not lie inside the source: '" + destination_path + "'.");
+    }
+
+    auto root = std::make_shared<SyncDir>();
+    root->source_path = source_path;
+    root->destination_path = destination_path;
+    root->source_fd = ::open(source_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root->source_fd < 0) {
+        throw common::make_errno_error("Failed to open source directory", m_options.source, errno);
+    }
+    if (::fstat(root->source_fd, &root->source_stat) != 0) {
+        throw common::make_errno_error("Failed to stat source directory", m_options.source, errno);
+    }
+    if (::mkdir(destination_path.c_str(), S_IRWXU) == 0) {
+        root->created = true;
+    } else if (errno != EEXIST) {
+        throw common::make_errno_error("Failed to create directory", m_options.destination, errno);
+    }
+    root->destination_fd = ::open(destination_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root->destination_fd < 0) {
+        throw common::make_errno_error("Failed to open destination directory", m_options.destination, errno);
+    }
+    struct stat destination_stat;
+    if (::fstat(root->destination_fd, &destination_stat) != 0) {
+        throw common::make_errno_error("Failed to stat destination directory", m_options.destination, errno);
+    }
+    if (destination_stat.st_dev == root->source_stat.st_dev && destination_stat.st_ino == root->source_stat.st_ino) {
+        throw common::IOCreateError("Source and destination are the same directory: '" + source_path + "'.");
+    }
+    m_destination_dev = destination_stat.st_dev;
+    m_destination_ino = destination_stat.st_ino;
+
+    std::filesystem::path index_file = std::filesystem::path(destination_key) / sync_index_name;
+    if (!m_options.rescan) {
+        m_index = load_index(index_file, source_key);
+        for (const auto& [key, entry] : m_index) {
+            if (key.empty()) {
+                continue;
+            }
+            size_t slash = key.rfind('/');
+            if (slash == std::string::npos) {
+                m_children[std::string()].push_back(key);
+            } else {
+                m_children[key.substr(0, slash)].push_back(key.substr(slash + 1));
+            }
+        }
+    }
+    report.index_used = !m_index.empty();
+    m_next_index.reserve(m_index.size());
+
+    root->walk = this;
+    struct stat root_stat = root->source_stat;
+    if (root->created) {
+        this->report({ProgressKind::Created, destination_path, 0, {}});
+    }
+    m_budget.acquire();
+    schedule([this, root] { scan_directory(root); });
+    root.reset();
+    m_pool.wait_idle();
+    // Directories deferred below a chain of open ones deeper than the budget
+    while (auto next = m_budget.take_stalled()) {
+        queue(std::move(next));
+        m_pool.wait_idle();
+    }
+
+    // Unchanged entries are carried over as they were, so an index that only
+    // lost entries or gained none needs no rewrite
+    if (m_index_changed || m_next_index.size() != m_index.size()) {
+        try {
+            save_index(index_file, source_key, m_next_index);
+            struct timespec times[2] = {root_stat.st_atim, root_stat.st_mtim};
+            ::utimensat(AT_FDCWD, destination_path.c_str(), times, 0); // Writing the index moved them
+            common::track_new_entry(index_file);
+        } catch (const std::exception& e) {
+            fail(nullptr, index_file.string(), e.what());
+        }
+    }
+
+    report.examined = m_examined.load();
+    report.unchanged = m_unchanged.load();
+    report.listed = m_listed.load();
+    report.copied = m_copied.load();
+    report.delta_updated = m_delta_updated.load();
+    report.delta_blocks_written = m_delta_blocks_written.load();
+    report.delta_blocks = m_delta_blocks.load();
+    report.metadata_updated = m_metadata_updated.load();
+    report.linked = m_linked.load();
+    report.removed = m_removed.load();
+
+    OperationResult result;
+    result.entries_processed = m_examined.load();
+    result.entries_failed = m_failed.load();
+    result.bytes_written = m_bytes_written.load();
+    result.bytes_read = m_bytes_read.load();
+    result.errors = std::move(m_errors);
+    return result;
+}
+#endif
+
+} // namespace
+
+OperationResult perform_sync(const SyncOptions& options, SyncReport& report) {
+    common::ScopedPerfCounters counters(common::PerfPhase::Sync);
+    auto start_time = std::chrono::steady_clock::now();
+#if defined(_WIN32)
+    (void)options;
+    (void)report;
+    throw common::IOCreateError("io sync is not supported on Windows.");
+#else
+    try {
+        size_t workers = options.jobs == 0 ? common::default_worker_count() : options.jobs;
+        SyncWalk walk(options, workers);
+        OperationResult result = walk.run(report);
+        result.elapsed = std::chrono::steady_clock::now() - start_time;
+        return result;
+    } catch (const std::filesystem::filesystem_error& e) {
+        throw common::make_errno_error("Failed to sync", e.path1(), e.code().value());
+    }
+#endif
+}
+
+void handle_sync(
+    const std::string& source,
+    const std::string& destination,
+    bool delete_extraneous,
+    bool rescan,
+    const std::string& delta_min_size,
+    const std::string& jobs,
+    bool output_enabled
+) {
+    common::TraceScope trace("sync");
+    bool text_output = output_enabled && common::output_format() == common::OutputFormat::Text;
+
+    SyncOptions options;
+    options.source = source;
+    options.destination = destination;
+    options.delete_extraneous = delete_extraneous;
+    options.rescan = rescan;
+    if (!delta_min_size.empty()) {
+        try {
+            options.delta_min_size = common::parse_size(delta_min_size);
+        } catch (const std::exception&) {
+            throw common::IOCreateError("Invalid value for --delta-min-size: \"" + delta_min_size + "\"");
+        }
+    }
+    if (!jobs.empty()) {
+        try {
+            options.jobs = std::stoul(jobs);
+        } catch (const std::exception&) {
+            throw common::IOCreateError("Invalid value for --jobs: \"" + jobs + "\"");
+        }
+    }
+    if (text_output) {
+        common::out() << "Settings for io sync:" << '\n';
+        common::out() << "  Source: " << source << '\n';
+        common::out() << "  Destination: " << destination << '\n';
+        common::out() << "  Delete extraneous: " << (delete_extraneous ? "true" : "false") << '\n';
+        common::out() << "  Index: " << (rescan ? "ignored" : "used") << '\n';
+        common::out() << "  Delta min size: " << options.delta_min_size << '\n';
+    }
+
+    bool structured = common::output_format() != common::OutputFormat::Text;
+    options.progress = [text_output, structured](const ProgressEvent& event) {
+        if (structured) {
+            emit_progress_record("sync", event);
+        } else if (event.kind == ProgressKind::EntryFailed) {
+            common::err() << "Error syncing " << event.path << ": " << event.message << std::endl;
+        } else if (text_output && event.kind == ProgressKind::Copied) {
+            common::out() << "Copied (" << event.message << "): " << event.path << '\n';
+        } else if (text_output && event.kind == ProgressKind::Linked) {
+            common::out() << "Linked: " << event.path << '\n';
+        } else if (text_output && event.kind == ProgressKind::Removed) {
+            common::out() << "Removed: " << event.path << '\n';
+        }
+    };
+
+    SyncReport report;
+    OperationResult result = perform_sync(options, report);
+    if (structured) {
+        common::emit(common::OutputRecord("sync")
+                         .add("source", source)
+                         .add("destination", destination)
+                         .add("index_used", report.index_used)
+                         .add("examined", report.examined)
+                         .add("unchanged", report.unchanged)
+                         .add("listed", report.listed)
+                         .add("copied", report.copied)
+                         .add("delta_updated", report.delta_updated)
+                         .add("delta_blocks_written", report.delta_blocks_written)
+                         .add("delta_blocks", report.delta_blocks)
+                         .add("metadata_updated", report.metadata_updated)
+                         .add("linked", report.linked)
+                         .add("removed", report.removed));
+    }
+    emit_result_record("sync", result);
+
+    if (text_output) {
+        common::out() << "Synced " << source << " to " << destination << ": " << report.examined << " entries examined ("
+                      << report.listed << " directories listed), " << report.unchanged << " unchanged, "
+                      << report.copied << " copied, " << report.delta_updated << " updated by delta ("
+                      << report.delta_blocks_written << " of " << report.delta_blocks << " blocks), "
+                      << report.metadata_updated << " metadata updated, " << report.linked << " linked, "
+                      << report.removed << " removed, " << result.bytes_written << " bytes written" << '\n';
+    }
+    if (!result.ok()) {
+        throw common::IOCreateError(std::to_string(result.entries_failed) + " of " + std::to_string(result.entries_processed) + " entries could not be synced.");
+    }
+}
+
+} // namespace allin1::io